@@ -3,6 +3,7 @@
 #include <math.h>
 #include "batch.h"
 #include "formulation.h"
+#include "intern.h"
 
 /* =========================================================================
    batch_calculate
@@ -17,9 +18,8 @@ void batch_calculate(BatchRun* br, const Formulation* f, float volume_liters)
     br->ingredient_count = 0;
 
     for (i = 0; i < f->compound_count && i < MAX_COMPOUNDS; i++) {
-        strncpy(br->ingredients[i].compound_name,
-                f->compounds[i].compound_name, 63);
-        br->ingredients[i].compound_name[63] = '\0';
+        br->ingredients[i].compound_library_id = f->compounds[i].compound_library_id;
+        br->ingredients[i].name_id             = f->compounds[i].name_id;
 
         /* ppm == mg/L for water-based beverages (density ~1 kg/L)
            grams = mg/L * L / 1000 */
@@ -53,12 +53,12 @@ void batch_print_manifest(const BatchRun* br)
     for (i = 0; i < br->ingredient_count; i++) {
         if (br->ingredients[i].cost_line >= 0.0f)
             printf("  %-24s  %10.4f  %12.4f\n",
-                   br->ingredients[i].compound_name,
+                   intern_str(br->ingredients[i].name_id),
                    br->ingredients[i].grams_needed,
                    br->ingredients[i].cost_line);
         else
             printf("  %-24s  %10.4f  %12s\n",
-                   br->ingredients[i].compound_name,
+                   intern_str(br->ingredients[i].name_id),
                    br->ingredients[i].grams_needed,
                    "--");
     }
@@ -228,8 +228,7 @@ void batch_calculate_from_ingredients(
 
     for (i = 0; i < base_count && br->ingredient_count < MAX_COMPOUNDS; i++) {
         BatchIngredient *bi = &br->ingredients[br->ingredient_count];
-        strncpy(bi->compound_name, bases[i].base_name, 63);
-        bi->compound_name[63] = '\0';
+        bi->name_id = intern(bases[i].base_name);
         bi->grams_needed = (strcmp(bases[i].unit, "%") == 0)
             ? (bases[i].amount / 100.0f) * volume_liters
             : bases[i].amount;
@@ -239,8 +238,7 @@ void batch_calculate_from_ingredients(
 
     for (i = 0; i < ing_count && br->ingredient_count < MAX_COMPOUNDS; i++) {
         BatchIngredient *bi = &br->ingredients[br->ingredient_count];
-        strncpy(bi->compound_name, ings[i].ingredient_name, 63);
-        bi->compound_name[63] = '\0';
+        bi->name_id = intern(ings[i].ingredient_name);
         bi->grams_needed = (strcmp(ings[i].unit, "%") == 0)
             ? (ings[i].amount / 100.0f) * volume_liters
             : ings[i].amount;
@@ -281,8 +279,55 @@ void batch_print_label(const BatchRun* br, const Formulation* f)
     for (i = 0; i < f->compound_count; i++) {
         int k = idx[i];
         printf("    %-24s  %.2f ppm\n",
-               f->compounds[k].compound_name,
+               intern_str(f->compounds[k].name_id),
                f->compounds[k].concentration_ppm);
     }
     printf("========================================\n\n");
 }
+
+/* =========================================================================
+   batch_format_number
+   ========================================================================= */
+int batch_format_number(const char* fmt, const char* flavor_code, int year, int seq,
+                        char* out, int out_len)
+{
+    const char* p;
+    int len = 0;
+    int has_seq = 0;
+
+    if (fmt == NULL || out == NULL || out_len <= 0) return -1;
+
+    for (p = fmt; *p; p++) {
+        char piece[32];
+        const char* add = piece;
+        int width = 0;
+        int n;
+
+        if (*p != '%') {
+            piece[0] = *p;
+            piece[1] = '\0';
+        } else {
+            p++;
+            while (*p >= '0' && *p <= '9' && width < 10)
+                width = width * 10 + (*p++ - '0');
+            if (width && *p != 'N') return -1;
+
+            switch (*p) {
+            case 'F': add = flavor_code ? flavor_code : "";                 break;
+            case 'Y': snprintf(piece, sizeof(piece), "%04d", year);         break;
+            case 'y': snprintf(piece, sizeof(piece), "%02d", year % 100);   break;
+            case 'N': snprintf(piece, sizeof(piece), "%0*d", width, seq);
+                      has_seq = 1;                                          break;
+            case '%': strcpy(piece, "%");                                   break;
+            default:  return -1;    /* includes a trailing '%' */
+            }
+        }
+
+        n = (int)strlen(add);
+        if (len + n >= out_len) return -1;
+        memcpy(out + len, add, (size_t)n);
+        len += n;
+    }
+    out[len] = '\0';
+    return has_seq ? 0 : -1;
+}
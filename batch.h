@@ -6,8 +6,12 @@
 #define MAX_BATCH_NUMBER 32
 #define MAX_BATCH_NOTES  256
 
+/* Default for the batch_number_format setting: "CINROLL-2026-001" */
+#define BATCH_NUMBER_FORMAT_DEFAULT "%F-%Y-%3N"
+
 typedef struct {
-    char  compound_name[64];
+    int   compound_library_id; /* 0 for base / ingredient lines               */
+    int   name_id;             /* intern() id of the display name             */
     float grams_needed;
     float cost_line;       /* grams_needed * cost_per_gram; -1.0 = no price data */
 } BatchIngredient;
@@ -80,4 +84,16 @@ void batch_calculate_from_ingredients(
     const FormIngredient *ings,     int ing_count,
     float                 volume_liters);
 
+/*
+ * Expand a batch number format into out:
+ *   %F  flavor code          %Y  four-digit year     %y  two-digit year
+ *   %N  sequence             %<w>N  sequence zero-padded to w digits
+ *   %%  a percent sign
+ * Anything else is copied as is.  %N is required, so every sequence
+ * number gives a different batch number.
+ * Returns 0, or -1 for a malformed format or a result over out_len - 1.
+ */
+int batch_format_number(const char* fmt, const char* flavor_code, int year, int seq,
+                        char* out, int out_len);
+
 #endif
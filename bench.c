@@ -0,0 +1,983 @@
+/*
+ * bench.c — database and batch-kernel benchmark on a synthetic dataset.
+ *
+ *   bench [-d file.db] [-o out.json] [-f flavors] [-v versions]
+ *         [-b batches] [-t tastings] [-r reps] [-s seed] [-p profile.txt]
+ *         [-S storage_profile] [-w writers] [-c compounds]
+ *
+ * Builds a fresh database of flavors x versions, each flavor with
+ * batches and tastings, then times every public db_* call and the
+ * batch.c kernels.  The results go to out.json: one entry per
+ * operation with call count, p50/p99/max latency and throughput.
+ * -p also turns on SQL profiling and writes the per-statement table
+ * (db_dump_sql_profile) to profile.txt; the timings then include the
+ * trace hook.  -S runs everything under a storage profile
+ * (db_set_storage_profile) so the profiles can be compared.
+ * -w then has that many threads, each on its own connection (dbc_open),
+ * save -b auto-numbered batches each onto the same few flavors at once;
+ * the run fails unless every batch number came out distinct and the
+ * batch_sequences counters advanced by exactly the batches saved.
+ * -c grows compound_library to that many rows (copies of the seed
+ * library) before the dataset is built.  Every run also times the
+ * compound search, typed one keystroke at a time, through the FTS5
+ * index (SQL_COMPOUNDS_SEARCH) and through the LIKE '%x%' scan it
+ * replaced, and reports both per search string.
+ * Commit one run as a baseline and compare later runs against it.
+ *
+ * Formulations use the seeded compound library, so compound lists are
+ * the compound_data.h beverage compounds, dosed inside each compound's
+ * recommended range.  The generator is deterministic for a given seed.
+ * stdout goes to the null device while the benchmark runs, so the
+ * db_list_* tables neither clutter the console nor time terminal output.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "database.h"
+#include "batch.h"
+#include "formulation.h"
+#include "tasting.h"
+#include "intern.h"
+#include "timing.h"
+#include "row_provider.h"
+#include "thread.h"
+#include "compound.h"
+#include "panel_sql.h"
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+#define MAX_OPS   80
+#define MAX_POOL  512
+
+/* =========================================================================
+   Latency samples
+   ========================================================================= */
+typedef struct {
+    const char* name;
+    double*     ms;
+    int         count;
+    int         cap;
+    double      total_ms;
+} BenchOp;
+
+static BenchOp g_ops[MAX_OPS];
+static int     g_op_count = 0;
+
+static void op_add(const char* name, double ms)
+{
+    BenchOp* op = NULL;
+    int i;
+
+    for (i = 0; i < g_op_count; i++) {
+        if (strcmp(g_ops[i].name, name) == 0) {
+            op = &g_ops[i];
+            break;
+        }
+    }
+    if (op == NULL) {
+        if (g_op_count == MAX_OPS) return;
+        op = &g_ops[g_op_count++];
+        op->name = name;
+    }
+    if (op->count == op->cap) {
+        int     cap = op->cap ? op->cap * 2 : 64;
+        double* ms2 = (double*)realloc(op->ms, (size_t)cap * sizeof(double));
+        if (ms2 == NULL) return;
+        op->ms  = ms2;
+        op->cap = cap;
+    }
+    op->ms[op->count++] = ms;
+    op->total_ms += ms;
+}
+
+/* Time one call and record it under name (a string literal). */
+#define TIMED(name, call) do {                      \
+        double t0_ = timing_now_ms();               \
+        call;                                       \
+        op_add(name, timing_now_ms() - t0_);        \
+    } while (0)
+
+static int cmp_double(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of sorted samples, p in (0, 1]. */
+static double percentile(const double* sorted, int n, double p)
+{
+    int idx = (int)(p * n + 0.999999) - 1;
+    if (idx < 0)  idx = 0;
+    if (idx >= n) idx = n - 1;
+    return sorted[idx];
+}
+
+/* =========================================================================
+   Deterministic generator (xorshift32)
+   ========================================================================= */
+static unsigned int g_rng = 2463534242u;
+
+static unsigned int rng_next(void)
+{
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return g_rng;
+}
+
+static int rng_int(int n)           { return (int)(rng_next() % (unsigned)n); }
+static float rng_float(float lo, float hi)
+{
+    return lo + (hi - lo) * (float)(rng_next() & 0xFFFFFF) / (float)0xFFFFFF;
+}
+
+/* Beverage compounds from the seeded library */
+static CompoundInfo g_pool[MAX_POOL];
+static int          g_pool_count = 0;
+
+/* Append a random pool compound not already in f; 0 if it was a repeat */
+static int add_pool_compound(Formulation* f)
+{
+    const CompoundInfo* c = &g_pool[rng_int(g_pool_count)];
+    float lo = c->rec_min_ppm > 0.0f ? c->rec_min_ppm : 0.1f;
+    float hi = c->rec_max_ppm > lo   ? c->rec_max_ppm : lo * 2.0f;
+    int   j;
+
+    if (f->compound_count >= MAX_COMPOUNDS) return 0;
+    /* One line per compound */
+    for (j = 0; j < f->compound_count; j++)
+        if (f->compounds[j].compound_library_id == c->id) return 0;
+
+    f->compounds[f->compound_count].compound_library_id = c->id;
+    f->compounds[f->compound_count].name_id = intern(c->compound_name);
+    f->compounds[f->compound_count].concentration_ppm = rng_float(lo, hi);
+    f->compound_count++;
+    return 1;
+}
+
+static void make_formulation(Formulation* f, int flavor, int version)
+{
+    int n = 5 + rng_int(11);
+    int i;
+
+    memset(f, 0, sizeof(*f));
+    snprintf(f->flavor_code, sizeof(f->flavor_code), "BF%05d", flavor);
+    snprintf(f->flavor_name, sizeof(f->flavor_name), "Bench Flavor %d", flavor);
+    f->version     = create_version(1, version, 0);
+    f->target_ph   = rng_float(2.8f, 3.8f);
+    f->target_brix = rng_float(9.0f, 13.0f);
+
+    for (i = 0; i < n; i++)
+        add_pool_compound(f);
+}
+
+/* The next version of f the way it is usually made: most often one
+   ppm nudged, sometimes a compound added or dropped */
+static void evolve_formulation(Formulation* f, int version)
+{
+    int r = rng_int(10);
+
+    f->version = create_version(1, version, 0);
+    if (r == 0) {
+        add_pool_compound(f);
+    } else if (r == 1 && f->compound_count > 1) {
+        int p = rng_int(f->compound_count);
+        memmove(&f->compounds[p], &f->compounds[p + 1],
+                (size_t)(f->compound_count - p - 1) * sizeof(f->compounds[0]));
+        f->compound_count--;
+    } else if (f->compound_count > 0) {
+        f->compounds[rng_int(f->compound_count)].concentration_ppm *= rng_float(0.9f, 1.1f);
+    }
+}
+
+static void make_tasting(TastingSession* ts, int i)
+{
+    char taster[16];
+
+    snprintf(taster, sizeof(taster), "panel%02d", i % 12);
+    tasting_create(ts, 0, taster);
+    ts->overall_score   = rng_float(1.0f, 10.0f);
+    ts->aroma_score     = rng_float(1.0f, 10.0f);
+    ts->flavor_score    = rng_float(1.0f, 10.0f);
+    ts->mouthfeel_score = rng_float(1.0f, 10.0f);
+    ts->finish_score    = rng_float(1.0f, 10.0f);
+    ts->sweetness_score = (i % 3) ? rng_float(1.0f, 10.0f) : -1.0f;
+}
+
+/* First column of the first row of sql, -1 on error */
+static int query_int(const char* sql)
+{
+    sqlite3_stmt* stmt = NULL;
+    int n = -1;
+
+    if (sqlite3_prepare_v2(db_get_handle(), sql, -1, &stmt, NULL) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW)
+        n = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    return n;
+}
+
+static int count_rows(const char* table)
+{
+    char sql[96];
+
+    snprintf(sql, sizeof(sql), "SELECT COUNT(*) FROM %s;", table);
+    return query_int(sql);
+}
+
+/* =========================================================================
+   Phases
+   ========================================================================= */
+typedef struct {
+    const char* db_path;
+    const char* out_path;
+    const char* prof_path;     /* -p, NULL = no SQL profile */
+    const char* storage;       /* -S, NULL = default */
+    int         flavors;
+    int         versions;
+    int         batches;
+    int         tastings;
+    int         reps;
+    int         writers;       /* -w, 0 = no concurrent save phase */
+    int         compounds;     /* -c, 0 = the seed library as it is */
+    unsigned    seed;
+} BenchConfig;
+
+static int load_pool(void)
+{
+    static int ids[MAX_POOL];
+    int n, i;
+
+    TIMED("db_find_compounds_by_app",
+          n = db_find_compounds_by_app(APP_BEVERAGES, DB_APP_ANY, ids, MAX_POOL));
+    if (n > MAX_POOL) n = MAX_POOL;
+    for (i = 0; i < n; i++) {
+        int rc;
+        TIMED("db_get_compound_by_id", rc = db_get_compound_by_id(ids[i], &g_pool[g_pool_count]));
+        if (rc == 0) g_pool_count++;
+    }
+    return g_pool_count > 0 ? 0 : -1;
+}
+
+/* flavors x versions formulations, batches and tastings per flavor */
+static int generate(const BenchConfig* cfg)
+{
+    Formulation      f;
+    Formulation      g;
+    BatchRun         br;
+    TastingSession   ts;
+    ValidationResult vr;
+    int fl, v, i, rc;
+
+    for (fl = 0; fl < cfg->flavors; fl++) {
+        for (v = 0; v < cfg->versions; v++) {
+            if (v == 0) make_formulation(&f, fl, v);
+            else        evolve_formulation(&f, v);
+            TIMED("db_check_formulation_limits", db_check_formulation_limits(&f, &vr));
+            TIMED("db_save_formulation", rc = db_save_formulation(&f));
+            if (rc != 0) return rc;
+        }
+
+        for (i = 0; i < cfg->batches; i++) {
+            v = rng_int(cfg->versions);
+            TIMED("db_load_version",
+                  rc = db_load_version(f.flavor_code, 1, v, 0, &g));
+            if (rc != 0) return rc;
+            memset(&br, 0, sizeof(br));
+            TIMED("batch_calculate", batch_calculate(&br, &g, rng_float(20.0f, 2000.0f)));
+            TIMED("db_cost_batch", db_cost_batch(&br));
+            TIMED("db_check_inventory", db_check_inventory(&br));
+            TIMED("db_save_batch", rc = db_save_batch(g.flavor_code, 1, v, 0, &br));
+            if (rc != 0) return rc;
+            TIMED("db_deduct_inventory", db_deduct_inventory(&br));
+        }
+
+        for (i = 0; i < cfg->tastings; i++) {
+            v = rng_int(cfg->versions);
+            make_tasting(&ts, i);
+            TIMED("db_save_tasting", rc = db_save_tasting(f.flavor_code, 1, v, 0, &ts));
+            if (rc != 0) return rc;
+        }
+    }
+    return 0;
+}
+
+/* What a virtual ListView asks for on first paint: one screen of cells */
+static void read_screen(RowProvider* p)
+{
+    int row, col;
+
+    for (row = 0; row < 40; row++)
+        for (col = 0; col < row_provider_columns(p); col++)
+            row_provider_cell(p, row, col);
+}
+
+/* Reads and the remaining write paths against the generated data */
+static void run_queries(const BenchConfig* cfg)
+{
+    Formulation    f;
+    BatchRun       br;
+    CompoundInfo   ci;
+    Ingredient     ing;
+    SodaBase       sb;
+    FormBase       bases[MAX_FORM_BASES];
+    FormIngredient ings[MAX_FORM_INGREDIENTS];
+    LabelConfig    lc;
+    char           code[MAX_FLAVOR_CODE];
+    char           name[64];
+    char           val[64];
+    char           label[4096];
+    int            counts[APP_CATEGORY_COUNT];
+    int            ids[64];
+    int            bc = 0, ic = 0;
+    int            r, id;
+    float          limit;
+    DbVersionDiff* diffs;
+    RowProvider*   rows;
+    unsigned long  since;
+    DbTastingStats tstats;
+    SensoryReport* sensory = NULL;
+    SensoryComparison cmp;
+    static const char* const batch_tables[] = { "batch_runs", "formulations", NULL };
+
+    diffs = (DbVersionDiff*)malloc((size_t)(cfg->versions > 0 ? cfg->versions : 1) *
+                                   sizeof(DbVersionDiff));
+    if (diffs == NULL) return;
+
+    memset(&lc, 0, sizeof(lc));
+    strcpy(lc.company_name, "Bench Soda Co.");
+    strcpy(lc.company_address, "1 Test Way, Fresno, CA 93701");
+    strcpy(lc.sweetener_name, "Cane Sugar");
+    strcpy(lc.acid_name, "Citric Acid");
+    lc.container_oz = 12.0f;
+    lc.servings_per_container = 1;
+
+    TIMED("db_check_query_plans", db_check_query_plans());
+    TIMED("db_sync_seed_data", db_sync_seed_data(NULL));
+    TIMED("db_list_formulations", db_list_formulations());
+    TIMED("db_list_compounds", db_list_compounds());
+    TIMED("db_list_inventory", db_list_inventory());
+    TIMED("db_count_compounds_by_app", db_count_compounds_by_app(counts));
+    TIMED("db_snapshot_stock", db_snapshot_stock());
+    TIMED("db_change_generation", since = db_change_generation());
+    TIMED("db_rebuild_tasting_aggregates", db_rebuild_tasting_aggregates(NULL));
+    TIMED("db_sensory_report (all)", db_sensory_report(NULL, 0.0, &sensory));
+    sensory_report_free(sensory);
+
+    for (r = 0; r < cfg->reps; r++) {
+        const CompoundInfo* c = &g_pool[rng_int(g_pool_count)];
+
+        snprintf(code, sizeof(code), "BF%05d", rng_int(cfg->flavors));
+
+        TIMED("db_load_latest", db_load_latest(code, &f));
+        TIMED("db_validate_formulation", db_validate_formulation(&f));
+        TIMED("db_get_version_history", db_get_version_history(code));
+        TIMED("db_diff_history", db_diff_history(code, diffs, cfg->versions));
+        TIMED("db_diff_versions",
+              db_diff_versions(code, create_version(1, 0, 0),
+                               create_version(1, cfg->versions - 1, 0), diffs));
+        TIMED("db_list_batches", db_list_batches(code));
+        TIMED("db_list_tastings_for_flavor", db_list_tastings_for_flavor(code));
+        TIMED("db_get_avg_scores", db_get_avg_scores(code));
+        TIMED("db_get_tasting_stats", db_get_tasting_stats(code, 1, 0, 0, &tstats));
+        TIMED("db_get_flavor_tasting_stats", db_get_flavor_tasting_stats(code, &tstats));
+        TIMED("db_sensory_report", db_sensory_report(code, 0.0, &sensory));
+        TIMED("sensory_compare",
+              sensory_compare(sensory, 0, sensory_version_count(sensory) - 1,
+                              SENSORY_OVERALL, &cmp));
+        sensory_report_free(sensory);
+        TIMED("row_provider_open",
+              rows = row_provider_open(db_get_handle(), ROW_SOURCE_BATCHES, code));
+        TIMED("row_provider_cell", read_screen(rows));
+        row_provider_close(rows);
+        TIMED("db_changed_since", db_changed_since(batch_tables, since));
+
+        TIMED("db_get_compound_by_name", db_get_compound_by_name(c->compound_name, &ci));
+        TIMED("db_get_active_limit", db_get_active_limit(c->compound_name, &limit));
+        TIMED("db_find_compounds_by_app",
+              db_find_compounds_by_app(1u << rng_int(APP_CATEGORY_COUNT), DB_APP_ANY, ids, 64));
+        TIMED("db_set_compound_cost",
+              db_set_compound_cost(c->compound_name, c->cost_per_gram));
+
+        /* Stock ledger: a receipt, its reversal, a stock take */
+        TIMED("db_receive_stock", db_receive_stock(c->compound_name, 100.0f, "bench"));
+        id = (int)sqlite3_last_insert_rowid(db_get_handle());
+        TIMED("db_get_stock", db_get_stock(c->compound_name, NULL, &limit));
+        TIMED("db_reverse_stock_movement", db_reverse_stock_movement(id, NULL));
+        TIMED("db_adjust_stock", db_adjust_stock(c->compound_name, limit, "bench count"));
+        TIMED("db_list_stock_movements", db_list_stock_movements(c->compound_name));
+
+        snprintf(name, sizeof(name), "bench_key_%d", r % 16);
+        snprintf(val, sizeof(val), "%d", r);
+        TIMED("db_set_setting", db_set_setting(name, val));
+        TIMED("db_get_setting", db_get_setting(name, val, sizeof(val)));
+
+        /* Suppliers */
+        snprintf(name, sizeof(name), "Bench Supplier %d", r);
+        TIMED("db_add_supplier",
+              db_add_supplier(name, "example.com", "sales@example.com", "555-0100", ""));
+        id = (int)sqlite3_last_insert_rowid(db_get_handle());
+        TIMED("db_update_supplier",
+              db_update_supplier(id, name, "example.com", "orders@example.com", "555-0101", "net 30"));
+        TIMED("db_add_compound_supplier",
+              db_add_compound_supplier(id, c->compound_name, "CAT-1", 0.5f, 25.0f, 7));
+        {
+            int cs_id = (int)sqlite3_last_insert_rowid(db_get_handle());
+            TIMED("db_update_compound_supplier",
+                  db_update_compound_supplier(cs_id, "CAT-2", 0.45f, 50.0f, 5));
+            TIMED("db_remove_compound_supplier", db_remove_compound_supplier(cs_id));
+        }
+        TIMED("db_delete_supplier", db_delete_supplier(id));
+
+        /* Ingredients */
+        memset(&ing, 0, sizeof(ing));
+        snprintf(ing.ingredient_name, sizeof(ing.ingredient_name), "Bench Syrup %d", r);
+        strcpy(ing.category, "sweetener");
+        strcpy(ing.unit, "kg");
+        ing.cost_per_unit = 1.25f;
+        TIMED("db_add_ingredient", db_add_ingredient(&ing));
+        ing.id = (int)sqlite3_last_insert_rowid(db_get_handle());
+        ing.cost_per_unit = 1.30f;
+        TIMED("db_update_ingredient", db_update_ingredient(&ing));
+        TIMED("db_get_ingredient", db_get_ingredient(ing.id, &ing));
+
+        /* Soda bases */
+        memset(&sb, 0, sizeof(sb));
+        snprintf(sb.base_code, sizeof(sb.base_code), "BB%05d", r);
+        snprintf(sb.base_name, sizeof(sb.base_name), "Bench Base %d", r);
+        sb.version      = create_version(1, 0, 0);
+        sb.yield_liters = 20.0f;
+        sb.compounds[0].name_id             = intern(c->compound_name);
+        sb.compounds[0].compound_library_id = c->id;
+        sb.compounds[0].concentration_ppm   = c->rec_min_ppm > 0.0f ? c->rec_min_ppm : 1.0f;
+        sb.compound_count = 1;
+        sb.ingredients[0].ingredient_id = ing.id;
+        strcpy(sb.ingredients[0].ingredient_name, ing.ingredient_name);
+        sb.ingredients[0].amount = 2.0f;
+        strcpy(sb.ingredients[0].unit, "kg");
+        sb.ingredient_count = 1;
+        TIMED("db_save_soda_base", db_save_soda_base(&sb));
+        TIMED("db_load_latest_base", db_load_latest_base(sb.base_code, &sb));
+
+        /* Formulation extras reference the base and ingredient */
+        memset(bases, 0, sizeof(bases));
+        memset(ings, 0, sizeof(ings));
+        bases[0].soda_base_id = sb.id;
+        strcpy(bases[0].base_name, sb.base_name);
+        bases[0].amount = 80.0f;
+        strcpy(bases[0].unit, "%");
+        ings[0].ingredient_id = ing.id;
+        strcpy(ings[0].ingredient_name, ing.ingredient_name);
+        ings[0].amount = 5.0f;
+        strcpy(ings[0].unit, "%");
+        TIMED("db_save_formulation_extras",
+              db_save_formulation_extras(f.flavor_code, f.version.major, f.version.minor,
+                                         f.version.patch, bases, 1, ings, 1));
+        TIMED("db_load_formulation_extras",
+              db_load_formulation_extras(f.flavor_code, f.version.major, f.version.minor,
+                                         f.version.patch, bases, &bc, ings, &ic));
+
+        memset(&br, 0, sizeof(br));
+        TIMED("batch_calculate_from_ingredients",
+              batch_calculate_from_ingredients(&br, bases, bc, ings, ic, 500.0f));
+        TIMED("batch_calculate", batch_calculate(&br, &f, 500.0f));
+        TIMED("batch_generate_fda_label",
+              batch_generate_fda_label("BENCH-001", f.flavor_name, f.flavor_code, "1.0.0",
+                                       f.target_brix, &lc, label, sizeof(label)));
+        TIMED("batch_print_manifest", batch_print_manifest(&br));
+        TIMED("batch_print_label", batch_print_label(&br, &f));
+
+        /* Clear the extras so the base and ingredient can go */
+        db_save_formulation_extras(f.flavor_code, f.version.major, f.version.minor,
+                                   f.version.patch, bases, 0, ings, 0);
+        TIMED("db_delete_soda_base", db_delete_soda_base(sb.base_code));
+        TIMED("db_delete_ingredient", db_delete_ingredient(ing.id));
+
+        /* Library growth: one new compound and one regulatory override */
+        memset(&ci, 0, sizeof(ci));
+        snprintf(ci.compound_name, sizeof(ci.compound_name), "Bench Compound %d", r);
+        ci.max_use_ppm   = 50.0f;
+        ci.cost_per_gram = 0.2f;
+        TIMED("db_add_compound", db_add_compound(&ci));
+        TIMED("db_add_regulatory_limit",
+              db_add_regulatory_limit(c->compound_name, "BENCH",
+                                      c->max_use_ppm > 0.0f ? c->max_use_ppm : 100.0f,
+                                      "2026-01-01", NULL));
+    }
+    free(diffs);
+}
+
+/* =========================================================================
+   Concurrent batch saves
+   ========================================================================= */
+#define STRESS_FLAVORS 3
+
+typedef struct {
+    const BenchConfig* cfg;
+    int                index;
+    double*            ms;          /* one latency per save attempt */
+    int                saved;
+    int                failed;
+} StressWriter;
+
+typedef struct {
+    int    saves;
+    int    failed;
+    int    duplicates;
+    int    seq_advance;     /* sum of batch_sequences.last_seq gained */
+    double wall_ms;
+} StressResult;
+
+/* One station: its own connection, saving onto the shared flavors */
+static void stress_writer(void* arg)
+{
+    StressWriter* w = (StressWriter*)arg;
+    const BenchConfig* cfg = w->cfg;
+    int flavors = cfg->flavors < STRESS_FLAVORS ? cfg->flavors : STRESS_FLAVORS;
+    DbContext* ctx = NULL;
+    Formulation f;
+    BatchRun br;
+    char code[MAX_FLAVOR_CODE];
+    int i;
+
+    if (dbc_open(cfg->db_path, &ctx) != 0) {
+        w->failed = cfg->batches;
+        return;
+    }
+    for (i = 0; i < cfg->batches; i++) {
+        double t0;
+        int rc;
+
+        snprintf(code, sizeof(code), "BF%05d", (w->index + i) % flavors);
+        if (dbc_load_version(ctx, code, 1, 0, 0, &f) != 0) {
+            w->failed++;
+            continue;
+        }
+        memset(&br, 0, sizeof(br));
+        batch_calculate(&br, &f, 100.0f + (float)i);
+        br.cost_total = -1.0f;
+
+        t0 = timing_now_ms();
+        rc = dbc_save_batch(ctx, code, 1, 0, 0, &br);
+        w->ms[i] = timing_now_ms() - t0;
+        if (rc == 0) w->saved++;
+        else         w->failed++;
+    }
+    dbc_close(ctx);
+}
+
+static int run_stress(const BenchConfig* cfg, StressResult* out)
+{
+    StressWriter* w;
+    Thread*       t;
+    const char*   seq_sql = "SELECT IFNULL(SUM(last_seq), 0) FROM batch_sequences;";
+    int           seq_before;
+    double        t0;
+    int           i, j, started;
+
+    memset(out, 0, sizeof(*out));
+    w = (StressWriter*)calloc((size_t)cfg->writers, sizeof(StressWriter));
+    t = (Thread*)calloc((size_t)cfg->writers, sizeof(Thread));
+    if (w == NULL || t == NULL) {
+        free(w);
+        free(t);
+        return -1;
+    }
+
+    seq_before = query_int(seq_sql);
+    t0 = timing_now_ms();
+    for (started = 0; started < cfg->writers; started++) {
+        w[started].cfg   = cfg;
+        w[started].index = started;
+        w[started].ms    = (double*)calloc((size_t)cfg->batches, sizeof(double));
+        if (w[started].ms == NULL ||
+            thread_start(&t[started], stress_writer, &w[started]) != 0) {
+            free(w[started].ms);
+            break;
+        }
+    }
+    for (i = 0; i < started; i++)
+        thread_join(t[i]);
+    out->wall_ms = timing_now_ms() - t0;
+
+    /* op_add is not thread-safe: merge the latencies after the join */
+    for (i = 0; i < started; i++) {
+        for (j = 0; j < cfg->batches; j++)
+            op_add("dbc_save_batch (concurrent)", w[i].ms[j]);
+        out->saves  += w[i].saved;
+        out->failed += w[i].failed;
+        free(w[i].ms);
+    }
+    out->failed += (cfg->writers - started) * cfg->batches;
+    out->duplicates  = query_int("SELECT COUNT(*) - COUNT(DISTINCT batch_number) FROM batch_runs;");
+    out->seq_advance = query_int(seq_sql) - seq_before;
+
+    free(w);
+    free(t);
+    return (out->failed == 0 && out->duplicates == 0 &&
+            out->seq_advance == out->saves) ? 0 : 1;
+}
+
+/* =========================================================================
+   Compound search
+   ========================================================================= */
+#define SEARCH_REPS     20     /* runs of each search string, averaged */
+#define SEARCH_STRINGS  14
+
+/* The compound search before the FTS5 index: ?1 = text LIKE
+   pattern, ?2 = application LIKE pattern, ?3 = solubilizer filter */
+#define SQL_COMPOUNDS_LIKE \
+    "SELECT compound_name, fema_number, max_use_ppm, " \
+    "       rec_min_ppm, rec_max_ppm, cost_per_gram, " \
+    "       requires_solubilizer, storage_temp " \
+    "FROM compound_library " \
+    "WHERE (compound_name      LIKE ?1" \
+    "    OR odor_profile       LIKE ?1" \
+    "    OR flavor_descriptors LIKE ?1)" \
+    "  AND (applications       LIKE ?2)" \
+    "  AND (?3 = -1 OR requires_solubilizer = ?3)" \
+    "ORDER BY compound_name;"
+
+/* Words typed into the search box, one keystroke per search string */
+static const char* const g_search_words[] = { "vanilla", "coconut" };
+
+typedef struct {
+    char   text[16];
+    double like_ms;            /* mean of SEARCH_REPS runs */
+    double fts_ms;
+    int    like_rows;
+    int    fts_rows;
+} SearchString;
+
+typedef struct {
+    int          count;
+    SearchString strings[SEARCH_STRINGS];
+    double       like_total_ms;
+    double       fts_total_ms;
+} SearchResult;
+
+/* Copy the library's rows under new names until it has cfg->compounds
+   rows.  Written through a second connection in one transaction; the
+   default connection's compound cache notices the commit and reloads. */
+static int grow_library(const BenchConfig* cfg)
+{
+    sqlite3*      db   = NULL;
+    sqlite3_stmt* stmt = NULL;
+    int have = count_rows("compound_library");
+    int seed = query_int("SELECT MAX(id) FROM compound_library;");
+    int rc;
+
+    if (cfg->compounds <= have) return 0;
+    if (have <= 0 || seed <= 0) return -1;
+
+    rc = sqlite3_open(cfg->db_path, &db);
+    if (rc == SQLITE_OK) rc = sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, NULL, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db,
+            "WITH RECURSIVE copy(n) AS ("
+            "    SELECT 1 UNION ALL SELECT n + 1 FROM copy WHERE n < ?1) "
+            "INSERT INTO compound_library "
+            "    (compound_name, cas_number, fema_number, max_use_ppm, "
+            "     rec_min_ppm, rec_max_ppm, molecular_weight, water_solubility, "
+            "     ph_stable_min, ph_stable_max, odor_profile, storage_temp, "
+            "     requires_solubilizer, requires_inert_atm, applications, "
+            "     cost_per_gram, flavor_descriptors, odor_threshold_ppm) "
+            "SELECT cl.compound_name || ' #' || copy.n, cl.cas_number, cl.fema_number, "
+            "       cl.max_use_ppm, cl.rec_min_ppm, cl.rec_max_ppm, "
+            "       cl.molecular_weight, cl.water_solubility, "
+            "       cl.ph_stable_min, cl.ph_stable_max, cl.odor_profile, cl.storage_temp, "
+            "       cl.requires_solubilizer, cl.requires_inert_atm, cl.applications, "
+            "       cl.cost_per_gram, cl.flavor_descriptors, cl.odor_threshold_ppm "
+            "FROM copy CROSS JOIN compound_library cl "
+            "WHERE cl.id <= ?2 "
+            "ORDER BY copy.n, cl.id LIMIT ?3;",
+            -1, &stmt, NULL);
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, (cfg->compounds - 1) / have);   /* copies, rounded up */
+        sqlite3_bind_int(stmt, 2, seed);
+        sqlite3_bind_int(stmt, 3, cfg->compounds - have);
+        rc = sqlite3_step(stmt);
+        rc = (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+    }
+    sqlite3_finalize(stmt);
+    if (rc == SQLITE_OK) rc = sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        fprintf(stderr, "bench: growing the library failed: %s\n", sqlite3_errmsg(db));
+    sqlite3_close(db);
+    return rc == SQLITE_OK ? 0 : -1;
+}
+
+/* Run one search the way Panel_Compounds_Refresh does: prepare, bind,
+   step every row.  Returns the row count, -1 on error. */
+static int search_once(const char* sql, const char* text, int like)
+{
+    sqlite3_stmt* stmt = NULL;
+    char arg[64];
+    int  n = 0;
+
+    if (like) snprintf(arg, sizeof(arg), "%%%s%%", text);
+    else      compound_search_expr(text, arg, sizeof(arg));
+
+    if (sqlite3_prepare_v2(db_get_handle(), sql, -1, &stmt, NULL) != SQLITE_OK)
+        return -1;
+    sqlite3_bind_text(stmt, 1, arg, -1, SQLITE_TRANSIENT);
+    if (like) {
+        sqlite3_bind_text(stmt, 2, "%", -1, SQLITE_STATIC);
+        sqlite3_bind_int (stmt, 3, -1);
+    } else {
+        sqlite3_bind_int (stmt, 2, -1);
+        sqlite3_bind_int (stmt, 3, 0);
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+        n++;
+    sqlite3_finalize(stmt);
+    return n;
+}
+
+/* Every prefix of every search word, through both queries */
+static void run_search(SearchResult* out)
+{
+    int w, len, r;
+
+    memset(out, 0, sizeof(*out));
+    for (w = 0; w < (int)(sizeof(g_search_words) / sizeof(g_search_words[0])); w++) {
+        const char* word = g_search_words[w];
+
+        for (len = 1; word[len - 1] != '\0' && out->count < SEARCH_STRINGS; len++) {
+            SearchString* ss = &out->strings[out->count++];
+
+            snprintf(ss->text, sizeof(ss->text), "%.*s", len, word);
+            for (r = 0; r < SEARCH_REPS; r++) {
+                double t0 = timing_now_ms();
+                double ms;
+
+                ss->like_rows = search_once(SQL_COMPOUNDS_LIKE, ss->text, 1);
+                ms = timing_now_ms() - t0;
+                op_add("compound search (LIKE)", ms);
+                ss->like_ms += ms;
+
+                t0 = timing_now_ms();
+                ss->fts_rows = search_once(SQL_COMPOUNDS_SEARCH, ss->text, 0);
+                ms = timing_now_ms() - t0;
+                op_add("compound search (FTS5)", ms);
+                ss->fts_ms += ms;
+            }
+            ss->like_ms /= SEARCH_REPS;
+            ss->fts_ms  /= SEARCH_REPS;
+            out->like_total_ms += ss->like_ms;
+            out->fts_total_ms  += ss->fts_ms;
+        }
+    }
+}
+
+/* =========================================================================
+   Report
+   ========================================================================= */
+static void write_report(FILE* fp, const BenchConfig* cfg, double gen_ms,
+                         const StressResult* stress, const SearchResult* search)
+{
+    DbStmtCacheStats     ss;
+    DbCompoundCacheStats cs;
+    int i;
+
+    db_get_stmt_cache_stats(&ss);
+    db_get_compound_cache_stats(&cs);
+
+    fprintf(fp, "{\n  \"config\": {\"flavors\": %d, \"versions\": %d, \"batches\": %d, "
+                "\"tastings\": %d, \"reps\": %d, \"seed\": %u, \"sqlite\": \"%s\", "
+                "\"storage_profile\": \"%s\"},\n",
+            cfg->flavors, cfg->versions, cfg->batches, cfg->tastings, cfg->reps,
+            cfg->seed, sqlite3_libversion(), db_get_storage_profile());
+    fprintf(fp, "  \"dataset\": {\"formulations\": %d, \"formulation_compounds\": %d, "
+                "\"compound_lines\": %d, \"keyframes\": %d, "
+                "\"batch_runs\": %d, \"tasting_sessions\": %d, \"compounds\": %d},\n",
+            count_rows("formulations"), count_rows("formulation_compounds"),
+            query_int("SELECT SUM(compound_count) FROM formulations;"),
+            query_int("SELECT COUNT(*) FROM formulations WHERE parent_id IS NULL;"),
+            count_rows("batch_runs"), count_rows("tasting_sessions"),
+            count_rows("compound_library"));
+    fprintf(fp, "  \"generate_ms\": %.1f,\n", gen_ms);
+    if (cfg->writers > 0)
+        fprintf(fp, "  \"batch_stress\": {\"writers\": %d, \"saves\": %d, \"failed\": %d, "
+                    "\"duplicates\": %d, \"sequence_advance\": %d, \"wall_ms\": %.1f, "
+                    "\"saves_per_sec\": %.1f},\n",
+                cfg->writers, stress->saves, stress->failed, stress->duplicates,
+                stress->seq_advance, stress->wall_ms,
+                stress->wall_ms > 0.0 ? stress->saves * 1000.0 / stress->wall_ms : 0.0);
+    fprintf(fp, "  \"compound_search\": {\"compounds\": %d, \"reps\": %d, "
+                "\"like_total_ms\": %.3f, \"fts_total_ms\": %.3f, \"strings\": [\n",
+            count_rows("compound_library"), SEARCH_REPS,
+            search->like_total_ms, search->fts_total_ms);
+    for (i = 0; i < search->count; i++) {
+        const SearchString* ss = &search->strings[i];
+        fprintf(fp, "    {\"text\": \"%s\", \"like_ms\": %.4f, \"like_rows\": %d, "
+                    "\"fts_ms\": %.4f, \"fts_rows\": %d}%s\n",
+                ss->text, ss->like_ms, ss->like_rows, ss->fts_ms, ss->fts_rows,
+                i + 1 < search->count ? "," : "");
+    }
+    fprintf(fp, "  ]},\n");
+    fprintf(fp, "  \"stmt_cache\": {\"hits\": %lu, \"misses\": %lu},\n", ss.hits, ss.misses);
+    fprintf(fp, "  \"compound_cache\": {\"hits\": %lu, \"misses\": %lu},\n", cs.hits, cs.misses);
+    fprintf(fp, "  \"ops\": [\n");
+
+    for (i = 0; i < g_op_count; i++) {
+        BenchOp* op = &g_ops[i];
+
+        qsort(op->ms, (size_t)op->count, sizeof(double), cmp_double);
+        fprintf(fp, "    {\"name\": \"%s\", \"calls\": %d, \"p50_ms\": %.4f, "
+                    "\"p99_ms\": %.4f, \"max_ms\": %.4f, \"ops_per_sec\": %.1f}%s\n",
+                op->name, op->count,
+                percentile(op->ms, op->count, 0.50),
+                percentile(op->ms, op->count, 0.99),
+                op->ms[op->count - 1],
+                op->total_ms > 0.0 ? op->count * 1000.0 / op->total_ms : 0.0,
+                i + 1 < g_op_count ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+static int arg_int(int argc, char** argv, int* i, int* out)
+{
+    if (*i + 1 >= argc) return -1;
+    *out = atoi(argv[++*i]);
+    return *out > 0 ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig  cfg;
+    StressResult stress;
+    SearchResult search;
+    FILE*        fp;
+    double       t0, gen_ms;
+    int          seed = 1;
+    int          stress_rc = 0;
+    int          i, rc;
+
+    cfg.db_path  = "bench.db";
+    cfg.out_path = "bench.json";
+    cfg.flavors  = 50;
+    cfg.versions = 5;
+    cfg.batches  = 20;
+    cfg.tastings = 10;
+    cfg.reps     = 200;
+    cfg.prof_path = NULL;
+    cfg.storage   = NULL;
+    cfg.writers   = 0;
+    cfg.compounds = 0;
+
+    for (i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        rc = 0;
+        if      (strcmp(a, "-d") == 0 && i + 1 < argc) cfg.db_path  = argv[++i];
+        else if (strcmp(a, "-o") == 0 && i + 1 < argc) cfg.out_path = argv[++i];
+        else if (strcmp(a, "-p") == 0 && i + 1 < argc) cfg.prof_path = argv[++i];
+        else if (strcmp(a, "-S") == 0 && i + 1 < argc) cfg.storage  = argv[++i];
+        else if (strcmp(a, "-f") == 0) rc = arg_int(argc, argv, &i, &cfg.flavors);
+        else if (strcmp(a, "-v") == 0) rc = arg_int(argc, argv, &i, &cfg.versions);
+        else if (strcmp(a, "-b") == 0) rc = arg_int(argc, argv, &i, &cfg.batches);
+        else if (strcmp(a, "-t") == 0) rc = arg_int(argc, argv, &i, &cfg.tastings);
+        else if (strcmp(a, "-r") == 0) rc = arg_int(argc, argv, &i, &cfg.reps);
+        else if (strcmp(a, "-s") == 0) rc = arg_int(argc, argv, &i, &seed);
+        else if (strcmp(a, "-w") == 0) rc = arg_int(argc, argv, &i, &cfg.writers);
+        else if (strcmp(a, "-c") == 0) rc = arg_int(argc, argv, &i, &cfg.compounds);
+        else rc = -1;
+        if (rc != 0) {
+            fprintf(stderr,
+                "usage: bench [-d file.db] [-o out.json] [-f flavors] [-v versions]\n"
+                "             [-b batches] [-t tastings] [-r reps] [-s seed]\n"
+                "             [-p profile.txt] [-S storage_profile] [-w writers]\n"
+                "             [-c compounds]\n");
+            return 2;
+        }
+    }
+    cfg.seed = (unsigned)seed;
+    g_rng   ^= cfg.seed * 2654435761u;
+    if (g_rng == 0) g_rng = 1;
+
+    /* Start from an empty file every run */
+    remove(cfg.db_path);
+    {
+        char side[512];
+        snprintf(side, sizeof(side), "%s-wal", cfg.db_path);
+        remove(side);
+        snprintf(side, sizeof(side), "%s-shm", cfg.db_path);
+        remove(side);
+    }
+
+    if (freopen(NULL_DEVICE, "w", stdout) == NULL)
+        fprintf(stderr, "bench: cannot redirect stdout; timings include console output\n");
+    db_set_verbose(0);
+    db_set_sql_profile(cfg.prof_path != NULL);
+
+    TIMED("db_open", rc = db_open(cfg.db_path));
+    if (rc != 0) {
+        fprintf(stderr, "bench: cannot open %s\n", cfg.db_path);
+        return 1;
+    }
+    if (cfg.storage != NULL && db_set_storage_profile(cfg.storage) != 0) {
+        db_close();
+        return 1;
+    }
+    TIMED("db_sync_seed_data", db_sync_seed_data(NULL));
+    if (load_pool() != 0) {
+        fprintf(stderr, "bench: no beverage compounds in the library\n");
+        db_close();
+        return 1;
+    }
+    if (cfg.compounds > 0) {
+        fprintf(stderr, "bench: growing the compound library to %d rows\n", cfg.compounds);
+        if (grow_library(&cfg) != 0) {
+            db_close();
+            return 1;
+        }
+    }
+
+    fprintf(stderr, "bench: generating %d flavors x %d versions, %d batches and %d tastings each\n",
+            cfg.flavors, cfg.versions, cfg.batches, cfg.tastings);
+    t0 = timing_now_ms();
+    rc = generate(&cfg);
+    gen_ms = timing_now_ms() - t0;
+    if (rc != 0) {
+        fprintf(stderr, "bench: dataset generation failed (%d)\n", rc);
+        db_close();
+        return 1;
+    }
+
+    fprintf(stderr, "bench: %d query rounds\n", cfg.reps);
+    run_queries(&cfg);
+
+    fprintf(stderr, "bench: compound search, %d runs per keystroke\n", SEARCH_REPS);
+    run_search(&search);
+
+    memset(&stress, 0, sizeof(stress));
+    if (cfg.writers > 0) {
+        fprintf(stderr, "bench: %d writers saving %d batches each\n", cfg.writers, cfg.batches);
+        stress_rc = run_stress(&cfg, &stress);
+        fprintf(stderr, "bench: %d saved, %d failed, %d duplicate numbers, sequences +%d\n",
+                stress.saves, stress.failed, stress.duplicates, stress.seq_advance);
+    }
+
+    fp = fopen(cfg.out_path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "bench: cannot write %s\n", cfg.out_path);
+        db_close();
+        return 1;
+    }
+    write_report(fp, &cfg, gen_ms, &stress, &search);
+    fclose(fp);
+    if (cfg.prof_path != NULL)
+        db_dump_sql_profile(cfg.prof_path);
+
+    db_close();
+    fprintf(stderr, "bench: %d operations timed, results in %s\n", g_op_count, cfg.out_path);
+
+    for (i = 0; i < g_op_count; i++)
+        free(g_ops[i].ms);
+    return stress_rc != 0 ? 1 : 0;
+}
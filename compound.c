@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <string.h>
+#include <ctype.h>
 #include "compound.h"
 
 /* =========================================================================
@@ -43,3 +45,86 @@ void compound_print(const CompoundInfo* c)
     if (c->cost_per_gram > 0.0f)
         printf("Cost:    $%.4f / g\n", c->cost_per_gram);
 }
+
+/* =========================================================================
+   Application categories — same order as the APP_* bits
+   ========================================================================= */
+static const char* const g_app_tokens[APP_CATEGORY_COUNT] = {
+    "beverages", "alcoholic", "baked goods", "dairy",
+    "meat", "confections", "savory"
+};
+
+static const char* const g_app_labels[APP_CATEGORY_COUNT] = {
+    "Beverages", "Alcoholic", "Baked Goods", "Dairy",
+    "Meat", "Confections", "Savory"
+};
+
+const char* compound_app_token(int i)
+{
+    return (i >= 0 && i < APP_CATEGORY_COUNT) ? g_app_tokens[i] : NULL;
+}
+
+const char* compound_app_label(int i)
+{
+    return (i >= 0 && i < APP_CATEGORY_COUNT) ? g_app_labels[i] : NULL;
+}
+
+/* =========================================================================
+   compound_search_expr
+   Words are split the way FTS5's unicode61 tokenizer splits them (ASCII
+   punctuation and spaces separate, UTF-8 bytes stay in the word) and
+   quoted, so user input can never be read as FTS5 query syntax.
+   ========================================================================= */
+static int is_word_char(unsigned char ch)
+{
+    return ch >= 0x80 || isalnum(ch);
+}
+
+/* Append s to out at *len if it fits; returns 0 on success, 1 if not. */
+static int expr_append(char* out, int out_size, int* len, const char* s, int n)
+{
+    if (*len + n >= out_size) return 1;
+    memcpy(out + *len, s, (size_t)n);
+    *len += n;
+    out[*len] = '\0';
+    return 0;
+}
+
+int compound_search_expr(const char* text, char* out, int out_size)
+{
+    static const char prefix[] = "{compound_name odor_profile flavor_descriptors} : (";
+    const char* p     = text ? text : "";
+    int         len   = 0;
+    int         words = 0;
+
+    if (out_size <= 0) return 0;
+    out[0] = '\0';
+
+    while (*p) {
+        const char* start;
+        int         n, mark;
+
+        while (*p && !is_word_char((unsigned char)*p)) p++;
+        start = p;
+        while (is_word_char((unsigned char)*p)) p++;
+        n = (int)(p - start);
+        if (n == 0) break;
+
+        /* out_size - 1 keeps room for the closing parenthesis */
+        mark = len;
+        if ((words == 0 && expr_append(out, out_size - 1, &len, prefix, (int)sizeof(prefix) - 1)) ||
+            (words >  0 && expr_append(out, out_size - 1, &len, " ", 1)) ||
+            expr_append(out, out_size - 1, &len, "\"", 1) ||
+            expr_append(out, out_size - 1, &len, start, n) ||
+            expr_append(out, out_size - 1, &len, "\"*", 2)) {
+            len = mark;
+            out[len] = '\0';
+            break;
+        }
+        words++;
+    }
+    if (words > 0)
+        expr_append(out, out_size, &len, ")", 1);
+
+    return len;
+}
@@ -21,8 +21,27 @@ typedef struct {
     char  flavor_descriptors[256]; /* retronasal/taste keywords */
     float odor_threshold_ppm;      /* detection threshold in water (ppm) */
     char  applications[128];       /* pipe-separated: "beverages|baked goods" */
+    unsigned int app_mask;         /* APP_* bits for the tokens in applications */
 } CompoundInfo;
 
+/* Application categories: bit i of app_mask is compound_app_token(i).
+   compound_library.app_mask is computed from applications by the schema. */
+#define APP_BEVERAGES       0x01u
+#define APP_ALCOHOLIC       0x02u
+#define APP_BAKED_GOODS     0x04u
+#define APP_DAIRY           0x08u
+#define APP_MEAT            0x10u
+#define APP_CONFECTIONS     0x20u
+#define APP_SAVORY          0x40u
+#define APP_CATEGORY_COUNT  7
+#define APP_ALL_MASK        ((1u << APP_CATEGORY_COUNT) - 1)
+
+/* applications token for category bit i ("baked goods"), NULL if out of range */
+const char* compound_app_token(int i);
+
+/* Display label for category bit i ("Baked Goods"), NULL if out of range */
+const char* compound_app_label(int i);
+
 /* Check ppm against max_use_ppm.
    Returns 0 = within limits, 1 = exceeds max, 2 = no limit data (max_use_ppm == 0) */
 int  compound_check_limit(const CompoundInfo* c, float ppm);
@@ -30,4 +49,10 @@ int  compound_check_limit(const CompoundInfo* c, float ppm);
 /* Print a formatted compound info card to stdout */
 void compound_print(const CompoundInfo* c);
 
+/* Build a compound_fts MATCH expression (see SQL_COMPOUNDS_SEARCH).
+   Each word of text becomes a prefix term on the name, odor and flavor
+   columns.  Words that do not fit in out are dropped.
+   Returns the expression length; 0 = nothing to match, list everything. */
+int  compound_search_expr(const char* text, char* out, int out_size);
+
 #endif
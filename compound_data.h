@@ -1,8 +1,11 @@
 #ifndef COMPOUND_DATA_H
 #define COMPOUND_DATA_H
 /*
- * compound_data.h — Static compound library seeding data.
- * Include ONLY from database.c.
+ * compound_data.h — Static seeding data: compound library, starting
+ * inventory and essential oils.  Include ONLY from database.c.
+ *
+ * db_sync_seed_data fingerprints these tables; any edit here is pushed
+ * into existing databases on the next launch.
  *
  * Field order:
  *   compound_name, cas_number, fema_number,
@@ -15,7 +18,8 @@
  *   flavor_descriptors, odor_threshold_ppm,
  *   applications (pipe-separated tokens)
  *
- * Application tokens:
+ * Application tokens (the APP_* bits of compound_library.app_mask, see
+ * compound.h):
  *   beverages | alcoholic | baked goods | dairy | meat | confections | savory
  *
  * Sources: FEMA GRAS, Fenaroli's Handbook, peer-reviewed literature.
@@ -369,4 +373,95 @@ static const struct {
 
 static const int NCOMPOUNDS = 238;
 
+/* =========================================================================
+   STARTING INVENTORY
+   compound_name, stock_grams, reorder_threshold_grams.
+   Only inserted for compounds not yet tracked; stock is user data.
+   ========================================================================= */
+static const struct {
+    const char* compound_name;
+    float       stock_grams;
+    float       reorder_grams;
+} seed_inventory[] = {
+    { "Benzaldehyde",        50.0f,  10.0f },
+    { "Benzyl acetate",      25.0f,   5.0f },
+    { "Butyric acid",        10.0f,   2.0f },
+    { "Cinnamaldehyde",      50.0f,  10.0f },
+    { "Cyclotene",           15.0f,   3.0f },
+    { "Delta-decalactone",   20.0f,   5.0f },
+    { "Diacetyl",            10.0f,   2.0f },
+    { "Ethyl cinnamate",     15.0f,   3.0f },
+    { "Ethyl maltol",       100.0f,  20.0f },
+    { "Eugenol",             30.0f,   5.0f },
+    { "Furaneol",             5.0f,   1.0f },
+    { "Gamma-undecalactone", 15.0f,   3.0f },
+    { "Maltol",             100.0f,  20.0f },
+    { "Sotolon",              2.0f,   0.5f },
+    { "Vanillin",           200.0f,  40.0f },
+};
+
+static const int NSEED_INVENTORY =
+    (int)(sizeof(seed_inventory) / sizeof(seed_inventory[0]));
+
+/* =========================================================================
+   ESSENTIAL OILS
+   Seeded into ingredients as category 'essential_oil', unit 'mL'.
+   ========================================================================= */
+static const char* const seed_oils[] = {
+    "Allspice Essential Oil",
+    "Anise Essential Oil",
+    "Basil Essential Oil",
+    "Bay Laurel Essential Oil",
+    "Bergamot Essential Oil",
+    "Black Pepper Essential Oil",
+    "Blood Orange Essential Oil",
+    "Cardamom Essential Oil",
+    "Caraway Essential Oil",
+    "Celery Seed Essential Oil",
+    "Chamomile (German) Essential Oil",
+    "Chamomile (Roman) Essential Oil",
+    "Cinnamon Bark Essential Oil",
+    "Cinnamon Leaf Essential Oil",
+    "Clove Bud Essential Oil",
+    "Cocoa Essential Oil",
+    "Coffee Essential Oil",
+    "Coriander Essential Oil",
+    "Cumin Essential Oil",
+    "Dill Essential Oil",
+    "Fennel (Sweet) Essential Oil",
+    "Frankincense Essential Oil",
+    "Geranium Essential Oil",
+    "Ginger Essential Oil",
+    "Grapefruit Essential Oil",
+    "Helichrysum Essential Oil",
+    "Jasmine Essential Oil",
+    "Lavender Essential Oil",
+    "Lemon Essential Oil",
+    "Lemongrass Essential Oil",
+    "Lime Essential Oil",
+    "Mandarin Essential Oil",
+    "Marjoram Essential Oil",
+    "Neroli Essential Oil",
+    "Nutmeg Essential Oil",
+    "Orange (Sweet) Essential Oil",
+    "Oregano Essential Oil",
+    "Palmarosa Essential Oil",
+    "Parsley Seed Essential Oil",
+    "Peppermint Essential Oil",
+    "Petitgrain Essential Oil",
+    "Rose Essential Oil",
+    "Rosemary Essential Oil",
+    "Sage Essential Oil",
+    "Spearmint Essential Oil",
+    "Star Anise Essential Oil",
+    "Tangerine Essential Oil",
+    "Tarragon Essential Oil",
+    "Thyme Essential Oil",
+    "Vanilla Essential Oil",
+    "Ylang Ylang Essential Oil",
+    "Yuzu Essential Oil",
+};
+
+static const int NSEED_OILS = (int)(sizeof(seed_oils) / sizeof(seed_oils[0]));
+
 #endif /* COMPOUND_DATA_H */
@@ -1,374 +1,3057 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
+#include <float.h>
 #include "compound.h"
 #include "tasting.h"
 #include "batch.h"
 #include "database.h"
 #include "sqlite3.h"
 #include "compound_data.h"
+#include "panel_sql.h"
+#include "intern.h"
+#include "timing.h"
 
-static sqlite3* g_db = NULL;
+/* =========================================================================
+   Prepared-statement cache
+   Hot statements are prepared once on first use and kept until db_close.
+   stmt_get() hands out the cached statement; stmt_done() resets it and
+   clears its bindings so the next caller starts clean.
+   Each statement may only be borrowed by one caller at a time.
+   ========================================================================= */
+typedef enum {
+    STMT_FIND_FORMULATION_ID,
+    STMT_INSERT_FORMULATION,
+    STMT_INSERT_FORM_COMPOUND,
+    STMT_LOAD_COMPOUNDS,
+    STMT_DELTA_BASE,
+    STMT_LOAD_LATEST,
+    STMT_LOAD_VERSION,
+    STMT_VERSION_HISTORY,
+    STMT_DIFF_VERSIONS,
+    STMT_DIFF_COMPOUNDS,
+    STMT_DIFF_BASES,
+    STMT_DIFF_INGREDIENTS,
+    STMT_ADD_COMPOUND,
+    STMT_GET_COMPOUND,
+    STMT_SET_COMPOUND_COST,
+    STMT_INSERT_TASTING,
+    STMT_LIST_TASTINGS,
+    STMT_TASTING_AGG_VERSION,
+    STMT_TASTING_AGG_FLAVOR,
+    STMT_SENSORY_SESSIONS_ALL,
+    STMT_SENSORY_SESSIONS_FLAVOR,
+    STMT_SENSORY_VERSION,
+    STMT_BATCH_SEQ_NEXT,
+    STMT_BATCH_SEQ_PEEK,
+    STMT_INSERT_BATCH_RUN,
+    STMT_INSERT_BATCH_INGREDIENT,
+    STMT_BATCH_BATCHED_AT,
+    STMT_LIST_BATCHES,
+    STMT_INVENTORY_STOCK,
+    STMT_STOCK_ENSURE,
+    STMT_STOCK_SET_THRESHOLD,
+    STMT_STOCK_INSERT_MOVEMENT,
+    STMT_STOCK_GET_MOVEMENT,
+    STMT_STOCK_LAST_AT,
+    STMT_STOCK_BALANCE_AT,
+    STMT_LIST_STOCK_MOVEMENTS,
+    STMT_REG_LIMIT_OVERRIDE,
+    STMT_INSERT_REG_LIMIT,
+    STMT_GET_SETTING,
+    STMT_SET_SETTING,
+    STMT_INSERT_COMPOUND_SUPPLIER,
+    STMT_GET_INGREDIENT,
+    STMT_INSERT_SODA_BASE,
+    STMT_INSERT_BASE_COMPOUND,
+    STMT_INSERT_BASE_INGREDIENT,
+    STMT_LOAD_LATEST_BASE,
+    STMT_LOAD_BASE_COMPOUNDS,
+    STMT_LOAD_BASE_INGREDIENTS,
+    STMT_DELETE_FORM_BASES,
+    STMT_DELETE_FORM_INGREDIENTS,
+    STMT_INSERT_FORM_BASE,
+    STMT_INSERT_FORM_INGREDIENT,
+    STMT_LOAD_FORM_BASES,
+    STMT_LOAD_FORM_INGREDIENTS,
+    STMT_VALIDATE_CLEAR,
+    STMT_VALIDATE_INSERT,
+    STMT_VALIDATE_LIMITS,
+    STMT_LOAD_ALL_COMPOUNDS,
+    STMT_COMPOUNDS_BY_APP,
+    STMT_COUNT_BY_APP_MASK,
+    STMT_DATA_VERSION,
+    STMT_COUNT
+} StmtId;
+
+static const char* const g_stmt_sql[STMT_COUNT] = {
+    [STMT_FIND_FORMULATION_ID] =
+        "SELECT id FROM formulations "
+        "WHERE flavor_code = ? "
+        "  AND ver_major = ? AND ver_minor = ? AND ver_patch = ?;",
+    [STMT_INSERT_FORMULATION] =
+        "INSERT INTO formulations "
+        "(flavor_code, flavor_name, ver_major, ver_minor, ver_patch, "
+        " target_ph, target_brix, production_instructions, "
+        " parent_id, chain_depth, compound_count) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
+    [STMT_INSERT_FORM_COMPOUND] =
+        "INSERT INTO formulation_compounds "
+        "(formulation_id, seq, compound_name, concentration_ppm, compound_library_id) "
+        "VALUES (?, ?, ?, ?, ?);",
+    /* Every row on the path from the version back to its keyframe,
+       keyframe first, so later rows overwrite earlier ones (see
+       load_compounds) */
+    [STMT_LOAD_COMPOUNDS] =
+        "WITH RECURSIVE chain(id, parent_id, depth) AS ("
+        "    SELECT id, parent_id, 0 FROM formulations WHERE id = ?1 "
+        "    UNION ALL "
+        "    SELECT f.id, f.parent_id, chain.depth + 1 "
+        "    FROM chain JOIN formulations f ON f.id = chain.parent_id"
+        ") "
+        "SELECT fc.seq, chain.depth, fc.compound_name, fc.concentration_ppm, "
+        "       COALESCE(fc.compound_library_id, 0) "
+        "FROM chain "
+        "JOIN formulation_compounds fc ON fc.formulation_id = chain.id;",
+    [STMT_DELTA_BASE] =
+        "SELECT f.id, f.chain_depth, f.compound_count "
+        "FROM latest_formulations lf "
+        "JOIN formulations f ON f.id = lf.formulation_id "
+        "WHERE lf.flavor_code = ?;",
+    [STMT_LOAD_LATEST] =
+        "SELECT id, flavor_code, flavor_name, ver_major, ver_minor, ver_patch, "
+        "       target_ph, target_brix, "
+        "       COALESCE(production_instructions,''), compound_count "
+        "FROM formulations "
+        "WHERE flavor_code = ? "
+        "ORDER BY ver_major DESC, ver_minor DESC, ver_patch DESC "
+        "LIMIT 1;",
+    [STMT_LOAD_VERSION] =
+        "SELECT id, flavor_code, flavor_name, ver_major, ver_minor, ver_patch, "
+        "       target_ph, target_brix, compound_count "
+        "FROM formulations "
+        "WHERE flavor_code = ? "
+        "  AND ver_major = ? AND ver_minor = ? AND ver_patch = ?;",
+    [STMT_VERSION_HISTORY] =
+        "SELECT ver_major, ver_minor, ver_patch, saved_at "
+        "FROM formulations "
+        "WHERE flavor_code = ? "
+        "ORDER BY ver_major ASC, ver_minor ASC, ver_patch ASC;",
+    /* db_diff_history: a flavor's versions, then every row they own.
+       The three row queries share a column layout: formulation id, key,
+       name, value, and the library id (compounds) or unit (extras). */
+    [STMT_DIFF_VERSIONS] =
+        "SELECT id, COALESCE(parent_id, 0), ver_major, ver_minor, ver_patch, "
+        "       target_ph, target_brix, compound_count "
+        "FROM formulations "
+        "WHERE flavor_code = ? "
+        "ORDER BY ver_major ASC, ver_minor ASC, ver_patch ASC;",
+    [STMT_DIFF_COMPOUNDS] =
+        "SELECT fc.formulation_id, fc.seq, fc.compound_name, fc.concentration_ppm, "
+        "       COALESCE(fc.compound_library_id, 0) "
+        "FROM formulations f "
+        "JOIN formulation_compounds fc ON fc.formulation_id = f.id "
+        "WHERE f.flavor_code = ?;",
+    [STMT_DIFF_BASES] =
+        "SELECT fb.formulation_id, fb.soda_base_id, sb.base_name, fb.amount, fb.unit "
+        "FROM formulations f "
+        "JOIN formulation_bases fb ON fb.formulation_id = f.id "
+        "JOIN soda_bases sb ON sb.id = fb.soda_base_id "
+        "WHERE f.flavor_code = ?;",
+    [STMT_DIFF_INGREDIENTS] =
+        "SELECT fi.formulation_id, fi.ingredient_id, i.ingredient_name, fi.amount, fi.unit "
+        "FROM formulations f "
+        "JOIN formulation_ingredients fi ON fi.formulation_id = f.id "
+        "JOIN ingredients i ON i.id = fi.ingredient_id "
+        "WHERE f.flavor_code = ?;",
+    /* Upsert rather than REPLACE: other tables key on compound_library.id,
+       so an existing compound must keep its id. */
+    [STMT_ADD_COMPOUND] =
+        "INSERT INTO compound_library "
+        "(compound_name, cas_number, fema_number, max_use_ppm, rec_min_ppm, "
+        " rec_max_ppm, molecular_weight, water_solubility, ph_stable_min, "
+        " ph_stable_max, odor_profile, storage_temp, "
+        " requires_solubilizer, requires_inert_atm) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?) "
+        "ON CONFLICT (compound_name) DO UPDATE SET "
+        "    cas_number = excluded.cas_number, "
+        "    fema_number = excluded.fema_number, "
+        "    max_use_ppm = excluded.max_use_ppm, "
+        "    rec_min_ppm = excluded.rec_min_ppm, "
+        "    rec_max_ppm = excluded.rec_max_ppm, "
+        "    molecular_weight = excluded.molecular_weight, "
+        "    water_solubility = excluded.water_solubility, "
+        "    ph_stable_min = excluded.ph_stable_min, "
+        "    ph_stable_max = excluded.ph_stable_max, "
+        "    odor_profile = excluded.odor_profile, "
+        "    storage_temp = excluded.storage_temp, "
+        "    requires_solubilizer = excluded.requires_solubilizer, "
+        "    requires_inert_atm = excluded.requires_inert_atm;",
+    [STMT_GET_COMPOUND] =
+        "SELECT id, compound_name, cas_number, fema_number, max_use_ppm, "
+        "       rec_min_ppm, rec_max_ppm, molecular_weight, water_solubility, "
+        "       ph_stable_min, ph_stable_max, odor_profile, storage_temp, "
+        "       requires_solubilizer, requires_inert_atm, cost_per_gram, "
+        "       flavor_descriptors, odor_threshold_ppm, applications, app_mask "
+        "FROM compound_library WHERE compound_name = ?;",
+    [STMT_SET_COMPOUND_COST] =
+        "UPDATE compound_library SET cost_per_gram = ? WHERE compound_name = ?;",
+    [STMT_INSERT_TASTING] =
+        "INSERT INTO tasting_sessions "
+        "(formulation_id, taster, overall_score, aroma_score, flavor_score, "
+        " mouthfeel_score, finish_score, sweetness_score, notes) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);",
+    [STMT_LIST_TASTINGS] =
+        "SELECT t.id, f.ver_major, f.ver_minor, f.ver_patch, "
+        "       t.taster, t.tasted_at, "
+        "       t.overall_score, t.aroma_score, t.flavor_score, "
+        "       t.mouthfeel_score, t.finish_score, t.sweetness_score, "
+        "       t.notes "
+        "FROM tasting_sessions t "
+        "JOIN formulations f ON f.id = t.formulation_id "
+        "WHERE f.flavor_code = ? "
+        "ORDER BY t.tasted_at ASC;",
+    /* tasting_aggregates columns: sessions, then (n, sum, sumsq) for each
+       of overall, aroma, flavor, mouthfeel, finish, sweetness */
+    [STMT_TASTING_AGG_VERSION] =
+        "SELECT f.id, a.sessions, "
+        "       a.overall_n, a.overall_sum, a.overall_sumsq, "
+        "       a.aroma_n, a.aroma_sum, a.aroma_sumsq, "
+        "       a.flavor_n, a.flavor_sum, a.flavor_sumsq, "
+        "       a.mouthfeel_n, a.mouthfeel_sum, a.mouthfeel_sumsq, "
+        "       a.finish_n, a.finish_sum, a.finish_sumsq, "
+        "       a.sweetness_n, a.sweetness_sum, a.sweetness_sumsq "
+        "FROM formulations f "
+        "LEFT JOIN tasting_aggregates a ON a.formulation_id = f.id "
+        "WHERE f.flavor_code = ? AND f.ver_major = ? AND f.ver_minor = ? "
+        "  AND f.ver_patch = ?;",
+    /* One row per version of the flavor, so a rollup is a short range */
+    [STMT_TASTING_AGG_FLAVOR] =
+        "SELECT COUNT(*), TOTAL(sessions), "
+        "       TOTAL(overall_n), TOTAL(overall_sum), TOTAL(overall_sumsq), "
+        "       TOTAL(aroma_n), TOTAL(aroma_sum), TOTAL(aroma_sumsq), "
+        "       TOTAL(flavor_n), TOTAL(flavor_sum), TOTAL(flavor_sumsq), "
+        "       TOTAL(mouthfeel_n), TOTAL(mouthfeel_sum), TOTAL(mouthfeel_sumsq), "
+        "       TOTAL(finish_n), TOTAL(finish_sum), TOTAL(finish_sumsq), "
+        "       TOTAL(sweetness_n), TOTAL(sweetness_sum), TOTAL(sweetness_sumsq) "
+        "FROM tasting_aggregates WHERE flavor_code = ?;",
+    /* No join: versions are named once each afterwards (STMT_SENSORY_VERSION),
+       which halves the whole-history read.  -1 = not scored, as in
+       SensoryRow, saves a column_type call per score. */
+    [STMT_SENSORY_SESSIONS_ALL] =
+        "SELECT formulation_id, taster, overall_score, "
+        "       IFNULL(aroma_score, -1), IFNULL(flavor_score, -1), "
+        "       IFNULL(mouthfeel_score, -1), IFNULL(finish_score, -1), "
+        "       IFNULL(sweetness_score, -1) "
+        "FROM tasting_sessions;",
+    [STMT_SENSORY_SESSIONS_FLAVOR] =
+        "SELECT formulation_id, taster, overall_score, "
+        "       IFNULL(aroma_score, -1), IFNULL(flavor_score, -1), "
+        "       IFNULL(mouthfeel_score, -1), IFNULL(finish_score, -1), "
+        "       IFNULL(sweetness_score, -1) "
+        "FROM tasting_sessions "
+        "WHERE formulation_id IN (SELECT id FROM formulations WHERE flavor_code = ?);",
+    [STMT_SENSORY_VERSION] =
+        "SELECT flavor_code, ver_major, ver_minor, ver_patch "
+        "FROM formulations WHERE id = ?;",
+    /* Reserves the next number: the increment is the row lock, so two
+       savers can never read the same last_seq (see db_save_batch) */
+    [STMT_BATCH_SEQ_NEXT] =
+        "INSERT INTO batch_sequences (flavor_code, year, last_seq) "
+        "VALUES (?1, CAST(strftime('%Y', 'now', 'localtime') AS INTEGER), 1) "
+        "ON CONFLICT(flavor_code, year) DO UPDATE SET last_seq = last_seq + 1 "
+        "RETURNING year, last_seq;",
+    [STMT_BATCH_SEQ_PEEK] =
+        "SELECT y, IFNULL((SELECT last_seq FROM batch_sequences "
+        "                  WHERE flavor_code = ?1 AND year = y), 0) + 1 "
+        "FROM (SELECT CAST(strftime('%Y', 'now', 'localtime') AS INTEGER) AS y);",
+    [STMT_INSERT_BATCH_RUN] =
+        "INSERT INTO batch_runs "
+        "(formulation_id, batch_number, volume_liters, cost_total, notes) "
+        "VALUES (?, ?, ?, ?, ?);",
+    [STMT_INSERT_BATCH_INGREDIENT] =
+        "INSERT INTO batch_ingredients "
+        "(batch_run_id, compound_name, grams_needed, cost_line, compound_library_id) "
+        "VALUES (?, ?, ?, ?, ?);",
+    [STMT_BATCH_BATCHED_AT] =
+        "SELECT batched_at FROM batch_runs WHERE id = ?;",
+    [STMT_LIST_BATCHES] =
+        "SELECT br.id, br.batch_number, "
+        "       f.ver_major, f.ver_minor, f.ver_patch, "
+        "       br.volume_liters, br.cost_total, br.batched_at "
+        "FROM batch_runs br "
+        "JOIN formulations f ON f.id = br.formulation_id "
+        "WHERE f.flavor_code = ? "
+        "ORDER BY br.batched_at ASC;",
+    [STMT_INVENTORY_STOCK] =
+        "SELECT stock_grams FROM compound_inventory WHERE compound_library_id = ?;",
+    [STMT_STOCK_ENSURE] =
+        "INSERT OR IGNORE INTO compound_inventory (compound_library_id, stock_grams) "
+        "VALUES (?, 0);",
+    [STMT_STOCK_SET_THRESHOLD] =
+        "UPDATE compound_inventory SET reorder_threshold_grams = ? "
+        "WHERE compound_library_id = ?;",
+    /* ?1 compound_library_id, ?2 kind, ?3 delta_grams, ?4 batch_run_id,
+       ?5 reverses_id, ?6 note; the ledger triggers do the rest */
+    [STMT_STOCK_INSERT_MOVEMENT] =
+        "INSERT INTO stock_movements "
+        "(compound_library_id, kind, delta_grams, batch_run_id, reverses_id, note) "
+        "VALUES (?1, ?2, ?3, ?4, ?5, ?6);",
+    [STMT_STOCK_GET_MOVEMENT] =
+        "SELECT compound_library_id, kind, delta_grams, "
+        "       EXISTS (SELECT 1 FROM stock_movements r WHERE r.reverses_id = m.id) "
+        "FROM stock_movements m WHERE m.id = ?;",
+    /* Point-in-time balance, in two seeks: the last movement at or
+       before ?2, then the nearest snapshot at or before that movement
+       plus the movements in between (at most STOCK_SNAPSHOT_EVERY) */
+    [STMT_STOCK_LAST_AT] =
+        "SELECT id FROM stock_movements "
+        "WHERE compound_library_id = ? AND moved_at <= ? "
+        "ORDER BY moved_at DESC, id DESC LIMIT 1;",
+    [STMT_STOCK_BALANCE_AT] =
+        "SELECT s.balance_grams + "
+        "       COALESCE((SELECT SUM(m.delta_grams) FROM stock_movements m "
+        "                 WHERE m.compound_library_id = ?1 "
+        "                   AND m.id > s.movement_id AND m.id <= ?2), 0) "
+        "FROM stock_snapshots s "
+        "WHERE s.compound_library_id = ?1 AND s.movement_id <= ?2 "
+        "ORDER BY s.movement_id DESC LIMIT 1;",
+    [STMT_LIST_STOCK_MOVEMENTS] =
+        "SELECT m.id, m.moved_at, m.kind, m.delta_grams, br.batch_number, "
+        "       m.reverses_id, m.note "
+        "FROM stock_movements m "
+        "LEFT JOIN batch_runs br ON br.id = m.batch_run_id "
+        "WHERE m.compound_library_id = ? "
+        "ORDER BY m.id;",
+    [STMT_REG_LIMIT_OVERRIDE] =
+        "SELECT max_use_ppm FROM regulatory_limits "
+        "WHERE compound_library_id = ? "
+        "ORDER BY effective_date DESC, id DESC LIMIT 1;",
+    [STMT_INSERT_REG_LIMIT] =
+        "INSERT INTO regulatory_limits "
+        "(compound_name, source, max_use_ppm, effective_date, notes, "
+        " compound_library_id) "
+        "VALUES (?, ?, ?, ?, ?, ?);",
+    [STMT_GET_SETTING] =
+        "SELECT value FROM app_settings WHERE key = ?;",
+    [STMT_SET_SETTING] =
+        "INSERT OR REPLACE INTO app_settings (key, value) VALUES (?, ?);",
+    [STMT_INSERT_COMPOUND_SUPPLIER] =
+        "INSERT OR IGNORE INTO compound_suppliers "
+        "(supplier_id, compound_library_id, catalog_number, "
+        " price_per_gram, min_order_grams, lead_time_days) "
+        "VALUES (?, ?, ?, ?, ?, ?);",
+    [STMT_GET_INGREDIENT] =
+        "SELECT id, ingredient_name, category, unit, cost_per_unit, "
+        "       COALESCE(supplier_id, 0), COALESCE(brand, ''), COALESCE(notes, '') "
+        "FROM ingredients WHERE id=?;",
+    [STMT_INSERT_SODA_BASE] =
+        "INSERT INTO soda_bases "
+        "(base_code, base_name, ver_major, ver_minor, ver_patch, yield_liters, notes) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?);",
+    [STMT_INSERT_BASE_COMPOUND] =
+        "INSERT INTO soda_base_compounds "
+        "(soda_base_id, compound_name, concentration_ppm, compound_library_id) "
+        "VALUES (?, ?, ?, ?);",
+    [STMT_INSERT_BASE_INGREDIENT] =
+        "INSERT INTO soda_base_ingredients "
+        "(soda_base_id, ingredient_id, amount, unit) VALUES (?, ?, ?, ?);",
+    [STMT_LOAD_LATEST_BASE] =
+        "SELECT id, base_code, base_name, ver_major, ver_minor, ver_patch, "
+        "       yield_liters, COALESCE(notes, '') "
+        "FROM soda_bases WHERE base_code=? "
+        "ORDER BY ver_major DESC, ver_minor DESC, ver_patch DESC LIMIT 1;",
+    [STMT_LOAD_BASE_COMPOUNDS] =
+        "SELECT compound_name, concentration_ppm, COALESCE(compound_library_id, 0) "
+        "FROM soda_base_compounds WHERE soda_base_id=? ORDER BY id;",
+    [STMT_LOAD_BASE_INGREDIENTS] =
+        "SELECT sbi.ingredient_id, i.ingredient_name, sbi.amount, sbi.unit "
+        "FROM soda_base_ingredients sbi "
+        "JOIN ingredients i ON i.id = sbi.ingredient_id "
+        "WHERE sbi.soda_base_id=? ORDER BY sbi.id;",
+    [STMT_DELETE_FORM_BASES] =
+        "DELETE FROM formulation_bases WHERE formulation_id=?;",
+    [STMT_DELETE_FORM_INGREDIENTS] =
+        "DELETE FROM formulation_ingredients WHERE formulation_id=?;",
+    [STMT_INSERT_FORM_BASE] =
+        "INSERT INTO formulation_bases "
+        "(formulation_id, soda_base_id, amount, unit) VALUES (?, ?, ?, ?);",
+    [STMT_INSERT_FORM_INGREDIENT] =
+        "INSERT INTO formulation_ingredients "
+        "(formulation_id, ingredient_id, amount, unit) VALUES (?, ?, ?, ?);",
+    [STMT_LOAD_FORM_BASES] =
+        "SELECT fb.soda_base_id, sb.base_name, fb.amount, fb.unit "
+        "FROM formulation_bases fb "
+        "JOIN soda_bases sb ON sb.id = fb.soda_base_id "
+        "WHERE fb.formulation_id=? ORDER BY fb.id;",
+    [STMT_LOAD_FORM_INGREDIENTS] =
+        "SELECT fi.ingredient_id, i.ingredient_name, fi.amount, fi.unit "
+        "FROM formulation_ingredients fi "
+        "JOIN ingredients i ON i.id = fi.ingredient_id "
+        "WHERE fi.formulation_id=? ORDER BY fi.id;",
+    [STMT_VALIDATE_CLEAR] =
+        "DELETE FROM temp.validate_input;",
+    [STMT_VALIDATE_INSERT] =
+        "INSERT INTO temp.validate_input (seq, compound_library_id, concentration_ppm) "
+        "VALUES (?, ?, ?);",
+    /* Newest override per compound wins; library limit otherwise.
+       from_override = 1 when the limit came from regulatory_limits. */
+    [STMT_VALIDATE_LIMITS] =
+        "WITH overrides AS ("
+        "    SELECT compound_library_id, max_use_ppm, "
+        "           ROW_NUMBER() OVER ("
+        "               PARTITION BY compound_library_id "
+        "               ORDER BY effective_date DESC, id DESC) AS rn "
+        "    FROM regulatory_limits "
+        "    WHERE compound_library_id IN "
+        "          (SELECT compound_library_id FROM temp.validate_input)"
+        ") "
+        "SELECT v.seq, "
+        "       COALESCE(o.max_use_ppm, cl.max_use_ppm, 0.0), "
+        "       o.max_use_ppm IS NOT NULL "
+        "FROM temp.validate_input v "
+        "LEFT JOIN overrides o "
+        "       ON o.compound_library_id = v.compound_library_id AND o.rn = 1 "
+        "LEFT JOIN compound_library cl ON cl.id = v.compound_library_id "
+        "ORDER BY v.seq;",
+    /* Same columns as STMT_GET_COMPOUND plus the newest override, if any */
+    [STMT_LOAD_ALL_COMPOUNDS] =
+        "SELECT id, compound_name, cas_number, fema_number, max_use_ppm, "
+        "       rec_min_ppm, rec_max_ppm, molecular_weight, water_solubility, "
+        "       ph_stable_min, ph_stable_max, odor_profile, storage_temp, "
+        "       requires_solubilizer, requires_inert_atm, cost_per_gram, "
+        "       flavor_descriptors, odor_threshold_ppm, applications, app_mask, "
+        "       (SELECT r.max_use_ppm FROM regulatory_limits r "
+        "        WHERE r.compound_library_id = cl.id "
+        "        ORDER BY r.effective_date DESC, r.id DESC LIMIT 1) "
+        "FROM compound_library cl;",
+    /* ?1 = JSON array of every app_mask value that qualifies, so each one
+       is an index lookup (see db_find_compounds_by_app) */
+    [STMT_COMPOUNDS_BY_APP] =
+        "SELECT id FROM compound_library "
+        "WHERE app_mask IN (SELECT value FROM json_each(?1)) "
+        "ORDER BY compound_name;",
+    [STMT_COUNT_BY_APP_MASK] =
+        "SELECT app_mask, COUNT(*) FROM compound_library GROUP BY app_mask;",
+    /* Moves when another connection commits (see change tracking) */
+    [STMT_DATA_VERSION] =
+        "PRAGMA data_version;",
+};
+
+/* =========================================================================
+   DbContext
+   One connection plus everything cached against it: prepared statements,
+   the compound cache and the counters behind the db_get_*_stats calls.
+   Contexts share nothing, so each may be used from its own thread.
+   g_default backs the db_* API; dbc_open hands out further contexts.
+   ========================================================================= */
+struct CachedCompound;
+struct SqlProfiler;
+struct ChangeTracker;
+struct StorageProfile;
+
+struct DbContext {
+    sqlite3*                db;
+
+    sqlite3_stmt*           stmts[STMT_COUNT];
+    DbStmtCacheStats        stmt_stats;
+
+    /* Compound cache, see below */
+    struct CachedCompound*  cc;
+    int                     cc_count;
+    int                     cc_cap;
+    int*                    cc_by_sym;     /* sym -> slot + 1 */
+    int                     cc_sym_cap;
+    int*                    cc_by_id;      /* id  -> slot + 1 */
+    int                     cc_id_cap;
+    int                     cc_loaded;
+    sqlite3_int64           cc_data_version;  /* PRAGMA data_version it was filled at */
+    DbCompoundCacheStats    cc_stats;
+
+    DbMigrationStats        migration_stats;
+
+    struct SqlProfiler*     prof;          /* NULL unless profiling is on */
+    struct ChangeTracker*   changes;       /* update/commit hook state */
+    const struct StorageProfile* storage;  /* NULL = SQLite defaults */
+};
+
+static DbContext g_default;
+
+/* Status chatter on stdout (see db_set_verbose); errors always go to stderr */
+static int g_verbose = 1;
+
+void db_set_verbose(int on) { g_verbose = on; }
+
+sqlite3* dbc_get_handle(DbContext* ctx) { return ctx->db; }
+
+/* Borrow the cached statement for id, preparing it on first use.
+   Returns SQLITE_OK and sets *out, or the prepare error code. */
+static int stmt_get(DbContext* ctx, StmtId id, sqlite3_stmt** out)
+{
+    int rc;
+
+    *out = ctx->stmts[id];
+    if (*out != NULL) {
+        ctx->stmt_stats.hits++;
+        return SQLITE_OK;
+    }
+
+    rc = sqlite3_prepare_v3(ctx->db, g_stmt_sql[id], -1,
+                            SQLITE_PREPARE_PERSISTENT, &ctx->stmts[id], NULL);
+    if (rc != SQLITE_OK) {
+        ctx->stmts[id] = NULL;
+        return rc;
+    }
+    ctx->stmt_stats.misses++;
+    ctx->stmt_stats.prepared++;
+    *out = ctx->stmts[id];
+    return SQLITE_OK;
+}
+
+/* Return a borrowed statement to the cache (reset + clear bindings). */
+static void stmt_done(sqlite3_stmt* stmt)
+{
+    if (stmt == NULL) return;
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+}
+
+static void stmt_cache_clear(DbContext* ctx)
+{
+    int i;
+    for (i = 0; i < STMT_COUNT; i++) {
+        if (ctx->stmts[i] != NULL) {
+            sqlite3_finalize(ctx->stmts[i]);
+            ctx->stmts[i] = NULL;
+        }
+    }
+    ctx->stmt_stats.prepared = 0;
+}
+
+void dbc_get_stmt_cache_stats(DbContext* ctx, DbStmtCacheStats* out)
+{
+    *out = ctx->stmt_stats;
+}
+
+void dbc_reset_stmt_cache_stats(DbContext* ctx)
+{
+    ctx->stmt_stats.hits   = 0;
+    ctx->stmt_stats.misses = 0;
+}
+
+/* =========================================================================
+   SQL profiling
+   Opt-in: db_set_sql_profile(1), or app_settings sql_profile = '1'.
+   ctx_open then hooks sqlite3_trace_v2 on the connection, so every
+   statement is seen, the panels' own prepares included.  Executions are
+   grouped by statement text in a fixed open-addressed table.  STMT marks
+   the start of an execution, ROW events count rows stepped and PROFILE
+   closes it.  The elapsed time is taken from timing_now_ms between STMT
+   and PROFILE: the nanosecond figure SQLite hands to PROFILE comes from
+   the VFS clock, which only ticks in whole milliseconds.  It is still the
+   fallback for statements SQLite runs without a STMT event (the FTS5
+   shadow-table writes nested inside another statement).
+   Statements past PROF_MAX_STMTS are folded into one "(other)" entry.
+   ========================================================================= */
+#define PROF_SLOTS      512             /* power of two */
+#define PROF_MAX_STMTS  384             /* keep the table 3/4 full at most */
+
+typedef struct {
+    char*          sql;                 /* owned copy, NULL = free slot */
+    unsigned long  hash;
+    unsigned long  pending_rows;        /* rows of the running execution */
+    double         start_ms;            /* when it began, 0 = no STMT seen */
+    DbSqlProfile   p;
+} ProfEntry;
+
+typedef struct SqlProfiler {
+    ProfEntry      slots[PROF_SLOTS];
+    ProfEntry      other;
+    int            count;
+    double         slow_ms;             /* 0 = no slow-query log */
+    char           dump_path[260];      /* written by db_close, "" = none */
+    sqlite3_stmt*  last_stmt;           /* ROW-event memo, see prof_find */
+    ProfEntry*     last_entry;
+} SqlProfiler;
+
+/* Profile every context opened from now on (see db_set_sql_profile) */
+static int g_sql_profile = 0;
+
+void db_set_sql_profile(int on) { g_sql_profile = on; }
+
+static unsigned long prof_hash(const char* s)
+{
+    unsigned long h = 2166136261UL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+static ProfEntry* prof_find(SqlProfiler* pr, sqlite3_stmt* stmt)
+{
+    const char*   sql = sqlite3_sql(stmt);
+    unsigned long h;
+    unsigned int  i;
+
+    /* Rows of one execution arrive back to back; hash them once */
+    if (stmt == pr->last_stmt) return pr->last_entry;
+
+    if (sql == NULL) return &pr->other;
+    h = prof_hash(sql);
+    for (i = (unsigned int)h & (PROF_SLOTS - 1); ; i = (i + 1) & (PROF_SLOTS - 1)) {
+        ProfEntry* e = &pr->slots[i];
+        if (e->sql == NULL) {
+            size_t n = strlen(sql) + 1;
+            if (pr->count >= PROF_MAX_STMTS) return &pr->other;
+            e->sql = (char*)malloc(n);
+            if (e->sql == NULL) return &pr->other;
+            memcpy(e->sql, sql, n);
+            e->hash  = h;
+            e->p.sql = e->sql;
+            pr->count++;
+            break;
+        }
+        if (e->hash == h && strcmp(e->sql, sql) == 0) break;
+    }
+    pr->last_stmt  = stmt;
+    pr->last_entry = &pr->slots[i];
+    return pr->last_entry;
+}
+
+/* time_hist[i]: under 2^i us (the last bucket takes the rest);
+   row_hist[0]: no rows, row_hist[i]: under 2^i rows */
+static int prof_bucket(unsigned long v, int buckets)
+{
+    int b = 0;
+    while (v > 0 && b < buckets - 1) {
+        v >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static int prof_trace(unsigned int type, void* arg, void* p, void* x)
+{
+    DbContext*    ctx = (DbContext*)arg;
+    SqlProfiler*  pr  = ctx->prof;
+    sqlite3_stmt* stmt = (sqlite3_stmt*)p;
+    ProfEntry*    e;
+    double        ms;
+    unsigned long rows;
+
+    if (pr == NULL) return 0;
+    e = prof_find(pr, stmt);
+
+    if (type == SQLITE_TRACE_ROW) {
+        e->pending_rows++;
+        return 0;
+    }
+    if (type == SQLITE_TRACE_STMT) {
+        /* Also sent as "-- name" when a trigger fires mid-execution */
+        const char* text = (const char*)x;
+        if (text == NULL || strncmp(text, "--", 2) != 0) {
+            e->start_ms     = timing_now_ms();
+            e->pending_rows = 0;
+        }
+        return 0;
+    }
+
+    /* SQLITE_TRACE_PROFILE: one execution is finished */
+    if (e->start_ms > 0)
+        ms = timing_now_ms() - e->start_ms;
+    else
+        ms = (double)*(sqlite3_int64*)x / 1e6;
+    rows = e->pending_rows;
+    e->pending_rows = 0;
+    e->start_ms     = 0;
+    pr->last_stmt   = NULL;
+
+    e->p.calls++;
+    e->p.rows     += rows;
+    e->p.total_ms += ms;
+    if (ms > e->p.max_ms) e->p.max_ms = ms;
+    e->p.time_hist[prof_bucket((unsigned long)(ms * 1000.0), DB_PROFILE_TIME_BUCKETS)]++;
+    e->p.row_hist[prof_bucket(rows, DB_PROFILE_ROW_BUCKETS)]++;
+
+    if (pr->slow_ms > 0 && ms >= pr->slow_ms) {
+        char* full = sqlite3_expanded_sql(stmt);
+        e->p.slow++;
+        fprintf(stderr, "[SLOW SQL] %.2f ms, %lu rows: %s\n", ms, rows,
+                full ? full : e->p.sql);
+        sqlite3_free(full);
+    }
+    return 0;
+}
+
+static void prof_clear(SqlProfiler* pr)
+{
+    int i;
+    for (i = 0; i < PROF_SLOTS; i++)
+        free(pr->slots[i].sql);
+    memset(pr->slots, 0, sizeof(pr->slots));
+    memset(&pr->other, 0, sizeof(pr->other));
+    pr->other.p.sql = "(other)";
+    pr->count      = 0;
+    pr->last_stmt  = NULL;
+    pr->last_entry = NULL;
+}
+
+/* Allocate the profiler and hook the connection; no-op if already on */
+static int prof_start(DbContext* ctx)
+{
+    if (ctx->prof != NULL) return 0;
+    ctx->prof = (SqlProfiler*)calloc(1, sizeof(SqlProfiler));
+    if (ctx->prof == NULL) return SQLITE_NOMEM;
+    prof_clear(ctx->prof);
+    return sqlite3_trace_v2(ctx->db, SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE |
+                                     SQLITE_TRACE_ROW,
+                            prof_trace, ctx);
+}
+
+/* Pick up sql_profile / sql_slow_ms / sql_profile_dump from app_settings */
+static void prof_configure(DbContext* ctx)
+{
+    char value[260];
+
+    if (dbc_get_setting(ctx, "sql_profile", value, sizeof(value)) &&
+        atoi(value) != 0)
+        prof_start(ctx);
+    if (ctx->prof == NULL) return;
+
+    if (dbc_get_setting(ctx, "sql_slow_ms", value, sizeof(value)))
+        ctx->prof->slow_ms = atof(value);
+    if (dbc_get_setting(ctx, "sql_profile_dump", value, sizeof(value)))
+        strcpy(ctx->prof->dump_path, value);
+}
+
+static void prof_stop(DbContext* ctx)
+{
+    if (ctx->prof == NULL) return;
+    if (ctx->prof->dump_path[0] != '\0')
+        dbc_dump_sql_profile(ctx, ctx->prof->dump_path);
+    sqlite3_trace_v2(ctx->db, 0, NULL, NULL);
+    prof_clear(ctx->prof);
+    free(ctx->prof);
+    ctx->prof = NULL;
+}
+
+static int prof_cmp_total(const void* a, const void* b)
+{
+    double ta = ((const DbSqlProfile*)a)->total_ms;
+    double tb = ((const DbSqlProfile*)b)->total_ms;
+    return (ta < tb) - (ta > tb);
+}
+
+int dbc_get_sql_profile(DbContext* ctx, DbSqlProfile* out, int max)
+{
+    SqlProfiler* pr = ctx->prof;
+    int i, n = 0;
+
+    if (pr == NULL || out == NULL || max <= 0) return 0;
+    for (i = 0; i < PROF_SLOTS && n < max; i++)
+        if (pr->slots[i].sql != NULL)
+            out[n++] = pr->slots[i].p;
+    if (pr->other.p.calls > 0 && n < max)
+        out[n++] = pr->other.p;
+    qsort(out, n, sizeof(DbSqlProfile), prof_cmp_total);
+    return n;
+}
+
+void dbc_reset_sql_profile(DbContext* ctx)
+{
+    if (ctx->prof != NULL) prof_clear(ctx->prof);
+}
+
+int dbc_dump_sql_profile(DbContext* ctx, const char* path)
+{
+    DbSqlProfile* rows;
+    FILE*         fp;
+    unsigned long calls = 0;
+    double        total = 0;
+    int           i, n;
+
+    if (ctx->prof == NULL) return -1;
+    rows = (DbSqlProfile*)malloc((PROF_MAX_STMTS + 1) * sizeof(DbSqlProfile));
+    if (rows == NULL) return -1;
+    n = dbc_get_sql_profile(ctx, rows, PROF_MAX_STMTS + 1);
+
+    fp = (path != NULL) ? fopen(path, "w") : stderr;
+    if (fp == NULL) {
+        fprintf(stderr, "Cannot write SQL profile to '%s'\n", path);
+        free(rows);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        calls += rows[i].calls;
+        total += rows[i].total_ms;
+    }
+    fprintf(fp, "SQL profile: %d statements, %lu calls, %.1f ms\n", n, calls, total);
+    fprintf(fp, "%9s %11s %9s %9s %10s %6s  %s\n",
+            "calls", "total_ms", "avg_ms", "max_ms", "rows", "slow", "sql");
+    for (i = 0; i < n; i++) {
+        const DbSqlProfile* r = &rows[i];
+        const char*         c;
+        int                 gap = 0;
+
+        fprintf(fp, "%9lu %11.2f %9.3f %9.3f %10lu %6lu  ",
+                r->calls, r->total_ms, r->calls ? r->total_ms / r->calls : 0.0,
+                r->max_ms, r->rows, r->slow);
+        /* One line per statement: collapse the SQL's own line breaks */
+        for (c = r->sql; *c; c++) {
+            if (*c == ' ' || *c == '\n' || *c == '\r' || *c == '\t') {
+                gap = 1;
+                continue;
+            }
+            if (gap) fputc(' ', fp);
+            gap = 0;
+            fputc(*c, fp);
+        }
+        fputc('\n', fp);
+    }
+
+    if (fp != stderr) fclose(fp);
+    free(rows);
+    return 0;
+}
+
+/* =========================================================================
+   Change tracking
+   sqlite3_update_hook appends every row written to a main-schema table
+   to the open transaction's list; the commit hook stamps the list with
+   the next generation and moves it into a ring of recent changes, the
+   rollback hook drops it.  Each table also remembers the last generation
+   that touched it, so "did anything this panel shows change" is a few
+   integer compares.  Commits by other connections (the CLI, a second
+   DbContext) never reach the hooks; PRAGMA data_version notices them and
+   they count as a change to every table with unknown rows.
+   Errs towards reporting too much: a commit that fails after its hook,
+   ROLLBACK TO a savepoint, or a row written twice all still show up.
+   Rows removed by REPLACE conflicts or the truncate optimization (DELETE
+   without WHERE) are not reported by SQLite at all.
+   ========================================================================= */
+#define CHG_RING         4096   /* committed changes kept, power of two */
+#define CHG_MAX_TABLES   64
+#define CHG_TABLE_NAME   48
+
+typedef struct {
+    char          name[CHG_TABLE_NAME];
+    unsigned long gen;                  /* last commit that touched it    */
+    int           pending;              /* written by the open transaction */
+} ChgTable;
+
+typedef struct ChangeTracker {
+    /* Open transaction */
+    DbChange*      pending;
+    int            pending_count;
+    int            pending_cap;
+    int            pending_lost;        /* rows past CHG_RING not kept    */
+
+    /* Committed */
+    unsigned long  generation;
+    unsigned long  all_gen;             /* every table changed (external) */
+    unsigned long  lost_gen;            /* rows of gens <= this are gone  */
+    DbChange       ring[CHG_RING];
+    unsigned long  ring_next;           /* entries ever appended          */
+
+    ChgTable       tables[CHG_MAX_TABLES];
+    int            table_count;
+    int            last_table;          /* memo for runs on one table     */
+    sqlite3_int64  data_version;
+    DbChangeStats  stats;
+} ChangeTracker;
+
+/* Slot for a table name; names past CHG_MAX_TABLES share the last slot */
+static ChgTable* chg_table(ChangeTracker* ct, const char* name)
+{
+    int i;
+
+    if (ct->table_count > 0 &&
+        strcmp(ct->tables[ct->last_table].name, name) == 0)
+        return &ct->tables[ct->last_table];
+
+    for (i = 0; i < ct->table_count; i++)
+        if (strcmp(ct->tables[i].name, name) == 0) break;
+    if (i == ct->table_count) {
+        if (ct->table_count == CHG_MAX_TABLES) {
+            i = CHG_MAX_TABLES - 1;
+            strcpy(ct->tables[i].name, "(other)");
+        } else {
+            strncpy(ct->tables[i].name, name, CHG_TABLE_NAME - 1);
+            ct->tables[i].name[CHG_TABLE_NAME - 1] = '\0';
+            ct->table_count++;
+        }
+    }
+    ct->last_table = i;
+    return &ct->tables[i];
+}
+
+static void chg_update_hook(void* arg, int op, const char* db_name,
+                            const char* table, sqlite3_int64 rowid)
+{
+    ChangeTracker* ct = ((DbContext*)arg)->changes;
+    ChgTable*      t;
+    DbChange*      c;
+
+    if (ct == NULL || strcmp(db_name, "main") != 0) return;   /* temp scratch */
+    t = chg_table(ct, table);
+    t->pending = 1;
+
+    /* Consecutive writes to one row (insert then update, ...) are one entry */
+    if (ct->pending_count > 0) {
+        c = &ct->pending[ct->pending_count - 1];
+        if (c->rowid == rowid && c->table == t->name) {
+            if (op == SQLITE_DELETE)
+                c->op = DB_CHANGE_DELETE;
+            else if (c->op != DB_CHANGE_INSERT)
+                c->op = DB_CHANGE_UPDATE;
+            return;
+        }
+    }
+
+    if (ct->pending_count == ct->pending_cap) {
+        DbChange* grown;
+        int cap = ct->pending_cap ? ct->pending_cap * 2 : 64;
+        if (ct->pending_count >= CHG_RING ||
+            (grown = (DbChange*)realloc(ct->pending,
+                                        (size_t)cap * sizeof(DbChange))) == NULL) {
+            ct->pending_lost++;
+            return;
+        }
+        ct->pending     = grown;
+        ct->pending_cap = cap;
+    }
+    c = &ct->pending[ct->pending_count++];
+    c->generation = 0;
+    c->table      = t->name;
+    c->rowid      = rowid;
+    c->op         = (op == SQLITE_INSERT) ? DB_CHANGE_INSERT :
+                    (op == SQLITE_DELETE) ? DB_CHANGE_DELETE : DB_CHANGE_UPDATE;
+}
+
+static void chg_discard(ChangeTracker* ct)
+{
+    int i;
+    for (i = 0; i < ct->table_count; i++)
+        ct->tables[i].pending = 0;
+    ct->pending_count = 0;
+    ct->pending_lost  = 0;
+}
+
+static int chg_commit_hook(void* arg)
+{
+    ChangeTracker* ct = ((DbContext*)arg)->changes;
+    unsigned long  gen;
+    int i;
+
+    if (ct == NULL || (ct->pending_count == 0 && ct->pending_lost == 0)) return 0;
+
+    gen = ++ct->generation;
+    for (i = 0; i < ct->table_count; i++) {
+        if (ct->tables[i].pending) {
+            ct->tables[i].gen     = gen;
+            ct->tables[i].pending = 0;
+        }
+    }
+    for (i = 0; i < ct->pending_count; i++) {
+        DbChange* slot = &ct->ring[ct->ring_next & (CHG_RING - 1)];
+        if (ct->ring_next >= CHG_RING) ct->lost_gen = slot->generation;
+        *slot = ct->pending[i];
+        slot->generation = gen;
+        ct->ring_next++;
+    }
+    if (ct->pending_lost) ct->lost_gen = gen;
+
+    ct->stats.commits++;
+    ct->stats.rows += (unsigned long)(ct->pending_count + ct->pending_lost);
+    ct->pending_count = 0;
+    ct->pending_lost  = 0;
+    return 0;   /* non-zero would turn the COMMIT into a rollback */
+}
+
+static void chg_rollback_hook(void* arg)
+{
+    ChangeTracker* ct = ((DbContext*)arg)->changes;
+    if (ct == NULL) return;
+    chg_discard(ct);
+    ct->stats.rollbacks++;
+}
+
+/* Returns 1 and sets *out, or 0 if the pragma could not be read */
+static int chg_data_version(DbContext* ctx, sqlite3_int64* out)
+{
+    sqlite3_stmt* stmt = NULL;
+    int ok = 0;
+
+    if (stmt_get(ctx, STMT_DATA_VERSION, &stmt) != SQLITE_OK) return 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        *out = sqlite3_column_int64(stmt, 0);
+        ok   = 1;
+    }
+    stmt_done(stmt);
+    return ok;
+}
+
+/* Fold in commits made through other connections since the last look */
+static void chg_poll_external(DbContext* ctx)
+{
+    ChangeTracker* ct = ctx->changes;
+    sqlite3_int64  v;
+
+    if (ct == NULL || !chg_data_version(ctx, &v) || v == ct->data_version) return;
+    ct->data_version = v;
+    ct->all_gen = ct->lost_gen = ++ct->generation;
+    ct->stats.external++;
+}
+
+/* Hook the connection; generation 0 is the state as opened */
+static int changes_start(DbContext* ctx)
+{
+    ctx->changes = (ChangeTracker*)calloc(1, sizeof(ChangeTracker));
+    if (ctx->changes == NULL) return SQLITE_NOMEM;
+    chg_data_version(ctx, &ctx->changes->data_version);
+
+    sqlite3_update_hook  (ctx->db, chg_update_hook,   ctx);
+    sqlite3_commit_hook  (ctx->db, chg_commit_hook,   ctx);
+    sqlite3_rollback_hook(ctx->db, chg_rollback_hook, ctx);
+    return SQLITE_OK;
+}
+
+static void changes_stop(DbContext* ctx)
+{
+    if (ctx->changes == NULL) return;
+    sqlite3_update_hook  (ctx->db, NULL, NULL);
+    sqlite3_commit_hook  (ctx->db, NULL, NULL);
+    sqlite3_rollback_hook(ctx->db, NULL, NULL);
+    free(ctx->changes->pending);
+    free(ctx->changes);
+    ctx->changes = NULL;
+}
+
+unsigned long dbc_change_generation(DbContext* ctx)
+{
+    if (ctx->changes == NULL) return 0;
+    chg_poll_external(ctx);
+    return ctx->changes->generation;
+}
+
+int dbc_changed_since(DbContext* ctx, const char* const* tables, unsigned long gen)
+{
+    ChangeTracker* ct = ctx->changes;
+    int i, j;
+
+    if (ct == NULL) return 1;
+    chg_poll_external(ctx);
+    if (tables == NULL || ct->all_gen > gen) return ct->generation > gen;
+
+    for (i = 0; tables[i] != NULL; i++)
+        for (j = 0; j < ct->table_count; j++)
+            if (ct->tables[j].gen > gen && strcmp(ct->tables[j].name, tables[i]) == 0)
+                return 1;
+    return 0;
+}
+
+int dbc_changes_since(DbContext* ctx, unsigned long gen, DbChange* out, int max)
+{
+    ChangeTracker* ct = ctx->changes;
+    unsigned long  first, i;
+    int n = 0;
+
+    if (ct == NULL) return -1;
+    chg_poll_external(ctx);
+    if (gen < ct->lost_gen) return -1;
+
+    /* The ring is in generation order: walk back to the first one after gen */
+    first = ct->ring_next;
+    while (first > 0 && ct->ring_next - first < CHG_RING &&
+           ct->ring[(first - 1) & (CHG_RING - 1)].generation > gen)
+        first--;
+
+    for (i = first; i < ct->ring_next; i++, n++)
+        if (out != NULL && n < max)
+            out[n] = ct->ring[i & (CHG_RING - 1)];
+    return n;
+}
+
+void dbc_get_change_stats(DbContext* ctx, DbChangeStats* out)
+{
+    if (ctx->changes == NULL) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    *out = ctx->changes->stats;
+    out->generation = ctx->changes->generation;
+    out->tables     = ctx->changes->table_count;
+}
+
+/* =========================================================================
+   Query-plan check
+   Runs EXPLAIN QUERY PLAN over the statement cache and the panel refresh
+   queries.  A full-list query may SCAN its outermost table; any other
+   SCAN (a join, a correlated subquery, a keyed lookup) means an index is
+   missing or unusable.
+   ========================================================================= */
+typedef struct {
+    const char* label;
+    const char* sql;
+    int         full_list;   /* 1 = outermost loop may SCAN */
+} PlanQuery;
+
+static const PlanQuery g_panel_queries[] = {
+    { "Panel_Formulations_Refresh",           SQL_FORMULATIONS_REFRESH, 1 },
+    { "FilterItemCombo",                      SQL_FORM_ITEM_BASES,      1 },
+    { "Panel_Bases_Refresh",                  SQL_BASES_REFRESH,        1 },
+    { "Panel_Batch_Refresh (keys, flavor)",   SQL_BATCH_KEYS_FLAVOR,    0 },
+    { "Panel_Batch_Refresh (keys, all)",      SQL_BATCH_KEYS_ALL,       1 },
+    { "Panel_Batch_Refresh (page, flavor)",   SQL_BATCH_PAGE_FLAVOR,    0 },
+    { "Panel_Batch_Refresh (page, all)",      SQL_BATCH_PAGE_ALL,       0 },
+    { "Panel_Tasting_Refresh (keys, flavor)", SQL_TASTING_KEYS_FLAVOR,  0 },
+    { "Panel_Tasting_Refresh (keys, all)",    SQL_TASTING_KEYS_ALL,     1 },
+    { "Panel_Tasting_Refresh (page, flavor)", SQL_TASTING_PAGE_FLAVOR,  0 },
+    { "Panel_Tasting_Refresh (page, all)",    SQL_TASTING_PAGE_ALL,     0 },
+    { "Panel_Inventory_Refresh (keys)",       SQL_INVENTORY_KEYS,       1 },
+    { "Panel_Inventory_Refresh (page)",       SQL_INVENTORY_PAGE,       0 },
+    { "Panel_Regulatory_Refresh",             SQL_REGULATORY_REFRESH,   1 },
+    { "Panel_Compounds_Refresh",              SQL_COMPOUNDS_REFRESH,    1 },
+    { "Panel_Compounds_Refresh (search)",     SQL_COMPOUNDS_SEARCH,     0 },
+};
+
+/* Cached statements that walk their whole outer table on purpose. */
+static int stmt_is_full_list(int id)
+{
+    switch (id) {
+    case STMT_VALIDATE_LIMITS:     /* one row per compound in validate_input */
+    case STMT_LOAD_ALL_COMPOUNDS:  /* compound cache fill */
+    case STMT_COUNT_BY_APP_MASK:   /* walks the app_mask index once */
+    case STMT_SENSORY_SESSIONS_ALL: /* whole-history sensory report */
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* 1 if the SCAN target (the text after "SCAN ") names a CTE of sql;
+   newer SQLite reports CTE walks by name rather than as SUBQUERY */
+static int scan_is_cte(const char* sql, const char* target)
+{
+    char   pat[72];
+    size_t n = strcspn(target, " ");
+
+    if (n == 0 || n > 60 || strstr(sql, "WITH ") == NULL) return 0;
+    snprintf(pat, sizeof(pat), "%.*s AS (", (int)n, target);
+    if (strstr(sql, pat) != NULL) return 1;
+    snprintf(pat, sizeof(pat), "%.*s(", (int)n, target);
+    return strstr(sql, pat) != NULL;
+}
+
+/* Returns 1 if sql has an unexpected SCAN, 0 if not, negative on error. */
+static int plan_has_scan(DbContext* ctx, const char* label, const char* sql, int full_list)
+{
+    sqlite3_stmt* stmt = NULL;
+    char*         eqp;
+    int           rc;
+    int           outer_seen = 0;
+    int           bad        = 0;
+
+    eqp = sqlite3_mprintf("EXPLAIN QUERY PLAN %s", sql);
+    if (eqp == NULL) return -1;
+    rc = sqlite3_prepare_v2(ctx->db, eqp, -1, &stmt, NULL);
+    sqlite3_free(eqp);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Query plan error (%s): %s\n", label, sqlite3_errmsg(ctx->db));
+        return -1;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int         parent = sqlite3_column_int(stmt, 1);
+        const char* detail = (const char*)sqlite3_column_text(stmt, 3);
+        const char* vt;
+
+        if (detail == NULL || strncmp(detail, "SCAN ", 5) != 0) continue;
+        /* A virtual table reports SCAN even when its own index serves
+           the constraints (FTS5 "INDEX 0:M1", json_each "INDEX 1:");
+           only "INDEX 0:" with no constraint string is a full walk */
+        vt = strstr(detail, " VIRTUAL TABLE INDEX ");
+        if (vt != NULL && strcmp(vt, " VIRTUAL TABLE INDEX 0:") != 0)
+            continue;
+        /* Walking a subquery/CTE result or a temp scratch table is fine */
+        if (strncmp(detail, "SCAN CONSTANT ROW", 17) == 0 ||
+            strncmp(detail, "SCAN (", 6) == 0 ||
+            strncmp(detail, "SCAN SUBQUERY", 13) == 0 ||
+            strncmp(detail, "SCAN temp.", 10) == 0 ||
+            scan_is_cte(sql, detail + 5))
+            continue;
+        if (full_list && parent == 0 && !outer_seen) {
+            outer_seen = 1;
+            continue;
+        }
+        fprintf(stderr, "[QUERY PLAN] %.72s\n  plan: %s\n", label, detail);
+        bad = 1;
+    }
+
+    sqlite3_finalize(stmt);
+    return bad;
+}
+
+int dbc_check_query_plans(DbContext* ctx)
+{
+    int i, r;
+    int count = 0;
+
+    if (ctx->db == NULL) return -1;
+
+    for (i = 0; i < STMT_COUNT; i++) {
+        r = plan_has_scan(ctx, g_stmt_sql[i], g_stmt_sql[i], stmt_is_full_list(i));
+        if (r < 0) return r;
+        count += r;
+    }
+    for (i = 0; i < (int)(sizeof(g_panel_queries) / sizeof(g_panel_queries[0])); i++) {
+        r = plan_has_scan(ctx, g_panel_queries[i].label, g_panel_queries[i].sql,
+                          g_panel_queries[i].full_list);
+        if (r < 0) return r;
+        count += r;
+    }
+    return count;
+}
+
+/* =========================================================================
+   Compound cache
+   Read-through copy of compound_library, indexed by interned name and by
+   id, plus each compound's active limit.  Filled in one pass on first
+   use (and after a seed sync).  db_set_compound_cost patches the cached entry in place;
+   db_add_compound marks it stale; db_add_regulatory_limit drops its
+   resolved limit.  Names not in the cache fall through to SQL.
+   Commits by other connections (a second DbContext, sodaf, another
+   station) are seen through PRAGMA data_version: each call that reads
+   the cache compares it once with the value the cache was filled at
+   (cc_find, or cc_poll_external ahead of a cc_resolve loop) and drops
+   the cache when it moved.
+   ========================================================================= */
+typedef struct CachedCompound {
+    CompoundInfo info;
+    int          sym;             /* intern() id of info.compound_name       */
+    int          stale;           /* 1 = re-read the row on next use         */
+    int          limit_src;       /* 0 override, 1 library, -1 not resolved  */
+    float        active_max_ppm;
+} CachedCompound;
+
+/* Fill c from a row laid out like STMT_GET_COMPOUND (columns 0-19). */
+static void compound_from_row(sqlite3_stmt* stmt, CompoundInfo* c)
+{
+    const char* s;
+
+    c->id = sqlite3_column_int(stmt, 0);
+
+    s = (const char*)sqlite3_column_text(stmt, 1);
+    strncpy(c->compound_name, s ? s : "", 127);
+    c->compound_name[127] = '\0';
+
+    s = (const char*)sqlite3_column_text(stmt, 2);
+    strncpy(c->cas_number, s ? s : "", 15);
+    c->cas_number[15] = '\0';
+
+    c->fema_number      = sqlite3_column_int   (stmt,  3);
+    c->max_use_ppm      = (float)sqlite3_column_double(stmt,  4);
+    c->rec_min_ppm      = (float)sqlite3_column_double(stmt,  5);
+    c->rec_max_ppm      = (float)sqlite3_column_double(stmt,  6);
+    c->molecular_weight = (float)sqlite3_column_double(stmt,  7);
+    c->water_solubility = (float)sqlite3_column_double(stmt,  8);
+    c->ph_stable_min    = (float)sqlite3_column_double(stmt,  9);
+    c->ph_stable_max    = (float)sqlite3_column_double(stmt, 10);
+
+    s = (const char*)sqlite3_column_text(stmt, 11);
+    strncpy(c->odor_profile, s ? s : "", 255);
+    c->odor_profile[255] = '\0';
+
+    s = (const char*)sqlite3_column_text(stmt, 12);
+    strncpy(c->storage_temp, s ? s : "", 15);
+    c->storage_temp[15] = '\0';
+
+    c->requires_solubilizer = sqlite3_column_int   (stmt, 13);
+    c->requires_inert_atm   = sqlite3_column_int   (stmt, 14);
+    c->cost_per_gram        = (float)sqlite3_column_double(stmt, 15);
+
+    s = (const char*)sqlite3_column_text(stmt, 16);
+    strncpy(c->flavor_descriptors, s ? s : "", 255);
+    c->flavor_descriptors[255] = '\0';
+
+    c->odor_threshold_ppm = (float)sqlite3_column_double(stmt, 17);
+
+    s = (const char*)sqlite3_column_text(stmt, 18);
+    strncpy(c->applications, s ? s : "", 127);
+    c->applications[127] = '\0';
+
+    c->app_mask = (unsigned int)sqlite3_column_int(stmt, 19);
+}
+
+/* Grow an index array so that idx is addressable. */
+static int cc_grow_index(int** arr, int* cap, int idx)
+{
+    int  new_cap;
+    int* p;
+
+    if (idx < *cap) return 0;
+    new_cap = *cap ? *cap : 256;
+    while (new_cap <= idx) new_cap *= 2;
+    p = (int*)realloc(*arr, (size_t)new_cap * sizeof(int));
+    if (p == NULL) return -1;
+    memset(p + *cap, 0, (size_t)(new_cap - *cap) * sizeof(int));
+    *arr = p;
+    *cap = new_cap;
+    return 0;
+}
+
+static void compound_cache_free(DbContext* ctx)
+{
+    free(ctx->cc);
+    free(ctx->cc_by_sym);
+    free(ctx->cc_by_id);
+    ctx->cc         = NULL;
+    ctx->cc_by_sym  = NULL;
+    ctx->cc_by_id   = NULL;
+    ctx->cc_count   = 0;
+    ctx->cc_cap     = 0;
+    ctx->cc_sym_cap = 0;
+    ctx->cc_id_cap  = 0;
+    ctx->cc_loaded  = 0;
+}
+
+/* Insert or overwrite the entry for c.  Returns the slot, or NULL on OOM. */
+static CachedCompound* cc_put(DbContext* ctx, const CompoundInfo* c, int limit_src, float active_max)
+{
+    CachedCompound* e;
+    int sym = intern(c->compound_name);
+    int slot;
+
+    if (sym == 0) return NULL;
+    if (cc_grow_index(&ctx->cc_by_sym, &ctx->cc_sym_cap, sym) != 0) return NULL;
+    if (cc_grow_index(&ctx->cc_by_id,  &ctx->cc_id_cap,  c->id) != 0) return NULL;
+
+    slot = ctx->cc_by_sym[sym] - 1;
+    if (slot < 0) {
+        if (ctx->cc_count == ctx->cc_cap) {
+            int new_cap = ctx->cc_cap ? ctx->cc_cap * 2 : 256;
+            CachedCompound* p = (CachedCompound*)realloc(ctx->cc,
+                                    (size_t)new_cap * sizeof(CachedCompound));
+            if (p == NULL) return NULL;
+            ctx->cc     = p;
+            ctx->cc_cap = new_cap;
+        }
+        slot = ctx->cc_count++;
+        ctx->cc_by_sym[sym] = slot + 1;
+    } else if (ctx->cc[slot].info.id != c->id && ctx->cc[slot].info.id < ctx->cc_id_cap) {
+        ctx->cc_by_id[ctx->cc[slot].info.id] = 0;   /* INSERT OR REPLACE moved the id */
+    }
+
+    e = &ctx->cc[slot];
+    e->info           = *c;
+    e->sym            = sym;
+    e->stale          = 0;
+    e->limit_src      = limit_src;
+    e->active_max_ppm = active_max;
+    ctx->cc_by_id[c->id] = slot + 1;
+    return e;
+}
+
+/* Load every compound_library row.  Returns 0 on success. */
+static int compound_cache_load(DbContext* ctx)
+{
+    sqlite3_stmt* stmt = NULL;
+    int rc;
+
+    compound_cache_free(ctx);
+
+    /* Read before the rows: a commit in between is caught next lookup */
+    if (!chg_data_version(ctx, &ctx->cc_data_version))
+        ctx->cc_data_version = -1;
+
+    rc = stmt_get(ctx, STMT_LOAD_ALL_COMPOUNDS, &stmt);
+    if (rc != SQLITE_OK) return rc;
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        CompoundInfo c;
+        int   has_override = (sqlite3_column_type(stmt, 20) != SQLITE_NULL);
+        float active;
+
+        compound_from_row(stmt, &c);
+        active = has_override ? (float)sqlite3_column_double(stmt, 20)
+                              : c.max_use_ppm;
+        if (cc_put(ctx, &c, has_override ? 0 : 1, active) == NULL) {
+            rc = SQLITE_NOMEM;
+            break;
+        }
+    }
+    stmt_done(stmt);
+
+    if (rc != SQLITE_DONE) {
+        compound_cache_free(ctx);
+        return rc;
+    }
+    ctx->cc_loaded = 1;
+    return 0;
+}
+
+/* Re-read one compound by name.  Returns the entry, or NULL if the
+   compound is not in compound_library (any stale entry is dropped). */
+static CachedCompound* cc_fetch(DbContext* ctx, const char* name)
+{
+    sqlite3_stmt* stmt = NULL;
+    CachedCompound* e = NULL;
+    CompoundInfo c;
+    int rc;
+
+    rc = stmt_get(ctx, STMT_GET_COMPOUND, &stmt);
+    if (rc != SQLITE_OK) return NULL;
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        compound_from_row(stmt, &c);
+        e = cc_put(ctx, &c, -1, 0.0f);
+    }
+    stmt_done(stmt);
+
+    if (e == NULL) {
+        int sym = intern_lookup(name);
+        if (sym > 0 && sym < ctx->cc_sym_cap && ctx->cc_by_sym[sym] > 0) {
+            CachedCompound* old = &ctx->cc[ctx->cc_by_sym[sym] - 1];
+            if (old->info.id < ctx->cc_id_cap) ctx->cc_by_id[old->info.id] = 0;
+            old->stale = 1;
+            ctx->cc_by_sym[sym] = 0;   /* slot is orphaned until the next load */
+        }
+    }
+    return e;
+}
+
+/* Drop the cache if another connection has committed since it was
+   filled; an unreadable data_version counts as a commit. */
+static void cc_poll_external(DbContext* ctx)
+{
+    sqlite3_int64 v;
+
+    if (!ctx->cc_loaded) return;
+    if (!chg_data_version(ctx, &v) || v != ctx->cc_data_version)
+        compound_cache_free(ctx);
+}
+
+/* Cache lookup by name, reading through to SQL on a miss. */
+static CachedCompound* cc_lookup(DbContext* ctx, const char* name)
+{
+    CachedCompound* e;
+    int sym;
+
+    if (!ctx->cc_loaded)
+        compound_cache_load(ctx);   /* on failure, fall through to cc_fetch */
+
+    sym = intern_lookup(name);
+    if (sym > 0 && sym < ctx->cc_sym_cap && ctx->cc_by_sym[sym] > 0) {
+        e = &ctx->cc[ctx->cc_by_sym[sym] - 1];
+        if (!e->stale) {
+            ctx->cc_stats.hits++;
+            return e;
+        }
+    }
+
+    ctx->cc_stats.misses++;
+    return cc_fetch(ctx, name);
+}
+
+/* Cache lookup by compound_library.id. */
+static CachedCompound* cc_lookup_id(DbContext* ctx, int id)
+{
+    CachedCompound* e;
+
+    if (!ctx->cc_loaded)
+        compound_cache_load(ctx);
+
+    if (id <= 0 || id >= ctx->cc_id_cap || ctx->cc_by_id[id] == 0) {
+        ctx->cc_stats.misses++;
+        return NULL;   /* no SQL fallback by id: the cache is the index */
+    }
+    e = &ctx->cc[ctx->cc_by_id[id] - 1];
+    if (e->stale) {
+        ctx->cc_stats.misses++;
+        e = cc_fetch(ctx, e->info.compound_name);
+        if (e == NULL || e->info.id != id) return NULL;
+    } else {
+        ctx->cc_stats.hits++;
+    }
+    return e;
+}
+
+/* One lookup for a call: poll, then look up. */
+static CachedCompound* cc_find(DbContext* ctx, const char* name)
+{
+    cc_poll_external(ctx);
+    return cc_lookup(ctx, name);
+}
+
+static CachedCompound* cc_find_id(DbContext* ctx, int id)
+{
+    cc_poll_external(ctx);
+    return cc_lookup_id(ctx, id);
+}
+
+/* Resolve a compound line: by library id when it has one, otherwise by
+   its interned name (lines typed in before the library knew them).
+   No poll: a caller resolving many lines calls cc_poll_external once. */
+static CachedCompound* cc_resolve(DbContext* ctx, int compound_library_id, int name_id)
+{
+    if (compound_library_id > 0) return cc_lookup_id(ctx, compound_library_id);
+    if (name_id <= 0) return NULL;
+    return cc_lookup(ctx, intern_str(name_id));
+}
+
+/* Resolve (and remember) the active limit of a cached compound. */
+static int cc_active_limit(DbContext* ctx, CachedCompound* e, float* out_max_ppm)
+{
+    sqlite3_stmt* stmt = NULL;
+    int rc;
+
+    if (e->limit_src < 0) {
+        e->limit_src      = 1;
+        e->active_max_ppm = e->info.max_use_ppm;
+        rc = stmt_get(ctx, STMT_REG_LIMIT_OVERRIDE, &stmt);
+        if (rc != SQLITE_OK) { e->limit_src = -1; return -1; }
+        sqlite3_bind_int(stmt, 1, e->info.id);
+        rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW) {
+            e->limit_src      = 0;
+            e->active_max_ppm = (float)sqlite3_column_double(stmt, 0);
+        }
+        stmt_done(stmt);
+        /* Only a row or no row is an answer; e.g. SQLITE_BUSY must not
+           cache the library limit over an override */
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+            e->limit_src = -1;
+            return -1;
+        }
+    }
+    *out_max_ppm = e->active_max_ppm;
+    return e->limit_src;
+}
+
+/* Cached entry for name, if any: no stats, no read-through. */
+static CachedCompound* cc_peek(DbContext* ctx, const char* name)
+{
+    int sym = intern_lookup(name);
+    if (sym > 0 && sym < ctx->cc_sym_cap && ctx->cc_by_sym[sym] > 0)
+        return &ctx->cc[ctx->cc_by_sym[sym] - 1];
+    return NULL;
+}
+
+static void cc_mark_stale(DbContext* ctx, const char* name)
+{
+    CachedCompound* e = cc_peek(ctx, name);
+    if (e != NULL) e->stale = 1;
+}
+
+void dbc_get_compound_cache_stats(DbContext* ctx, DbCompoundCacheStats* out)
+{
+    *out = ctx->cc_stats;
+    out->entries = ctx->cc_loaded ? ctx->cc_count : 0;
+}
+
+int dbc_get_compound_by_id(DbContext* ctx, int id, CompoundInfo* c)
+{
+    CachedCompound* e;
+
+    if (!ctx->cc_loaded && compound_cache_load(ctx) != 0)
+        return -1;
+    e = cc_find_id(ctx, id);
+    if (e == NULL) return 1;
+    *c = e->info;
+    return 0;
+}
+
+/* =========================================================================
+   Private helper: execute a parameter-free SQL statement (DDL / PRAGMA /
+   transaction control).  Uses sqlite3_exec with NULL callback.
+   ========================================================================= */
+static int db_exec_simple(DbContext* ctx, const char* sql)
+{
+    char* errmsg = NULL;
+    int rc = sqlite3_exec(ctx->db, sql, NULL, NULL, &errmsg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL error (%d): %s\n  SQL: %s\n", rc, errmsg, sql);
+        sqlite3_free(errmsg);
+    }
+    return rc;
+}
+
+/* =========================================================================
+   Schema migrations
+   PRAGMA user_version holds the number of the last step applied.  db_open
+   runs only the steps above it, each in its own transaction together with
+   the user_version bump and its schema_migrations row, so a failing step
+   leaves the database at the previous version instead of half-migrated.
+   Steps must also accept databases created before versioning existed
+   (user_version 0 with some or all of the tables already present).
+   Append new steps at the end; never change one that has shipped.
+   ========================================================================= */
+/* 1 if table has a column named column, 0 if not, negative on DB error. */
+static int column_exists(DbContext* ctx, const char* table, const char* column)
+{
+    sqlite3_stmt* stmt = NULL;
+    int rc;
+
+    rc = sqlite3_prepare_v2(ctx->db,
+        "SELECT 1 FROM pragma_table_info(?1) WHERE name = ?2;",
+        -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return -rc;
+    sqlite3_bind_text(stmt, 1, table,  -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, column, -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc == SQLITE_ROW)  return 1;
+    if (rc == SQLITE_DONE) return 0;
+    return -rc;
+}
+
+static int add_column_if_missing(DbContext* ctx, const char* table, const char* column,
+                                                 const char* decl)
+{
+    char sql[256];
+    int  exists = column_exists(ctx, table, column);
+
+    if (exists < 0) return -exists;
+    if (exists)     return SQLITE_OK;
+    snprintf(sql, sizeof(sql), "ALTER TABLE %s ADD COLUMN %s %s;",
+             table, column, decl);
+    return db_exec_simple(ctx, sql);
+}
+
+/* v1 — every table as it stood before versioning, including the columns
+   earlier releases added with unconditional ALTERs at startup. */
+static int migrate_base_schema(DbContext* ctx)
+{
+    int rc;
+
+    /* formulations — one row per saved version */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS formulations ("
+        "    id          INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "    flavor_code TEXT    NOT NULL,"
+        "    flavor_name TEXT    NOT NULL,"
+        "    ver_major   INTEGER NOT NULL,"
+        "    ver_minor   INTEGER NOT NULL,"
+        "    ver_patch   INTEGER NOT NULL,"
+        "    target_ph   REAL    NOT NULL,"
+        "    target_brix REAL    NOT NULL,"
+        "    saved_at    TEXT    NOT NULL DEFAULT (DATETIME('now', 'localtime')),"
+        "    UNIQUE (flavor_code, ver_major, ver_minor, ver_patch)"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* formulation_compounds — compounds per formulation version */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS formulation_compounds ("
+        "    id                  INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "    formulation_id      INTEGER NOT NULL REFERENCES formulations(id),"
+        "    compound_name       TEXT    NOT NULL,"
+        "    concentration_ppm   REAL    NOT NULL,"
+        "    compound_library_id INTEGER"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* compound_library — Phase 2 stub; full schema defined now to avoid
+       future migration.  All columns defined; only id/compound_name required. */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS compound_library ("
+        "    id                   INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "    compound_name        TEXT    NOT NULL UNIQUE,"
+        "    cas_number           TEXT,"
+        "    fema_number          INTEGER,"
+        "    max_use_ppm          REAL,"
+        "    rec_min_ppm          REAL,"
+        "    rec_max_ppm          REAL,"
+        "    molecular_weight     REAL,"
+        "    water_solubility     REAL,"
+        "    ph_stable_min        REAL,"
+        "    ph_stable_max        REAL,"
+        "    odor_profile         TEXT,"
+        "    storage_temp         TEXT,"
+        "    requires_solubilizer INTEGER NOT NULL DEFAULT 0,"
+        "    requires_inert_atm   INTEGER NOT NULL DEFAULT 0,"
+        "    applications         TEXT"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* cost_per_gram column — added in Phase 4. */
+    rc = add_column_if_missing(ctx, "compound_library", "cost_per_gram", "REAL NOT NULL DEFAULT 0");
+    if (rc != SQLITE_OK) return rc;
+
+    /* flavor_descriptors and odor_threshold_ppm — added in Phase 5. */
+    rc = add_column_if_missing(ctx, "compound_library", "flavor_descriptors", "TEXT");
+    if (rc != SQLITE_OK) return rc;
+    rc = add_column_if_missing(ctx, "compound_library", "odor_threshold_ppm", "REAL");
+    if (rc != SQLITE_OK) return rc;
+
+    /* applications — added for app-category filtering. */
+    rc = add_column_if_missing(ctx, "compound_library", "applications", "TEXT");
+    if (rc != SQLITE_OK) return rc;
+
+    /* tasting_sessions — one row per sensory evaluation */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS tasting_sessions ("
+        "    id              INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "    formulation_id  INTEGER NOT NULL REFERENCES formulations(id),"
+        "    tasted_at       TEXT    NOT NULL DEFAULT (DATETIME('now', 'localtime')),"
+        "    taster          TEXT    NOT NULL DEFAULT 'unknown',"
+        "    overall_score   REAL    NOT NULL,"
+        "    aroma_score     REAL,"
+        "    flavor_score    REAL,"
+        "    mouthfeel_score REAL,"
+        "    finish_score    REAL,"
+        "    sweetness_score REAL,"
+        "    notes           TEXT"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* batch_runs — one row per production batch */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS batch_runs ("
+        "    id             INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "    formulation_id INTEGER NOT NULL REFERENCES formulations(id),"
+        "    batch_number   TEXT    NOT NULL UNIQUE,"
+        "    volume_liters  REAL    NOT NULL,"
+        "    cost_total     REAL,"
+        "    batched_at     TEXT    NOT NULL DEFAULT (DATETIME('now', 'localtime')),"
+        "    notes          TEXT"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* batch_ingredients — compound weights per batch */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS batch_ingredients ("
+        "    id           INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "    batch_run_id INTEGER NOT NULL REFERENCES batch_runs(id),"
+        "    compound_name TEXT   NOT NULL,"
+        "    grams_needed  REAL   NOT NULL,"
+        "    cost_line     REAL"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* compound_inventory — stock levels per compound */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS compound_inventory ("
+        "    id                      INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "    compound_library_id     INTEGER NOT NULL UNIQUE REFERENCES compound_library(id),"
+        "    stock_grams             REAL    NOT NULL DEFAULT 0,"
+        "    reorder_threshold_grams REAL    NOT NULL DEFAULT 10,"
+        "    last_updated            TEXT    NOT NULL DEFAULT (DATETIME('now', 'localtime'))"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* regulatory_limits — override max_use_ppm without rebuild */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS regulatory_limits ("
+        "    id             INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "    compound_name  TEXT NOT NULL,"
+        "    source         TEXT NOT NULL,"
+        "    max_use_ppm    REAL NOT NULL,"
+        "    effective_date TEXT NOT NULL,"
+        "    notes          TEXT,"
+        "    added_at       TEXT NOT NULL"
+        "             DEFAULT (DATETIME('now','localtime'))"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* app_settings — persistent key-value store for user preferences */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS app_settings ("
+        "  key   TEXT PRIMARY KEY,"
+        "  value TEXT NOT NULL DEFAULT ''"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS suppliers ("
+        "  id            INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  supplier_name TEXT NOT NULL UNIQUE,"
+        "  website       TEXT,"
+        "  email         TEXT,"
+        "  phone         TEXT,"
+        "  notes         TEXT"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS compound_suppliers ("
+        "  id                  INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  supplier_id         INTEGER NOT NULL REFERENCES suppliers(id),"
+        "  compound_library_id INTEGER NOT NULL REFERENCES compound_library(id),"
+        "  catalog_number      TEXT,"
+        "  price_per_gram      REAL,"
+        "  min_order_grams     REAL,"
+        "  lead_time_days      INTEGER,"
+        "  UNIQUE(supplier_id, compound_library_id)"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* ingredients — general non-compound inputs */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS ingredients ("
+        "  id              INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  ingredient_name TEXT    NOT NULL UNIQUE,"
+        "  category        TEXT    NOT NULL DEFAULT 'other',"
+        "  unit            TEXT    NOT NULL DEFAULT 'g',"
+        "  cost_per_unit   REAL    NOT NULL DEFAULT 0,"
+        "  supplier_id     INTEGER REFERENCES suppliers(id),"
+        "  brand           TEXT,"
+        "  notes           TEXT"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* soda_bases — versioned sub-formulations */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS soda_bases ("
+        "  id           INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  base_code    TEXT    NOT NULL,"
+        "  base_name    TEXT    NOT NULL,"
+        "  ver_major    INTEGER NOT NULL DEFAULT 1,"
+        "  ver_minor    INTEGER NOT NULL DEFAULT 0,"
+        "  ver_patch    INTEGER NOT NULL DEFAULT 0,"
+        "  yield_liters REAL    NOT NULL DEFAULT 1.0,"
+        "  notes        TEXT,"
+        "  saved_at     TEXT    NOT NULL DEFAULT (DATETIME('now','localtime')),"
+        "  UNIQUE (base_code, ver_major, ver_minor, ver_patch)"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* soda_base_compounds — aroma compounds inside a base */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS soda_base_compounds ("
+        "  id                  INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  soda_base_id        INTEGER NOT NULL REFERENCES soda_bases(id),"
+        "  compound_name       TEXT    NOT NULL,"
+        "  concentration_ppm   REAL    NOT NULL,"
+        "  compound_library_id INTEGER REFERENCES compound_library(id)"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* soda_base_ingredients — general ingredients inside a base */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS soda_base_ingredients ("
+        "  id            INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  soda_base_id  INTEGER NOT NULL REFERENCES soda_bases(id),"
+        "  ingredient_id INTEGER NOT NULL REFERENCES ingredients(id),"
+        "  amount        REAL    NOT NULL,"
+        "  unit          TEXT    NOT NULL DEFAULT 'g'"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* formulation_bases — soda bases used in a formulation */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS formulation_bases ("
+        "  id             INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  formulation_id INTEGER NOT NULL REFERENCES formulations(id),"
+        "  soda_base_id   INTEGER NOT NULL REFERENCES soda_bases(id),"
+        "  amount         REAL    NOT NULL,"
+        "  unit           TEXT    NOT NULL DEFAULT '%'"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* formulation_ingredients — general ingredients used in a formulation */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS formulation_ingredients ("
+        "  id             INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  formulation_id INTEGER NOT NULL REFERENCES formulations(id),"
+        "  ingredient_id  INTEGER NOT NULL REFERENCES ingredients(id),"
+        "  amount         REAL    NOT NULL,"
+        "  unit           TEXT    NOT NULL DEFAULT 'g'"
+        ");"
+    );
+    if (rc != SQLITE_OK) return rc;
 
-sqlite3* db_get_handle(void) { return g_db; }
+    /* production_instructions — added for per-formulation process notes. */
+    rc = add_column_if_missing(ctx, "formulations", "production_instructions", "TEXT DEFAULT ''");
+    if (rc != SQLITE_OK) return rc;
 
-/* =========================================================================
-   Private helper: execute a parameter-free SQL statement (DDL / PRAGMA /
-   transaction control).  Uses sqlite3_exec with NULL callback.
-   ========================================================================= */
-static int db_exec_simple(const char* sql)
+    return SQLITE_OK;
+}
+
+/* v2 — secondary indexes on foreign keys and per-row lookups.
+   (flavor_code, ver_*) and (base_code, ver_*) are already covered by
+   the UNIQUE constraints on formulations and soda_bases. */
+static int migrate_indexes(DbContext* ctx)
 {
-    char* errmsg = NULL;
-    int rc = sqlite3_exec(g_db, sql, NULL, NULL, &errmsg);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "SQL error (%d): %s\n  SQL: %s\n", rc, errmsg, sql);
-        sqlite3_free(errmsg);
+    static const char* const index_sql[] = {
+        "CREATE INDEX IF NOT EXISTS idx_formulation_compounds_formulation "
+        "ON formulation_compounds(formulation_id);",
+        "CREATE INDEX IF NOT EXISTS idx_tasting_sessions_formulation "
+        "ON tasting_sessions(formulation_id);",
+        "CREATE INDEX IF NOT EXISTS idx_tasting_sessions_tasted_at "
+        "ON tasting_sessions(tasted_at);",
+        "CREATE INDEX IF NOT EXISTS idx_batch_runs_formulation "
+        "ON batch_runs(formulation_id);",
+        "CREATE INDEX IF NOT EXISTS idx_batch_runs_batched_at "
+        "ON batch_runs(batched_at);",
+        "CREATE INDEX IF NOT EXISTS idx_batch_ingredients_batch_run "
+        "ON batch_ingredients(batch_run_id);",
+        "CREATE INDEX IF NOT EXISTS idx_regulatory_limits_compound "
+        "ON regulatory_limits(compound_name, effective_date);",
+        "CREATE INDEX IF NOT EXISTS idx_compound_suppliers_compound "
+        "ON compound_suppliers(compound_library_id);",
+        "CREATE INDEX IF NOT EXISTS idx_soda_base_compounds_base "
+        "ON soda_base_compounds(soda_base_id);",
+        "CREATE INDEX IF NOT EXISTS idx_soda_base_compounds_compound "
+        "ON soda_base_compounds(compound_library_id);",
+        "CREATE INDEX IF NOT EXISTS idx_soda_base_ingredients_base "
+        "ON soda_base_ingredients(soda_base_id);",
+        "CREATE INDEX IF NOT EXISTS idx_soda_base_ingredients_ingredient "
+        "ON soda_base_ingredients(ingredient_id);",
+        "CREATE INDEX IF NOT EXISTS idx_formulation_bases_formulation "
+        "ON formulation_bases(formulation_id);",
+        "CREATE INDEX IF NOT EXISTS idx_formulation_bases_base "
+        "ON formulation_bases(soda_base_id);",
+        "CREATE INDEX IF NOT EXISTS idx_formulation_ingredients_formulation "
+        "ON formulation_ingredients(formulation_id);",
+        "CREATE INDEX IF NOT EXISTS idx_formulation_ingredients_ingredient "
+        "ON formulation_ingredients(ingredient_id);",
+        "CREATE INDEX IF NOT EXISTS idx_ingredients_supplier "
+        "ON ingredients(supplier_id);",
+    };
+    int rc;
+    int i;
+
+    for (i = 0; i < (int)(sizeof(index_sql) / sizeof(index_sql[0])); i++) {
+        rc = db_exec_simple(ctx, index_sql[i]);
+        if (rc != SQLITE_OK) return rc;
     }
-    return rc;
+
+    return SQLITE_OK;
 }
 
-/* =========================================================================
-   db_open
-   ========================================================================= */
-int db_open(const char* db_path)
+/* v3 — materialized latest version per flavor / base. */
+static int migrate_latest_versions(DbContext* ctx)
 {
     int rc;
 
-    rc = sqlite3_open(db_path, &g_db);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Cannot open database '%s': %s\n",
-                db_path, sqlite3_errmsg(g_db));
-        sqlite3_close(g_db);
-        g_db = NULL;
-        return rc;
-    }
+    /* latest_formulations / latest_soda_bases — one row per code pointing
+       at its highest version.  Kept current by the triggers below so list
+       screens join once instead of running a per-row subquery.  Derived
+       data, so no REFERENCES clause: the triggers own every row. */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS latest_formulations ("
+        "    flavor_code    TEXT    PRIMARY KEY,"
+        "    formulation_id INTEGER NOT NULL"
+        ") WITHOUT ROWID;"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS latest_soda_bases ("
+        "    base_code    TEXT    PRIMARY KEY,"
+        "    soda_base_id INTEGER NOT NULL"
+        ") WITHOUT ROWID;"
+    );
+    if (rc != SQLITE_OK) return rc;
 
-    /* Performance and integrity settings */
-    db_exec_simple("PRAGMA journal_mode=WAL;");
-    db_exec_simple("PRAGMA foreign_keys=ON;");
+    /* A new version replaces the mapping unless a higher one is already
+       there (versions can be saved out of order). */
+    rc = db_exec_simple(ctx,
+        "CREATE TRIGGER IF NOT EXISTS trg_formulations_latest_ins "
+        "AFTER INSERT ON formulations BEGIN "
+        "    INSERT OR REPLACE INTO latest_formulations (flavor_code, formulation_id) "
+        "    SELECT NEW.flavor_code, NEW.id "
+        "    WHERE NOT EXISTS ("
+        "        SELECT 1 FROM latest_formulations lf "
+        "        JOIN formulations cur ON cur.id = lf.formulation_id "
+        "        WHERE lf.flavor_code = NEW.flavor_code "
+        "          AND (cur.ver_major, cur.ver_minor, cur.ver_patch) > "
+        "              (NEW.ver_major, NEW.ver_minor, NEW.ver_patch)"
+        "    );"
+        "END;"
+    );
+    if (rc != SQLITE_OK) return rc;
 
-    /* formulations — one row per saved version */
-    rc = db_exec_simple(
-        "CREATE TABLE IF NOT EXISTS formulations ("
-        "    id          INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "    flavor_code TEXT    NOT NULL,"
-        "    flavor_name TEXT    NOT NULL,"
-        "    ver_major   INTEGER NOT NULL,"
-        "    ver_minor   INTEGER NOT NULL,"
-        "    ver_patch   INTEGER NOT NULL,"
-        "    target_ph   REAL    NOT NULL,"
-        "    target_brix REAL    NOT NULL,"
-        "    saved_at    TEXT    NOT NULL DEFAULT (DATETIME('now', 'localtime')),"
-        "    UNIQUE (flavor_code, ver_major, ver_minor, ver_patch)"
+    /* Deleting the latest version falls back to the next highest one;
+       OR IGNORE leaves the mapping alone when an older version went. */
+    rc = db_exec_simple(ctx,
+        "CREATE TRIGGER IF NOT EXISTS trg_formulations_latest_del "
+        "AFTER DELETE ON formulations BEGIN "
+        "    DELETE FROM latest_formulations "
+        "    WHERE flavor_code = OLD.flavor_code AND formulation_id = OLD.id;"
+        "    INSERT OR IGNORE INTO latest_formulations (flavor_code, formulation_id) "
+        "    SELECT flavor_code, id FROM formulations "
+        "    WHERE flavor_code = OLD.flavor_code "
+        "    ORDER BY ver_major DESC, ver_minor DESC, ver_patch DESC LIMIT 1;"
+        "END;"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    rc = db_exec_simple(ctx,
+        "CREATE TRIGGER IF NOT EXISTS trg_soda_bases_latest_ins "
+        "AFTER INSERT ON soda_bases BEGIN "
+        "    INSERT OR REPLACE INTO latest_soda_bases (base_code, soda_base_id) "
+        "    SELECT NEW.base_code, NEW.id "
+        "    WHERE NOT EXISTS ("
+        "        SELECT 1 FROM latest_soda_bases ls "
+        "        JOIN soda_bases cur ON cur.id = ls.soda_base_id "
+        "        WHERE ls.base_code = NEW.base_code "
+        "          AND (cur.ver_major, cur.ver_minor, cur.ver_patch) > "
+        "              (NEW.ver_major, NEW.ver_minor, NEW.ver_patch)"
+        "    );"
+        "END;"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    rc = db_exec_simple(ctx,
+        "CREATE TRIGGER IF NOT EXISTS trg_soda_bases_latest_del "
+        "AFTER DELETE ON soda_bases BEGIN "
+        "    DELETE FROM latest_soda_bases "
+        "    WHERE base_code = OLD.base_code AND soda_base_id = OLD.id;"
+        "    INSERT OR IGNORE INTO latest_soda_bases (base_code, soda_base_id) "
+        "    SELECT base_code, id FROM soda_bases "
+        "    WHERE base_code = OLD.base_code "
+        "    ORDER BY ver_major DESC, ver_minor DESC, ver_patch DESC LIMIT 1;"
+        "END;"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* Backfill databases created before the mapping tables existed.
+       Only runs while a mapping table is still empty. */
+    rc = db_exec_simple(ctx,
+        "INSERT INTO latest_formulations (flavor_code, formulation_id) "
+        "SELECT flavor_code, id FROM ("
+        "    SELECT flavor_code, id, ROW_NUMBER() OVER ("
+        "        PARTITION BY flavor_code "
+        "        ORDER BY ver_major DESC, ver_minor DESC, ver_patch DESC) AS rn "
+        "    FROM formulations"
+        ") WHERE rn = 1 "
+        "  AND NOT EXISTS (SELECT 1 FROM latest_formulations);"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    rc = db_exec_simple(ctx,
+        "INSERT INTO latest_soda_bases (base_code, soda_base_id) "
+        "SELECT base_code, id FROM ("
+        "    SELECT base_code, id, ROW_NUMBER() OVER ("
+        "        PARTITION BY base_code "
+        "        ORDER BY ver_major DESC, ver_minor DESC, ver_patch DESC) AS rn "
+        "    FROM soda_bases"
+        ") WHERE rn = 1 "
+        "  AND NOT EXISTS (SELECT 1 FROM latest_soda_bases);"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    return SQLITE_OK;
+}
+
+/* v4 — key batch_ingredients and regulatory_limits on compound_library_id.
+   compound_name stays as the display label.  The backfill only touches
+   rows without an id, so it is safe on databases that already have the
+   columns. */
+static int migrate_compound_ids(DbContext* ctx)
+{
+    int rc;
+
+    rc = add_column_if_missing(ctx, "batch_ingredients", "compound_library_id", "INTEGER");
+    if (rc != SQLITE_OK) return rc;
+    rc = db_exec_simple(ctx,
+        "UPDATE batch_ingredients SET compound_library_id = "
+        "    (SELECT id FROM compound_library cl "
+        "     WHERE cl.compound_name = batch_ingredients.compound_name) "
+        "WHERE compound_library_id IS NULL;"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    rc = add_column_if_missing(ctx, "regulatory_limits", "compound_library_id", "INTEGER");
+    if (rc != SQLITE_OK) return rc;
+    rc = db_exec_simple(ctx,
+        "UPDATE regulatory_limits SET compound_library_id = "
+        "    (SELECT id FROM compound_library cl "
+        "     WHERE cl.compound_name = regulatory_limits.compound_name) "
+        "WHERE compound_library_id IS NULL;"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    rc = db_exec_simple(ctx, "DROP INDEX IF EXISTS idx_regulatory_limits_compound;");
+    if (rc != SQLITE_OK) return rc;
+    return db_exec_simple(ctx,
+        "CREATE INDEX IF NOT EXISTS idx_regulatory_limits_compound_id "
+        "ON regulatory_limits(compound_library_id, effective_date);"
+    );
+}
+
+/* v5 — compound_fts, an external-content FTS5 index over the searchable
+   compound_library text.  Triggers keep it in step with the table; the
+   rank function weights a name hit above a descriptor hit. */
+static int migrate_compound_fts(DbContext* ctx)
+{
+    int rc;
+
+    rc = db_exec_simple(ctx,
+        "CREATE VIRTUAL TABLE IF NOT EXISTS compound_fts USING fts5("
+        "    compound_name, odor_profile, flavor_descriptors, applications,"
+        "    content='compound_library', content_rowid='id', prefix='2 3'"
         ");"
     );
     if (rc != SQLITE_OK) return rc;
 
-    /* formulation_compounds — compounds per formulation version */
-    rc = db_exec_simple(
-        "CREATE TABLE IF NOT EXISTS formulation_compounds ("
+    rc = db_exec_simple(ctx,
+        "CREATE TRIGGER IF NOT EXISTS compound_fts_ai "
+        "AFTER INSERT ON compound_library BEGIN "
+        "    INSERT INTO compound_fts(rowid, compound_name, odor_profile, "
+        "                             flavor_descriptors, applications) "
+        "    VALUES (new.id, new.compound_name, new.odor_profile, "
+        "            new.flavor_descriptors, new.applications); "
+        "END;"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    rc = db_exec_simple(ctx,
+        "CREATE TRIGGER IF NOT EXISTS compound_fts_ad "
+        "AFTER DELETE ON compound_library BEGIN "
+        "    INSERT INTO compound_fts(compound_fts, rowid, compound_name, "
+        "                             odor_profile, flavor_descriptors, applications) "
+        "    VALUES ('delete', old.id, old.compound_name, old.odor_profile, "
+        "            old.flavor_descriptors, old.applications); "
+        "END;"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* Cost and limit edits leave the index alone */
+    rc = db_exec_simple(ctx,
+        "CREATE TRIGGER IF NOT EXISTS compound_fts_au "
+        "AFTER UPDATE OF compound_name, odor_profile, flavor_descriptors, "
+        "                applications ON compound_library BEGIN "
+        "    INSERT INTO compound_fts(compound_fts, rowid, compound_name, "
+        "                             odor_profile, flavor_descriptors, applications) "
+        "    VALUES ('delete', old.id, old.compound_name, old.odor_profile, "
+        "            old.flavor_descriptors, old.applications); "
+        "    INSERT INTO compound_fts(rowid, compound_name, odor_profile, "
+        "                             flavor_descriptors, applications) "
+        "    VALUES (new.id, new.compound_name, new.odor_profile, "
+        "            new.flavor_descriptors, new.applications); "
+        "END;"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    rc = db_exec_simple(ctx,
+        "INSERT INTO compound_fts(compound_fts, rank) "
+        "VALUES ('rank', 'bm25(10.0, 2.0, 2.0, 1.0)');"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    return db_exec_simple(ctx,
+        "INSERT INTO compound_fts(compound_fts) VALUES ('rebuild');"
+    );
+}
+
+/* v6 — app_mask, the APP_* bits of the pipe-separated applications
+   string, as a generated column with its own index.  Tokens are matched
+   whole ('|' on both sides), so one can never hit inside another.  A new
+   category means a new migration that redefines the column. */
+static int migrate_app_mask(DbContext* ctx)
+{
+    char expr[1024];
+    char sql[1200];
+    int  len = 0;
+    int  i, rc;
+
+    expr[0] = '\0';
+    for (i = 0; i < APP_CATEGORY_COUNT; i++) {
+        len += snprintf(expr + len, sizeof(expr) - (size_t)len,
+            "%s((instr('|' || COALESCE(applications, '') || '|', '|%s|') > 0) << %d)",
+            i ? " | " : "", compound_app_token(i), i);
+        if (len >= (int)sizeof(expr)) return SQLITE_TOOBIG;
+    }
+
+    snprintf(sql, sizeof(sql),
+        "ALTER TABLE compound_library ADD COLUMN app_mask INTEGER "
+        "GENERATED ALWAYS AS (%s) VIRTUAL;", expr);
+    rc = db_exec_simple(ctx, sql);
+    if (rc != SQLITE_OK) return rc;
+
+    return db_exec_simple(ctx,
+        "CREATE INDEX IF NOT EXISTS idx_compound_library_app_mask "
+        "ON compound_library(app_mask);"
+    );
+}
+
+/* v7 — stock_movements, an append-only ledger of every stock change, and
+   stock_snapshots, the running balance every STOCK_SNAPSHOT_EVERY
+   movements per compound.  compound_inventory.stock_grams becomes a
+   mirror of the latest balance kept by trigger (no longer clamped at 0,
+   so drift below zero shows); ledger_tail counts movements since the
+   compound's last snapshot.  Existing balances enter as 'opening' rows. */
+#define STOCK_SNAPSHOT_EVERY 64     /* baked into the trigger; changing it needs a migration */
+
+static int migrate_stock_ledger(DbContext* ctx)
+{
+    char sql[1024];
+    int  rc;
+
+    rc = add_column_if_missing(ctx, "compound_inventory", "ledger_tail",
+                               "INTEGER NOT NULL DEFAULT 0");
+    if (rc != SQLITE_OK) return rc;
+
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS stock_movements ("
         "    id                  INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "    formulation_id      INTEGER NOT NULL REFERENCES formulations(id),"
-        "    compound_name       TEXT    NOT NULL,"
-        "    concentration_ppm   REAL    NOT NULL,"
-        "    compound_library_id INTEGER"
+        "    compound_library_id INTEGER NOT NULL REFERENCES compound_library(id),"
+        "    kind                TEXT    NOT NULL CHECK (kind IN "
+        "                        ('opening', 'receipt', 'consume', 'adjust', 'reversal')),"
+        "    delta_grams         REAL    NOT NULL,"
+        "    batch_run_id        INTEGER REFERENCES batch_runs(id),"
+        "    reverses_id         INTEGER REFERENCES stock_movements(id),"
+        "    note                TEXT,"
+        "    moved_at            TEXT    NOT NULL DEFAULT (DATETIME('now', 'localtime'))"
         ");"
     );
     if (rc != SQLITE_OK) return rc;
 
-    /* compound_library — Phase 2 stub; full schema defined now to avoid
-       future migration.  All columns defined; only id/compound_name required. */
-    rc = db_exec_simple(
-        "CREATE TABLE IF NOT EXISTS compound_library ("
-        "    id                   INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "    compound_name        TEXT    NOT NULL UNIQUE,"
-        "    cas_number           TEXT,"
-        "    fema_number          INTEGER,"
-        "    max_use_ppm          REAL,"
-        "    rec_min_ppm          REAL,"
-        "    rec_max_ppm          REAL,"
-        "    molecular_weight     REAL,"
-        "    water_solubility     REAL,"
-        "    ph_stable_min        REAL,"
-        "    ph_stable_max        REAL,"
-        "    odor_profile         TEXT,"
-        "    storage_temp         TEXT,"
-        "    requires_solubilizer INTEGER NOT NULL DEFAULT 0,"
-        "    requires_inert_atm   INTEGER NOT NULL DEFAULT 0,"
-        "    applications         TEXT"
+    /* (compound, id) serves the snapshot tail, (compound, moved_at) the
+       point-in-time lookup; a movement can be reversed only once */
+    rc = db_exec_simple(ctx,
+        "CREATE INDEX IF NOT EXISTS idx_stock_movements_compound "
+        "ON stock_movements(compound_library_id, id);"
+        "CREATE INDEX IF NOT EXISTS idx_stock_movements_time "
+        "ON stock_movements(compound_library_id, moved_at, id);"
+        "CREATE UNIQUE INDEX IF NOT EXISTS idx_stock_movements_reverses "
+        "ON stock_movements(reverses_id) WHERE reverses_id IS NOT NULL;"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* balance_grams includes every movement of the compound up to and
+       including movement_id */
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS stock_snapshots ("
+        "    compound_library_id INTEGER NOT NULL,"
+        "    movement_id         INTEGER NOT NULL,"
+        "    balance_grams       REAL    NOT NULL,"
+        "    taken_at            TEXT    NOT NULL,"
+        "    PRIMARY KEY (compound_library_id, movement_id)"
+        ") WITHOUT ROWID;"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* Opening balances, only for compounds not yet in the ledger */
+    rc = db_exec_simple(ctx,
+        "INSERT INTO stock_movements "
+        "(compound_library_id, kind, delta_grams, note, moved_at) "
+        "SELECT ci.compound_library_id, 'opening', ci.stock_grams, "
+        "       'balance before the ledger', ci.last_updated "
+        "FROM compound_inventory ci "
+        "WHERE NOT EXISTS (SELECT 1 FROM stock_movements m "
+        "                  WHERE m.compound_library_id = ci.compound_library_id);"
+        "INSERT OR IGNORE INTO stock_snapshots "
+        "(compound_library_id, movement_id, balance_grams, taken_at) "
+        "SELECT compound_library_id, id, delta_grams, moved_at "
+        "FROM stock_movements WHERE kind = 'opening';"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    rc = db_exec_simple(ctx,
+        "CREATE TRIGGER IF NOT EXISTS trg_stock_movements_no_update "
+        "BEFORE UPDATE ON stock_movements BEGIN "
+        "    SELECT RAISE(ABORT, 'stock_movements is append-only');"
+        "END;"
+        "CREATE TRIGGER IF NOT EXISTS trg_stock_movements_no_delete "
+        "BEFORE DELETE ON stock_movements BEGIN "
+        "    SELECT RAISE(ABORT, 'stock_movements is append-only');"
+        "END;"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* A new inventory row opens its ledger with its starting stock */
+    rc = db_exec_simple(ctx,
+        "CREATE TRIGGER IF NOT EXISTS trg_compound_inventory_opening "
+        "AFTER INSERT ON compound_inventory BEGIN "
+        "    INSERT INTO stock_movements "
+        "    (compound_library_id, kind, delta_grams, moved_at) "
+        "    VALUES (NEW.compound_library_id, 'opening', NEW.stock_grams, NEW.last_updated);"
+        "    INSERT INTO stock_snapshots "
+        "    (compound_library_id, movement_id, balance_grams, taken_at) "
+        "    VALUES (NEW.compound_library_id, last_insert_rowid(), NEW.stock_grams, "
+        "            NEW.last_updated);"
+        "END;"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* Every other movement moves the mirror, and every
+       STOCK_SNAPSHOT_EVERY of them the running balance is written down */
+    snprintf(sql, sizeof(sql),
+        "CREATE TRIGGER IF NOT EXISTS trg_stock_movements_apply "
+        "AFTER INSERT ON stock_movements WHEN NEW.kind <> 'opening' BEGIN "
+        "    UPDATE compound_inventory "
+        "    SET stock_grams  = stock_grams + NEW.delta_grams, "
+        "        ledger_tail  = ledger_tail + 1, "
+        "        last_updated = NEW.moved_at "
+        "    WHERE compound_library_id = NEW.compound_library_id;"
+        "    INSERT INTO stock_snapshots "
+        "    (compound_library_id, movement_id, balance_grams, taken_at) "
+        "    SELECT compound_library_id, NEW.id, stock_grams, NEW.moved_at "
+        "    FROM compound_inventory "
+        "    WHERE compound_library_id = NEW.compound_library_id AND ledger_tail >= %d;"
+        "    UPDATE compound_inventory SET ledger_tail = 0 "
+        "    WHERE compound_library_id = NEW.compound_library_id AND ledger_tail >= %d;"
+        "END;", STOCK_SNAPSHOT_EVERY, STOCK_SNAPSHOT_EVERY);
+    return db_exec_simple(ctx, sql);
+}
+
+/* v8 — formulation versions stored as deltas.  A version's compound list
+   is an array: seq is the position, compound_count the length.  A
+   keyframe (parent_id NULL) has a row for every position; a delta has
+   rows only for the positions that differ from its parent's array, and
+   its parent is the flavor's latest version when it was saved.
+   chain_depth counts deltas back to the keyframe.  Existing versions
+   become keyframes with seq numbered in their old row order. */
+static int migrate_version_deltas(DbContext* ctx)
+{
+    int rc;
+
+    rc = add_column_if_missing(ctx, "formulations", "parent_id",
+                               "INTEGER REFERENCES formulations(id)");
+    if (rc != SQLITE_OK) return rc;
+    rc = add_column_if_missing(ctx, "formulations", "chain_depth",
+                               "INTEGER NOT NULL DEFAULT 0");
+    if (rc != SQLITE_OK) return rc;
+    rc = add_column_if_missing(ctx, "formulations", "compound_count",
+                               "INTEGER NOT NULL DEFAULT 0");
+    if (rc != SQLITE_OK) return rc;
+    rc = add_column_if_missing(ctx, "formulation_compounds", "seq",
+                               "INTEGER NOT NULL DEFAULT 0");
+    if (rc != SQLITE_OK) return rc;
+
+    rc = db_exec_simple(ctx,
+        "UPDATE formulation_compounds SET seq = "
+        "    (SELECT COUNT(*) FROM formulation_compounds p "
+        "     WHERE p.formulation_id = formulation_compounds.formulation_id "
+        "       AND p.id < formulation_compounds.id);"
+        "UPDATE formulations SET compound_count = "
+        "    (SELECT COUNT(*) FROM formulation_compounds fc "
+        "     WHERE fc.formulation_id = formulations.id) "
+        "WHERE parent_id IS NULL;"
+    );
+    if (rc != SQLITE_OK) return rc;
+
+    /* parent_id is a self-reference, so every insert looks for children */
+    rc = db_exec_simple(ctx,
+        "CREATE INDEX IF NOT EXISTS idx_formulation_compounds_seq "
+        "ON formulation_compounds(formulation_id, seq);"
+        "CREATE INDEX IF NOT EXISTS idx_formulations_parent "
+        "ON formulations(parent_id);"
+    );
+    if (rc != SQLITE_OK) return rc;
+    return db_exec_simple(ctx, "DROP INDEX IF EXISTS idx_formulation_compounds_formulation;");
+}
+
+/* v9 — tasting_aggregates: per formulation version, the session count
+   and for each score dimension how many sessions scored it, their sum
+   and their sum of squares, so means and variances need no scan.
+   Triggers on tasting_sessions keep it current (an update is taken out
+   under OLD and put back under NEW); db_rebuild_tasting_aggregates
+   recomputes it from scratch.  flavor_code is copied in for the
+   per-flavor rollup. */
+static const char* const g_score_dims[DB_SCORE_DIMENSIONS] = {
+    "overall", "aroma", "flavor", "mouthfeel", "finish", "sweetness"
+};
+
+/* Upsert that adds (sign "+") or takes out (sign "-") the tasting_sessions
+   row named row ("NEW" / "OLD").  sqlite3_free the result. */
+static char* agg_upsert_sql(const char* row, const char* sign)
+{
+    sqlite3_str* cols = sqlite3_str_new(NULL);
+    sqlite3_str* vals = sqlite3_str_new(NULL);
+    sqlite3_str* sets = sqlite3_str_new(NULL);
+    char *c, *v, *u, *sql;
+    int i;
+
+    for (i = 0; i < DB_SCORE_DIMENSIONS; i++) {
+        const char* d = g_score_dims[i];
+        sqlite3_str_appendf(cols, ", %s_n, %s_sum, %s_sumsq", d, d, d);
+        sqlite3_str_appendf(vals,
+            ", %s(%s.%s_score IS NOT NULL), %sIFNULL(%s.%s_score, 0), "
+            "%sIFNULL(%s.%s_score * %s.%s_score, 0)",
+            sign, row, d, sign, row, d, sign, row, d, row, d);
+        sqlite3_str_appendf(sets,
+            ", %s_n = %s_n + excluded.%s_n, %s_sum = %s_sum + excluded.%s_sum, "
+            "%s_sumsq = %s_sumsq + excluded.%s_sumsq",
+            d, d, d, d, d, d, d, d, d);
+    }
+    c = sqlite3_str_finish(cols);
+    v = sqlite3_str_finish(vals);
+    u = sqlite3_str_finish(sets);
+    sql = (c && v && u) ? sqlite3_mprintf(
+        "INSERT INTO tasting_aggregates (formulation_id, flavor_code, sessions%s) "
+        "SELECT f.id, f.flavor_code, %s1%s FROM formulations f WHERE f.id = %s.formulation_id "
+        "ON CONFLICT(formulation_id) DO UPDATE SET sessions = sessions + excluded.sessions%s;",
+        c, sign, v, row, u) : NULL;
+    sqlite3_free(c);
+    sqlite3_free(v);
+    sqlite3_free(u);
+    return sql;
+}
+
+/* SELECT of the aggregate columns recomputed from tasting_sessions */
+static char* agg_recompute_sql(void)
+{
+    sqlite3_str* q = sqlite3_str_new(NULL);
+    int i;
+
+    sqlite3_str_appendall(q, "SELECT t.formulation_id, f.flavor_code, COUNT(*) AS sessions");
+    for (i = 0; i < DB_SCORE_DIMENSIONS; i++) {
+        const char* d = g_score_dims[i];
+        sqlite3_str_appendf(q, ", COUNT(t.%s_score) AS %s_n, TOTAL(t.%s_score) AS %s_sum, "
+                               "TOTAL(t.%s_score * t.%s_score) AS %s_sumsq",
+                            d, d, d, d, d, d, d);
+    }
+    sqlite3_str_appendall(q, " FROM tasting_sessions t "
+                             "JOIN formulations f ON f.id = t.formulation_id "
+                             "GROUP BY t.formulation_id");
+    return sqlite3_str_finish(q);
+}
+
+static int migrate_tasting_aggregates(DbContext* ctx)
+{
+    sqlite3_str* q = sqlite3_str_new(NULL);
+    char* add_new = agg_upsert_sql("NEW", "+");
+    char* sub_old = agg_upsert_sql("OLD", "-");
+    char* recompute = agg_recompute_sql();
+    char* sql;
+    int   i, rc;
+
+    sqlite3_str_appendall(q,
+        "CREATE TABLE IF NOT EXISTS tasting_aggregates ("
+        "    formulation_id  INTEGER PRIMARY KEY REFERENCES formulations(id),"
+        "    flavor_code     TEXT    NOT NULL,"
+        "    sessions        INTEGER NOT NULL");
+    for (i = 0; i < DB_SCORE_DIMENSIONS; i++)
+        sqlite3_str_appendf(q,
+            ", %s_n INTEGER NOT NULL, %s_sum REAL NOT NULL, %s_sumsq REAL NOT NULL",
+            g_score_dims[i], g_score_dims[i], g_score_dims[i]);
+    sqlite3_str_appendf(q,
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_tasting_aggregates_flavor "
+        "ON tasting_aggregates(flavor_code);"
+        "INSERT OR REPLACE INTO tasting_aggregates %s;"
+        "CREATE TRIGGER IF NOT EXISTS trg_tasting_sessions_agg_ins "
+        "AFTER INSERT ON tasting_sessions BEGIN %s END;"
+        "CREATE TRIGGER IF NOT EXISTS trg_tasting_sessions_agg_del "
+        "AFTER DELETE ON tasting_sessions BEGIN %s END;"
+        "CREATE TRIGGER IF NOT EXISTS trg_tasting_sessions_agg_upd "
+        "AFTER UPDATE OF formulation_id, overall_score, aroma_score, flavor_score, "
+        "mouthfeel_score, finish_score, sweetness_score ON tasting_sessions "
+        "BEGIN %s %s END;",
+        recompute, add_new, sub_old, sub_old, add_new);
+    sql = sqlite3_str_finish(q);
+
+    rc = (sql && add_new && sub_old && recompute) ? db_exec_simple(ctx, sql) : SQLITE_NOMEM;
+    sqlite3_free(sql);
+    sqlite3_free(add_new);
+    sqlite3_free(sub_old);
+    sqlite3_free(recompute);
+    return rc;
+}
+
+/* v10 — batch_sequences: the last batch number handed out per flavor and year.
+   Seeded from the numbers already issued in the old fixed format
+   (CODE-YYYY-NNN), so the first new number follows the highest old one. */
+static int migrate_batch_sequences(DbContext* ctx)
+{
+    return db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS batch_sequences ("
+        "    flavor_code TEXT    NOT NULL,"
+        "    year        INTEGER NOT NULL,"
+        "    last_seq    INTEGER NOT NULL,"
+        "    PRIMARY KEY (flavor_code, year)"
+        ") WITHOUT ROWID;"
+        "INSERT OR REPLACE INTO batch_sequences (flavor_code, year, last_seq) "
+        "SELECT f.flavor_code, "
+        "       CAST(substr(br.batch_number, length(f.flavor_code) + 2, 4) AS INTEGER), "
+        "       MAX(CAST(substr(br.batch_number, length(f.flavor_code) + 7) AS INTEGER)) "
+        "FROM batch_runs br JOIN formulations f ON f.id = br.formulation_id "
+        "WHERE br.batch_number GLOB f.flavor_code || '-[0-9][0-9][0-9][0-9]-[0-9]*' "
+        "GROUP BY 1, 2;"
+    );
+}
+
+typedef struct {
+    const char* name;
+    int       (*apply)(DbContext* ctx);   /* returns SQLITE_OK or an error code */
+} Migration;
+
+/* Step N (1-based) brings the database to user_version N. */
+static const Migration g_migrations[] = {
+    { "base schema",            migrate_base_schema        },
+    { "secondary indexes",      migrate_indexes            },
+    { "latest version tables",  migrate_latest_versions    },
+    { "compound library ids",   migrate_compound_ids       },
+    { "compound search index",  migrate_compound_fts       },
+    { "application bitmask",    migrate_app_mask           },
+    { "stock ledger",           migrate_stock_ledger       },
+    { "version deltas",         migrate_version_deltas     },
+    { "tasting aggregates",     migrate_tasting_aggregates },
+    { "batch sequences",        migrate_batch_sequences    },
+};
+
+#define SCHEMA_VERSION ((int)(sizeof(g_migrations) / sizeof(g_migrations[0])))
+
+static int read_user_version(DbContext* ctx, int* out)
+{
+    sqlite3_stmt* stmt = NULL;
+    int rc;
+
+    rc = sqlite3_prepare_v2(ctx->db, "PRAGMA user_version;", -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return rc;
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        *out = sqlite3_column_int(stmt, 0);
+        rc = SQLITE_OK;
+    }
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+/* Apply one step and stamp it, all inside one transaction. */
+static int apply_migration(DbContext* ctx, int version)
+{
+    const Migration* m = &g_migrations[version - 1];
+    sqlite3_stmt* stmt = NULL;
+    char   sql[64];
+    double t0 = timing_now_ms();
+    int    rc;
+
+    rc = db_exec_simple(ctx, "BEGIN IMMEDIATE;");
+    if (rc != SQLITE_OK) return rc;
+
+    rc = m->apply(ctx);
+    if (rc == SQLITE_OK) {
+        snprintf(sql, sizeof(sql), "PRAGMA user_version = %d;", version);
+        rc = db_exec_simple(ctx, sql);
+    }
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(ctx->db,
+            "INSERT OR REPLACE INTO schema_migrations (version, name, duration_ms) "
+            "VALUES (?, ?, ?);",
+            -1, &stmt, NULL);
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_int   (stmt, 1, version);
+        sqlite3_bind_text  (stmt, 2, m->name, -1, SQLITE_STATIC);
+        sqlite3_bind_double(stmt, 3, timing_now_ms() - t0);
+        rc = sqlite3_step(stmt);
+        rc = (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+    }
+    sqlite3_finalize(stmt);
+
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Migration to v%d (%s) failed: %s\n",
+                version, m->name, sqlite3_errmsg(ctx->db));
+        db_exec_simple(ctx, "ROLLBACK;");
+        return rc;
+    }
+    return db_exec_simple(ctx, "COMMIT;");
+}
+
+/* Bring the schema up to SCHEMA_VERSION.  An up-to-date database costs
+   one PRAGMA read. */
+static int run_migrations(DbContext* ctx)
+{
+    double t0;
+    int    version = 0;
+    int    rc;
+
+    memset(&ctx->migration_stats, 0, sizeof(ctx->migration_stats));
+
+    rc = read_user_version(ctx, &version);
+    if (rc != SQLITE_OK) return rc;
+    ctx->migration_stats.from_version = version;
+    ctx->migration_stats.to_version   = version;
+
+    if (version > SCHEMA_VERSION) {
+        fprintf(stderr, "Database schema v%d is newer than this build (v%d).\n",
+                version, SCHEMA_VERSION);
+        return SQLITE_OK;
+    }
+    if (version == SCHEMA_VERSION) return SQLITE_OK;
+
+    t0 = timing_now_ms();
+    rc = db_exec_simple(ctx,
+        "CREATE TABLE IF NOT EXISTS schema_migrations ("
+        "    version     INTEGER PRIMARY KEY,"
+        "    name        TEXT    NOT NULL,"
+        "    applied_at  TEXT    NOT NULL DEFAULT (DATETIME('now', 'localtime')),"
+        "    duration_ms REAL    NOT NULL"
         ");"
     );
+
+    while (rc == SQLITE_OK && version < SCHEMA_VERSION) {
+        rc = apply_migration(ctx, version + 1);
+        if (rc == SQLITE_OK) {
+            version++;
+            ctx->migration_stats.steps_applied++;
+        }
+    }
+
+    ctx->migration_stats.to_version = version;
+    ctx->migration_stats.elapsed_ms = timing_now_ms() - t0;
+    if (rc != SQLITE_OK) return rc;
+
+    if (g_verbose)
+        printf("Schema migrated: v%d -> v%d (%d step%s, %.1f ms)\n",
+               ctx->migration_stats.from_version, version,
+               ctx->migration_stats.steps_applied,
+               ctx->migration_stats.steps_applied == 1 ? "" : "s",
+               ctx->migration_stats.elapsed_ms);
+    return SQLITE_OK;
+}
+
+void dbc_get_migration_stats(DbContext* ctx, DbMigrationStats* out)
+{
+    *out = ctx->migration_stats;
+}
+
+/* =========================================================================
+   Storage profiles
+   Named sets of the per-connection PRAGMAs that trade speed for safety.
+   app_settings storage_profile picks one at open; db_set_storage_profile
+   switches a live connection.  Every profile sets every knob, so
+   switching back to "default" really restores SQLite's stock values.
+   ========================================================================= */
+typedef struct StorageProfile {
+    const char* name;
+    int         cache_kib;            /* PRAGMA cache_size = -cache_kib */
+    int         mmap_mib;             /* PRAGMA mmap_size, 0 = off      */
+    const char* temp_store;           /* DEFAULT | FILE | MEMORY        */
+    const char* synchronous;          /* OFF | NORMAL | FULL            */
+    int         wal_autocheckpoint;   /* pages                          */
+} StorageProfile;
+
+static const StorageProfile g_storage_profiles[] = {
+    /* SQLite's own defaults, as when storage_profile is unset */
+    { "default",       2000,   0, "DEFAULT", "FULL",    1000 },
+    /* Day-to-day use on a kitchen laptop: WAL + NORMAL cannot corrupt the
+       file, a power cut loses at most the last few commits */
+    { "laptop",       16384,  64, "MEMORY",  "NORMAL",  1000 },
+    /* Loading a lot of data once (seed sync, imports); a crash mid-way
+       can corrupt the file, so only use it with a backup at hand */
+    { "bulk_import",  65536, 128, "MEMORY",  "OFF",    10000 },
+    /* Every commit is on disk before it returns; no mmap so an I/O error
+       surfaces as an error code rather than a fault */
+    { "durable",       8192,   0, "FILE",    "FULL",    1000 },
+};
+
+#define STORAGE_PROFILE_COUNT \
+    ((int)(sizeof(g_storage_profiles) / sizeof(g_storage_profiles[0])))
+
+static int storage_apply(DbContext* ctx, const StorageProfile* sp)
+{
+    char* sql;
+    int   rc;
+
+    sql = sqlite3_mprintf(
+        "PRAGMA cache_size=-%d;"
+        "PRAGMA mmap_size=%lld;"
+        "PRAGMA temp_store=%s;"
+        "PRAGMA synchronous=%s;"
+        "PRAGMA wal_autocheckpoint=%d;",
+        sp->cache_kib, (sqlite3_int64)sp->mmap_mib * 1024 * 1024,
+        sp->temp_store, sp->synchronous, sp->wal_autocheckpoint);
+    if (sql == NULL) return SQLITE_NOMEM;
+    rc = db_exec_simple(ctx, sql);
+    sqlite3_free(sql);
+    if (rc == SQLITE_OK) ctx->storage = sp;
+    return rc;
+}
+
+static const StorageProfile* storage_find(const char* name)
+{
+    int i;
+    for (i = 0; i < STORAGE_PROFILE_COUNT; i++)
+        if (strcmp(g_storage_profiles[i].name, name) == 0)
+            return &g_storage_profiles[i];
+    return NULL;
+}
+
+/* Apply the profile named in app_settings, if any */
+static void storage_configure(DbContext* ctx)
+{
+    const StorageProfile* sp;
+    char name[64];
+
+    if (!dbc_get_setting(ctx, "storage_profile", name, sizeof(name)) ||
+        name[0] == '\0')
+        return;
+    sp = storage_find(name);
+    if (sp == NULL) {
+        fprintf(stderr, "Unknown storage_profile '%s', keeping default\n", name);
+        return;
+    }
+    storage_apply(ctx, sp);
+}
+
+int dbc_set_storage_profile(DbContext* ctx, const char* name)
+{
+    const StorageProfile* sp;
+    int rc;
+
+    if (!ctx->db || name == NULL) return -1;
+    sp = storage_find(name);
+    if (sp == NULL) {
+        fprintf(stderr, "Unknown storage profile '%s'\n", name);
+        return -1;
+    }
+    rc = storage_apply(ctx, sp);
     if (rc != SQLITE_OK) return rc;
+    dbc_set_setting(ctx, "storage_profile", name);
+    return 0;
+}
 
-    /* cost_per_gram column — added in Phase 4.
-       ALTER TABLE ADD COLUMN is a no-op if the column already exists
-       (we just ignore the error). */
-    sqlite3_exec(g_db,
-        "ALTER TABLE compound_library ADD COLUMN cost_per_gram REAL NOT NULL DEFAULT 0;",
-        NULL, NULL, NULL);  /* ignore error — already exists on fresh DB */
+const char* dbc_get_storage_profile(DbContext* ctx)
+{
+    return ctx->storage ? ctx->storage->name : "default";
+}
 
-    /* flavor_descriptors and odor_threshold_ppm — added in Phase 5. */
-    sqlite3_exec(g_db,
-        "ALTER TABLE compound_library ADD COLUMN flavor_descriptors TEXT;",
-        NULL, NULL, NULL);
-    sqlite3_exec(g_db,
-        "ALTER TABLE compound_library ADD COLUMN odor_threshold_ppm REAL;",
-        NULL, NULL, NULL);
+const char* db_storage_profile_name(int i)
+{
+    if (i < 0 || i >= STORAGE_PROFILE_COUNT) return NULL;
+    return g_storage_profiles[i].name;
+}
 
-    /* applications — added for app-category filtering. */
-    sqlite3_exec(g_db,
-        "ALTER TABLE compound_library ADD COLUMN applications TEXT;",
-        NULL, NULL, NULL);
+/* =========================================================================
+   db_open / dbc_open
+   ========================================================================= */
+static int ctx_open(DbContext* ctx, const char* db_path)
+{
+    int rc;
 
-    /* tasting_sessions — one row per sensory evaluation */
-    rc = db_exec_simple(
-        "CREATE TABLE IF NOT EXISTS tasting_sessions ("
-        "    id              INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "    formulation_id  INTEGER NOT NULL REFERENCES formulations(id),"
-        "    tasted_at       TEXT    NOT NULL DEFAULT (DATETIME('now', 'localtime')),"
-        "    taster          TEXT    NOT NULL DEFAULT 'unknown',"
-        "    overall_score   REAL    NOT NULL,"
-        "    aroma_score     REAL,"
-        "    flavor_score    REAL,"
-        "    mouthfeel_score REAL,"
-        "    finish_score    REAL,"
-        "    sweetness_score REAL,"
-        "    notes           TEXT"
-        ");"
-    );
-    if (rc != SQLITE_OK) return rc;
+    rc = sqlite3_open(db_path, &ctx->db);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Cannot open database '%s': %s\n",
+                db_path, sqlite3_errmsg(ctx->db));
+        sqlite3_close(ctx->db);
+        ctx->db = NULL;
+        return rc;
+    }
+    /* Other stations may be writing the same file: wait for their
+       commits rather than fail with SQLITE_BUSY */
+    sqlite3_busy_timeout(ctx->db, 2000);
 
-    /* batch_runs — one row per production batch */
-    rc = db_exec_simple(
-        "CREATE TABLE IF NOT EXISTS batch_runs ("
-        "    id             INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "    formulation_id INTEGER NOT NULL REFERENCES formulations(id),"
-        "    batch_number   TEXT    NOT NULL UNIQUE,"
-        "    volume_liters  REAL    NOT NULL,"
-        "    cost_total     REAL,"
-        "    batched_at     TEXT    NOT NULL DEFAULT (DATETIME('now', 'localtime')),"
-        "    notes          TEXT"
-        ");"
-    );
-    if (rc != SQLITE_OK) return rc;
+    /* Fresh statement cache for this connection */
+    memset(ctx->stmts, 0, sizeof(ctx->stmts));
+    memset(&ctx->stmt_stats, 0, sizeof(ctx->stmt_stats));
+    compound_cache_free(ctx);
+    memset(&ctx->cc_stats, 0, sizeof(ctx->cc_stats));
 
-    /* batch_ingredients — compound weights per batch */
-    rc = db_exec_simple(
-        "CREATE TABLE IF NOT EXISTS batch_ingredients ("
-        "    id           INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "    batch_run_id INTEGER NOT NULL REFERENCES batch_runs(id),"
-        "    compound_name TEXT   NOT NULL,"
-        "    grams_needed  REAL   NOT NULL,"
-        "    cost_line     REAL"
-        ");"
-    );
-    if (rc != SQLITE_OK) return rc;
+    /* Performance and integrity settings (per connection) */
+    db_exec_simple(ctx, "PRAGMA journal_mode=WAL;");
+    db_exec_simple(ctx, "PRAGMA foreign_keys=ON;");
 
-    /* compound_inventory — stock levels per compound */
-    rc = db_exec_simple(
-        "CREATE TABLE IF NOT EXISTS compound_inventory ("
-        "    id                      INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "    compound_library_id     INTEGER NOT NULL UNIQUE REFERENCES compound_library(id),"
-        "    stock_grams             REAL    NOT NULL DEFAULT 0,"
-        "    reorder_threshold_grams REAL    NOT NULL DEFAULT 10,"
-        "    last_updated            TEXT    NOT NULL DEFAULT (DATETIME('now', 'localtime'))"
-        ");"
-    );
-    if (rc != SQLITE_OK) return rc;
+    if (g_sql_profile) prof_start(ctx);
 
-    /* regulatory_limits — override max_use_ppm without rebuild */
-    rc = db_exec_simple(
-        "CREATE TABLE IF NOT EXISTS regulatory_limits ("
-        "    id             INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "    compound_name  TEXT NOT NULL,"
-        "    source         TEXT NOT NULL,"
-        "    max_use_ppm    REAL NOT NULL,"
-        "    effective_date TEXT NOT NULL,"
-        "    notes          TEXT,"
-        "    added_at       TEXT NOT NULL"
-        "             DEFAULT (DATETIME('now','localtime'))"
+    rc = run_migrations(ctx);
+    if (rc != SQLITE_OK) return rc;
+    prof_configure(ctx);
+    storage_configure(ctx);
+
+    /* validate_input — per-connection scratch table that
+       db_check_formulation_limits fills with one formulation's compounds */
+    rc = db_exec_simple(ctx,
+        "CREATE TEMP TABLE IF NOT EXISTS validate_input ("
+        "    seq                 INTEGER PRIMARY KEY,"
+        "    compound_library_id INTEGER,"
+        "    concentration_ppm   REAL    NOT NULL"
         ");"
     );
     if (rc != SQLITE_OK) return rc;
 
-    /* app_settings — persistent key-value store for user preferences */
-    sqlite3_exec(g_db,
-        "CREATE TABLE IF NOT EXISTS app_settings ("
-        "  key   TEXT PRIMARY KEY,"
-        "  value TEXT NOT NULL DEFAULT ''"
-        ");",
-        NULL, NULL, NULL);
+    /* After migrations, so generation 0 is the schema as opened */
+    rc = changes_start(ctx);
+    if (rc != SQLITE_OK) return rc;
 
-    sqlite3_exec(g_db,
-        "CREATE TABLE IF NOT EXISTS suppliers ("
-        "  id            INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "  supplier_name TEXT NOT NULL UNIQUE,"
-        "  website       TEXT,"
-        "  email         TEXT,"
-        "  phone         TEXT,"
-        "  notes         TEXT"
-        ");",
-        NULL, NULL, NULL);
+    if (g_verbose)
+        printf("Database opened: %s\n", db_path);
+    return 0;
+}
 
-    sqlite3_exec(g_db,
-        "CREATE TABLE IF NOT EXISTS compound_suppliers ("
-        "  id                  INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "  supplier_id         INTEGER NOT NULL REFERENCES suppliers(id),"
-        "  compound_library_id INTEGER NOT NULL REFERENCES compound_library(id),"
-        "  catalog_number      TEXT,"
-        "  price_per_gram      REAL,"
-        "  min_order_grams     REAL,"
-        "  lead_time_days      INTEGER,"
-        "  UNIQUE(supplier_id, compound_library_id)"
-        ");",
-        NULL, NULL, NULL);
+/* =========================================================================
+   db_create_from_image
+   First run only: the image is deserialized read-only into a scratch
+   :memory: connection and copied page by page into the new file with the
+   backup API.  db_open then finds user_version and the seed fingerprint
+   already current, so it applies nothing.
+   ========================================================================= */
+int db_create_from_image(const char* db_path,
+                         const unsigned char* image, size_t size)
+{
+    sqlite3*        src = NULL;
+    sqlite3*        dst = NULL;
+    sqlite3_backup* bk;
+    FILE*           fp;
+    double          t0;
+    int             rc;
+
+    fp = fopen(db_path, "rb");
+    if (fp != NULL) {
+        fclose(fp);
+        return 1;
+    }
+    if (image == NULL || size == 0) return 1;
 
-    /* ingredients — general non-compound inputs */
-    sqlite3_exec(g_db,
-        "CREATE TABLE IF NOT EXISTS ingredients ("
-        "  id              INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "  ingredient_name TEXT    NOT NULL UNIQUE,"
-        "  category        TEXT    NOT NULL DEFAULT 'other',"
-        "  unit            TEXT    NOT NULL DEFAULT 'g',"
-        "  cost_per_unit   REAL    NOT NULL DEFAULT 0,"
-        "  supplier_id     INTEGER REFERENCES suppliers(id),"
-        "  brand           TEXT,"
-        "  notes           TEXT"
-        ");",
-        NULL, NULL, NULL);
+    t0 = timing_now_ms();
 
-    /* soda_bases — versioned sub-formulations */
-    sqlite3_exec(g_db,
-        "CREATE TABLE IF NOT EXISTS soda_bases ("
-        "  id           INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "  base_code    TEXT    NOT NULL,"
-        "  base_name    TEXT    NOT NULL,"
-        "  ver_major    INTEGER NOT NULL DEFAULT 1,"
-        "  ver_minor    INTEGER NOT NULL DEFAULT 0,"
-        "  ver_patch    INTEGER NOT NULL DEFAULT 0,"
-        "  yield_liters REAL    NOT NULL DEFAULT 1.0,"
-        "  notes        TEXT,"
-        "  saved_at     TEXT    NOT NULL DEFAULT (DATETIME('now','localtime')),"
-        "  UNIQUE (base_code, ver_major, ver_minor, ver_patch)"
-        ");",
-        NULL, NULL, NULL);
+    rc = sqlite3_open(":memory:", &src);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_deserialize(src, "main", (unsigned char*)image,
+                                 (sqlite3_int64)size, (sqlite3_int64)size,
+                                 SQLITE_DESERIALIZE_READONLY);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_open(db_path, &dst);
+    if (rc == SQLITE_OK) {
+        bk = sqlite3_backup_init(dst, "main", src, "main");
+        if (bk == NULL) {
+            rc = sqlite3_errcode(dst);
+        } else {
+            sqlite3_backup_step(bk, -1);
+            rc = sqlite3_backup_finish(bk);
+        }
+    }
 
-    /* soda_base_compounds — aroma compounds inside a base */
-    sqlite3_exec(g_db,
-        "CREATE TABLE IF NOT EXISTS soda_base_compounds ("
-        "  id                  INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "  soda_base_id        INTEGER NOT NULL REFERENCES soda_bases(id),"
-        "  compound_name       TEXT    NOT NULL,"
-        "  concentration_ppm   REAL    NOT NULL,"
-        "  compound_library_id INTEGER REFERENCES compound_library(id)"
-        ");",
-        NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Cannot create '%s' from template: %s\n", db_path,
+                dst ? sqlite3_errmsg(dst) : sqlite3_errmsg(src));
+        sqlite3_close(dst);
+        sqlite3_close(src);
+        remove(db_path);
+        return -1;
+    }
 
-    /* soda_base_ingredients — general ingredients inside a base */
-    sqlite3_exec(g_db,
-        "CREATE TABLE IF NOT EXISTS soda_base_ingredients ("
-        "  id            INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "  soda_base_id  INTEGER NOT NULL REFERENCES soda_bases(id),"
-        "  ingredient_id INTEGER NOT NULL REFERENCES ingredients(id),"
-        "  amount        REAL    NOT NULL,"
-        "  unit          TEXT    NOT NULL DEFAULT 'g'"
-        ");",
-        NULL, NULL, NULL);
+    sqlite3_close(dst);
+    sqlite3_close(src);
+    if (g_verbose)
+        printf("Created %s from template (%u KB, %.1f ms)\n", db_path,
+               (unsigned)(size / 1024), timing_now_ms() - t0);
+    return 0;
+}
 
-    /* formulation_bases — soda bases used in a formulation */
-    sqlite3_exec(g_db,
-        "CREATE TABLE IF NOT EXISTS formulation_bases ("
-        "  id             INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "  formulation_id INTEGER NOT NULL REFERENCES formulations(id),"
-        "  soda_base_id   INTEGER NOT NULL REFERENCES soda_bases(id),"
-        "  amount         REAL    NOT NULL,"
-        "  unit           TEXT    NOT NULL DEFAULT '%'"
-        ");",
-        NULL, NULL, NULL);
+/* =========================================================================
+   db_close / dbc_open / dbc_close
+   ========================================================================= */
+static void ctx_close(DbContext* ctx)
+{
+    if (ctx->db != NULL) {
+        changes_stop(ctx);
+        stmt_cache_clear(ctx);
+        prof_stop(ctx);
+        compound_cache_free(ctx);
+        sqlite3_close(ctx->db);
+        ctx->db = NULL;
+        ctx->storage = NULL;
+    }
+}
 
-    /* formulation_ingredients — general ingredients used in a formulation */
-    sqlite3_exec(g_db,
-        "CREATE TABLE IF NOT EXISTS formulation_ingredients ("
-        "  id             INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "  formulation_id INTEGER NOT NULL REFERENCES formulations(id),"
-        "  ingredient_id  INTEGER NOT NULL REFERENCES ingredients(id),"
-        "  amount         REAL    NOT NULL,"
-        "  unit           TEXT    NOT NULL DEFAULT 'g'"
-        ");",
-        NULL, NULL, NULL);
+int dbc_open(const char* db_path, DbContext** out)
+{
+    DbContext* ctx;
+    int rc;
 
-    /* Migration: add production_instructions if not present (ignore error if column exists) */
-    sqlite3_exec(g_db,
-        "ALTER TABLE formulations ADD COLUMN production_instructions TEXT DEFAULT '';",
-        NULL, NULL, NULL);
+    *out = NULL;
+    ctx = (DbContext*)calloc(1, sizeof(DbContext));
+    if (ctx == NULL) return SQLITE_NOMEM;
 
-    printf("Database opened: %s\n", db_path);
+    rc = ctx_open(ctx, db_path);
+    if (rc != SQLITE_OK) {
+        ctx_close(ctx);
+        free(ctx);
+        return rc;
+    }
+    *out = ctx;
     return 0;
 }
 
+void dbc_close(DbContext* ctx)
+{
+    if (ctx == NULL) return;
+    ctx_close(ctx);
+    free(ctx);
+}
+
 /* =========================================================================
-   db_close
+   Private helper: look up compound_library.id by name.
+   Returns the id, or 0 if not found.
    ========================================================================= */
-void db_close(void)
+static sqlite3_int64 lookup_compound_library_id(DbContext* ctx, const char* name)
+{
+    CachedCompound* e = cc_find(ctx, name);
+    return e ? e->info.id : 0;
+}
+
+/* =========================================================================
+   Private helper: load compounds into f given the formulation's DB row id
+   and its compound_count.  The keyframe's rows are laid down first and
+   each delta on the way to the version overwrites its positions; the
+   array is then cut to count.
+   Called while no other statement is active on ctx->db.
+   ========================================================================= */
+static int load_compounds(DbContext* ctx, sqlite3_int64 formulation_id, int count,
+                          Formulation* f)
 {
-    if (g_db != NULL) {
-        sqlite3_close(g_db);
-        g_db = NULL;
+    sqlite3_stmt* stmt = NULL;
+    int depth_of[MAX_COMPOUNDS];
+    int rc;
+
+    rc = stmt_get(ctx, STMT_LOAD_COMPOUNDS, &stmt);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
+        return rc;
+    }
+
+    sqlite3_bind_int64(stmt, 1, formulation_id);
+
+    if (count > MAX_COMPOUNDS) count = MAX_COMPOUNDS;
+    memset(depth_of, 0x7f, sizeof(depth_of));
+    f->compound_count = 0;
+
+    /* Rows arrive in no particular order; for each position the row
+       nearest the requested version (smallest depth) wins */
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int seq   = sqlite3_column_int(stmt, 0);
+        int depth = sqlite3_column_int(stmt, 1);
+        if (seq < 0 || seq >= count) continue;   /* cut by a later version */
+        if (depth >= depth_of[seq]) continue;
+        depth_of[seq] = depth;
+        f->compounds[seq].name_id =
+            intern((const char*)sqlite3_column_text(stmt, 2));
+        f->compounds[seq].concentration_ppm =
+            (float)sqlite3_column_double(stmt, 3);
+        f->compounds[seq].compound_library_id =
+            sqlite3_column_int(stmt, 4);
     }
+    f->compound_count = count;
+
+    stmt_done(stmt);
+    return (rc == SQLITE_DONE) ? 0 : rc;
 }
 
 /* =========================================================================
-   Private helper: look up compound_library.id by name.
-   Returns the id, or 0 if not found.
+   Private helper: choose how db_save_formulation stores f.
+   The base is the flavor's latest version.  f becomes a delta against it
+   unless that would make the chain longer than VERSION_KEYFRAME_EVERY or
+   touch more than half the positions; otherwise it is a keyframe.
+   Sets *parent_id (0 = keyframe) and *depth, and changed[i] = 1 for
+   each position that needs a row.
    ========================================================================= */
-static sqlite3_int64 lookup_compound_library_id(const char* name)
+#define VERSION_KEYFRAME_EVERY 16
+
+static int version_plan(DbContext* ctx, const Formulation* f,
+                        const sqlite3_int64* lib_ids,
+                        sqlite3_int64* parent_id, int* depth,
+                        unsigned char* changed)
 {
     sqlite3_stmt* stmt = NULL;
-    sqlite3_int64 id = 0;
+    Formulation*  base;
+    sqlite3_int64 base_id = 0;
+    int base_depth = 0, base_count = 0;
+    int i, diff = 0;
     int rc;
 
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT id FROM compound_library WHERE compound_name = ?;",
-        -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return 0;
+    *parent_id = 0;
+    *depth     = 0;
+    memset(changed, 1, MAX_COMPOUNDS);
 
-    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
-    if (sqlite3_step(stmt) == SQLITE_ROW)
-        id = sqlite3_column_int64(stmt, 0);
+    rc = stmt_get(ctx, STMT_DELTA_BASE, &stmt);
+    if (rc != SQLITE_OK) return rc;
+    sqlite3_bind_text(stmt, 1, f->flavor_code, -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        base_id    = sqlite3_column_int64(stmt, 0);
+        base_depth = sqlite3_column_int(stmt, 1);
+        base_count = sqlite3_column_int(stmt, 2);
+    }
+    stmt_done(stmt);
+    if (rc != SQLITE_ROW) return (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+    if (base_depth + 1 >= VERSION_KEYFRAME_EVERY) return SQLITE_OK;
 
-    sqlite3_finalize(stmt);
-    return id;
+    base = (Formulation*)malloc(sizeof(Formulation));
+    if (base == NULL) return SQLITE_NOMEM;
+    rc = load_compounds(ctx, base_id, base_count, base);
+    if (rc != SQLITE_OK) {
+        free(base);
+        return rc;
+    }
+
+    for (i = 0; i < f->compound_count; i++) {
+        changed[i] = (i >= base->compound_count ||
+                      base->compounds[i].name_id != f->compounds[i].name_id ||
+                      base->compounds[i].concentration_ppm != f->compounds[i].concentration_ppm ||
+                      (sqlite3_int64)base->compounds[i].compound_library_id != lib_ids[i]);
+        diff += changed[i];
+    }
+    free(base);
+
+    if (diff * 2 > f->compound_count) {
+        memset(changed, 1, MAX_COMPOUNDS);
+        return SQLITE_OK;
+    }
+    *parent_id = base_id;
+    *depth     = base_depth + 1;
+    return SQLITE_OK;
 }
 
 /* =========================================================================
    db_save_formulation
    ========================================================================= */
-int db_save_formulation(const Formulation* f)
+int dbc_save_formulation(DbContext* ctx, const Formulation* f)
 {
     sqlite3_stmt* stmt = NULL;
     sqlite3_int64 formulation_id;
+    sqlite3_int64 parent_id;
+    sqlite3_int64 lib_ids[MAX_COMPOUNDS];
+    unsigned char changed[MAX_COMPOUNDS];
+    int depth;
     int rc;
     int i;
     int violations;
 
-    violations = db_validate_formulation(f);
+    violations = dbc_validate_formulation(ctx, f);
     if (violations > 0)
         fprintf(stderr, "  Warning: %d safety limit violation(s) noted above. Saving anyway.\n",
                 violations);
 
-    rc = db_exec_simple("BEGIN;");
+    /* IMMEDIATE: a deferred transaction that reads and then writes
+       fails with SQLITE_BUSY, without waiting, if another connection
+       commits in between */
+    rc = db_exec_simple(ctx, "BEGIN IMMEDIATE;");
     if (rc != SQLITE_OK) return rc;
 
+    cc_poll_external(ctx);
+    for (i = 0; i < f->compound_count; i++) {
+        CachedCompound* e = cc_resolve(ctx, f->compounds[i].compound_library_id,
+                                       f->compounds[i].name_id);
+        lib_ids[i] = e ? e->info.id : 0;
+    }
+    rc = version_plan(ctx, f, lib_ids, &parent_id, &depth, changed);
+    if (rc != SQLITE_OK) {
+        db_exec_simple(ctx, "ROLLBACK;");
+        return rc;
+    }
+
     /* Insert the formulation header row */
-    rc = sqlite3_prepare_v2(g_db,
-        "INSERT INTO formulations "
-        "(flavor_code, flavor_name, ver_major, ver_minor, ver_patch, "
-        " target_ph, target_brix, production_instructions) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?, ?);",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_INSERT_FORMULATION, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
-        db_exec_simple("ROLLBACK;");
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
+        db_exec_simple(ctx, "ROLLBACK;");
         return rc;
     }
 
@@ -380,9 +3063,13 @@ int db_save_formulation(const Formulation* f)
     sqlite3_bind_double(stmt, 6, (double)f->target_ph);
     sqlite3_bind_double(stmt, 7, (double)f->target_brix);
     sqlite3_bind_text  (stmt, 8, f->production_instructions,  -1, SQLITE_STATIC);
+    if (parent_id > 0) sqlite3_bind_int64(stmt, 9, parent_id);
+    else               sqlite3_bind_null (stmt, 9);
+    sqlite3_bind_int   (stmt, 10, depth);
+    sqlite3_bind_int   (stmt, 11, f->compound_count);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    stmt_done(stmt);
     stmt = NULL;
 
     if (rc == SQLITE_CONSTRAINT) {
@@ -391,120 +3078,75 @@ int db_save_formulation(const Formulation* f)
             "Increment the version before saving.\n",
             f->flavor_code,
             f->version.major, f->version.minor, f->version.patch);
-        db_exec_simple("ROLLBACK;");
+        db_exec_simple(ctx, "ROLLBACK;");
         return -1;
     }
     if (rc != SQLITE_DONE) {
-        fprintf(stderr, "Step error: %s\n", sqlite3_errmsg(g_db));
-        db_exec_simple("ROLLBACK;");
+        fprintf(stderr, "Step error: %s\n", sqlite3_errmsg(ctx->db));
+        db_exec_simple(ctx, "ROLLBACK;");
         return rc;
     }
 
-    formulation_id = sqlite3_last_insert_rowid(g_db);
+    formulation_id = sqlite3_last_insert_rowid(ctx->db);
 
-    /* Insert each compound, reusing a single prepared statement */
-    rc = sqlite3_prepare_v2(g_db,
-        "INSERT INTO formulation_compounds "
-        "(formulation_id, compound_name, concentration_ppm, compound_library_id) "
-        "VALUES (?, ?, ?, ?);",
-        -1, &stmt, NULL);
+    /* Insert the compounds the plan marked, reusing the cached insert
+       statement: all of them for a keyframe, the changes for a delta */
+    rc = stmt_get(ctx, STMT_INSERT_FORM_COMPOUND, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
-        db_exec_simple("ROLLBACK;");
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
+        db_exec_simple(ctx, "ROLLBACK;");
         return rc;
     }
 
     for (i = 0; i < f->compound_count; i++) {
-        sqlite3_int64 lib_id = lookup_compound_library_id(f->compounds[i].compound_name);
+        if (!changed[i]) continue;
         sqlite3_reset(stmt);
         sqlite3_bind_int64 (stmt, 1, formulation_id);
-        sqlite3_bind_text  (stmt, 2, f->compounds[i].compound_name, -1, SQLITE_STATIC);
-        sqlite3_bind_double(stmt, 3, (double)f->compounds[i].concentration_ppm);
-        if (lib_id > 0)
-            sqlite3_bind_int64(stmt, 4, lib_id);
+        sqlite3_bind_int   (stmt, 2, i);
+        sqlite3_bind_text  (stmt, 3, intern_str(f->compounds[i].name_id), -1, SQLITE_STATIC);
+        sqlite3_bind_double(stmt, 4, (double)f->compounds[i].concentration_ppm);
+        if (lib_ids[i] > 0)
+            sqlite3_bind_int64(stmt, 5, lib_ids[i]);
         else
-            sqlite3_bind_null(stmt, 4);
+            sqlite3_bind_null(stmt, 5);
 
         rc = sqlite3_step(stmt);
-        if (rc != SQLITE_DONE) {
-            fprintf(stderr, "Compound insert error: %s\n", sqlite3_errmsg(g_db));
-            sqlite3_finalize(stmt);
-            db_exec_simple("ROLLBACK;");
-            return rc;
-        }
-    }
-
-    sqlite3_finalize(stmt);
-
-    rc = db_exec_simple("COMMIT;");
-    if (rc != SQLITE_OK) return rc;
-
-    printf("Saved: %s v%d.%d.%d (%d compound%s)\n",
-        f->flavor_code,
-        f->version.major, f->version.minor, f->version.patch,
-        f->compound_count,
-        f->compound_count == 1 ? "" : "s");
-
-    return 0;
-}
-
-/* =========================================================================
-   Private helper: load compounds into f given the formulation's DB row id.
-   Called while no other statement is active on g_db.
-   ========================================================================= */
-static int load_compounds(sqlite3_int64 formulation_id, Formulation* f)
-{
-    sqlite3_stmt* stmt = NULL;
-    int rc;
-
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT compound_name, concentration_ppm "
-        "FROM formulation_compounds "
-        "WHERE formulation_id = ? "
-        "ORDER BY id ASC;",
-        -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
-        return rc;
+        if (rc != SQLITE_DONE) {
+            fprintf(stderr, "Compound insert error: %s\n", sqlite3_errmsg(ctx->db));
+            stmt_done(stmt);
+            db_exec_simple(ctx, "ROLLBACK;");
+            return rc;
+        }
     }
 
-    sqlite3_bind_int64(stmt, 1, formulation_id);
+    stmt_done(stmt);
 
-    f->compound_count = 0;
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        if (f->compound_count >= MAX_COMPOUNDS) break;
-        strncpy(f->compounds[f->compound_count].compound_name,
-                (const char*)sqlite3_column_text(stmt, 0), 63);
-        f->compounds[f->compound_count].compound_name[63] = '\0';
-        f->compounds[f->compound_count].concentration_ppm =
-            (float)sqlite3_column_double(stmt, 1);
-        f->compound_count++;
-    }
+    rc = db_exec_simple(ctx, "COMMIT;");
+    if (rc != SQLITE_OK) return rc;
 
-    sqlite3_finalize(stmt);
-    return (rc == SQLITE_DONE) ? 0 : rc;
+    if (g_verbose)
+        printf("Saved: %s v%d.%d.%d (%d compound%s)\n",
+            f->flavor_code,
+            f->version.major, f->version.minor, f->version.patch,
+            f->compound_count,
+            f->compound_count == 1 ? "" : "s");
+
+    return 0;
 }
 
 /* =========================================================================
    db_load_latest
    ========================================================================= */
-int db_load_latest(const char* flavor_code, Formulation* f)
+int dbc_load_latest(DbContext* ctx, const char* flavor_code, Formulation* f)
 {
     sqlite3_stmt* stmt = NULL;
     sqlite3_int64 row_id;
+    int count;
     int rc;
 
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT id, flavor_code, flavor_name, ver_major, ver_minor, ver_patch, "
-        "       target_ph, target_brix, "
-        "       COALESCE(production_instructions,'') "
-        "FROM formulations "
-        "WHERE flavor_code = ? "
-        "ORDER BY ver_major DESC, ver_minor DESC, ver_patch DESC "
-        "LIMIT 1;",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_LOAD_LATEST, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
@@ -512,12 +3154,12 @@ int db_load_latest(const char* flavor_code, Formulation* f)
 
     rc = sqlite3_step(stmt);
     if (rc == SQLITE_DONE) {
-        sqlite3_finalize(stmt);
+        stmt_done(stmt);
         return 1;  /* not found */
     }
     if (rc != SQLITE_ROW) {
-        fprintf(stderr, "Step error: %s\n", sqlite3_errmsg(g_db));
-        sqlite3_finalize(stmt);
+        fprintf(stderr, "Step error: %s\n", sqlite3_errmsg(ctx->db));
+        stmt_done(stmt);
         return rc;
     }
 
@@ -549,30 +3191,27 @@ int db_load_latest(const char* flavor_code, Formulation* f)
         }
     }
 
-    sqlite3_finalize(stmt);  /* finalize before opening compound query */
+    count = sqlite3_column_int(stmt, 9);
 
-    return load_compounds(row_id, f);
+    stmt_done(stmt);  /* release before opening compound query */
+
+    return load_compounds(ctx, row_id, count, f);
 }
 
 /* =========================================================================
    db_load_version
    ========================================================================= */
-int db_load_version(const char* flavor_code, int major, int minor, int patch,
-                    Formulation* f)
+int dbc_load_version(DbContext* ctx, const char* flavor_code, int major, int minor, int patch,
+                                     Formulation* f)
 {
     sqlite3_stmt* stmt = NULL;
     sqlite3_int64 row_id;
+    int count;
     int rc;
 
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT id, flavor_code, flavor_name, ver_major, ver_minor, ver_patch, "
-        "       target_ph, target_brix "
-        "FROM formulations "
-        "WHERE flavor_code = ? "
-        "  AND ver_major = ? AND ver_minor = ? AND ver_patch = ?;",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_LOAD_VERSION, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
@@ -583,12 +3222,12 @@ int db_load_version(const char* flavor_code, int major, int minor, int patch,
 
     rc = sqlite3_step(stmt);
     if (rc == SQLITE_DONE) {
-        sqlite3_finalize(stmt);
+        stmt_done(stmt);
         return 1;  /* not found */
     }
     if (rc != SQLITE_ROW) {
-        fprintf(stderr, "Step error: %s\n", sqlite3_errmsg(g_db));
-        sqlite3_finalize(stmt);
+        fprintf(stderr, "Step error: %s\n", sqlite3_errmsg(ctx->db));
+        stmt_done(stmt);
         return rc;
     }
 
@@ -607,36 +3246,32 @@ int db_load_version(const char* flavor_code, int major, int minor, int patch,
     f->version.patch = sqlite3_column_int(stmt, 5);
     f->target_ph     = (float)sqlite3_column_double(stmt, 6);
     f->target_brix   = (float)sqlite3_column_double(stmt, 7);
+    count            = sqlite3_column_int(stmt, 8);
 
-    sqlite3_finalize(stmt);  /* finalize before opening compound query */
+    stmt_done(stmt);  /* release before opening compound query */
 
-    return load_compounds(row_id, f);
+    return load_compounds(ctx, row_id, count, f);
 }
 
 /* =========================================================================
    db_list_formulations
    ========================================================================= */
-int db_list_formulations(void)
+int dbc_list_formulations(DbContext* ctx)
 {
     sqlite3_stmt* stmt = NULL;
     int rc;
 
-    /* Correlated subquery: for each row, verify it is the highest version
-       for its flavor_code.  ORDER BY flavor_code for consistent output. */
-    rc = sqlite3_prepare_v2(g_db,
+    /* latest_formulations is keyed on flavor_code, so walking it gives
+       alphabetical output with one primary-key lookup per flavor. */
+    rc = sqlite3_prepare_v2(ctx->db,
         "SELECT f.flavor_code, f.flavor_name, "
         "       f.ver_major, f.ver_minor, f.ver_patch, f.saved_at "
-        "FROM formulations f "
-        "WHERE f.id = ("
-        "    SELECT id FROM formulations "
-        "    WHERE flavor_code = f.flavor_code "
-        "    ORDER BY ver_major DESC, ver_minor DESC, ver_patch DESC "
-        "    LIMIT 1"
-        ") "
-        "ORDER BY f.flavor_code ASC;",
+        "FROM latest_formulations lf "
+        "JOIN formulations f ON f.id = lf.formulation_id "
+        "ORDER BY lf.flavor_code ASC;",
         -1, &stmt, NULL);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
@@ -665,19 +3300,14 @@ int db_list_formulations(void)
 /* =========================================================================
    db_get_version_history
    ========================================================================= */
-int db_get_version_history(const char* flavor_code)
+int dbc_get_version_history(DbContext* ctx, const char* flavor_code)
 {
     sqlite3_stmt* stmt = NULL;
     int rc;
 
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT ver_major, ver_minor, ver_patch, saved_at "
-        "FROM formulations "
-        "WHERE flavor_code = ? "
-        "ORDER BY ver_major ASC, ver_minor ASC, ver_patch ASC;",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_VERSION_HISTORY, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
@@ -692,162 +3322,775 @@ int db_get_version_history(const char* flavor_code)
                (const char*)sqlite3_column_text(stmt, 3));
     }
 
-    sqlite3_finalize(stmt);
+    stmt_done(stmt);
     return (rc == SQLITE_DONE) ? 0 : rc;
 }
 
 /* =========================================================================
-   db_seed_compound_library
-   INSERT OR IGNORE for all compounds defined in compound_data.h.
-   Safe to call every startup — idempotent.
+   Version diffs
+   Each side of a diff is reduced to three DiffLine lists (compounds,
+   bases, ingredients) sorted by key, and diff_merge walks each pair of
+   lists once.  Compounds are keyed by compound_library_id; lines with no
+   library id use -name_id so they still pair up by name.
+   ========================================================================= */
+typedef struct {
+    int   key;
+    int   name_id;
+    int   unit_id;
+    float value;
+} DiffLine;
+
+typedef struct {
+    Version   ver;
+    float     ph, brix;
+    DiffLine* lines[3];     /* indexed by DB_DIFF_COMPOUND/_BASE/_INGREDIENT */
+    int       n[3];
+} DiffSide;
+
+static int diff_line_cmp(const void* a, const void* b)
+{
+    int x = ((const DiffLine*)a)->key;
+    int y = ((const DiffLine*)b)->key;
+    return (x > y) - (x < y);
+}
+
+static int compound_key(int compound_library_id, int name_id)
+{
+    return compound_library_id > 0 ? compound_library_id : -name_id;
+}
+
+static void diff_add(DbVersionDiff* out, int what, int kind,
+                     const DiffLine* o, const DiffLine* n)
+{
+    const DiffLine* any = n ? n : o;
+    DbDiffItem* it;
+
+    if (out->count >= DB_DIFF_MAX_ITEMS) return;
+    it = &out->items[out->count++];
+    it->what        = (unsigned char)what;
+    it->kind        = (unsigned char)kind;
+    it->id          = any->key > 0 ? any->key : 0;
+    it->name_id     = any->name_id;
+    it->old_unit_id = o ? o->unit_id : 0;
+    it->new_unit_id = n ? n->unit_id : 0;
+    it->old_value   = o ? o->value : 0.0f;
+    it->new_value   = n ? n->value : 0.0f;
+    it->delta       = it->new_value - it->old_value;
+    it->delta_pct   = it->old_value != 0.0f ? it->delta / it->old_value * 100.0f : 0.0f;
+
+    if      (kind == DB_DIFF_ADDED)   out->added++;
+    else if (kind == DB_DIFF_REMOVED) out->removed++;
+    else                              out->changed++;
+}
+
+/* One pass over two key-sorted lists */
+static void diff_merge(DbVersionDiff* out, int what,
+                       const DiffLine* a, int na, const DiffLine* b, int nb)
+{
+    int i = 0, j = 0;
+
+    while (i < na || j < nb) {
+        if (j >= nb || (i < na && a[i].key < b[j].key)) {
+            diff_add(out, what, DB_DIFF_REMOVED, &a[i++], NULL);
+        } else if (i >= na || b[j].key < a[i].key) {
+            diff_add(out, what, DB_DIFF_ADDED, NULL, &b[j++]);
+        } else {
+            if (a[i].value != b[j].value || a[i].unit_id != b[j].unit_id)
+                diff_add(out, what, DB_DIFF_CHANGED, &a[i], &b[j]);
+            i++;
+            j++;
+        }
+    }
+}
+
+static void diff_sides(DbVersionDiff* out, const DiffSide* a, const DiffSide* b)
+{
+    int w;
+
+    out->from     = a->ver;
+    out->to       = b->ver;
+    out->old_ph   = a->ph;
+    out->new_ph   = b->ph;
+    out->old_brix = a->brix;
+    out->new_brix = b->brix;
+    out->added = out->removed = out->changed = 0;
+    out->count = 0;
+    for (w = DB_DIFF_COMPOUND; w <= DB_DIFF_INGREDIENT; w++)
+        diff_merge(out, w, a->lines[w], a->n[w], b->lines[w], b->n[w]);
+}
+
+/* =========================================================================
+   db_diff_versions
+   Loads both versions through the normal load path and merges them.
+   ========================================================================= */
+typedef struct {
+    Formulation    f;
+    FormBase       bases[MAX_FORM_BASES];
+    FormIngredient ings[MAX_FORM_INGREDIENTS];
+    DiffLine       lines[MAX_COMPOUNDS + MAX_FORM_BASES + MAX_FORM_INGREDIENTS];
+    DiffSide       side;
+} DiffLoad;
+
+static int diff_load(DbContext* ctx, const char* flavor_code, Version v, DiffLoad* d)
+{
+    DiffSide* s = &d->side;
+    int nb = 0, ni = 0;
+    int i, rc;
+
+    rc = dbc_load_version(ctx, flavor_code, v.major, v.minor, v.patch, &d->f);
+    if (rc != 0) return rc;
+    rc = dbc_load_formulation_extras(ctx, flavor_code, v.major, v.minor, v.patch,
+                                     d->bases, &nb, d->ings, &ni);
+    if (rc != 0) return rc;
+
+    s->ver  = d->f.version;
+    s->ph   = d->f.target_ph;
+    s->brix = d->f.target_brix;
+    s->lines[DB_DIFF_COMPOUND]   = d->lines;
+    s->lines[DB_DIFF_BASE]       = d->lines + d->f.compound_count;
+    s->lines[DB_DIFF_INGREDIENT] = s->lines[DB_DIFF_BASE] + nb;
+    s->n[DB_DIFF_COMPOUND]   = d->f.compound_count;
+    s->n[DB_DIFF_BASE]       = nb;
+    s->n[DB_DIFF_INGREDIENT] = ni;
+
+    for (i = 0; i < d->f.compound_count; i++) {
+        const FormulaCompound* c = &d->f.compounds[i];
+        DiffLine* l = &s->lines[DB_DIFF_COMPOUND][i];
+        l->key     = compound_key(c->compound_library_id, c->name_id);
+        l->name_id = c->name_id;
+        l->unit_id = 0;
+        l->value   = c->concentration_ppm;
+    }
+    for (i = 0; i < nb; i++) {
+        DiffLine* l = &s->lines[DB_DIFF_BASE][i];
+        l->key     = d->bases[i].soda_base_id;
+        l->name_id = intern(d->bases[i].base_name);
+        l->unit_id = intern(d->bases[i].unit);
+        l->value   = d->bases[i].amount;
+    }
+    for (i = 0; i < ni; i++) {
+        DiffLine* l = &s->lines[DB_DIFF_INGREDIENT][i];
+        l->key     = d->ings[i].ingredient_id;
+        l->name_id = intern(d->ings[i].ingredient_name);
+        l->unit_id = intern(d->ings[i].unit);
+        l->value   = d->ings[i].amount;
+    }
+    for (i = DB_DIFF_COMPOUND; i <= DB_DIFF_INGREDIENT; i++)
+        qsort(s->lines[i], (size_t)s->n[i], sizeof(DiffLine), diff_line_cmp);
+    return 0;
+}
+
+int dbc_diff_versions(DbContext* ctx, const char* flavor_code, Version from, Version to,
+                      DbVersionDiff* out)
+{
+    DiffLoad* d;
+    int rc;
+
+    if (!ctx->db) return -1;
+    d = (DiffLoad*)calloc(2, sizeof(DiffLoad));
+    if (d == NULL) return -1;
+
+    rc = diff_load(ctx, flavor_code, from, &d[0]);
+    if (rc == 0) rc = diff_load(ctx, flavor_code, to, &d[1]);
+    if (rc == 0) diff_sides(out, &d[0].side, &d[1].side);
+
+    free(d);
+    if (rc == 1) return 1;
+    return rc == 0 ? 0 : -1;
+}
+
+/* =========================================================================
+   db_diff_history
+   Reads the flavor's version headers and all of their compound, base and
+   ingredient rows (four queries), rebuilds each version's compound list
+   from its delta chain in memory the way load_compounds does in SQL, and
+   merges every adjacent pair.
    ========================================================================= */
-int db_seed_compound_library(void)
+typedef struct {
+    sqlite3_int64 id;
+    sqlite3_int64 parent_id;
+    int           count;        /* compound_count                          */
+    int           state;        /* 0 = not rebuilt, 1 = in progress, 2 = done */
+    int           own, own_n;   /* its formulation_compounds rows in rows[] */
+    DiffSide      side;
+} HistVersion;
+
+typedef struct {
+    sqlite3_int64 id;
+    int           vi;           /* index into the HistVersion array */
+} HistId;
+
+typedef struct {
+    int      vi;
+    int      seq;               /* position, compound rows only */
+    DiffLine line;
+} HistRow;
+
+static int hist_id_cmp(const void* a, const void* b)
+{
+    sqlite3_int64 x = ((const HistId*)a)->id;
+    sqlite3_int64 y = ((const HistId*)b)->id;
+    return (x > y) - (x < y);
+}
+
+static int hist_row_cmp(const void* a, const void* b)
+{
+    const HistRow* x = (const HistRow*)a;
+    const HistRow* y = (const HistRow*)b;
+    if (x->vi != y->vi) return (x->vi > y->vi) - (x->vi < y->vi);
+    return diff_line_cmp(&x->line, &y->line);
+}
+
+static int hist_find(const HistId* ids, int n, sqlite3_int64 id)
 {
+    HistId key;
+    const HistId* hit;
+
+    key.id = id;
+    hit = (const HistId*)bsearch(&key, ids, (size_t)n, sizeof(HistId), hist_id_cmp);
+    return hit ? hit->vi : -1;
+}
 
+/* Read every row of stmt_id for flavor_code into *out, sorted by version
+   and key.  Returns the row count, negative on error. */
+static int hist_read(DbContext* ctx, int stmt_id, const char* flavor_code,
+                     const HistId* ids, int n, HistRow** out)
+{
     sqlite3_stmt* stmt = NULL;
+    HistRow* rows = NULL;
+    int count = 0, cap = 0;
     int rc;
+
+    *out = NULL;
+    rc = stmt_get(ctx, stmt_id, &stmt);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, flavor_code, -1, SQLITE_STATIC);
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        HistRow* r;
+        int vi = hist_find(ids, n, sqlite3_column_int64(stmt, 0));
+
+        if (vi < 0) continue;
+        if (count == cap) {
+            HistRow* grown;
+            cap = cap ? cap * 2 : 256;
+            grown = (HistRow*)realloc(rows, (size_t)cap * sizeof(HistRow));
+            if (grown == NULL) { rc = SQLITE_NOMEM; break; }
+            rows = grown;
+        }
+        r = &rows[count++];
+        r->vi = vi;
+        r->line.name_id = intern((const char*)sqlite3_column_text(stmt, 2));
+        r->line.value   = (float)sqlite3_column_double(stmt, 3);
+        if (stmt_id == STMT_DIFF_COMPOUNDS) {
+            r->seq          = sqlite3_column_int(stmt, 1);
+            r->line.key     = compound_key(sqlite3_column_int(stmt, 4), r->line.name_id);
+            r->line.unit_id = 0;
+        } else {
+            r->seq          = 0;
+            r->line.key     = sqlite3_column_int(stmt, 1);
+            r->line.unit_id = intern((const char*)sqlite3_column_text(stmt, 4));
+        }
+    }
+    stmt_done(stmt);
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Diff read error: %s\n", sqlite3_errmsg(ctx->db));
+        free(rows);
+        return -1;
+    }
+    qsort(rows, (size_t)count, sizeof(HistRow), hist_row_cmp);
+    *out = rows;
+    return count;
+}
+
+/* Lay version vi's compounds out by position: its parent's list, then
+   its own rows on top, cut to its compound_count */
+static void hist_build(HistVersion* hv, int vi, const HistId* ids, int n,
+                       const HistRow* rows)
+{
+    HistVersion* v = &hv[vi];
+    DiffLine*    l = v->side.lines[DB_DIFF_COMPOUND];
+    int i, p;
+
+    if (v->state != 0) return;          /* done, or a broken parent loop */
+    v->state = 1;
+
+    if (v->parent_id != 0 && (p = hist_find(ids, n, v->parent_id)) >= 0) {
+        int keep;
+        hist_build(hv, p, ids, n, rows);
+        keep = hv[p].side.n[DB_DIFF_COMPOUND];
+        if (keep > v->count) keep = v->count;
+        memcpy(l, hv[p].side.lines[DB_DIFF_COMPOUND], (size_t)keep * sizeof(DiffLine));
+    }
+    for (i = v->own; i < v->own + v->own_n; i++)
+        if (rows[i].seq >= 0 && rows[i].seq < v->count)
+            l[rows[i].seq] = rows[i].line;
+
+    v->side.n[DB_DIFF_COMPOUND] = v->count;
+    v->state = 2;
+}
+
+/* Point each version's side.lines[what] at its rows, copied to pool */
+static void hist_attach(HistVersion* hv, int what, const HistRow* rows, int count,
+                        DiffLine* pool)
+{
     int i;
-    int count;
 
-    rc = db_exec_simple("BEGIN;");
-    if (rc != SQLITE_OK) return rc;
+    for (i = 0; i < count; i++) {
+        HistVersion* v = &hv[rows[i].vi];
+        if (v->side.n[what] == 0) v->side.lines[what] = &pool[i];
+        v->side.n[what]++;
+        pool[i] = rows[i].line;
+    }
+}
 
-    rc = sqlite3_prepare_v2(g_db,
-        "INSERT OR IGNORE INTO compound_library "
-        "(compound_name, cas_number, fema_number, max_use_ppm, rec_min_ppm, "
-        " rec_max_ppm, molecular_weight, water_solubility, ph_stable_min, "
-        " ph_stable_max, odor_profile, storage_temp, "
-        " requires_solubilizer, requires_inert_atm, cost_per_gram) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
-        -1, &stmt, NULL);
+int dbc_diff_history(DbContext* ctx, const char* flavor_code, DbVersionDiff* out, int max)
+{
+    sqlite3_stmt* stmt = NULL;
+    HistVersion*  hv    = NULL;
+    HistId*       ids   = NULL;
+    HistRow*      rows[3] = { NULL, NULL, NULL };
+    DiffLine*     pool  = NULL;
+    int n = 0, cap = 0, total = 0;
+    int nrows[3];
+    int i, rc;
+
+    if (!ctx->db) return -1;
+
+    rc = stmt_get(ctx, STMT_DIFF_VERSIONS, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
-        db_exec_simple("ROLLBACK;");
-        return rc;
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, flavor_code, -1, SQLITE_STATIC);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        HistVersion* v;
+        if (n == cap) {
+            HistVersion* grown;
+            cap = cap ? cap * 2 : 64;
+            grown = (HistVersion*)realloc(hv, (size_t)cap * sizeof(HistVersion));
+            if (grown == NULL) { rc = SQLITE_NOMEM; break; }
+            hv = grown;
+        }
+        v = &hv[n++];
+        memset(v, 0, sizeof(*v));
+        v->id             = sqlite3_column_int64(stmt, 0);
+        v->parent_id      = sqlite3_column_int64(stmt, 1);
+        v->side.ver.major = sqlite3_column_int(stmt, 2);
+        v->side.ver.minor = sqlite3_column_int(stmt, 3);
+        v->side.ver.patch = sqlite3_column_int(stmt, 4);
+        v->side.ph        = (float)sqlite3_column_double(stmt, 5);
+        v->side.brix      = (float)sqlite3_column_double(stmt, 6);
+        v->count          = sqlite3_column_int(stmt, 7);
+        if (v->count < 0) v->count = 0;
+        if (v->count > MAX_COMPOUNDS) v->count = MAX_COMPOUNDS;
+        total += v->count;
+    }
+    stmt_done(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Diff read error: %s\n", sqlite3_errmsg(ctx->db));
+        free(hv);
+        return -1;
+    }
+    if (n < 2 || max <= 0) {
+        free(hv);
+        return n < 2 ? 0 : n - 1;
     }
 
-    for (i = 0; i < NCOMPOUNDS; i++) {
-        sqlite3_reset(stmt);
-        sqlite3_bind_text  (stmt,  1, compounds[i].compound_name,    -1, SQLITE_STATIC);
-        sqlite3_bind_text  (stmt,  2, compounds[i].cas_number,       -1, SQLITE_STATIC);
-        sqlite3_bind_int   (stmt,  3, compounds[i].fema_number);
-        sqlite3_bind_double(stmt,  4, (double)compounds[i].max_use_ppm);
-        sqlite3_bind_double(stmt,  5, (double)compounds[i].rec_min_ppm);
-        sqlite3_bind_double(stmt,  6, (double)compounds[i].rec_max_ppm);
-        sqlite3_bind_double(stmt,  7, (double)compounds[i].molecular_weight);
-        sqlite3_bind_double(stmt,  8, (double)compounds[i].water_solubility);
-        sqlite3_bind_double(stmt,  9, (double)compounds[i].ph_stable_min);
-        sqlite3_bind_double(stmt, 10, (double)compounds[i].ph_stable_max);
-        sqlite3_bind_text  (stmt, 11, compounds[i].odor_profile,     -1, SQLITE_STATIC);
-        sqlite3_bind_text  (stmt, 12, compounds[i].storage_temp,     -1, SQLITE_STATIC);
-        sqlite3_bind_int   (stmt, 13, compounds[i].requires_solubilizer);
-        sqlite3_bind_int   (stmt, 14, compounds[i].requires_inert_atm);
-        sqlite3_bind_double(stmt, 15, (double)compounds[i].cost_per_gram);
+    ids = (HistId*)malloc((size_t)n * sizeof(HistId));
+    if (ids == NULL) { free(hv); return -1; }
+    for (i = 0; i < n; i++) {
+        ids[i].id = hv[i].id;
+        ids[i].vi = i;
+    }
+    qsort(ids, (size_t)n, sizeof(HistId), hist_id_cmp);
 
-        rc = sqlite3_step(stmt);
-        if (rc != SQLITE_DONE) {
-            fprintf(stderr, "Seed insert error: %s\n", sqlite3_errmsg(g_db));
-            sqlite3_finalize(stmt);
-            db_exec_simple("ROLLBACK;");
-            return rc;
+    rc = 0;
+    nrows[0] = hist_read(ctx, STMT_DIFF_COMPOUNDS,   flavor_code, ids, n, &rows[0]);
+    nrows[1] = hist_read(ctx, STMT_DIFF_BASES,       flavor_code, ids, n, &rows[1]);
+    nrows[2] = hist_read(ctx, STMT_DIFF_INGREDIENTS, flavor_code, ids, n, &rows[2]);
+    if (nrows[0] < 0 || nrows[1] < 0 || nrows[2] < 0) rc = -1;
+
+    if (rc == 0) {
+        pool = (DiffLine*)calloc((size_t)(total + nrows[1] + nrows[2] + 1), sizeof(DiffLine));
+        if (pool == NULL) rc = -1;
+    }
+    if (rc == 0) {
+        DiffLine* next = pool;
+
+        for (i = 0; i < n; i++) {
+            hv[i].side.lines[DB_DIFF_COMPOUND] = next;
+            next += hv[i].count;
+        }
+        for (i = 0; i < nrows[0]; i++) {
+            HistVersion* v = &hv[rows[0][i].vi];
+            if (v->own_n == 0) v->own = i;
+            v->own_n++;
         }
+        for (i = 0; i < n; i++)
+            hist_build(hv, i, ids, n, rows[0]);
+        for (i = 0; i < n; i++)
+            qsort(hv[i].side.lines[DB_DIFF_COMPOUND], (size_t)hv[i].side.n[DB_DIFF_COMPOUND],
+                  sizeof(DiffLine), diff_line_cmp);
+
+        hist_attach(hv, DB_DIFF_BASE,       rows[1], nrows[1], next);
+        hist_attach(hv, DB_DIFF_INGREDIENT, rows[2], nrows[2], next + nrows[1]);
+
+        for (i = 0; i + 1 < n && i < max; i++)
+            diff_sides(&out[i], &hv[i].side, &hv[i + 1].side);
+        rc = n - 1;
     }
 
-    sqlite3_finalize(stmt);
-    stmt = NULL;
+    free(pool);
+    for (i = 0; i < 3; i++) free(rows[i]);
+    free(ids);
+    free(hv);
+    return rc;
+}
 
-    /* Set cost_per_gram only where it hasn't been set yet (cost == 0).
-       This preserves any user edits made after initial seeding. */
-    rc = sqlite3_prepare_v2(g_db,
-        "UPDATE compound_library SET cost_per_gram = ? "
-        "WHERE compound_name = ? AND cost_per_gram = 0;",
-        -1, &stmt, NULL);
-    if (rc == SQLITE_OK) {
-        for (i = 0; i < NCOMPOUNDS; i++) {
+/* =========================================================================
+   Seed data sync
+   The seed tables in compound_data.h are fingerprinted (FNV-1a over every
+   field) and the fingerprint is kept in app_settings.  When it matches,
+   startup does no seed work at all.  Otherwise each seed compound is
+   diffed against the cached library row and only new or changed rows are
+   written.  Reference columns belong to the seed; cost_per_gram is only
+   filled while still 0, and existing stock levels are never touched.
+   ========================================================================= */
+#define SEED_FINGERPRINT_KEY "seed_fingerprint"
+#define SEED_SYNC_FORMAT     1   /* bump to force one re-sync everywhere */
+
+static unsigned long long fnv_bytes(unsigned long long h, const void* p, size_t n)
+{
+    const unsigned char* b = (const unsigned char*)p;
+    while (n--) {
+        h ^= *b++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static unsigned long long fnv_str(unsigned long long h, const char* s)
+{
+    if (s == NULL) s = "";
+    return fnv_bytes(h, s, strlen(s) + 1);   /* keep the terminator */
+}
+
+static unsigned long long fnv_int(unsigned long long h, int v)
+{
+    return fnv_bytes(h, &v, sizeof(v));
+}
+
+static unsigned long long fnv_float(unsigned long long h, float v)
+{
+    return fnv_bytes(h, &v, sizeof(v));
+}
+
+static unsigned long long seed_fingerprint(void)
+{
+    unsigned long long h = 14695981039346656037ULL;
+    int i;
+
+    h = fnv_int(h, SEED_SYNC_FORMAT);
+
+    h = fnv_int(h, NCOMPOUNDS);
+    for (i = 0; i < NCOMPOUNDS; i++) {
+        h = fnv_str  (h, compounds[i].compound_name);
+        h = fnv_str  (h, compounds[i].cas_number);
+        h = fnv_int  (h, compounds[i].fema_number);
+        h = fnv_float(h, compounds[i].max_use_ppm);
+        h = fnv_float(h, compounds[i].rec_min_ppm);
+        h = fnv_float(h, compounds[i].rec_max_ppm);
+        h = fnv_float(h, compounds[i].molecular_weight);
+        h = fnv_float(h, compounds[i].water_solubility);
+        h = fnv_float(h, compounds[i].ph_stable_min);
+        h = fnv_float(h, compounds[i].ph_stable_max);
+        h = fnv_str  (h, compounds[i].odor_profile);
+        h = fnv_str  (h, compounds[i].storage_temp);
+        h = fnv_int  (h, compounds[i].requires_solubilizer);
+        h = fnv_int  (h, compounds[i].requires_inert_atm);
+        h = fnv_float(h, compounds[i].cost_per_gram);
+        h = fnv_str  (h, compounds[i].flavor_descriptors);
+        h = fnv_float(h, compounds[i].odor_threshold_ppm);
+        h = fnv_str  (h, compounds[i].applications);
+    }
+
+    h = fnv_int(h, NSEED_INVENTORY);
+    for (i = 0; i < NSEED_INVENTORY; i++) {
+        h = fnv_str  (h, seed_inventory[i].compound_name);
+        h = fnv_float(h, seed_inventory[i].stock_grams);
+        h = fnv_float(h, seed_inventory[i].reorder_grams);
+    }
+
+    h = fnv_int(h, NSEED_OILS);
+    for (i = 0; i < NSEED_OILS; i++)
+        h = fnv_str(h, seed_oils[i]);
+
+    return h;
+}
+
+static int seed_str_differs(const char* have, size_t cap, const char* want)
+{
+    return strncmp(have, want ? want : "", cap - 1) != 0;
+}
+
+/* 1 if the library row differs from seed compound i in a seed-owned column. */
+static int seed_compound_differs(const CompoundInfo* c, int i)
+{
+    return seed_str_differs(c->cas_number, sizeof(c->cas_number),
+                            compounds[i].cas_number)
+        || c->fema_number          != compounds[i].fema_number
+        || c->max_use_ppm          != compounds[i].max_use_ppm
+        || c->rec_min_ppm          != compounds[i].rec_min_ppm
+        || c->rec_max_ppm          != compounds[i].rec_max_ppm
+        || c->molecular_weight     != compounds[i].molecular_weight
+        || c->water_solubility     != compounds[i].water_solubility
+        || c->ph_stable_min        != compounds[i].ph_stable_min
+        || c->ph_stable_max        != compounds[i].ph_stable_max
+        || seed_str_differs(c->odor_profile, sizeof(c->odor_profile),
+                            compounds[i].odor_profile)
+        || seed_str_differs(c->storage_temp, sizeof(c->storage_temp),
+                            compounds[i].storage_temp)
+        || c->requires_solubilizer != compounds[i].requires_solubilizer
+        || c->requires_inert_atm   != compounds[i].requires_inert_atm
+        || seed_str_differs(c->flavor_descriptors, sizeof(c->flavor_descriptors),
+                            compounds[i].flavor_descriptors)
+        || c->odor_threshold_ppm   != compounds[i].odor_threshold_ppm
+        || seed_str_differs(c->applications, sizeof(c->applications),
+                            compounds[i].applications)
+        || (c->cost_per_gram == 0.0f && compounds[i].cost_per_gram != 0.0f);
+}
+
+/* Bind parameters 1-17 of the seed insert / update statements. */
+static void bind_seed_compound(sqlite3_stmt* stmt, int i)
+{
+    sqlite3_bind_text  (stmt,  1, compounds[i].cas_number,        -1, SQLITE_STATIC);
+    sqlite3_bind_int   (stmt,  2, compounds[i].fema_number);
+    sqlite3_bind_double(stmt,  3, (double)compounds[i].max_use_ppm);
+    sqlite3_bind_double(stmt,  4, (double)compounds[i].rec_min_ppm);
+    sqlite3_bind_double(stmt,  5, (double)compounds[i].rec_max_ppm);
+    sqlite3_bind_double(stmt,  6, (double)compounds[i].molecular_weight);
+    sqlite3_bind_double(stmt,  7, (double)compounds[i].water_solubility);
+    sqlite3_bind_double(stmt,  8, (double)compounds[i].ph_stable_min);
+    sqlite3_bind_double(stmt,  9, (double)compounds[i].ph_stable_max);
+    sqlite3_bind_text  (stmt, 10, compounds[i].odor_profile,      -1, SQLITE_STATIC);
+    sqlite3_bind_text  (stmt, 11, compounds[i].storage_temp,      -1, SQLITE_STATIC);
+    sqlite3_bind_int   (stmt, 12, compounds[i].requires_solubilizer);
+    sqlite3_bind_int   (stmt, 13, compounds[i].requires_inert_atm);
+    sqlite3_bind_text  (stmt, 14, compounds[i].flavor_descriptors, -1, SQLITE_STATIC);
+    sqlite3_bind_double(stmt, 15, (double)compounds[i].odor_threshold_ppm);
+    sqlite3_bind_text  (stmt, 16, compounds[i].applications,      -1, SQLITE_STATIC);
+    sqlite3_bind_double(stmt, 17, (double)compounds[i].cost_per_gram);
+}
+
+/* Insert new seed compounds and update changed ones.  Needs a loaded
+   compound cache; runs inside the caller's transaction. */
+static int seed_sync_compounds(DbContext* ctx, DbSeedSyncStats* st)
+{
+    sqlite3_stmt* ins = NULL;
+    sqlite3_stmt* upd = NULL;
+    int rc;
+    int i;
+
+    rc = sqlite3_prepare_v2(ctx->db,
+        "INSERT INTO compound_library "
+        "(cas_number, fema_number, max_use_ppm, rec_min_ppm, rec_max_ppm, "
+        " molecular_weight, water_solubility, ph_stable_min, ph_stable_max, "
+        " odor_profile, storage_temp, requires_solubilizer, requires_inert_atm, "
+        " flavor_descriptors, odor_threshold_ppm, applications, cost_per_gram, "
+        " compound_name) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
+        -1, &ins, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(ctx->db,
+            "UPDATE compound_library SET "
+            "    cas_number = ?1, fema_number = ?2, max_use_ppm = ?3, "
+            "    rec_min_ppm = ?4, rec_max_ppm = ?5, molecular_weight = ?6, "
+            "    water_solubility = ?7, ph_stable_min = ?8, ph_stable_max = ?9, "
+            "    odor_profile = ?10, storage_temp = ?11, "
+            "    requires_solubilizer = ?12, requires_inert_atm = ?13, "
+            "    flavor_descriptors = ?14, odor_threshold_ppm = ?15, "
+            "    applications = ?16, "
+            "    cost_per_gram = CASE WHEN cost_per_gram = 0 THEN ?17 "
+            "                         ELSE cost_per_gram END "
+            "WHERE id = ?18;",
+            -1, &upd, NULL);
+
+    for (i = 0; rc == SQLITE_OK && i < NCOMPOUNDS; i++) {
+        CachedCompound* e = cc_peek(ctx, compounds[i].compound_name);
+        sqlite3_stmt*   stmt;
+
+        if (e == NULL) {
+            stmt = ins;
+            sqlite3_reset(stmt);
+            bind_seed_compound(stmt, i);
+            sqlite3_bind_text(stmt, 18, compounds[i].compound_name, -1, SQLITE_STATIC);
+            st->compounds_added++;
+        } else if (seed_compound_differs(&e->info, i)) {
+            stmt = upd;
             sqlite3_reset(stmt);
-            sqlite3_bind_double(stmt, 1, (double)compounds[i].cost_per_gram);
-            sqlite3_bind_text  (stmt, 2, compounds[i].compound_name, -1, SQLITE_STATIC);
-            sqlite3_step(stmt);
+            bind_seed_compound(stmt, i);
+            sqlite3_bind_int(stmt, 18, e->info.id);
+            st->compounds_updated++;
+        } else {
+            continue;
         }
-        sqlite3_finalize(stmt);
-        stmt = NULL;
+
+        rc = sqlite3_step(stmt);
+        rc = (rc == SQLITE_DONE) ? SQLITE_OK : rc;
     }
 
-    /* Set flavor_descriptors and odor_threshold_ppm where not yet populated.
-       Idempotent: skips rows that already have data. */
-    rc = sqlite3_prepare_v2(g_db,
-        "UPDATE compound_library "
-        "SET flavor_descriptors = ?, odor_threshold_ppm = ? "
-        "WHERE compound_name = ? "
-        "  AND (flavor_descriptors IS NULL OR flavor_descriptors = '');",
+    if (rc != SQLITE_OK)
+        fprintf(stderr, "Seed compound error: %s\n", sqlite3_errmsg(ctx->db));
+    sqlite3_finalize(ins);
+    sqlite3_finalize(upd);
+    return rc;
+}
+
+/* Start tracking seed inventory compounds that are not tracked yet. */
+static int seed_sync_inventory(DbContext* ctx, DbSeedSyncStats* st)
+{
+    sqlite3_stmt* stmt = NULL;
+    int rc;
+    int i;
+
+    rc = sqlite3_prepare_v2(ctx->db,
+        "INSERT OR IGNORE INTO compound_inventory "
+        "(compound_library_id, stock_grams, reorder_threshold_grams) "
+        "SELECT id, ?, ? FROM compound_library WHERE compound_name = ?;",
         -1, &stmt, NULL);
-    if (rc == SQLITE_OK) {
-        for (i = 0; i < NCOMPOUNDS; i++) {
-            sqlite3_reset(stmt);
-            sqlite3_bind_text  (stmt, 1, compounds[i].flavor_descriptors, -1, SQLITE_STATIC);
-            sqlite3_bind_double(stmt, 2, (double)compounds[i].odor_threshold_ppm);
-            sqlite3_bind_text  (stmt, 3, compounds[i].compound_name, -1, SQLITE_STATIC);
-            sqlite3_step(stmt);
-        }
-        sqlite3_finalize(stmt);
-        stmt = NULL;
+
+    for (i = 0; rc == SQLITE_OK && i < NSEED_INVENTORY; i++) {
+        sqlite3_reset(stmt);
+        sqlite3_bind_double(stmt, 1, (double)seed_inventory[i].stock_grams);
+        sqlite3_bind_double(stmt, 2, (double)seed_inventory[i].reorder_grams);
+        sqlite3_bind_text  (stmt, 3, seed_inventory[i].compound_name, -1, SQLITE_STATIC);
+        rc = sqlite3_step(stmt);
+        rc = (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+        if (rc == SQLITE_OK) st->inventory_added += sqlite3_changes(ctx->db);
     }
 
-    /* Set applications where not yet populated. Idempotent. */
-    rc = sqlite3_prepare_v2(g_db,
-        "UPDATE compound_library SET applications = ? "
-        "WHERE compound_name = ? "
-        "  AND (applications IS NULL OR applications = '');",
+    if (rc != SQLITE_OK)
+        fprintf(stderr, "Inventory seed error: %s\n", sqlite3_errmsg(ctx->db));
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+static int seed_sync_oils(DbContext* ctx, DbSeedSyncStats* st)
+{
+    sqlite3_stmt* stmt = NULL;
+    int rc;
+    int i;
+
+    rc = sqlite3_prepare_v2(ctx->db,
+        "INSERT OR IGNORE INTO ingredients "
+        "(ingredient_name, category, unit, cost_per_unit) "
+        "VALUES (?, 'essential_oil', 'mL', 0.0);",
         -1, &stmt, NULL);
-    if (rc == SQLITE_OK) {
-        for (i = 0; i < NCOMPOUNDS; i++) {
-            sqlite3_reset(stmt);
-            sqlite3_bind_text(stmt, 1, compounds[i].applications, -1, SQLITE_STATIC);
-            sqlite3_bind_text(stmt, 2, compounds[i].compound_name, -1, SQLITE_STATIC);
-            sqlite3_step(stmt);
-        }
-        sqlite3_finalize(stmt);
-        stmt = NULL;
+
+    for (i = 0; rc == SQLITE_OK && i < NSEED_OILS; i++) {
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, seed_oils[i], -1, SQLITE_STATIC);
+        rc = sqlite3_step(stmt);
+        rc = (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+        if (rc == SQLITE_OK) st->oils_added += sqlite3_changes(ctx->db);
+    }
+
+    if (rc != SQLITE_OK)
+        fprintf(stderr, "EO seed error: %s\n", sqlite3_errmsg(ctx->db));
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+/* =========================================================================
+   db_sync_seed_data
+   ========================================================================= */
+int dbc_sync_seed_data(DbContext* ctx, DbSeedSyncStats* out)
+{
+    DbSeedSyncStats st;
+    sqlite3_stmt* stmt = NULL;
+    char   have[32];
+    char   want[32];
+    double t0 = timing_now_ms();
+    int    rc;
+
+    memset(&st, 0, sizeof(st));
+    snprintf(want, sizeof(want), "%016llx", seed_fingerprint());
+    dbc_get_setting(ctx, SEED_FINGERPRINT_KEY, have, sizeof(have));
+
+    if (strcmp(have, want) == 0) {
+        st.skipped    = 1;
+        st.elapsed_ms = timing_now_ms() - t0;
+        if (out) *out = st;
+        if (g_verbose)
+            printf("Seed data unchanged (%s); sync skipped.\n", want);
+        return 0;
+    }
+
+    /* The diff reads the current library from the compound cache */
+    rc = compound_cache_load(ctx);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Seed sync: compound cache load failed (%d).\n", rc);
+        return rc;
+    }
+
+    rc = db_exec_simple(ctx, "BEGIN IMMEDIATE;");
+    if (rc != SQLITE_OK) return rc;
+
+    rc = seed_sync_compounds(ctx, &st);
+    if (rc == SQLITE_OK) rc = seed_sync_inventory(ctx, &st);
+    if (rc == SQLITE_OK) rc = seed_sync_oils(ctx, &st);
+    if (rc == SQLITE_OK) rc = stmt_get(ctx, STMT_SET_SETTING, &stmt);
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, SEED_FINGERPRINT_KEY, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, want,                 -1, SQLITE_STATIC);
+        rc = sqlite3_step(stmt);
+        rc = (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+        stmt_done(stmt);
     }
 
-    rc = db_exec_simple("COMMIT;");
+    if (rc != SQLITE_OK) {
+        db_exec_simple(ctx, "ROLLBACK;");
+        compound_cache_free(ctx);   /* reloads lazily from the rolled-back state */
+        return rc;
+    }
+    rc = db_exec_simple(ctx, "COMMIT;");
     if (rc != SQLITE_OK) return rc;
 
-    /* Report total count in library */
-    {
-        sqlite3_stmt* cnt_stmt = NULL;
-        count = 0;
-        if (sqlite3_prepare_v2(g_db,
-                "SELECT COUNT(*) FROM compound_library;",
-                -1, &cnt_stmt, NULL) == SQLITE_OK) {
-            if (sqlite3_step(cnt_stmt) == SQLITE_ROW)
-                count = sqlite3_column_int(cnt_stmt, 0);
-            sqlite3_finalize(cnt_stmt);
-        }
+    if (st.compounds_added > 0 || st.compounds_updated > 0) {
+        rc = compound_cache_load(ctx);
+        if (rc != 0)
+            fprintf(stderr, "Compound cache load failed (%d); using SQL lookups.\n", rc);
     }
 
-    printf("Compound library: %d compounds seeded.\n", count);
+    st.elapsed_ms = timing_now_ms() - t0;
+    if (out) *out = st;
+    if (g_verbose)
+        printf("Seed sync: %d compound%s added, %d updated, "
+               "%d inventory row%s and %d oil%s added (%.1f ms).\n",
+               st.compounds_added, st.compounds_added == 1 ? "" : "s",
+               st.compounds_updated,
+               st.inventory_added, st.inventory_added == 1 ? "" : "s",
+               st.oils_added, st.oils_added == 1 ? "" : "s",
+               st.elapsed_ms);
     return 0;
 }
 
 /* =========================================================================
    db_add_compound
    ========================================================================= */
-int db_add_compound(const CompoundInfo* c)
+int dbc_add_compound(DbContext* ctx, const CompoundInfo* c)
 {
     sqlite3_stmt* stmt = NULL;
     int rc;
 
-    rc = sqlite3_prepare_v2(g_db,
-        "INSERT OR REPLACE INTO compound_library "
-        "(compound_name, cas_number, fema_number, max_use_ppm, rec_min_ppm, "
-        " rec_max_ppm, molecular_weight, water_solubility, ph_stable_min, "
-        " ph_stable_max, odor_profile, storage_temp, "
-        " requires_solubilizer, requires_inert_atm) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_ADD_COMPOUND, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
@@ -867,95 +4110,28 @@ int db_add_compound(const CompoundInfo* c)
     sqlite3_bind_int   (stmt, 14, c->requires_inert_atm);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    stmt_done(stmt);
+    if (rc == SQLITE_DONE)
+        cc_mark_stale(ctx, c->compound_name);
     return (rc == SQLITE_DONE) ? 0 : rc;
 }
 
 /* =========================================================================
    db_get_compound_by_name
    ========================================================================= */
-int db_get_compound_by_name(const char* name, CompoundInfo* c)
+int dbc_get_compound_by_name(DbContext* ctx, const char* name, CompoundInfo* c)
 {
-    sqlite3_stmt* stmt = NULL;
-    int rc;
-
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT id, compound_name, cas_number, fema_number, max_use_ppm, "
-        "       rec_min_ppm, rec_max_ppm, molecular_weight, water_solubility, "
-        "       ph_stable_min, ph_stable_max, odor_profile, storage_temp, "
-        "       requires_solubilizer, requires_inert_atm, cost_per_gram, "
-        "       flavor_descriptors, odor_threshold_ppm, applications "
-        "FROM compound_library WHERE compound_name = ?;",
-        -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
-        return rc;
-    }
-
-    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
-
-    rc = sqlite3_step(stmt);
-    if (rc == SQLITE_DONE) {
-        sqlite3_finalize(stmt);
-        return 1;  /* not found */
-    }
-    if (rc != SQLITE_ROW) {
-        fprintf(stderr, "Step error: %s\n", sqlite3_errmsg(g_db));
-        sqlite3_finalize(stmt);
-        return rc;
-    }
-
-    c->id = sqlite3_column_int(stmt, 0);
-
-    strncpy(c->compound_name, (const char*)sqlite3_column_text(stmt, 1), 127);
-    c->compound_name[127] = '\0';
-
-    strncpy(c->cas_number, (const char*)sqlite3_column_text(stmt, 2), 15);
-    c->cas_number[15] = '\0';
-
-    c->fema_number      = sqlite3_column_int   (stmt,  3);
-    c->max_use_ppm      = (float)sqlite3_column_double(stmt,  4);
-    c->rec_min_ppm      = (float)sqlite3_column_double(stmt,  5);
-    c->rec_max_ppm      = (float)sqlite3_column_double(stmt,  6);
-    c->molecular_weight = (float)sqlite3_column_double(stmt,  7);
-    c->water_solubility = (float)sqlite3_column_double(stmt,  8);
-    c->ph_stable_min    = (float)sqlite3_column_double(stmt,  9);
-    c->ph_stable_max    = (float)sqlite3_column_double(stmt, 10);
-
-    strncpy(c->odor_profile, (const char*)sqlite3_column_text(stmt, 11), 255);
-    c->odor_profile[255] = '\0';
-
-    strncpy(c->storage_temp, (const char*)sqlite3_column_text(stmt, 12), 15);
-    c->storage_temp[15] = '\0';
-
-    c->requires_solubilizer = sqlite3_column_int   (stmt, 13);
-    c->requires_inert_atm   = sqlite3_column_int   (stmt, 14);
-    c->cost_per_gram        = (float)sqlite3_column_double(stmt, 15);
+    CachedCompound* e = cc_find(ctx, name);
 
-    if (sqlite3_column_type(stmt, 16) != SQLITE_NULL) {
-        strncpy(c->flavor_descriptors,
-                (const char*)sqlite3_column_text(stmt, 16), 255);
-        c->flavor_descriptors[255] = '\0';
-    } else {
-        c->flavor_descriptors[0] = '\0';
-    }
-    c->odor_threshold_ppm = (float)sqlite3_column_double(stmt, 17);
-
-    if (sqlite3_column_type(stmt, 18) != SQLITE_NULL) {
-        strncpy(c->applications, (const char*)sqlite3_column_text(stmt, 18), 127);
-        c->applications[127] = '\0';
-    } else {
-        c->applications[0] = '\0';
-    }
-
-    sqlite3_finalize(stmt);
+    if (e == NULL) return 1;  /* not found */
+    *c = e->info;
     return 0;
 }
 
 /* =========================================================================
    db_list_compounds
    ========================================================================= */
-int db_list_compounds(void)
+int dbc_list_compounds(DbContext* ctx)
 {
     sqlite3_stmt* stmt = NULL;
     sqlite3_stmt* cnt_stmt = NULL;
@@ -963,7 +4139,7 @@ int db_list_compounds(void)
     int rc;
 
     /* Get total count for the header */
-    if (sqlite3_prepare_v2(g_db,
+    if (sqlite3_prepare_v2(ctx->db,
             "SELECT COUNT(*) FROM compound_library;",
             -1, &cnt_stmt, NULL) == SQLITE_OK) {
         if (sqlite3_step(cnt_stmt) == SQLITE_ROW)
@@ -971,13 +4147,13 @@ int db_list_compounds(void)
         sqlite3_finalize(cnt_stmt);
     }
 
-    rc = sqlite3_prepare_v2(g_db,
+    rc = sqlite3_prepare_v2(ctx->db,
         "SELECT compound_name, fema_number, max_use_ppm, rec_min_ppm, "
         "       rec_max_ppm, requires_solubilizer, odor_profile "
         "FROM compound_library ORDER BY compound_name ASC;",
         -1, &stmt, NULL);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
@@ -1019,16 +4195,14 @@ int db_list_compounds(void)
 /* =========================================================================
    db_set_compound_cost
    ========================================================================= */
-int db_set_compound_cost(const char* compound_name, float cost_per_gram)
+int dbc_set_compound_cost(DbContext* ctx, const char* compound_name, float cost_per_gram)
 {
     sqlite3_stmt* stmt = NULL;
     int rc;
 
-    rc = sqlite3_prepare_v2(g_db,
-        "UPDATE compound_library SET cost_per_gram = ? WHERE compound_name = ?;",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_SET_COMPOUND_COST, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
@@ -1036,49 +4210,236 @@ int db_set_compound_cost(const char* compound_name, float cost_per_gram)
     sqlite3_bind_text  (stmt, 2, compound_name, -1, SQLITE_STATIC);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    stmt_done(stmt);
 
     if (rc != SQLITE_DONE) {
-        fprintf(stderr, "Cost update error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Cost update error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
-    if (sqlite3_changes(g_db) == 0) {
+    if (sqlite3_changes(ctx->db) == 0) {
         fprintf(stderr, "Cost update: compound '%s' not found.\n", compound_name);
         return 1;
     }
 
-    printf("Cost updated: %s = $%.4f / g\n", compound_name, cost_per_gram);
+    {
+        CachedCompound* e = cc_find(ctx, compound_name);
+        if (e != NULL) e->info.cost_per_gram = cost_per_gram;
+    }
+
+    if (g_verbose)
+        printf("Cost updated: %s = $%.4f / g\n", compound_name, cost_per_gram);
     return 0;
 }
 
+/* =========================================================================
+   Application categories
+   With only APP_CATEGORY_COUNT bits there are few enough distinct masks
+   to test each one in C; the ones that qualify go to SQL as an IN list
+   and are looked up in idx_compound_library_app_mask.
+   ========================================================================= */
+int dbc_find_compounds_by_app(DbContext* ctx, unsigned int mask, int mode, int* ids, int max)
+{
+    sqlite3_stmt* stmt = NULL;
+    char          list[4 * (APP_ALL_MASK + 1) + 3];
+    int           len   = 0;
+    int           count = 0;
+    unsigned int  v;
+    int           rc;
+
+    mask &= APP_ALL_MASK;
+    list[len++] = '[';
+    for (v = 0; v <= APP_ALL_MASK; v++) {
+        int match = (mode == DB_APP_ALL) ? (v & mask) == mask
+                                         : (v & mask) != 0;
+        if (match)
+            len += sprintf(list + len, "%s%u", len > 1 ? "," : "", v);
+    }
+    list[len++] = ']';
+    list[len]   = '\0';
+
+    rc = stmt_get(ctx, STMT_COMPOUNDS_BY_APP, &stmt);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, list, len, SQLITE_STATIC);
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (count < max) ids[count] = sqlite3_column_int(stmt, 0);
+        count++;
+    }
+    stmt_done(stmt);
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Category lookup error: %s\n", sqlite3_errmsg(ctx->db));
+        return -1;
+    }
+    return count;
+}
+
+int dbc_count_compounds_by_app(DbContext* ctx, int counts[APP_CATEGORY_COUNT])
+{
+    sqlite3_stmt* stmt = NULL;
+    int           total = 0;
+    int           i, rc;
+
+    for (i = 0; i < APP_CATEGORY_COUNT; i++) counts[i] = 0;
+
+    rc = stmt_get(ctx, STMT_COUNT_BY_APP_MASK, &stmt);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
+        return -1;
+    }
+
+    /* One row per distinct mask; spread each group over its bits */
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        unsigned int mask = (unsigned int)sqlite3_column_int(stmt, 0);
+        int          n    = sqlite3_column_int(stmt, 1);
+
+        for (i = 0; i < APP_CATEGORY_COUNT; i++)
+            if (mask & (1u << i)) counts[i] += n;
+        total += n;
+    }
+    stmt_done(stmt);
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Category count error: %s\n", sqlite3_errmsg(ctx->db));
+        return -1;
+    }
+    return total;
+}
+
 /* =========================================================================
    db_validate_formulation
    ========================================================================= */
-int db_validate_formulation(const Formulation* f)
+int dbc_validate_formulation(DbContext* ctx, const Formulation* f)
 {
-    int violations = 0;
+    ValidationResult vr;
+    int violations;
     int i;
 
-    for (i = 0; i < f->compound_count; i++) {
-        float active_max = 0.0f;
-        int   src = db_get_active_limit(f->compounds[i].compound_name,
-                                        &active_max);
-        if (src >= 0 && active_max > 0.0f &&
-            f->compounds[i].concentration_ppm > active_max)
-        {
-            fprintf(stderr,
-                "  [SAFETY WARNING] %s: %.2f ppm exceeds %s limit %.2f ppm\n",
-                f->compounds[i].compound_name,
-                f->compounds[i].concentration_ppm,
-                src == 0 ? "regulatory override" : "library",
-                active_max);
-            violations++;
-        }
+    violations = dbc_check_formulation_limits(ctx, f, &vr);
+    for (i = 0; i < vr.count; i++) {
+        fprintf(stderr,
+            "  [SAFETY WARNING] %s: %.2f ppm exceeds %s limit %.2f ppm\n",
+            vr.items[i].compound_name,
+            vr.items[i].concentration_ppm,
+            vr.items[i].from_override ? "regulatory override" : "library",
+            vr.items[i].limit_ppm);
     }
     return violations;
 }
 
+/* =========================================================================
+   db_check_formulation_limits
+   Loads the compounds into temp.validate_input and resolves every active
+   limit with a single query, instead of two lookups per compound.
+   ========================================================================= */
+int dbc_check_formulation_limits(DbContext* ctx, const Formulation* f, ValidationResult* out)
+{
+    sqlite3_stmt* stmt = NULL;
+    int rc;
+    int i;
+
+    out->count = 0;
+    if (f->compound_count <= 0) return 0;
+
+    cc_poll_external(ctx);
+    /* Memory path: every compound is in the cache */
+    for (i = 0; i < f->compound_count; i++)
+        if (cc_resolve(ctx, f->compounds[i].compound_library_id,
+                       f->compounds[i].name_id) == NULL) break;
+    if (i == f->compound_count) {
+        for (i = 0; i < f->compound_count; i++) {
+            const FormulaCompound* fc = &f->compounds[i];
+            CachedCompound* e = cc_resolve(ctx, fc->compound_library_id, fc->name_id);
+            float limit_ppm;
+            int   src;
+            SafetyViolation* v;
+
+            if (e == NULL) continue;   /* cannot happen: checked above */
+            src = cc_active_limit(ctx, e, &limit_ppm);
+            if (src < 0) { out->count = 0; return -1; }
+            if (limit_ppm <= 0.0f || fc->concentration_ppm <= limit_ppm)
+                continue;
+
+            v = &out->items[out->count++];
+            strncpy(v->compound_name, intern_str(fc->name_id), sizeof(v->compound_name) - 1);
+            v->compound_name[sizeof(v->compound_name) - 1] = '\0';
+            v->concentration_ppm = fc->concentration_ppm;
+            v->limit_ppm         = limit_ppm;
+            v->from_override     = (src == 0);
+        }
+        return out->count;
+    }
+
+    /* SAVEPOINT works both inside and outside an open transaction */
+    rc = db_exec_simple(ctx, "SAVEPOINT validate;");
+    if (rc != SQLITE_OK) return -1;
+
+    rc = stmt_get(ctx, STMT_VALIDATE_CLEAR, &stmt);
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_step(stmt);
+        stmt_done(stmt);
+        rc = (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+    }
+
+    for (i = 0; rc == SQLITE_OK && i < f->compound_count; i++) {
+        CachedCompound* e = cc_resolve(ctx, f->compounds[i].compound_library_id,
+                                       f->compounds[i].name_id);
+        rc = stmt_get(ctx, STMT_VALIDATE_INSERT, &stmt);
+        if (rc != SQLITE_OK) break;
+        sqlite3_bind_int   (stmt, 1, i);
+        if (e != NULL)
+            sqlite3_bind_int(stmt, 2, e->info.id);
+        else
+            sqlite3_bind_null(stmt, 2);
+        sqlite3_bind_double(stmt, 3, (double)f->compounds[i].concentration_ppm);
+        rc = sqlite3_step(stmt);
+        stmt_done(stmt);
+        rc = (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+    }
+
+    if (rc == SQLITE_OK)
+        rc = stmt_get(ctx, STMT_VALIDATE_LIMITS, &stmt);
+    if (rc == SQLITE_OK) {
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            int   seq       = sqlite3_column_int(stmt, 0);
+            float limit_ppm = (float)sqlite3_column_double(stmt, 1);
+            const FormulaCompound* fc;
+            SafetyViolation*       v;
+
+            if (seq < 0 || seq >= f->compound_count) continue;
+            fc = &f->compounds[seq];
+
+            /* Compare as float, the same precision the limits are edited in */
+            if (limit_ppm <= 0.0f || fc->concentration_ppm <= limit_ppm)
+                continue;
+
+            v = &out->items[out->count++];
+            strncpy(v->compound_name, intern_str(fc->name_id), sizeof(v->compound_name) - 1);
+            v->compound_name[sizeof(v->compound_name) - 1] = '\0';
+            v->concentration_ppm = fc->concentration_ppm;
+            v->limit_ppm         = limit_ppm;
+            v->from_override     = sqlite3_column_int(stmt, 2);
+        }
+        stmt_done(stmt);
+        rc = (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+    }
+
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Validation error: %s\n", sqlite3_errmsg(ctx->db));
+        db_exec_simple(ctx, "ROLLBACK TO validate;");
+        db_exec_simple(ctx, "RELEASE validate;");
+        out->count = 0;
+        return -1;
+    }
+
+    db_exec_simple(ctx, "RELEASE validate;");
+    return out->count;
+}
+
 /* =========================================================================
    Private helper: bind a score that may be -1 (not scored) → NULL.
    ========================================================================= */
@@ -1093,22 +4454,18 @@ static void bind_score(sqlite3_stmt* stmt, int col, float score)
 /* =========================================================================
    db_save_tasting
    ========================================================================= */
-int db_save_tasting(const char* flavor_code,
-                    int major, int minor, int patch,
-                    TastingSession* ts)
+int dbc_save_tasting(DbContext* ctx, const char* flavor_code,
+                                     int major, int minor, int patch,
+                                     TastingSession* ts)
 {
     sqlite3_stmt* stmt = NULL;
     sqlite3_int64 formulation_id = 0;
     int rc;
 
     /* Look up the formulation's DB id */
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT id FROM formulations "
-        "WHERE flavor_code = ? "
-        "  AND ver_major = ? AND ver_minor = ? AND ver_patch = ?;",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_FIND_FORMULATION_ID, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
@@ -1119,29 +4476,24 @@ int db_save_tasting(const char* flavor_code,
 
     rc = sqlite3_step(stmt);
     if (rc == SQLITE_DONE) {
-        sqlite3_finalize(stmt);
+        stmt_done(stmt);
         fprintf(stderr, "Tasting: formulation %s v%d.%d.%d not found.\n",
                 flavor_code, major, minor, patch);
         return 1;
     }
     if (rc != SQLITE_ROW) {
-        fprintf(stderr, "Step error: %s\n", sqlite3_errmsg(g_db));
-        sqlite3_finalize(stmt);
+        fprintf(stderr, "Step error: %s\n", sqlite3_errmsg(ctx->db));
+        stmt_done(stmt);
         return rc;
     }
     formulation_id = sqlite3_column_int64(stmt, 0);
-    sqlite3_finalize(stmt);
+    stmt_done(stmt);
     stmt = NULL;
 
     /* Insert tasting session */
-    rc = sqlite3_prepare_v2(g_db,
-        "INSERT INTO tasting_sessions "
-        "(formulation_id, taster, overall_score, aroma_score, flavor_score, "
-        " mouthfeel_score, finish_score, sweetness_score, notes) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_INSERT_TASTING, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
@@ -1159,44 +4511,35 @@ int db_save_tasting(const char* flavor_code,
         sqlite3_bind_null(stmt, 9);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    stmt_done(stmt);
 
     if (rc != SQLITE_DONE) {
-        fprintf(stderr, "Tasting insert error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Tasting insert error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
-    ts->id             = (int)sqlite3_last_insert_rowid(g_db);
+    ts->id             = (int)sqlite3_last_insert_rowid(ctx->db);
     ts->formulation_id = (int)formulation_id;
 
-    printf("Tasting saved: %s v%d.%d.%d  taster=%s  overall=%.1f\n",
-           flavor_code, major, minor, patch,
-           ts->taster[0] ? ts->taster : "unknown",
-           ts->overall_score);
+    if (g_verbose)
+        printf("Tasting saved: %s v%d.%d.%d  taster=%s  overall=%.1f\n",
+               flavor_code, major, minor, patch,
+               ts->taster[0] ? ts->taster : "unknown",
+               ts->overall_score);
     return 0;
 }
 
 /* =========================================================================
    db_list_tastings_for_flavor
    ========================================================================= */
-int db_list_tastings_for_flavor(const char* flavor_code)
+int dbc_list_tastings_for_flavor(DbContext* ctx, const char* flavor_code)
 {
     sqlite3_stmt* stmt = NULL;
     int rc;
 
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT t.id, f.ver_major, f.ver_minor, f.ver_patch, "
-        "       t.taster, t.tasted_at, "
-        "       t.overall_score, t.aroma_score, t.flavor_score, "
-        "       t.mouthfeel_score, t.finish_score, t.sweetness_score, "
-        "       t.notes "
-        "FROM tasting_sessions t "
-        "JOIN formulations f ON f.id = t.formulation_id "
-        "WHERE f.flavor_code = ? "
-        "ORDER BY t.tasted_at ASC;",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_LIST_TASTINGS, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
@@ -1247,264 +4590,294 @@ int db_list_tastings_for_flavor(const char* flavor_code)
                notes);
     }
 
-    sqlite3_finalize(stmt);
+    stmt_done(stmt);
     printf("\n");
     return (rc == SQLITE_DONE) ? 0 : rc;
 }
 
 /* =========================================================================
-   db_get_avg_scores
+   Tasting aggregates
+   Reads of tasting_aggregates (see migrate_tasting_aggregates): columns
+   from first on are sessions, then n / sum / sumsq per score dimension.
    ========================================================================= */
-int db_get_avg_scores(const char* flavor_code)
+static void tasting_stats_from_row(sqlite3_stmt* stmt, int first, DbTastingStats* out)
+{
+    int i;
+
+    memset(out, 0, sizeof(*out));
+    out->sessions = (int)sqlite3_column_int64(stmt, first);
+    for (i = 0; i < DB_SCORE_DIMENSIONS; i++) {
+        int    col   = first + 1 + i * 3;
+        double n     = sqlite3_column_double(stmt, col);
+        double sum   = sqlite3_column_double(stmt, col + 1);
+        double sumsq = sqlite3_column_double(stmt, col + 2);
+        DbScoreStat* d = &out->score[i];
+
+        d->n = (int)n;
+        if (d->n > 0) d->mean = sum / n;
+        /* Sample variance; the subtraction can dip just below zero */
+        if (d->n > 1) {
+            d->variance = (sumsq - sum * sum / n) / (n - 1.0);
+            if (d->variance < 0.0) d->variance = 0.0;
+        }
+    }
+}
+
+int dbc_get_tasting_stats(DbContext* ctx, const char* flavor_code,
+                          int major, int minor, int patch, DbTastingStats* out)
 {
     sqlite3_stmt* stmt = NULL;
     int rc;
 
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT COUNT(*), "
-        "       AVG(t.overall_score), "
-        "       AVG(t.aroma_score), "
-        "       AVG(t.flavor_score), "
-        "       AVG(t.mouthfeel_score), "
-        "       AVG(t.finish_score), "
-        "       AVG(t.sweetness_score) "
-        "FROM tasting_sessions t "
-        "JOIN formulations f ON f.id = t.formulation_id "
-        "WHERE f.flavor_code = ?;",
-        -1, &stmt, NULL);
+    memset(out, 0, sizeof(*out));
+    rc = stmt_get(ctx, STMT_TASTING_AGG_VERSION, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
-        return rc;
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
+        return -1;
     }
-
     sqlite3_bind_text(stmt, 1, flavor_code, -1, SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 2, major);
+    sqlite3_bind_int (stmt, 3, minor);
+    sqlite3_bind_int (stmt, 4, patch);
 
     rc = sqlite3_step(stmt);
-    if (rc == SQLITE_ROW) {
-        int    n    = sqlite3_column_int(stmt, 0);
-        double ovrl = sqlite3_column_double(stmt, 1);
+    if (rc == SQLITE_ROW) tasting_stats_from_row(stmt, 1, out);
+    stmt_done(stmt);
 
-        printf("\n--- Avg Scores: %s  (%d session%s) ---\n",
-               flavor_code, n, n == 1 ? "" : "s");
+    if (rc == SQLITE_DONE) return 1;
+    return (rc == SQLITE_ROW) ? 0 : -1;
+}
 
-        if (n == 0) {
-            printf("  No tasting sessions recorded.\n");
-        } else {
-#define PRINT_AVG(label, col) \
-            if (sqlite3_column_type(stmt, (col)) == SQLITE_NULL) \
-                printf("  %-18s  --\n", (label)); \
-            else \
-                printf("  %-18s  %.2f / 10\n", (label), sqlite3_column_double(stmt, (col)))
-
-            printf("  %-18s  %.2f / 10\n", "Overall", ovrl);
-            PRINT_AVG("Aroma",     2);
-            PRINT_AVG("Flavor",    3);
-            PRINT_AVG("Mouthfeel", 4);
-            PRINT_AVG("Finish",    5);
-            PRINT_AVG("Sweetness", 6);
-#undef PRINT_AVG
-        }
-        printf("\n");
+int dbc_get_flavor_tasting_stats(DbContext* ctx, const char* flavor_code,
+                                 DbTastingStats* out)
+{
+    sqlite3_stmt* stmt = NULL;
+    int rc;
+
+    memset(out, 0, sizeof(*out));
+    rc = stmt_get(ctx, STMT_TASTING_AGG_FLAVOR, &stmt);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
+        return -1;
     }
+    sqlite3_bind_text(stmt, 1, flavor_code, -1, SQLITE_STATIC);
 
-    sqlite3_finalize(stmt);
-    return (rc == SQLITE_ROW || rc == SQLITE_DONE) ? 0 : rc;
-}
-
-/* =========================================================================
-   db_seed_inventory
-   INSERT OR IGNORE so user edits are preserved across restarts.
-   ========================================================================= */
-int db_seed_inventory(void)
-{
-    /* name, stock_grams, reorder_threshold_grams */
-    static const struct { const char* name; float stock; float reorder; } inv[] = {
-        { "Benzaldehyde",        50.0f,  10.0f },
-        { "Benzyl acetate",      25.0f,   5.0f },
-        { "Butyric acid",        10.0f,   2.0f },
-        { "Cinnamaldehyde",      50.0f,  10.0f },
-        { "Cyclotene",           15.0f,   3.0f },
-        { "Delta-decalactone",   20.0f,   5.0f },
-        { "Diacetyl",            10.0f,   2.0f },
-        { "Ethyl cinnamate",     15.0f,   3.0f },
-        { "Ethyl maltol",       100.0f,  20.0f },
-        { "Eugenol",             30.0f,   5.0f },
-        { "Furaneol",             5.0f,   1.0f },
-        { "Gamma-undecalactone", 15.0f,   3.0f },
-        { "Maltol",             100.0f,  20.0f },
-        { "Sotolon",              2.0f,   0.5f },
-        { "Vanillin",           200.0f,  40.0f },
-    };
-    static const int NCOMP = 15;
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) tasting_stats_from_row(stmt, 1, out);
+    stmt_done(stmt);
+    return (rc == SQLITE_ROW) ? 0 : -1;
+}
 
+/* Recompute into a temp table, count the stored rows that disagree, then
+   replace the table with the recomputed rows (which also clears the
+   rounding a long run of trigger updates leaves in the sums) */
+int dbc_rebuild_tasting_aggregates(DbContext* ctx, int* mismatches)
+{
     sqlite3_stmt* stmt = NULL;
-    int rc;
-    int i;
+    sqlite3_str*  q;
+    char* recompute;
+    char* sql;
+    int   i, bad = 0;
+    int   rc;
+
+    if (mismatches) *mismatches = 0;
+    recompute = agg_recompute_sql();
+    if (recompute == NULL) return SQLITE_NOMEM;
+    sql = sqlite3_mprintf(
+        "DROP TABLE IF EXISTS temp.tasting_agg_check;"
+        "CREATE TEMP TABLE tasting_agg_check AS %s;", recompute);
+    sqlite3_free(recompute);
+    if (sql == NULL) return SQLITE_NOMEM;
+
+    rc = db_exec_simple(ctx, "BEGIN IMMEDIATE;");
+    if (rc != SQLITE_OK) {
+        sqlite3_free(sql);
+        return rc;
+    }
+    rc = db_exec_simple(ctx, sql);
+    sqlite3_free(sql);
 
-    rc = db_exec_simple("BEGIN;");
-    if (rc != SQLITE_OK) return rc;
+    /* Counts must match exactly, sums to rounding.  A stored row with no
+       recomputed partner is only wrong if it still claims sessions. */
+    if (rc == SQLITE_OK) {
+        q = sqlite3_str_new(NULL);
+        sqlite3_str_appendall(q,
+            "SELECT (SELECT COUNT(*) FROM temp.tasting_agg_check c "
+            "        LEFT JOIN tasting_aggregates a "
+            "               ON a.formulation_id = c.formulation_id "
+            "        WHERE a.formulation_id IS NULL OR a.sessions <> c.sessions");
+        for (i = 0; i < DB_SCORE_DIMENSIONS; i++) {
+            const char* d = g_score_dims[i];
+            sqlite3_str_appendf(q,
+                " OR a.%s_n <> c.%s_n"
+                " OR ABS(a.%s_sum - c.%s_sum) > 1e-6 * MAX(1.0, ABS(c.%s_sum))"
+                " OR ABS(a.%s_sumsq - c.%s_sumsq) > 1e-6 * MAX(1.0, ABS(c.%s_sumsq))",
+                d, d, d, d, d, d, d, d);
+        }
+        sqlite3_str_appendall(q,
+            ") + (SELECT COUNT(*) FROM tasting_aggregates a "
+            "     WHERE a.sessions <> 0 AND a.formulation_id NOT IN "
+            "           (SELECT formulation_id FROM temp.tasting_agg_check));");
+        sql = sqlite3_str_finish(q);
+        rc = sql ? sqlite3_prepare_v2(ctx->db, sql, -1, &stmt, NULL) : SQLITE_NOMEM;
+        sqlite3_free(sql);
+        if (rc == SQLITE_OK) {
+            rc = sqlite3_step(stmt);
+            if (rc == SQLITE_ROW) {
+                bad = sqlite3_column_int(stmt, 0);
+                rc  = SQLITE_OK;
+            }
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    /* The WHERE keeps SQLite from truncating, which the update hook
+       would not see (change tracking) */
+    if (rc == SQLITE_OK)
+        rc = db_exec_simple(ctx,
+            "DELETE FROM tasting_aggregates WHERE formulation_id > 0;"
+            "INSERT INTO tasting_aggregates SELECT * FROM temp.tasting_agg_check;"
+            "DROP TABLE temp.tasting_agg_check;");
 
-    rc = sqlite3_prepare_v2(g_db,
-        "INSERT OR IGNORE INTO compound_inventory "
-        "(compound_library_id, stock_grams, reorder_threshold_grams) "
-        "SELECT id, ?, ? FROM compound_library WHERE compound_name = ?;",
-        -1, &stmt, NULL);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
-        db_exec_simple("ROLLBACK;");
+        fprintf(stderr, "Tasting aggregate rebuild error: %s\n", sqlite3_errmsg(ctx->db));
+        db_exec_simple(ctx, "ROLLBACK;");
         return rc;
     }
+    rc = db_exec_simple(ctx, "COMMIT;");
+    if (rc != SQLITE_OK) return rc;
 
-    for (i = 0; i < NCOMP; i++) {
-        sqlite3_reset(stmt);
-        sqlite3_bind_double(stmt, 1, (double)inv[i].stock);
-        sqlite3_bind_double(stmt, 2, (double)inv[i].reorder);
-        sqlite3_bind_text  (stmt, 3, inv[i].name, -1, SQLITE_STATIC);
-        rc = sqlite3_step(stmt);
-        if (rc != SQLITE_DONE) {
-            fprintf(stderr, "Inventory seed error: %s\n", sqlite3_errmsg(g_db));
-            sqlite3_finalize(stmt);
-            db_exec_simple("ROLLBACK;");
-            return rc;
+    if (mismatches) *mismatches = bad;
+    if (g_verbose)
+        printf("Tasting aggregates rebuilt: %d row%s differed\n", bad, bad == 1 ? "" : "s");
+    return 0;
+}
+
+/* =========================================================================
+   Sensory report
+   One pass over the sessions into a SensoryReport (sensory.c).
+   ========================================================================= */
+int dbc_sensory_report(DbContext* ctx, const char* flavor_code, double confidence,
+                       SensoryReport** out)
+{
+    sqlite3_stmt*  stmt = NULL;
+    SensoryReport* r;
+    SensoryRow     row;
+    Version        v;
+    int filtered = flavor_code && flavor_code[0];
+    int i, d, rc;
+
+    *out = NULL;
+    if (confidence <= 0.0 || confidence >= 1.0) confidence = SENSORY_DEFAULT_CONFIDENCE;
+    r = sensory_report_new();
+    if (r == NULL) return SQLITE_NOMEM;
+
+    rc = stmt_get(ctx, filtered ? STMT_SENSORY_SESSIONS_FLAVOR : STMT_SENSORY_SESSIONS_ALL,
+                  &stmt);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
+        sensory_report_free(r);
+        return -1;
+    }
+    if (filtered) sqlite3_bind_text(stmt, 1, flavor_code, -1, SQLITE_STATIC);
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        row.formulation_id = sqlite3_column_int(stmt, 0);
+        row.taster         = (const char*)sqlite3_column_text(stmt, 1);
+        for (d = 0; d < SENSORY_DIMENSIONS; d++)
+            row.score[d] = sqlite3_column_double(stmt, 2 + d);
+        if (sensory_report_add(r, &row) != 0) {
+            rc = SQLITE_NOMEM;
+            break;
+        }
+    }
+    stmt_done(stmt);
+    stmt = NULL;
+
+    if (rc == SQLITE_DONE) {
+        rc = stmt_get(ctx, STMT_SENSORY_VERSION, &stmt);
+        for (i = 0; rc == SQLITE_OK && i < sensory_version_count(r); i++) {
+            int id = sensory_version(r, i)->formulation_id;
+
+            sqlite3_bind_int(stmt, 1, id);
+            rc = sqlite3_step(stmt);
+            if (rc == SQLITE_ROW) {
+                v.major = sqlite3_column_int(stmt, 1);
+                v.minor = sqlite3_column_int(stmt, 2);
+                v.patch = sqlite3_column_int(stmt, 3);
+                sensory_report_set_version(r, id, (const char*)sqlite3_column_text(stmt, 0), v);
+            }
+            if (rc == SQLITE_ROW || rc == SQLITE_DONE) rc = SQLITE_OK;
+            sqlite3_reset(stmt);
         }
+        stmt_done(stmt);
+        if (rc == SQLITE_OK) rc = SQLITE_DONE;
     }
+    if (rc != SQLITE_DONE && rc != SQLITE_NOMEM)
+        fprintf(stderr, "Sensory report error: %s\n", sqlite3_errmsg(ctx->db));
 
-    sqlite3_finalize(stmt);
-    rc = db_exec_simple("COMMIT;");
-    if (rc != SQLITE_OK) return rc;
-
-    printf("Inventory seeded: %d compounds.\n", NCOMP);
+    if (rc == SQLITE_DONE && sensory_report_finish(r, confidence) != 0)
+        rc = SQLITE_NOMEM;
+    if (rc != SQLITE_DONE) {
+        sensory_report_free(r);
+        return -1;
+    }
+    *out = r;
     return 0;
 }
 
 /* =========================================================================
-   db_seed_essential_oils
-   INSERT OR IGNORE — idempotent, safe to call every startup.
-   ========================================================================= */
-int db_seed_essential_oils(void)
-{
-    static const char *oils[] = {
-        "Allspice Essential Oil",
-        "Anise Essential Oil",
-        "Basil Essential Oil",
-        "Bay Laurel Essential Oil",
-        "Bergamot Essential Oil",
-        "Black Pepper Essential Oil",
-        "Blood Orange Essential Oil",
-        "Cardamom Essential Oil",
-        "Caraway Essential Oil",
-        "Celery Seed Essential Oil",
-        "Chamomile (German) Essential Oil",
-        "Chamomile (Roman) Essential Oil",
-        "Cinnamon Bark Essential Oil",
-        "Cinnamon Leaf Essential Oil",
-        "Clove Bud Essential Oil",
-        "Cocoa Essential Oil",
-        "Coffee Essential Oil",
-        "Coriander Essential Oil",
-        "Cumin Essential Oil",
-        "Dill Essential Oil",
-        "Fennel (Sweet) Essential Oil",
-        "Frankincense Essential Oil",
-        "Geranium Essential Oil",
-        "Ginger Essential Oil",
-        "Grapefruit Essential Oil",
-        "Helichrysum Essential Oil",
-        "Jasmine Essential Oil",
-        "Lavender Essential Oil",
-        "Lemon Essential Oil",
-        "Lemongrass Essential Oil",
-        "Lime Essential Oil",
-        "Mandarin Essential Oil",
-        "Marjoram Essential Oil",
-        "Neroli Essential Oil",
-        "Nutmeg Essential Oil",
-        "Orange (Sweet) Essential Oil",
-        "Oregano Essential Oil",
-        "Palmarosa Essential Oil",
-        "Parsley Seed Essential Oil",
-        "Peppermint Essential Oil",
-        "Petitgrain Essential Oil",
-        "Rose Essential Oil",
-        "Rosemary Essential Oil",
-        "Sage Essential Oil",
-        "Spearmint Essential Oil",
-        "Star Anise Essential Oil",
-        "Tangerine Essential Oil",
-        "Tarragon Essential Oil",
-        "Thyme Essential Oil",
-        "Vanilla Essential Oil",
-        "Ylang Ylang Essential Oil",
-        "Yuzu Essential Oil"
+   db_get_avg_scores
+   ========================================================================= */
+int dbc_get_avg_scores(DbContext* ctx, const char* flavor_code)
+{
+    static const char* const labels[DB_SCORE_DIMENSIONS] = {
+        "Overall", "Aroma", "Flavor", "Mouthfeel", "Finish", "Sweetness"
     };
-    static const int NOILS = (int)(sizeof(oils) / sizeof(oils[0]));
-    sqlite3_stmt *stmt = NULL;
-    int           rc, i;
+    DbTastingStats st;
+    int i;
 
-    rc = db_exec_simple("BEGIN;");
-    if (rc != SQLITE_OK) return rc;
+    if (dbc_get_flavor_tasting_stats(ctx, flavor_code, &st) != 0) return -1;
 
-    rc = sqlite3_prepare_v2(g_db,
-        "INSERT OR IGNORE INTO ingredients "
-        "(ingredient_name, category, unit, cost_per_unit) "
-        "VALUES (?, 'essential_oil', 'mL', 0.0);",
-        -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "EO seed prepare: %s\n", sqlite3_errmsg(g_db));
-        db_exec_simple("ROLLBACK;");
-        return rc;
-    }
+    printf("\n--- Avg Scores: %s  (%d session%s) ---\n",
+           flavor_code, st.sessions, st.sessions == 1 ? "" : "s");
 
-    for (i = 0; i < NOILS; i++) {
-        sqlite3_reset(stmt);
-        sqlite3_bind_text(stmt, 1, oils[i], -1, SQLITE_STATIC);
-        rc = sqlite3_step(stmt);
-        if (rc != SQLITE_DONE) {
-            fprintf(stderr, "EO seed error: %s\n", sqlite3_errmsg(g_db));
-            sqlite3_finalize(stmt);
-            db_exec_simple("ROLLBACK;");
-            return rc;
+    if (st.sessions == 0) {
+        printf("  No tasting sessions recorded.\n");
+    } else {
+        for (i = 0; i < DB_SCORE_DIMENSIONS; i++) {
+            const DbScoreStat* d = &st.score[i];
+            if (d->n == 0)
+                printf("  %-18s  --\n", labels[i]);
+            else if (d->n == 1)
+                printf("  %-18s  %.2f / 10\n", labels[i], d->mean);
+            else
+                printf("  %-18s  %.2f / 10  (sd %.2f, n %d)\n",
+                       labels[i], d->mean, sqrt(d->variance), d->n);
         }
     }
-
-    sqlite3_finalize(stmt);
-    rc = db_exec_simple("COMMIT;");
-    if (rc != SQLITE_OK) return rc;
-
-    printf("Essential oils seeded: %d oils.\n", NOILS);
+    printf("\n");
     return 0;
 }
 
 /* =========================================================================
    db_cost_batch
    ========================================================================= */
-int db_cost_batch(BatchRun* br)
+int dbc_cost_batch(DbContext* ctx, BatchRun* br)
 {
-    sqlite3_stmt* stmt = NULL;
-    int rc;
     int i;
     float total = 0.0f;
     int   has_all_costs = 1;
 
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT cost_per_gram FROM compound_library WHERE compound_name = ?;",
-        -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
-        return rc;
-    }
-
+    cc_poll_external(ctx);
     for (i = 0; i < br->ingredient_count; i++) {
-        double cpg = 0.0;
-        sqlite3_reset(stmt);
-        sqlite3_bind_text(stmt, 1, br->ingredients[i].compound_name,
-                          -1, SQLITE_STATIC);
-        if (sqlite3_step(stmt) == SQLITE_ROW)
-            cpg = sqlite3_column_double(stmt, 0);
+        CachedCompound* e = cc_resolve(ctx, br->ingredients[i].compound_library_id,
+                                       br->ingredients[i].name_id);
+        float cpg = e ? e->info.cost_per_gram : 0.0f;
 
-        if (cpg > 0.0) {
+        if (cpg > 0.0f) {
             br->ingredients[i].cost_line =
-                br->ingredients[i].grams_needed * (float)cpg;
+                br->ingredients[i].grams_needed * cpg;
             total += br->ingredients[i].cost_line;
         } else {
             br->ingredients[i].cost_line = -1.0f;
@@ -1512,32 +4885,146 @@ int db_cost_batch(BatchRun* br)
         }
     }
 
-    sqlite3_finalize(stmt);
     br->cost_total = has_all_costs ? total : -1.0f;
     return 0;
 }
 
+/* =========================================================================
+   Batch numbers
+   batch_sequences holds the last number issued per (flavor_code, year).
+   db_save_batch takes the next one with STMT_BATCH_SEQ_NEXT inside its
+   own write transaction, so concurrent stations are serialized by the
+   database lock and a rolled-back save gives its number back.  The
+   app_settings key batch_number_format picks the layout (see
+   batch_format_number); unset means BATCH_NUMBER_FORMAT_DEFAULT.
+   ========================================================================= */
+#define BATCH_NUMBER_RETRIES 16   /* numbers taken already, e.g. by hand */
+
+static void batch_number_format(DbContext* ctx, char* fmt, int fmt_len)
+{
+    char probe[MAX_BATCH_NUMBER];
+
+    if (!dbc_get_setting(ctx, "batch_number_format", fmt, fmt_len) || fmt[0] == '\0') {
+        strncpy(fmt, BATCH_NUMBER_FORMAT_DEFAULT, fmt_len - 1);
+        fmt[fmt_len - 1] = '\0';
+    } else if (batch_format_number(fmt, "", 2026, 1, probe, sizeof(probe)) != 0) {
+        fprintf(stderr, "Invalid batch_number_format '%s', using default\n", fmt);
+        strncpy(fmt, BATCH_NUMBER_FORMAT_DEFAULT, fmt_len - 1);
+        fmt[fmt_len - 1] = '\0';
+    }
+}
+
+/* Format flavor_code's number for (year, seq); a layout too long for
+   this flavor code falls back to the default one, which always fits */
+static void batch_number_build(const char* fmt, const char* flavor_code,
+                               int year, int seq, char* out, int out_len)
+{
+    if (batch_format_number(fmt, flavor_code, year, seq, out, out_len) != 0)
+        batch_format_number(BATCH_NUMBER_FORMAT_DEFAULT, flavor_code, year, seq,
+                            out, out_len);
+}
+
+/* Reserve the next number.  Call inside a write transaction. */
+static int batch_number_next(DbContext* ctx, const char* flavor_code, const char* fmt,
+                             char* out, int out_len)
+{
+    sqlite3_stmt* stmt = NULL;
+    int year, seq;
+    int rc;
+
+    rc = stmt_get(ctx, STMT_BATCH_SEQ_NEXT, &stmt);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
+        return rc;
+    }
+    sqlite3_bind_text(stmt, 1, flavor_code, -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmt);
+    if (rc != SQLITE_ROW) {
+        fprintf(stderr, "Batch sequence error: %s\n", sqlite3_errmsg(ctx->db));
+        stmt_done(stmt);
+        return rc;
+    }
+    year = sqlite3_column_int(stmt, 0);
+    seq  = sqlite3_column_int(stmt, 1);
+    stmt_done(stmt);
+
+    batch_number_build(fmt, flavor_code, year, seq, out, out_len);
+    return SQLITE_OK;
+}
+
+int dbc_peek_batch_number(DbContext* ctx, const char* flavor_code,
+                          char* out, int out_len)
+{
+    sqlite3_stmt* stmt = NULL;
+    char fmt[MAX_BATCH_NUMBER * 2];
+    int year, seq;
+    int rc;
+
+    if (!ctx->db || out == NULL || out_len <= 0) return -1;
+    out[0] = '\0';
+    batch_number_format(ctx, fmt, sizeof(fmt));
+
+    rc = stmt_get(ctx, STMT_BATCH_SEQ_PEEK, &stmt);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
+        return rc;
+    }
+    sqlite3_bind_text(stmt, 1, flavor_code, -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmt);
+    if (rc != SQLITE_ROW) {
+        stmt_done(stmt);
+        return rc;
+    }
+    year = sqlite3_column_int(stmt, 0);
+    seq  = sqlite3_column_int(stmt, 1);
+    stmt_done(stmt);
+
+    batch_number_build(fmt, flavor_code, year, seq, out, out_len);
+    return 0;
+}
+
+int dbc_set_batch_number_format(DbContext* ctx, const char* fmt)
+{
+    char probe[MAX_BATCH_NUMBER];
+
+    if (!ctx->db || fmt == NULL) return -1;
+    if (strlen(fmt) >= MAX_BATCH_NUMBER * 2 ||
+        batch_format_number(fmt, "", 2026, 1, probe, sizeof(probe)) != 0) {
+        fprintf(stderr, "Invalid batch number format '%s'\n", fmt);
+        return -1;
+    }
+    dbc_set_setting(ctx, "batch_number_format", fmt);
+    return 0;
+}
+
+/* Roll back a failed save; an auto-generated number was not issued */
+static int save_batch_abort(DbContext* ctx, BatchRun* br, int auto_number, int rc)
+{
+    db_exec_simple(ctx, "ROLLBACK;");
+    if (auto_number) br->batch_number[0] = '\0';
+    return rc;
+}
+
 /* =========================================================================
    db_save_batch
    ========================================================================= */
-int db_save_batch(const char* flavor_code,
-                  int major, int minor, int patch,
-                  BatchRun* br)
+int dbc_save_batch(DbContext* ctx, const char* flavor_code,
+                                   int major, int minor, int patch,
+                                   BatchRun* br)
 {
     sqlite3_stmt* stmt = NULL;
     sqlite3_int64 formulation_id = 0;
     sqlite3_int64 batch_run_id   = 0;
+    char fmt[MAX_BATCH_NUMBER * 2];
+    int auto_number = !br->batch_number[0];
+    int attempt;
     int rc;
     int i;
 
     /* Look up formulation DB id */
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT id FROM formulations "
-        "WHERE flavor_code = ? "
-        "  AND ver_major = ? AND ver_minor = ? AND ver_patch = ?;",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_FIND_FORMULATION_ID, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
     sqlite3_bind_text(stmt, 1, flavor_code, -1, SQLITE_STATIC);
@@ -1547,89 +5034,79 @@ int db_save_batch(const char* flavor_code,
 
     rc = sqlite3_step(stmt);
     if (rc == SQLITE_DONE) {
-        sqlite3_finalize(stmt);
+        stmt_done(stmt);
         fprintf(stderr, "Batch: formulation %s v%d.%d.%d not found.\n",
                 flavor_code, major, minor, patch);
         return 1;
     }
     formulation_id = sqlite3_column_int64(stmt, 0);
-    sqlite3_finalize(stmt);
+    stmt_done(stmt);
     stmt = NULL;
 
-    /* Auto-generate batch_number if not set */
-    if (!br->batch_number[0]) {
-        int seq = 1;
-        rc = sqlite3_prepare_v2(g_db,
-            "SELECT COUNT(*) FROM batch_runs br "
-            "JOIN formulations f ON f.id = br.formulation_id "
-            "WHERE f.flavor_code = ?;",
-            -1, &stmt, NULL);
-        if (rc == SQLITE_OK) {
-            sqlite3_bind_text(stmt, 1, flavor_code, -1, SQLITE_STATIC);
-            if (sqlite3_step(stmt) == SQLITE_ROW)
-                seq = sqlite3_column_int(stmt, 0) + 1;
-            sqlite3_finalize(stmt);
-            stmt = NULL;
-        }
-        snprintf(br->batch_number, MAX_BATCH_NUMBER,
-                 "%s-2026-%03d", flavor_code, seq);
-    }
+    if (auto_number) batch_number_format(ctx, fmt, sizeof(fmt));
 
-    rc = db_exec_simple("BEGIN;");
+    /* IMMEDIATE: take the write lock before reading the sequence, so a
+       busy database makes this wait (busy timeout) rather than fail */
+    rc = db_exec_simple(ctx, "BEGIN IMMEDIATE;");
     if (rc != SQLITE_OK) return rc;
 
-    /* Insert batch_run header */
-    rc = sqlite3_prepare_v2(g_db,
-        "INSERT INTO batch_runs "
-        "(formulation_id, batch_number, volume_liters, cost_total, notes) "
-        "VALUES (?, ?, ?, ?, ?);",
-        -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
-        db_exec_simple("ROLLBACK;");
-        return rc;
-    }
+    /* Insert batch_run header, numbering it first if not set.  A number
+       already taken (entered by hand, or under an older format) is
+       skipped for the next one. */
+    for (attempt = 0; ; attempt++) {
+        if (auto_number) {
+            rc = batch_number_next(ctx, flavor_code, fmt,
+                                   br->batch_number, MAX_BATCH_NUMBER);
+            if (rc != SQLITE_OK) return save_batch_abort(ctx, br, auto_number, rc);
+        }
 
-    sqlite3_bind_int64(stmt, 1, formulation_id);
-    sqlite3_bind_text (stmt, 2, br->batch_number, -1, SQLITE_STATIC);
-    sqlite3_bind_double(stmt, 3, (double)br->volume_liters);
-    if (br->cost_total >= 0.0f)
-        sqlite3_bind_double(stmt, 4, (double)br->cost_total);
-    else
-        sqlite3_bind_null(stmt, 4);
-    if (br->notes[0])
-        sqlite3_bind_text(stmt, 5, br->notes, -1, SQLITE_STATIC);
-    else
-        sqlite3_bind_null(stmt, 5);
+        rc = stmt_get(ctx, STMT_INSERT_BATCH_RUN, &stmt);
+        if (rc != SQLITE_OK) {
+            fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
+            return save_batch_abort(ctx, br, auto_number, rc);
+        }
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    stmt = NULL;
+        sqlite3_bind_int64(stmt, 1, formulation_id);
+        sqlite3_bind_text (stmt, 2, br->batch_number, -1, SQLITE_STATIC);
+        sqlite3_bind_double(stmt, 3, (double)br->volume_liters);
+        if (br->cost_total >= 0.0f)
+            sqlite3_bind_double(stmt, 4, (double)br->cost_total);
+        else
+            sqlite3_bind_null(stmt, 4);
+        if (br->notes[0])
+            sqlite3_bind_text(stmt, 5, br->notes, -1, SQLITE_STATIC);
+        else
+            sqlite3_bind_null(stmt, 5);
 
-    if (rc != SQLITE_DONE) {
-        fprintf(stderr, "Batch run insert error: %s\n", sqlite3_errmsg(g_db));
-        db_exec_simple("ROLLBACK;");
-        return rc;
+        rc = sqlite3_step(stmt);
+        stmt_done(stmt);
+        stmt = NULL;
+
+        if (rc == SQLITE_DONE) break;
+        if (auto_number && attempt < BATCH_NUMBER_RETRIES &&
+            sqlite3_extended_errcode(ctx->db) == SQLITE_CONSTRAINT_UNIQUE)
+            continue;
+
+        fprintf(stderr, "Batch run insert error: %s\n", sqlite3_errmsg(ctx->db));
+        return save_batch_abort(ctx, br, auto_number, rc);
     }
 
-    batch_run_id = sqlite3_last_insert_rowid(g_db);
+    batch_run_id = sqlite3_last_insert_rowid(ctx->db);
 
     /* Insert batch_ingredients */
-    rc = sqlite3_prepare_v2(g_db,
-        "INSERT INTO batch_ingredients "
-        "(batch_run_id, compound_name, grams_needed, cost_line) "
-        "VALUES (?, ?, ?, ?);",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_INSERT_BATCH_INGREDIENT, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
-        db_exec_simple("ROLLBACK;");
-        return rc;
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
+        return save_batch_abort(ctx, br, auto_number, rc);
     }
 
+    cc_poll_external(ctx);
     for (i = 0; i < br->ingredient_count; i++) {
+        CachedCompound* e = cc_resolve(ctx, br->ingredients[i].compound_library_id,
+                                       br->ingredients[i].name_id);
         sqlite3_reset(stmt);
         sqlite3_bind_int64 (stmt, 1, batch_run_id);
-        sqlite3_bind_text  (stmt, 2, br->ingredients[i].compound_name,
+        sqlite3_bind_text  (stmt, 2, intern_str(br->ingredients[i].name_id),
                             -1, SQLITE_STATIC);
         sqlite3_bind_double(stmt, 3, (double)br->ingredients[i].grams_needed);
         if (br->ingredients[i].cost_line >= 0.0f)
@@ -1637,24 +5114,25 @@ int db_save_batch(const char* flavor_code,
                                 (double)br->ingredients[i].cost_line);
         else
             sqlite3_bind_null(stmt, 4);
+        if (e != NULL)
+            sqlite3_bind_int(stmt, 5, e->info.id);
+        else
+            sqlite3_bind_null(stmt, 5);
 
         rc = sqlite3_step(stmt);
         if (rc != SQLITE_DONE) {
             fprintf(stderr, "Ingredient insert error: %s\n",
-                    sqlite3_errmsg(g_db));
-            sqlite3_finalize(stmt);
-            db_exec_simple("ROLLBACK;");
-            return rc;
+                    sqlite3_errmsg(ctx->db));
+            stmt_done(stmt);
+            return save_batch_abort(ctx, br, auto_number, rc);
         }
     }
 
-    sqlite3_finalize(stmt);
+    stmt_done(stmt);
     stmt = NULL;
 
     /* Fetch batched_at back from DB */
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT batched_at FROM batch_runs WHERE id = ?;",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_BATCH_BATCHED_AT, &stmt);
     if (rc == SQLITE_OK) {
         sqlite3_bind_int64(stmt, 1, batch_run_id);
         if (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -1662,42 +5140,36 @@ int db_save_batch(const char* flavor_code,
                     (const char*)sqlite3_column_text(stmt, 0), 31);
             br->batched_at[31] = '\0';
         }
-        sqlite3_finalize(stmt);
+        stmt_done(stmt);
         stmt = NULL;
     }
 
-    rc = db_exec_simple("COMMIT;");
-    if (rc != SQLITE_OK) return rc;
+    rc = db_exec_simple(ctx, "COMMIT;");
+    if (rc != SQLITE_OK) return save_batch_abort(ctx, br, auto_number, rc);
 
     br->id             = (int)batch_run_id;
     br->formulation_id = (int)formulation_id;
 
-    printf("Batch saved: %s  %.1f L", br->batch_number, br->volume_liters);
-    if (br->cost_total >= 0.0f)
-        printf("  flavor cost $%.4f", br->cost_total);
-    printf("\n");
+    if (g_verbose) {
+        printf("Batch saved: %s  %.1f L", br->batch_number, br->volume_liters);
+        if (br->cost_total >= 0.0f)
+            printf("  flavor cost $%.4f", br->cost_total);
+        printf("\n");
+    }
     return 0;
 }
 
 /* =========================================================================
    db_list_batches
    ========================================================================= */
-int db_list_batches(const char* flavor_code)
+int dbc_list_batches(DbContext* ctx, const char* flavor_code)
 {
     sqlite3_stmt* stmt = NULL;
     int rc;
 
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT br.id, br.batch_number, "
-        "       f.ver_major, f.ver_minor, f.ver_patch, "
-        "       br.volume_liters, br.cost_total, br.batched_at "
-        "FROM batch_runs br "
-        "JOIN formulations f ON f.id = br.formulation_id "
-        "WHERE f.flavor_code = ? "
-        "ORDER BY br.batched_at ASC;",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_LIST_BATCHES, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
@@ -1719,114 +5191,400 @@ int db_list_batches(const char* flavor_code)
         char   cost[14];
         char   ver[10];
 
-        if (sqlite3_column_type(stmt, 6) == SQLITE_NULL)
-            strncpy(cost, "--", sizeof(cost));
-        else
-            snprintf(cost, sizeof(cost), "$%.4f", sqlite3_column_double(stmt, 6));
+        if (sqlite3_column_type(stmt, 6) == SQLITE_NULL)
+            strncpy(cost, "--", sizeof(cost));
+        else
+            snprintf(cost, sizeof(cost), "$%.4f", sqlite3_column_double(stmt, 6));
+
+        snprintf(ver, sizeof(ver), "%d.%d.%d", vmaj, vmin, vpat);
+
+        printf("%-4d | %-18s | %-7s | %8.2f | %-12s | %s\n",
+               id, bn ? bn : "", ver, vol, cost, bat ? bat : "");
+    }
+
+    stmt_done(stmt);
+    printf("\n");
+    return (rc == SQLITE_DONE) ? 0 : rc;
+}
+
+/* =========================================================================
+   Stock ledger
+   Every change to stock is a stock_movements row; the triggers from
+   migrate_stock_ledger keep compound_inventory.stock_grams and the
+   snapshots in step.  Nothing here updates stock_grams directly.
+   ========================================================================= */
+
+/* 1 if the compound has an inventory row (and so a ledger) */
+static int stock_is_tracked(DbContext* ctx, int compound_id)
+{
+    sqlite3_stmt* stmt = NULL;
+    int found = 0;
+
+    if (stmt_get(ctx, STMT_INVENTORY_STOCK, &stmt) != SQLITE_OK) return 0;
+    sqlite3_bind_int(stmt, 1, compound_id);
+    found = (sqlite3_step(stmt) == SQLITE_ROW);
+    stmt_done(stmt);
+    return found;
+}
+
+/* Append one movement.  Returns 0 or an SQLite error code. */
+static int stock_insert(DbContext* ctx, int compound_id, const char* kind,
+                        double delta, int reverses_id, const char* note)
+{
+    sqlite3_stmt* stmt = NULL;
+    int rc;
+
+    rc = stmt_get(ctx, STMT_STOCK_INSERT_MOVEMENT, &stmt);
+    if (rc != SQLITE_OK) return rc;
+    sqlite3_bind_int   (stmt, 1, compound_id);
+    sqlite3_bind_text  (stmt, 2, kind, -1, SQLITE_STATIC);
+    sqlite3_bind_double(stmt, 3, delta);
+    sqlite3_bind_null  (stmt, 4);
+    if (reverses_id > 0) sqlite3_bind_int(stmt, 5, reverses_id);
+    else                 sqlite3_bind_null(stmt, 5);
+    if (note != NULL && note[0] != '\0')
+        sqlite3_bind_text(stmt, 6, note, -1, SQLITE_STATIC);
+    else
+        sqlite3_bind_null(stmt, 6);
+    rc = sqlite3_step(stmt);
+    if (rc != SQLITE_DONE)
+        fprintf(stderr, "Stock movement error: %s\n", sqlite3_errmsg(ctx->db));
+    stmt_done(stmt);
+    return (rc == SQLITE_DONE) ? 0 : rc;
+}
+
+/* Balance of compound_id as of when (NULL = now).
+   Returns 0 and sets *out, 1 if it had no ledger yet, or an error code. */
+static int stock_at(DbContext* ctx, int compound_id, const char* when, double* out)
+{
+    sqlite3_stmt* stmt = NULL;
+    sqlite3_int64 last = 0;
+    int rc;
+
+    *out = 0.0;
+    rc = stmt_get(ctx, STMT_STOCK_LAST_AT, &stmt);
+    if (rc != SQLITE_OK) return rc;
+    sqlite3_bind_int (stmt, 1, compound_id);
+    sqlite3_bind_text(stmt, 2, when ? when : "9999-12-31", -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) last = sqlite3_column_int64(stmt, 0);
+    stmt_done(stmt);
+    if (rc == SQLITE_DONE) return 1;
+    if (rc != SQLITE_ROW)  return rc;
+
+    rc = stmt_get(ctx, STMT_STOCK_BALANCE_AT, &stmt);
+    if (rc != SQLITE_OK) return rc;
+    sqlite3_bind_int  (stmt, 1, compound_id);
+    sqlite3_bind_int64(stmt, 2, last);
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) *out = sqlite3_column_double(stmt, 0);
+    stmt_done(stmt);
+    /* Every ledger starts with a snapshotted 'opening' row */
+    if (rc == SQLITE_DONE) return 1;
+    return (rc == SQLITE_ROW) ? 0 : rc;
+}
+
+int dbc_receive_stock(DbContext* ctx, const char* compound_name, float grams,
+                      const char* note)
+{
+    CachedCompound* e = cc_find(ctx, compound_name);
+    sqlite3_stmt*   stmt = NULL;
+    int rc;
+
+    if (e == NULL) return 1;
+    if (grams <= 0.0f) return -1;
+
+    /* A compound received for the first time gets an inventory row;
+       its opening movement is 0 and the receipt follows */
+    rc = stmt_get(ctx, STMT_STOCK_ENSURE, &stmt);
+    if (rc != SQLITE_OK) return rc;
+    sqlite3_bind_int(stmt, 1, e->info.id);
+    rc = sqlite3_step(stmt);
+    stmt_done(stmt);
+    if (rc != SQLITE_DONE) return rc;
+
+    return stock_insert(ctx, e->info.id, "receipt", (double)grams, 0, note);
+}
+
+/* A count that matches the balance to the 4 decimals stock is shown
+   with, or to float precision, is no change: re-saving a displayed
+   value must not append rounding error to the ledger */
+#define STOCK_COUNT_EPSILON 0.00005
+
+int dbc_adjust_stock(DbContext* ctx, const char* compound_name, float counted_grams,
+                     const char* note)
+{
+    CachedCompound* e = cc_find(ctx, compound_name);
+    double have;
+    int rc;
+
+    if (e == NULL) return 1;
+    rc = stock_at(ctx, e->info.id, NULL, &have);
+    if (rc != 0) return rc;
+    if (fabs((double)counted_grams - have) < STOCK_COUNT_EPSILON + fabs(have) * FLT_EPSILON)
+        return 0;
+    return stock_insert(ctx, e->info.id, "adjust", (double)counted_grams - have, 0, note);
+}
+
+int dbc_set_reorder_threshold(DbContext* ctx, const char* compound_name, float grams)
+{
+    CachedCompound* e = cc_find(ctx, compound_name);
+    sqlite3_stmt*   stmt = NULL;
+    int rc;
+
+    if (e == NULL) return 1;
+    if (grams < 0.0f) return -1;
+    rc = stmt_get(ctx, STMT_STOCK_SET_THRESHOLD, &stmt);
+    if (rc != SQLITE_OK) return rc;
+    sqlite3_bind_double(stmt, 1, (double)grams);
+    sqlite3_bind_int   (stmt, 2, e->info.id);
+    rc = sqlite3_step(stmt);
+    if (rc != SQLITE_DONE)
+        fprintf(stderr, "Reorder threshold error: %s\n", sqlite3_errmsg(ctx->db));
+    stmt_done(stmt);
+    if (rc != SQLITE_DONE) return rc;
+    return sqlite3_changes(ctx->db) > 0 ? 0 : 1;
+}
+
+int dbc_stock_take(DbContext* ctx, const char* compound_name, float counted_grams,
+                   float reorder_threshold_grams, const char* note)
+{
+    int rc, rc2;
+
+    rc = db_exec_simple(ctx, "SAVEPOINT stock_take;");
+    if (rc != SQLITE_OK) return rc;
+    rc = dbc_adjust_stock(ctx, compound_name, counted_grams, note);
+    if (rc == 0)
+        rc = dbc_set_reorder_threshold(ctx, compound_name, reorder_threshold_grams);
+    if (rc != 0) {
+        db_exec_simple(ctx, "ROLLBACK TO stock_take;");
+        db_exec_simple(ctx, "RELEASE stock_take;");
+        return rc;
+    }
+    rc2 = db_exec_simple(ctx, "RELEASE stock_take;");
+    return (rc2 == SQLITE_OK) ? 0 : rc2;
+}
+
+int dbc_reverse_stock_movement(DbContext* ctx, int movement_id, const char* note)
+{
+    sqlite3_stmt* stmt = NULL;
+    char   kind[16] = "";
+    int    compound_id = 0, reversed = 0;
+    double delta = 0.0;
+    int    rc;
+
+    rc = stmt_get(ctx, STMT_STOCK_GET_MOVEMENT, &stmt);
+    if (rc != SQLITE_OK) return rc;
+    sqlite3_bind_int(stmt, 1, movement_id);
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        compound_id = sqlite3_column_int(stmt, 0);
+        strncpy(kind, (const char*)sqlite3_column_text(stmt, 1), sizeof(kind) - 1);
+        delta    = sqlite3_column_double(stmt, 2);
+        reversed = sqlite3_column_int(stmt, 3);
+    }
+    stmt_done(stmt);
+    if (rc != SQLITE_ROW) return (rc == SQLITE_DONE) ? 1 : rc;
+
+    /* An opening balance is corrected with an adjustment, and a reversal
+       with a fresh movement, never by stacking reversals */
+    if (reversed || strcmp(kind, "opening") == 0 || strcmp(kind, "reversal") == 0)
+        return 1;
+    return stock_insert(ctx, compound_id, "reversal", -delta, movement_id, note);
+}
+
+int dbc_get_stock(DbContext* ctx, const char* compound_name, const char* when,
+                  float* out_grams)
+{
+    CachedCompound* e = cc_find(ctx, compound_name);
+    double grams = 0.0;
+    int rc;
+
+    *out_grams = 0.0f;
+    if (e == NULL) return 1;
+    rc = stock_at(ctx, e->info.id, when, &grams);
+    if (rc == 0) *out_grams = (float)grams;
+    return rc;
+}
+
+int dbc_snapshot_stock(DbContext* ctx)
+{
+    int rc, n;
+
+    rc = db_exec_simple(ctx, "SAVEPOINT snapshot;");
+    if (rc != SQLITE_OK) return -rc;
+    rc = db_exec_simple(ctx,
+        "INSERT OR IGNORE INTO stock_snapshots "
+        "(compound_library_id, movement_id, balance_grams, taken_at) "
+        "SELECT ci.compound_library_id, "
+        "       (SELECT MAX(m.id) FROM stock_movements m "
+        "        WHERE m.compound_library_id = ci.compound_library_id), "
+        "       ci.stock_grams, DATETIME('now', 'localtime') "
+        "FROM compound_inventory ci WHERE ci.ledger_tail > 0;"
+    );
+    n = sqlite3_changes(ctx->db);
+    if (rc == SQLITE_OK)
+        rc = db_exec_simple(ctx,
+            "UPDATE compound_inventory SET ledger_tail = 0 WHERE ledger_tail > 0;");
+    if (rc != SQLITE_OK) {
+        db_exec_simple(ctx, "ROLLBACK TO snapshot;");
+        db_exec_simple(ctx, "RELEASE snapshot;");
+        return -rc;
+    }
+    rc = db_exec_simple(ctx, "RELEASE snapshot;");
+    return (rc == SQLITE_OK) ? n : -rc;
+}
+
+int dbc_list_stock_movements(DbContext* ctx, const char* compound_name)
+{
+    CachedCompound* e = cc_find(ctx, compound_name);
+    sqlite3_stmt*   stmt = NULL;
+    float           now = 0.0f;
+    int rc;
 
-        snprintf(ver, sizeof(ver), "%d.%d.%d", vmaj, vmin, vpat);
+    if (e == NULL) {
+        printf("Compound not found: %s\n", compound_name);
+        return 1;
+    }
+    rc = stmt_get(ctx, STMT_LIST_STOCK_MOVEMENTS, &stmt);
+    if (rc != SQLITE_OK) return rc;
+    sqlite3_bind_int(stmt, 1, e->info.id);
+
+    printf("\n=== Stock ledger: %s ===\n", compound_name);
+    printf("  %-6s %-19s  %-8s  %12s  %-16s  %s\n",
+           "ID", "When", "Kind", "Grams", "Batch", "Note");
+    printf("  %-6s %-19s  %-8s  %12s  %-16s  %s\n",
+           "------", "-------------------", "--------", "------------",
+           "----------------", "----");
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char* batch = (const char*)sqlite3_column_text(stmt, 4);
+        const char* note  = (const char*)sqlite3_column_text(stmt, 6);
+        char        ref[24] = "";
 
-        printf("%-4d | %-18s | %-7s | %8.2f | %-12s | %s\n",
-               id, bn ? bn : "", ver, vol, cost, bat ? bat : "");
+        if (sqlite3_column_type(stmt, 5) != SQLITE_NULL)
+            snprintf(ref, sizeof(ref), "undo #%d", sqlite3_column_int(stmt, 5));
+        printf("  %-6d %-19s  %-8s  %+12.4f  %-16s  %s\n",
+               sqlite3_column_int(stmt, 0),
+               (const char*)sqlite3_column_text(stmt, 1),
+               (const char*)sqlite3_column_text(stmt, 2),
+               sqlite3_column_double(stmt, 3),
+               batch ? batch : ref,
+               note ? note : "");
     }
+    stmt_done(stmt);
+    if (rc != SQLITE_DONE) return rc;
 
-    sqlite3_finalize(stmt);
-    printf("\n");
-    return (rc == SQLITE_DONE) ? 0 : rc;
+    dbc_get_stock(ctx, compound_name, NULL, &now);
+    printf("  Balance: %.4f g\n\n", now);
+    return 0;
 }
 
 /* =========================================================================
    db_check_inventory
    ========================================================================= */
-int db_check_inventory(const BatchRun* br)
+int dbc_check_inventory(DbContext* ctx, const BatchRun* br)
 {
     sqlite3_stmt* stmt = NULL;
     int rc;
     int i;
     int shortfalls = 0;
 
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT ci.stock_grams "
-        "FROM compound_inventory ci "
-        "JOIN compound_library cl ON cl.id = ci.compound_library_id "
-        "WHERE cl.compound_name = ?;",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_INVENTORY_STOCK, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
+    cc_poll_external(ctx);
     for (i = 0; i < br->ingredient_count; i++) {
+        CachedCompound* e = cc_resolve(ctx, br->ingredients[i].compound_library_id,
+                                       br->ingredients[i].name_id);
         double stock = 0.0;
         int    found = 0;
 
-        sqlite3_reset(stmt);
-        sqlite3_bind_text(stmt, 1, br->ingredients[i].compound_name,
-                          -1, SQLITE_STATIC);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            stock = sqlite3_column_double(stmt, 0);
-            found = 1;
+        if (e != NULL) {
+            sqlite3_reset(stmt);
+            sqlite3_bind_int(stmt, 1, e->info.id);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                stock = sqlite3_column_double(stmt, 0);
+                found = 1;
+            }
         }
 
         if (!found) {
-            printf("  [INVENTORY] %s: not tracked — add to inventory.\n",
-                   br->ingredients[i].compound_name);
+            if (g_verbose)
+                printf("  [INVENTORY] %s: not tracked — add to inventory.\n",
+                       intern_str(br->ingredients[i].name_id));
         } else if (stock < (double)br->ingredients[i].grams_needed) {
-            printf("  [LOW STOCK] %s: need %.4f g, have %.4f g (short %.4f g)\n",
-                   br->ingredients[i].compound_name,
-                   br->ingredients[i].grams_needed,
-                   stock,
-                   br->ingredients[i].grams_needed - (float)stock);
+            if (g_verbose)
+                printf("  [LOW STOCK] %s: need %.4f g, have %.4f g (short %.4f g)\n",
+                       intern_str(br->ingredients[i].name_id),
+                       br->ingredients[i].grams_needed,
+                       stock,
+                       br->ingredients[i].grams_needed - (float)stock);
             shortfalls++;
         }
     }
 
-    if (shortfalls == 0)
+    if (shortfalls == 0 && g_verbose)
         printf("  Inventory check: all compounds sufficient.\n");
 
-    sqlite3_finalize(stmt);
+    stmt_done(stmt);
     return shortfalls;
 }
 
 /* =========================================================================
    db_deduct_inventory
    ========================================================================= */
-int db_deduct_inventory(const BatchRun* br)
+int dbc_deduct_inventory(DbContext* ctx, const BatchRun* br)
 {
     sqlite3_stmt* stmt = NULL;
     int rc;
     int i;
 
-    rc = sqlite3_prepare_v2(g_db,
-        "UPDATE compound_inventory "
-        "SET stock_grams = MAX(0, stock_grams - ?), "
-        "    last_updated = DATETIME('now', 'localtime') "
-        "WHERE compound_library_id = "
-        "    (SELECT id FROM compound_library WHERE compound_name = ?);",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_STOCK_INSERT_MOVEMENT, &stmt);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
+        return rc;
+    }
+
+    /* All lines or none */
+    rc = db_exec_simple(ctx, "SAVEPOINT deduct;");
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        stmt_done(stmt);
         return rc;
     }
 
+    cc_poll_external(ctx);
     for (i = 0; i < br->ingredient_count; i++) {
+        CachedCompound* e = cc_resolve(ctx, br->ingredients[i].compound_library_id,
+                                       br->ingredients[i].name_id);
+        if (e == NULL) continue;   /* not a library compound: nothing stocked */
+        if (!stock_is_tracked(ctx, e->info.id)) continue;
         sqlite3_reset(stmt);
-        sqlite3_bind_double(stmt, 1,
-                            (double)br->ingredients[i].grams_needed);
-        sqlite3_bind_text  (stmt, 2,
-                            br->ingredients[i].compound_name,
-                            -1, SQLITE_STATIC);
+        sqlite3_bind_int   (stmt, 1, e->info.id);
+        sqlite3_bind_text  (stmt, 2, "consume", -1, SQLITE_STATIC);
+        sqlite3_bind_double(stmt, 3, -(double)br->ingredients[i].grams_needed);
+        if (br->id > 0) sqlite3_bind_int(stmt, 4, br->id);
+        else            sqlite3_bind_null(stmt, 4);
+        sqlite3_bind_null  (stmt, 5);
+        sqlite3_bind_text  (stmt, 6, br->batch_number, -1, SQLITE_STATIC);
         rc = sqlite3_step(stmt);
         if (rc != SQLITE_DONE) {
             fprintf(stderr, "Inventory deduct error: %s\n",
-                    sqlite3_errmsg(g_db));
-            sqlite3_finalize(stmt);
+                    sqlite3_errmsg(ctx->db));
+            stmt_done(stmt);
+            db_exec_simple(ctx, "ROLLBACK TO deduct;");
+            db_exec_simple(ctx, "RELEASE deduct;");
             return rc;
         }
     }
 
-    sqlite3_finalize(stmt);
-    printf("Inventory updated after batch %s.\n", br->batch_number);
+    stmt_done(stmt);
+    rc = db_exec_simple(ctx, "RELEASE deduct;");
+    if (rc != SQLITE_OK) return rc;
+    if (g_verbose)
+        printf("Inventory updated after batch %s.\n", br->batch_number);
     return 0;
 }
 
@@ -1835,60 +5593,33 @@ int db_deduct_inventory(const BatchRun* br)
    Returns 0 if regulatory override found, 1 if library fallback,
    negative on DB error.
    ========================================================================= */
-int db_get_active_limit(const char* compound_name, float* out_max_ppm)
+int dbc_get_active_limit(DbContext* ctx, const char* compound_name, float* out_max_ppm)
 {
-    sqlite3_stmt* stmt = NULL;
-    int rc;
-
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT max_use_ppm FROM regulatory_limits "
-        "WHERE compound_name = ? "
-        "ORDER BY effective_date DESC, id DESC LIMIT 1;",
-        -1, &stmt, NULL);
-    if (rc == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, compound_name, -1, SQLITE_STATIC);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            *out_max_ppm = (float)sqlite3_column_double(stmt, 0);
-            sqlite3_finalize(stmt);
-            return 0;  /* regulatory override found */
-        }
-        sqlite3_finalize(stmt);
-        stmt = NULL;
-    }
+    CachedCompound* e = cc_find(ctx, compound_name);
 
-    /* Fall back to compound_library */
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT max_use_ppm FROM compound_library WHERE compound_name = ?;",
-        -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return rc;
-    sqlite3_bind_text(stmt, 1, compound_name, -1, SQLITE_STATIC);
-    rc = sqlite3_step(stmt);
-    if (rc == SQLITE_ROW) {
-        *out_max_ppm = (float)sqlite3_column_double(stmt, 0);
-        sqlite3_finalize(stmt);
-        return 1;  /* library fallback */
+    /* Overrides are keyed by compound_library_id, so a name outside the
+       library has neither an override nor a library limit. */
+    if (e == NULL) {
+        *out_max_ppm = 0.0f;
+        return 1;
     }
-    sqlite3_finalize(stmt);
-    return (rc == SQLITE_DONE) ? 1 : rc;
+    return cc_active_limit(ctx, e, out_max_ppm);
 }
 
 /* =========================================================================
    db_add_regulatory_limit
    ========================================================================= */
-int db_add_regulatory_limit(const char* compound_name, const char* source,
-                            float max_use_ppm, const char* effective_date,
-                            const char* notes)
+int dbc_add_regulatory_limit(DbContext* ctx, const char* compound_name, const char* source,
+                                             float max_use_ppm, const char* effective_date,
+                                             const char* notes)
 {
     sqlite3_stmt* stmt = NULL;
+    CachedCompound* e = cc_find(ctx, compound_name);
     int rc;
 
-    rc = sqlite3_prepare_v2(g_db,
-        "INSERT INTO regulatory_limits "
-        "(compound_name, source, max_use_ppm, effective_date, notes) "
-        "VALUES (?, ?, ?, ?, ?);",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_INSERT_REG_LIMIT, &stmt);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
@@ -1900,27 +5631,33 @@ int db_add_regulatory_limit(const char* compound_name, const char* source,
         sqlite3_bind_text(stmt, 5, notes, -1, SQLITE_STATIC);
     else
         sqlite3_bind_null(stmt, 5);
+    if (e != NULL)
+        sqlite3_bind_int(stmt, 6, e->info.id);
+    else
+        sqlite3_bind_null(stmt, 6);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    stmt_done(stmt);
 
     if (rc != SQLITE_DONE) {
         fprintf(stderr, "Regulatory limit insert error: %s\n",
-                sqlite3_errmsg(g_db));
+                sqlite3_errmsg(ctx->db));
         return rc;
     }
+
+    if (e != NULL) e->limit_src = -1;
     return 0;
 }
 
 /* =========================================================================
    db_list_inventory
    ========================================================================= */
-int db_list_inventory(void)
+int dbc_list_inventory(DbContext* ctx)
 {
     sqlite3_stmt* stmt = NULL;
     int rc;
 
-    rc = sqlite3_prepare_v2(g_db,
+    rc = sqlite3_prepare_v2(ctx->db,
         "SELECT cl.compound_name, cl.cost_per_gram, "
         "       ci.stock_grams, ci.reorder_threshold_grams, ci.last_updated "
         "FROM compound_inventory ci "
@@ -1928,7 +5665,7 @@ int db_list_inventory(void)
         "ORDER BY cl.compound_name ASC;",
         -1, &stmt, NULL);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(g_db));
+        fprintf(stderr, "Prepare error: %s\n", sqlite3_errmsg(ctx->db));
         return rc;
     }
 
@@ -1970,15 +5707,13 @@ int db_list_inventory(void)
    Returns 1 if key found and value copied, 0 if not found.
    out_value is always NUL-terminated on return.
    ========================================================================= */
-int db_get_setting(const char *key, char *out_value, int out_len)
+int dbc_get_setting(DbContext* ctx, const char *key, char *out_value, int out_len)
 {
     sqlite3_stmt *stmt;
     int found = 0;
-    if (!g_db || !out_value || out_len <= 0) return 0;
+    if (!ctx->db || !out_value || out_len <= 0) return 0;
     out_value[0] = '\0';
-    if (sqlite3_prepare_v2(g_db,
-            "SELECT value FROM app_settings WHERE key = ?;",
-            -1, &stmt, NULL) != SQLITE_OK) return 0;
+    if (stmt_get(ctx, STMT_GET_SETTING, &stmt) != SQLITE_OK) return 0;
     sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         const char *v = (const char*)sqlite3_column_text(stmt, 0);
@@ -1988,799 +5723,1148 @@ int db_get_setting(const char *key, char *out_value, int out_len)
         }
         found = 1;
     }
+    stmt_done(stmt);
+    return found;
+}
+
+/* =========================================================================
+   db_set_setting
+   Upserts a key-value pair in app_settings.
+   ========================================================================= */
+void dbc_set_setting(DbContext* ctx, const char *key, const char *value)
+{
+    sqlite3_stmt *stmt;
+    if (!ctx->db) return;
+    if (stmt_get(ctx, STMT_SET_SETTING, &stmt) != SQLITE_OK) return;
+    sqlite3_bind_text(stmt, 1, key,            -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, value ? value : "", -1, SQLITE_STATIC);
+    sqlite3_step(stmt);
+    stmt_done(stmt);
+}
+
+/* =========================================================================
+   db_add_supplier
+   INSERT OR IGNORE — returns 0 on success, 1 if name already exists.
+   ========================================================================= */
+int dbc_add_supplier(DbContext* ctx, const char *name, const char *website,
+                                     const char *email, const char *phone, const char *notes)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+
+    if (!ctx->db) return -1;
+    rc = sqlite3_prepare_v2(ctx->db,
+        "INSERT OR IGNORE INTO suppliers "
+        "(supplier_name, website, email, phone, notes) "
+        "VALUES (?, ?, ?, ?, ?);",
+        -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return rc;
+
+    sqlite3_bind_text(stmt, 1, name,    -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, website ? website : "", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, email   ? email   : "", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, phone   ? phone   : "", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, notes   ? notes   : "", -1, SQLITE_STATIC);
+
+    sqlite3_step(stmt);
+    rc = (sqlite3_changes(ctx->db) == 1) ? 0 : 1;
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+/* =========================================================================
+   db_update_supplier
+   ========================================================================= */
+int dbc_update_supplier(DbContext* ctx, int id, const char *name, const char *website,
+                                        const char *email, const char *phone, const char *notes)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+
+    if (!ctx->db) return -1;
+    rc = sqlite3_prepare_v2(ctx->db,
+        "UPDATE suppliers "
+        "SET supplier_name=?, website=?, email=?, phone=?, notes=? "
+        "WHERE id=?;",
+        -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return rc;
+
+    sqlite3_bind_text(stmt, 1, name,    -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, website ? website : "", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, email   ? email   : "", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, phone   ? phone   : "", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, notes   ? notes   : "", -1, SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 6, id);
+
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+/* =========================================================================
+   db_delete_supplier
+   Deletes compound_suppliers rows then the supplier row in a transaction.
+   ========================================================================= */
+int dbc_delete_supplier(DbContext* ctx, int id)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+
+    if (!ctx->db) return -1;
+
+    rc = db_exec_simple(ctx, "BEGIN IMMEDIATE;");
+    if (rc != SQLITE_OK) return rc;
+
+    /* Remove linked compound rows first */
+    if (sqlite3_prepare_v2(ctx->db,
+            "DELETE FROM compound_suppliers WHERE supplier_id = ?;",
+            -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, id);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+
+    /* Remove supplier row */
+    if (sqlite3_prepare_v2(ctx->db,
+            "DELETE FROM suppliers WHERE id = ?;",
+            -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, id);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+
+    return db_exec_simple(ctx, "COMMIT;");
+}
+
+/* =========================================================================
+   db_add_compound_supplier
+   Returns 0=success, 1=compound not found, 2=link already exists.
+   ========================================================================= */
+int dbc_add_compound_supplier(DbContext* ctx, int supplier_id, const char *compound_name,
+                                              const char *catalog_number,
+                                              float price_per_gram, float min_order_grams,
+                                              int lead_time_days)
+{
+    sqlite3_stmt *stmt;
+    sqlite3_int64 cpd_id;
+    int rc;
+
+    if (!ctx->db) return -1;
+
+    cpd_id = lookup_compound_library_id(ctx, compound_name);
+    if (cpd_id == 0) return 1;
+
+    rc = stmt_get(ctx, STMT_INSERT_COMPOUND_SUPPLIER, &stmt);
+    if (rc != SQLITE_OK) return rc;
+
+    sqlite3_bind_int   (stmt, 1, supplier_id);
+    sqlite3_bind_int64 (stmt, 2, cpd_id);
+    sqlite3_bind_text  (stmt, 3, catalog_number ? catalog_number : "", -1, SQLITE_STATIC);
+    sqlite3_bind_double(stmt, 4, (double)price_per_gram);
+    sqlite3_bind_double(stmt, 5, (double)min_order_grams);
+    sqlite3_bind_int   (stmt, 6, lead_time_days);
+
+    sqlite3_step(stmt);
+    rc = (sqlite3_changes(ctx->db) == 1) ? 0 : 2;
+    stmt_done(stmt);
+    return rc;
+}
+
+/* =========================================================================
+   db_update_compound_supplier
+   ========================================================================= */
+int dbc_update_compound_supplier(DbContext* ctx, int cs_id, const char *catalog_number,
+                                                 float price_per_gram, float min_order_grams,
+                                                 int lead_time_days)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+
+    if (!ctx->db) return -1;
+    rc = sqlite3_prepare_v2(ctx->db,
+        "UPDATE compound_suppliers "
+        "SET catalog_number=?, price_per_gram=?, min_order_grams=?, lead_time_days=? "
+        "WHERE id=?;",
+        -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return rc;
+
+    sqlite3_bind_text  (stmt, 1, catalog_number ? catalog_number : "", -1, SQLITE_STATIC);
+    sqlite3_bind_double(stmt, 2, (double)price_per_gram);
+    sqlite3_bind_double(stmt, 3, (double)min_order_grams);
+    sqlite3_bind_int   (stmt, 4, lead_time_days);
+    sqlite3_bind_int   (stmt, 5, cs_id);
+
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+/* =========================================================================
+   db_remove_compound_supplier
+   ========================================================================= */
+int dbc_remove_compound_supplier(DbContext* ctx, int cs_id)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+
+    if (!ctx->db) return -1;
+    rc = sqlite3_prepare_v2(ctx->db,
+        "DELETE FROM compound_suppliers WHERE id=?;",
+        -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return rc;
+
+    sqlite3_bind_int(stmt, 1, cs_id);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+/* =========================================================================
+   db_add_ingredient
+   INSERT OR IGNORE — returns 0 on success, 1 if name already exists.
+   ========================================================================= */
+int dbc_add_ingredient(DbContext* ctx, const Ingredient *ing)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+
+    if (!ctx->db) return -1;
+    rc = sqlite3_prepare_v2(ctx->db,
+        "INSERT OR IGNORE INTO ingredients "
+        "(ingredient_name, category, unit, cost_per_unit, supplier_id, brand, notes) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?);",
+        -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return rc;
+
+    sqlite3_bind_text  (stmt, 1, ing->ingredient_name, -1, SQLITE_STATIC);
+    sqlite3_bind_text  (stmt, 2, ing->category,        -1, SQLITE_STATIC);
+    sqlite3_bind_text  (stmt, 3, ing->unit,             -1, SQLITE_STATIC);
+    sqlite3_bind_double(stmt, 4, (double)ing->cost_per_unit);
+    if (ing->supplier_id > 0)
+        sqlite3_bind_int(stmt, 5, ing->supplier_id);
+    else
+        sqlite3_bind_null(stmt, 5);
+    sqlite3_bind_text(stmt, 6, ing->brand[0] ? ing->brand : "", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 7, ing->notes[0] ? ing->notes : "", -1, SQLITE_STATIC);
+
+    sqlite3_step(stmt);
+    rc = (sqlite3_changes(ctx->db) == 1) ? 0 : 1;
     sqlite3_finalize(stmt);
-    return found;
+    return rc;
 }
 
 /* =========================================================================
-   db_set_setting
-   Upserts a key-value pair in app_settings.
+   db_update_ingredient
    ========================================================================= */
-void db_set_setting(const char *key, const char *value)
+int dbc_update_ingredient(DbContext* ctx, const Ingredient *ing)
 {
     sqlite3_stmt *stmt;
-    if (!g_db) return;
-    if (sqlite3_prepare_v2(g_db,
-            "INSERT OR REPLACE INTO app_settings (key, value) VALUES (?, ?);",
-            -1, &stmt, NULL) != SQLITE_OK) return;
-    sqlite3_bind_text(stmt, 1, key,            -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, value ? value : "", -1, SQLITE_STATIC);
+    int rc;
+
+    if (!ctx->db) return -1;
+    rc = sqlite3_prepare_v2(ctx->db,
+        "UPDATE ingredients "
+        "SET ingredient_name=?, category=?, unit=?, cost_per_unit=?, "
+        "    supplier_id=?, brand=?, notes=? "
+        "WHERE id=?;",
+        -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return rc;
+
+    sqlite3_bind_text  (stmt, 1, ing->ingredient_name, -1, SQLITE_STATIC);
+    sqlite3_bind_text  (stmt, 2, ing->category,        -1, SQLITE_STATIC);
+    sqlite3_bind_text  (stmt, 3, ing->unit,             -1, SQLITE_STATIC);
+    sqlite3_bind_double(stmt, 4, (double)ing->cost_per_unit);
+    if (ing->supplier_id > 0)
+        sqlite3_bind_int(stmt, 5, ing->supplier_id);
+    else
+        sqlite3_bind_null(stmt, 5);
+    sqlite3_bind_text(stmt, 6, ing->brand, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 7, ing->notes, -1, SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 8, ing->id);
+
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
+    return 0;
 }
 
 /* =========================================================================
-   db_add_supplier
-   INSERT OR IGNORE — returns 0 on success, 1 if name already exists.
+   db_delete_ingredient
+   Returns 0=ok, 1=in use, negative=DB error.
    ========================================================================= */
-int db_add_supplier(const char *name, const char *website,
-                    const char *email, const char *phone, const char *notes)
+int dbc_delete_ingredient(DbContext* ctx, int id)
 {
     sqlite3_stmt *stmt;
+    int count = 0;
     int rc;
 
-    if (!g_db) return -1;
-    rc = sqlite3_prepare_v2(g_db,
-        "INSERT OR IGNORE INTO suppliers "
-        "(supplier_name, website, email, phone, notes) "
-        "VALUES (?, ?, ?, ?, ?);",
+    if (!ctx->db) return -1;
+
+    if (sqlite3_prepare_v2(ctx->db,
+        "SELECT COUNT(*) FROM formulation_ingredients WHERE ingredient_id=?;",
+        -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, id);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            count += sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+
+    if (sqlite3_prepare_v2(ctx->db,
+        "SELECT COUNT(*) FROM soda_base_ingredients WHERE ingredient_id=?;",
+        -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, id);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            count += sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+
+    if (count > 0) return 1;
+
+    rc = sqlite3_prepare_v2(ctx->db,
+        "DELETE FROM ingredients WHERE id=?;",
         -1, &stmt, NULL);
     if (rc != SQLITE_OK) return rc;
 
-    sqlite3_bind_text(stmt, 1, name,    -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, website ? website : "", -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, email   ? email   : "", -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 4, phone   ? phone   : "", -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 5, notes   ? notes   : "", -1, SQLITE_STATIC);
-
+    sqlite3_bind_int(stmt, 1, id);
     sqlite3_step(stmt);
-    rc = (sqlite3_changes(g_db) == 1) ? 0 : 1;
     sqlite3_finalize(stmt);
-    return rc;
+    return 0;
 }
 
 /* =========================================================================
-   db_update_supplier
+   db_get_ingredient
+   Returns 0=found, 1=not found, negative=DB error.
    ========================================================================= */
-int db_update_supplier(int id, const char *name, const char *website,
-                       const char *email, const char *phone, const char *notes)
+int dbc_get_ingredient(DbContext* ctx, int id, Ingredient *out)
 {
     sqlite3_stmt *stmt;
     int rc;
+    const char *v;
 
-    if (!g_db) return -1;
-    rc = sqlite3_prepare_v2(g_db,
-        "UPDATE suppliers "
-        "SET supplier_name=?, website=?, email=?, phone=?, notes=? "
-        "WHERE id=?;",
-        -1, &stmt, NULL);
+    if (!ctx->db) return -1;
+    rc = stmt_get(ctx, STMT_GET_INGREDIENT, &stmt);
     if (rc != SQLITE_OK) return rc;
 
-    sqlite3_bind_text(stmt, 1, name,    -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, website ? website : "", -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, email   ? email   : "", -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 4, phone   ? phone   : "", -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 5, notes   ? notes   : "", -1, SQLITE_STATIC);
-    sqlite3_bind_int (stmt, 6, id);
+    sqlite3_bind_int(stmt, 1, id);
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_DONE) { stmt_done(stmt); return 1; }
+    if (rc != SQLITE_ROW)  { stmt_done(stmt); return rc; }
 
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    out->id = sqlite3_column_int(stmt, 0);
+
+    v = (const char *)sqlite3_column_text(stmt, 1);
+    strncpy(out->ingredient_name, v ? v : "", MAX_INGREDIENT_NAME - 1);
+    out->ingredient_name[MAX_INGREDIENT_NAME - 1] = '\0';
+
+    v = (const char *)sqlite3_column_text(stmt, 2);
+    strncpy(out->category, v ? v : "", MAX_INGREDIENT_CATEGORY - 1);
+    out->category[MAX_INGREDIENT_CATEGORY - 1] = '\0';
+
+    v = (const char *)sqlite3_column_text(stmt, 3);
+    strncpy(out->unit, v ? v : "g", MAX_INGREDIENT_UNIT - 1);
+    out->unit[MAX_INGREDIENT_UNIT - 1] = '\0';
+
+    out->cost_per_unit = (float)sqlite3_column_double(stmt, 4);
+    out->supplier_id   = sqlite3_column_int(stmt, 5);
+
+    v = (const char *)sqlite3_column_text(stmt, 6);
+    strncpy(out->brand, v ? v : "", MAX_INGREDIENT_BRAND - 1);
+    out->brand[MAX_INGREDIENT_BRAND - 1] = '\0';
+
+    v = (const char *)sqlite3_column_text(stmt, 7);
+    strncpy(out->notes, v ? v : "", 255);
+    out->notes[255] = '\0';
+
+    stmt_done(stmt);
     return 0;
 }
 
 /* =========================================================================
-   db_delete_supplier
-   Deletes compound_suppliers rows then the supplier row in a transaction.
+   db_save_soda_base
+   Returns 0=ok, -1=version conflict, negative=DB error.
    ========================================================================= */
-int db_delete_supplier(int id)
+int dbc_save_soda_base(DbContext* ctx, const SodaBase *sb)
 {
     sqlite3_stmt *stmt;
+    sqlite3_int64 base_id;
     int rc;
+    int i;
 
-    if (!g_db) return -1;
+    if (!ctx->db) return -1;
 
-    rc = db_exec_simple("BEGIN;");
+    rc = db_exec_simple(ctx, "BEGIN IMMEDIATE;");
     if (rc != SQLITE_OK) return rc;
 
-    /* Remove linked compound rows first */
-    if (sqlite3_prepare_v2(g_db,
-            "DELETE FROM compound_suppliers WHERE supplier_id = ?;",
-            -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_int(stmt, 1, id);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
+    rc = stmt_get(ctx, STMT_INSERT_SODA_BASE, &stmt);
+    if (rc != SQLITE_OK) { db_exec_simple(ctx, "ROLLBACK;"); return rc; }
+
+    sqlite3_bind_text  (stmt, 1, sb->base_code,    -1, SQLITE_STATIC);
+    sqlite3_bind_text  (stmt, 2, sb->base_name,    -1, SQLITE_STATIC);
+    sqlite3_bind_int   (stmt, 3, sb->version.major);
+    sqlite3_bind_int   (stmt, 4, sb->version.minor);
+    sqlite3_bind_int   (stmt, 5, sb->version.patch);
+    sqlite3_bind_double(stmt, 6, (double)sb->yield_liters);
+    if (sb->notes[0])
+        sqlite3_bind_text(stmt, 7, sb->notes, -1, SQLITE_STATIC);
+    else
+        sqlite3_bind_null(stmt, 7);
+
+    rc = sqlite3_step(stmt);
+    stmt_done(stmt);
+    stmt = NULL;
+
+    if (rc == SQLITE_CONSTRAINT) { db_exec_simple(ctx, "ROLLBACK;"); return -1; }
+    if (rc != SQLITE_DONE) { db_exec_simple(ctx, "ROLLBACK;"); return rc; }
+
+    base_id = sqlite3_last_insert_rowid(ctx->db);
+
+    if (sb->compound_count > 0) {
+        rc = stmt_get(ctx, STMT_INSERT_BASE_COMPOUND, &stmt);
+        if (rc != SQLITE_OK) { db_exec_simple(ctx, "ROLLBACK;"); return rc; }
+
+        cc_poll_external(ctx);
+        for (i = 0; i < sb->compound_count; i++) {
+            CachedCompound* e = cc_resolve(ctx, sb->compounds[i].compound_library_id,
+                                           sb->compounds[i].name_id);
+            sqlite3_int64 lib_id = e ? e->info.id : 0;
+            sqlite3_reset(stmt);
+            sqlite3_bind_int64 (stmt, 1, base_id);
+            sqlite3_bind_text  (stmt, 2, intern_str(sb->compounds[i].name_id), -1, SQLITE_STATIC);
+            sqlite3_bind_double(stmt, 3, (double)sb->compounds[i].concentration_ppm);
+            if (lib_id > 0) sqlite3_bind_int64(stmt, 4, lib_id);
+            else            sqlite3_bind_null(stmt, 4);
+            rc = sqlite3_step(stmt);
+            if (rc != SQLITE_DONE) {
+                stmt_done(stmt);
+                db_exec_simple(ctx, "ROLLBACK;");
+                return rc;
+            }
+        }
+        stmt_done(stmt);
+        stmt = NULL;
     }
 
-    /* Remove supplier row */
-    if (sqlite3_prepare_v2(g_db,
-            "DELETE FROM suppliers WHERE id = ?;",
-            -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_int(stmt, 1, id);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
+    if (sb->ingredient_count > 0) {
+        rc = stmt_get(ctx, STMT_INSERT_BASE_INGREDIENT, &stmt);
+        if (rc != SQLITE_OK) { db_exec_simple(ctx, "ROLLBACK;"); return rc; }
+
+        for (i = 0; i < sb->ingredient_count; i++) {
+            sqlite3_reset(stmt);
+            sqlite3_bind_int64 (stmt, 1, base_id);
+            sqlite3_bind_int   (stmt, 2, sb->ingredients[i].ingredient_id);
+            sqlite3_bind_double(stmt, 3, (double)sb->ingredients[i].amount);
+            sqlite3_bind_text  (stmt, 4, sb->ingredients[i].unit, -1, SQLITE_STATIC);
+            rc = sqlite3_step(stmt);
+            if (rc != SQLITE_DONE) {
+                stmt_done(stmt);
+                db_exec_simple(ctx, "ROLLBACK;");
+                return rc;
+            }
+        }
+        stmt_done(stmt);
     }
 
-    return db_exec_simple("COMMIT;");
+    return db_exec_simple(ctx, "COMMIT;");
 }
 
 /* =========================================================================
-   db_add_compound_supplier
-   Returns 0=success, 1=compound not found, 2=link already exists.
+   db_load_latest_base
+   Returns 0=ok, 1=not found, negative=DB error.
    ========================================================================= */
-int db_add_compound_supplier(int supplier_id, const char *compound_name,
-                             const char *catalog_number,
-                             float price_per_gram, float min_order_grams,
-                             int lead_time_days)
+int dbc_load_latest_base(DbContext* ctx, const char *base_code, SodaBase *sb)
 {
     sqlite3_stmt *stmt;
-    sqlite3_int64 cpd_id;
+    sqlite3_int64 base_id;
     int rc;
+    int i;
+    const char *v;
 
-    if (!g_db) return -1;
-
-    cpd_id = lookup_compound_library_id(compound_name);
-    if (cpd_id == 0) return 1;
+    if (!ctx->db) return -1;
 
-    rc = sqlite3_prepare_v2(g_db,
-        "INSERT OR IGNORE INTO compound_suppliers "
-        "(supplier_id, compound_library_id, catalog_number, "
-        " price_per_gram, min_order_grams, lead_time_days) "
-        "VALUES (?, ?, ?, ?, ?, ?);",
-        -1, &stmt, NULL);
+    rc = stmt_get(ctx, STMT_LOAD_LATEST_BASE, &stmt);
     if (rc != SQLITE_OK) return rc;
 
-    sqlite3_bind_int   (stmt, 1, supplier_id);
-    sqlite3_bind_int64 (stmt, 2, cpd_id);
-    sqlite3_bind_text  (stmt, 3, catalog_number ? catalog_number : "", -1, SQLITE_STATIC);
-    sqlite3_bind_double(stmt, 4, (double)price_per_gram);
-    sqlite3_bind_double(stmt, 5, (double)min_order_grams);
-    sqlite3_bind_int   (stmt, 6, lead_time_days);
+    sqlite3_bind_text(stmt, 1, base_code, -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_DONE) { stmt_done(stmt); return 1; }
+    if (rc != SQLITE_ROW)  { stmt_done(stmt); return rc; }
 
-    sqlite3_step(stmt);
-    rc = (sqlite3_changes(g_db) == 1) ? 0 : 2;
-    sqlite3_finalize(stmt);
-    return rc;
+    base_id = sqlite3_column_int64(stmt, 0);
+    sb->id  = (int)base_id;
+
+    v = (const char *)sqlite3_column_text(stmt, 1);
+    strncpy(sb->base_code, v ? v : "", MAX_BASE_CODE - 1);
+    sb->base_code[MAX_BASE_CODE - 1] = '\0';
+
+    v = (const char *)sqlite3_column_text(stmt, 2);
+    strncpy(sb->base_name, v ? v : "", MAX_BASE_NAME - 1);
+    sb->base_name[MAX_BASE_NAME - 1] = '\0';
+
+    sb->version.major = sqlite3_column_int(stmt, 3);
+    sb->version.minor = sqlite3_column_int(stmt, 4);
+    sb->version.patch = sqlite3_column_int(stmt, 5);
+    sb->yield_liters  = (float)sqlite3_column_double(stmt, 6);
+
+    v = (const char *)sqlite3_column_text(stmt, 7);
+    strncpy(sb->notes, v ? v : "", 255);
+    sb->notes[255] = '\0';
+
+    stmt_done(stmt);
+
+    sb->compound_count = 0;
+    if (stmt_get(ctx, STMT_LOAD_BASE_COMPOUNDS, &stmt) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, base_id);
+        i = 0;
+        while (sqlite3_step(stmt) == SQLITE_ROW && i < MAX_BASE_COMPOUNDS) {
+            sb->compounds[i].name_id                = intern((const char *)sqlite3_column_text(stmt, 0));
+            sb->compounds[i].concentration_ppm      = (float)sqlite3_column_double(stmt, 1);
+            sb->compounds[i].compound_library_id    = sqlite3_column_int(stmt, 2);
+            i++;
+        }
+        sb->compound_count = i;
+        stmt_done(stmt);
+    }
+
+    sb->ingredient_count = 0;
+    if (stmt_get(ctx, STMT_LOAD_BASE_INGREDIENTS, &stmt) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, base_id);
+        i = 0;
+        while (sqlite3_step(stmt) == SQLITE_ROW && i < MAX_BASE_INGREDIENTS) {
+            sb->ingredients[i].ingredient_id = sqlite3_column_int(stmt, 0);
+            v = (const char *)sqlite3_column_text(stmt, 1);
+            strncpy(sb->ingredients[i].ingredient_name, v ? v : "", 63);
+            sb->ingredients[i].ingredient_name[63] = '\0';
+            sb->ingredients[i].amount = (float)sqlite3_column_double(stmt, 2);
+            v = (const char *)sqlite3_column_text(stmt, 3);
+            strncpy(sb->ingredients[i].unit, v ? v : "g", 15);
+            sb->ingredients[i].unit[15] = '\0';
+            i++;
+        }
+        sb->ingredient_count = i;
+        stmt_done(stmt);
+    }
+
+    return 0;
 }
 
 /* =========================================================================
-   db_update_compound_supplier
+   db_delete_soda_base
+   Returns 0=ok, 1=referenced by a formulation, negative=DB error.
    ========================================================================= */
-int db_update_compound_supplier(int cs_id, const char *catalog_number,
-                                float price_per_gram, float min_order_grams,
-                                int lead_time_days)
+int dbc_delete_soda_base(DbContext* ctx, const char *base_code)
 {
     sqlite3_stmt *stmt;
+    int count = 0;
     int rc;
 
-    if (!g_db) return -1;
-    rc = sqlite3_prepare_v2(g_db,
-        "UPDATE compound_suppliers "
-        "SET catalog_number=?, price_per_gram=?, min_order_grams=?, lead_time_days=? "
-        "WHERE id=?;",
-        -1, &stmt, NULL);
+    if (!ctx->db) return -1;
+
+    if (sqlite3_prepare_v2(ctx->db,
+        "SELECT COUNT(*) FROM formulation_bases fb "
+        "JOIN soda_bases sb ON sb.id = fb.soda_base_id "
+        "WHERE sb.base_code=?;",
+        -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, base_code, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            count = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    if (count > 0) return 1;
+
+    rc = db_exec_simple(ctx, "BEGIN IMMEDIATE;");
     if (rc != SQLITE_OK) return rc;
 
-    sqlite3_bind_text  (stmt, 1, catalog_number ? catalog_number : "", -1, SQLITE_STATIC);
-    sqlite3_bind_double(stmt, 2, (double)price_per_gram);
-    sqlite3_bind_double(stmt, 3, (double)min_order_grams);
-    sqlite3_bind_int   (stmt, 4, lead_time_days);
-    sqlite3_bind_int   (stmt, 5, cs_id);
+    if (sqlite3_prepare_v2(ctx->db,
+        "DELETE FROM soda_base_compounds WHERE soda_base_id IN "
+        "(SELECT id FROM soda_bases WHERE base_code=?);",
+        -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, base_code, -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
 
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    return 0;
+    if (sqlite3_prepare_v2(ctx->db,
+        "DELETE FROM soda_base_ingredients WHERE soda_base_id IN "
+        "(SELECT id FROM soda_bases WHERE base_code=?);",
+        -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, base_code, -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+
+    if (sqlite3_prepare_v2(ctx->db,
+        "DELETE FROM soda_bases WHERE base_code=?;",
+        -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, base_code, -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+
+    return db_exec_simple(ctx, "COMMIT;");
 }
 
 /* =========================================================================
-   db_remove_compound_supplier
+   db_save_formulation_extras
+   Returns 0=ok, 1=formulation not found, negative=DB error.
    ========================================================================= */
-int db_remove_compound_supplier(int cs_id)
+int dbc_save_formulation_extras(DbContext* ctx, const char *flavor_code,
+                                                int major, int minor, int patch,
+                                                const FormBase *bases, int base_count,
+                                                const FormIngredient *ings, int ing_count)
 {
     sqlite3_stmt *stmt;
+    sqlite3_int64 form_id = 0;
     int rc;
+    int i;
 
-    if (!g_db) return -1;
-    rc = sqlite3_prepare_v2(g_db,
-        "DELETE FROM compound_suppliers WHERE id=?;",
-        -1, &stmt, NULL);
+    if (!ctx->db) return -1;
+
+    rc = stmt_get(ctx, STMT_FIND_FORMULATION_ID, &stmt);
     if (rc != SQLITE_OK) return rc;
 
-    sqlite3_bind_int(stmt, 1, cs_id);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    return 0;
-}
+    sqlite3_bind_text(stmt, 1, flavor_code, -1, SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 2, major);
+    sqlite3_bind_int (stmt, 3, minor);
+    sqlite3_bind_int (stmt, 4, patch);
 
-/* =========================================================================
-   db_add_ingredient
-   INSERT OR IGNORE — returns 0 on success, 1 if name already exists.
-   ========================================================================= */
-int db_add_ingredient(const Ingredient *ing)
-{
-    sqlite3_stmt *stmt;
-    int rc;
+    rc = sqlite3_step(stmt);
+    if (rc != SQLITE_ROW) { stmt_done(stmt); return (rc == SQLITE_DONE) ? 1 : rc; }
+    form_id = sqlite3_column_int64(stmt, 0);
+    stmt_done(stmt);
 
-    if (!g_db) return -1;
-    rc = sqlite3_prepare_v2(g_db,
-        "INSERT OR IGNORE INTO ingredients "
-        "(ingredient_name, category, unit, cost_per_unit, supplier_id, brand, notes) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?);",
-        -1, &stmt, NULL);
+    rc = db_exec_simple(ctx, "BEGIN IMMEDIATE;");
     if (rc != SQLITE_OK) return rc;
 
-    sqlite3_bind_text  (stmt, 1, ing->ingredient_name, -1, SQLITE_STATIC);
-    sqlite3_bind_text  (stmt, 2, ing->category,        -1, SQLITE_STATIC);
-    sqlite3_bind_text  (stmt, 3, ing->unit,             -1, SQLITE_STATIC);
-    sqlite3_bind_double(stmt, 4, (double)ing->cost_per_unit);
-    if (ing->supplier_id > 0)
-        sqlite3_bind_int(stmt, 5, ing->supplier_id);
-    else
-        sqlite3_bind_null(stmt, 5);
-    sqlite3_bind_text(stmt, 6, ing->brand[0] ? ing->brand : "", -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 7, ing->notes[0] ? ing->notes : "", -1, SQLITE_STATIC);
+    if (stmt_get(ctx, STMT_DELETE_FORM_BASES, &stmt) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, form_id);
+        sqlite3_step(stmt);
+        stmt_done(stmt);
+    }
 
-    sqlite3_step(stmt);
-    rc = (sqlite3_changes(g_db) == 1) ? 0 : 1;
-    sqlite3_finalize(stmt);
-    return rc;
+    if (stmt_get(ctx, STMT_DELETE_FORM_INGREDIENTS, &stmt) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, form_id);
+        sqlite3_step(stmt);
+        stmt_done(stmt);
+    }
+
+    if (base_count > 0) {
+        rc = stmt_get(ctx, STMT_INSERT_FORM_BASE, &stmt);
+        if (rc != SQLITE_OK) { db_exec_simple(ctx, "ROLLBACK;"); return rc; }
+
+        for (i = 0; i < base_count; i++) {
+            sqlite3_reset(stmt);
+            sqlite3_bind_int64 (stmt, 1, form_id);
+            sqlite3_bind_int   (stmt, 2, bases[i].soda_base_id);
+            sqlite3_bind_double(stmt, 3, (double)bases[i].amount);
+            sqlite3_bind_text  (stmt, 4, bases[i].unit, -1, SQLITE_STATIC);
+            rc = sqlite3_step(stmt);
+            if (rc != SQLITE_DONE) {
+                stmt_done(stmt);
+                db_exec_simple(ctx, "ROLLBACK;");
+                return rc;
+            }
+        }
+        stmt_done(stmt);
+    }
+
+    if (ing_count > 0) {
+        rc = stmt_get(ctx, STMT_INSERT_FORM_INGREDIENT, &stmt);
+        if (rc != SQLITE_OK) { db_exec_simple(ctx, "ROLLBACK;"); return rc; }
+
+        for (i = 0; i < ing_count; i++) {
+            sqlite3_reset(stmt);
+            sqlite3_bind_int64 (stmt, 1, form_id);
+            sqlite3_bind_int   (stmt, 2, ings[i].ingredient_id);
+            sqlite3_bind_double(stmt, 3, (double)ings[i].amount);
+            sqlite3_bind_text  (stmt, 4, ings[i].unit, -1, SQLITE_STATIC);
+            rc = sqlite3_step(stmt);
+            if (rc != SQLITE_DONE) {
+                stmt_done(stmt);
+                db_exec_simple(ctx, "ROLLBACK;");
+                return rc;
+            }
+        }
+        stmt_done(stmt);
+    }
+
+    return db_exec_simple(ctx, "COMMIT;");
 }
 
 /* =========================================================================
-   db_update_ingredient
+   db_load_formulation_extras
+   Returns 0=ok, 1=not found, negative=DB error.
    ========================================================================= */
-int db_update_ingredient(const Ingredient *ing)
+int dbc_load_formulation_extras(DbContext* ctx, const char *flavor_code,
+                                                int major, int minor, int patch,
+                                                FormBase *bases, int *base_count,
+                                                FormIngredient *ings, int *ing_count)
 {
     sqlite3_stmt *stmt;
+    sqlite3_int64 form_id = 0;
     int rc;
+    int i;
+    const char *v;
 
-    if (!g_db) return -1;
-    rc = sqlite3_prepare_v2(g_db,
-        "UPDATE ingredients "
-        "SET ingredient_name=?, category=?, unit=?, cost_per_unit=?, "
-        "    supplier_id=?, brand=?, notes=? "
-        "WHERE id=?;",
-        -1, &stmt, NULL);
+    if (!ctx->db) return -1;
+    *base_count = 0;
+    *ing_count  = 0;
+
+    rc = stmt_get(ctx, STMT_FIND_FORMULATION_ID, &stmt);
     if (rc != SQLITE_OK) return rc;
 
-    sqlite3_bind_text  (stmt, 1, ing->ingredient_name, -1, SQLITE_STATIC);
-    sqlite3_bind_text  (stmt, 2, ing->category,        -1, SQLITE_STATIC);
-    sqlite3_bind_text  (stmt, 3, ing->unit,             -1, SQLITE_STATIC);
-    sqlite3_bind_double(stmt, 4, (double)ing->cost_per_unit);
-    if (ing->supplier_id > 0)
-        sqlite3_bind_int(stmt, 5, ing->supplier_id);
-    else
-        sqlite3_bind_null(stmt, 5);
-    sqlite3_bind_text(stmt, 6, ing->brand, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 7, ing->notes, -1, SQLITE_STATIC);
-    sqlite3_bind_int (stmt, 8, ing->id);
+    sqlite3_bind_text(stmt, 1, flavor_code, -1, SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 2, major);
+    sqlite3_bind_int (stmt, 3, minor);
+    sqlite3_bind_int (stmt, 4, patch);
+
+    rc = sqlite3_step(stmt);
+    if (rc != SQLITE_ROW) { stmt_done(stmt); return (rc == SQLITE_DONE) ? 1 : rc; }
+    form_id = sqlite3_column_int64(stmt, 0);
+    stmt_done(stmt);
+
+    if (stmt_get(ctx, STMT_LOAD_FORM_BASES, &stmt) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, form_id);
+        i = 0;
+        while (sqlite3_step(stmt) == SQLITE_ROW && i < MAX_FORM_BASES) {
+            bases[i].soda_base_id = sqlite3_column_int(stmt, 0);
+            v = (const char *)sqlite3_column_text(stmt, 1);
+            strncpy(bases[i].base_name, v ? v : "", MAX_BASE_NAME - 1);
+            bases[i].base_name[MAX_BASE_NAME - 1] = '\0';
+            bases[i].amount = (float)sqlite3_column_double(stmt, 2);
+            v = (const char *)sqlite3_column_text(stmt, 3);
+            strncpy(bases[i].unit, v ? v : "%", 15);
+            bases[i].unit[15] = '\0';
+            i++;
+        }
+        *base_count = i;
+        stmt_done(stmt);
+    }
+
+    if (stmt_get(ctx, STMT_LOAD_FORM_INGREDIENTS, &stmt) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, form_id);
+        i = 0;
+        while (sqlite3_step(stmt) == SQLITE_ROW && i < MAX_FORM_INGREDIENTS) {
+            ings[i].ingredient_id = sqlite3_column_int(stmt, 0);
+            v = (const char *)sqlite3_column_text(stmt, 1);
+            strncpy(ings[i].ingredient_name, v ? v : "", MAX_INGREDIENT_NAME - 1);
+            ings[i].ingredient_name[MAX_INGREDIENT_NAME - 1] = '\0';
+            ings[i].amount = (float)sqlite3_column_double(stmt, 2);
+            v = (const char *)sqlite3_column_text(stmt, 3);
+            strncpy(ings[i].unit, v ? v : "g", 15);
+            ings[i].unit[15] = '\0';
+            i++;
+        }
+        *ing_count = i;
+        stmt_done(stmt);
+    }
 
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
     return 0;
 }
 
 /* =========================================================================
-   db_delete_ingredient
-   Returns 0=ok, 1=in use, negative=DB error.
+   Default-context wrappers
+   The db_* API used by the UI and the tools: each one runs its dbc_*
+   counterpart on g_default, the connection db_open manages.
    ========================================================================= */
-int db_delete_ingredient(int id)
+void db_get_stmt_cache_stats(DbStmtCacheStats* out)
 {
-    sqlite3_stmt *stmt;
-    int count = 0;
-    int rc;
+    dbc_get_stmt_cache_stats(&g_default, out);
+}
 
-    if (!g_db) return -1;
+void db_reset_stmt_cache_stats(void)
+{
+    dbc_reset_stmt_cache_stats(&g_default);
+}
 
-    if (sqlite3_prepare_v2(g_db,
-        "SELECT COUNT(*) FROM formulation_ingredients WHERE ingredient_id=?;",
-        -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_int(stmt, 1, id);
-        if (sqlite3_step(stmt) == SQLITE_ROW)
-            count += sqlite3_column_int(stmt, 0);
-        sqlite3_finalize(stmt);
-    }
+int db_check_query_plans(void)
+{
+    return dbc_check_query_plans(&g_default);
+}
 
-    if (sqlite3_prepare_v2(g_db,
-        "SELECT COUNT(*) FROM soda_base_ingredients WHERE ingredient_id=?;",
-        -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_int(stmt, 1, id);
-        if (sqlite3_step(stmt) == SQLITE_ROW)
-            count += sqlite3_column_int(stmt, 0);
-        sqlite3_finalize(stmt);
-    }
+int db_get_sql_profile(DbSqlProfile* out, int max)
+{
+    return dbc_get_sql_profile(&g_default, out, max);
+}
 
-    if (count > 0) return 1;
+void db_reset_sql_profile(void)
+{
+    dbc_reset_sql_profile(&g_default);
+}
 
-    rc = sqlite3_prepare_v2(g_db,
-        "DELETE FROM ingredients WHERE id=?;",
-        -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return rc;
+unsigned long db_change_generation(void)
+{
+    return dbc_change_generation(&g_default);
+}
 
-    sqlite3_bind_int(stmt, 1, id);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    return 0;
+int db_changed_since(const char* const* tables, unsigned long gen)
+{
+    return dbc_changed_since(&g_default, tables, gen);
 }
 
-/* =========================================================================
-   db_get_ingredient
-   Returns 0=found, 1=not found, negative=DB error.
-   ========================================================================= */
-int db_get_ingredient(int id, Ingredient *out)
+int db_changes_since(unsigned long gen, DbChange* out, int max)
 {
-    sqlite3_stmt *stmt;
-    int rc;
-    const char *v;
+    return dbc_changes_since(&g_default, gen, out, max);
+}
+
+void db_get_change_stats(DbChangeStats* out)
+{
+    dbc_get_change_stats(&g_default, out);
+}
+
+int db_dump_sql_profile(const char* path)
+{
+    return dbc_dump_sql_profile(&g_default, path);
+}
 
-    if (!g_db) return -1;
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT id, ingredient_name, category, unit, cost_per_unit, "
-        "       COALESCE(supplier_id, 0), COALESCE(brand, ''), COALESCE(notes, '') "
-        "FROM ingredients WHERE id=?;",
-        -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return rc;
+int db_set_storage_profile(const char* name)
+{
+    return dbc_set_storage_profile(&g_default, name);
+}
 
-    sqlite3_bind_int(stmt, 1, id);
-    rc = sqlite3_step(stmt);
-    if (rc == SQLITE_DONE) { sqlite3_finalize(stmt); return 1; }
-    if (rc != SQLITE_ROW)  { sqlite3_finalize(stmt); return rc; }
+const char* db_get_storage_profile(void)
+{
+    return dbc_get_storage_profile(&g_default);
+}
 
-    out->id = sqlite3_column_int(stmt, 0);
+void db_get_compound_cache_stats(DbCompoundCacheStats* out)
+{
+    dbc_get_compound_cache_stats(&g_default, out);
+}
 
-    v = (const char *)sqlite3_column_text(stmt, 1);
-    strncpy(out->ingredient_name, v ? v : "", MAX_INGREDIENT_NAME - 1);
-    out->ingredient_name[MAX_INGREDIENT_NAME - 1] = '\0';
+int db_get_compound_by_id(int id, CompoundInfo* c)
+{
+    return dbc_get_compound_by_id(&g_default, id, c);
+}
 
-    v = (const char *)sqlite3_column_text(stmt, 2);
-    strncpy(out->category, v ? v : "", MAX_INGREDIENT_CATEGORY - 1);
-    out->category[MAX_INGREDIENT_CATEGORY - 1] = '\0';
+void db_get_migration_stats(DbMigrationStats* out)
+{
+    dbc_get_migration_stats(&g_default, out);
+}
 
-    v = (const char *)sqlite3_column_text(stmt, 3);
-    strncpy(out->unit, v ? v : "g", MAX_INGREDIENT_UNIT - 1);
-    out->unit[MAX_INGREDIENT_UNIT - 1] = '\0';
+int db_open(const char* db_path)
+{
+    return ctx_open(&g_default, db_path);
+}
 
-    out->cost_per_unit = (float)sqlite3_column_double(stmt, 4);
-    out->supplier_id   = sqlite3_column_int(stmt, 5);
+void db_close(void)
+{
+    ctx_close(&g_default);
+}
 
-    v = (const char *)sqlite3_column_text(stmt, 6);
-    strncpy(out->brand, v ? v : "", MAX_INGREDIENT_BRAND - 1);
-    out->brand[MAX_INGREDIENT_BRAND - 1] = '\0';
+sqlite3* db_get_handle(void)
+{
+    return g_default.db;
+}
 
-    v = (const char *)sqlite3_column_text(stmt, 7);
-    strncpy(out->notes, v ? v : "", 255);
-    out->notes[255] = '\0';
+int db_save_formulation(const Formulation* f)
+{
+    return dbc_save_formulation(&g_default, f);
+}
 
-    sqlite3_finalize(stmt);
-    return 0;
+int db_load_latest(const char* flavor_code, Formulation* f)
+{
+    return dbc_load_latest(&g_default, flavor_code, f);
 }
 
-/* =========================================================================
-   db_save_soda_base
-   Returns 0=ok, -1=version conflict, negative=DB error.
-   ========================================================================= */
-int db_save_soda_base(const SodaBase *sb)
+int db_load_version(const char* flavor_code, int major, int minor, int patch,
+                    Formulation* f)
 {
-    sqlite3_stmt *stmt;
-    sqlite3_int64 base_id;
-    int rc;
-    int i;
+    return dbc_load_version(&g_default, flavor_code, major, minor, patch, f);
+}
 
-    if (!g_db) return -1;
+int db_list_formulations(void)
+{
+    return dbc_list_formulations(&g_default);
+}
 
-    rc = db_exec_simple("BEGIN;");
-    if (rc != SQLITE_OK) return rc;
+int db_get_version_history(const char* flavor_code)
+{
+    return dbc_get_version_history(&g_default, flavor_code);
+}
 
-    rc = sqlite3_prepare_v2(g_db,
-        "INSERT INTO soda_bases "
-        "(base_code, base_name, ver_major, ver_minor, ver_patch, yield_liters, notes) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?);",
-        -1, &stmt, NULL);
-    if (rc != SQLITE_OK) { db_exec_simple("ROLLBACK;"); return rc; }
+int db_diff_versions(const char* flavor_code, Version from, Version to,
+                     DbVersionDiff* out)
+{
+    return dbc_diff_versions(&g_default, flavor_code, from, to, out);
+}
 
-    sqlite3_bind_text  (stmt, 1, sb->base_code,    -1, SQLITE_STATIC);
-    sqlite3_bind_text  (stmt, 2, sb->base_name,    -1, SQLITE_STATIC);
-    sqlite3_bind_int   (stmt, 3, sb->version.major);
-    sqlite3_bind_int   (stmt, 4, sb->version.minor);
-    sqlite3_bind_int   (stmt, 5, sb->version.patch);
-    sqlite3_bind_double(stmt, 6, (double)sb->yield_liters);
-    if (sb->notes[0])
-        sqlite3_bind_text(stmt, 7, sb->notes, -1, SQLITE_STATIC);
-    else
-        sqlite3_bind_null(stmt, 7);
+int db_diff_history(const char* flavor_code, DbVersionDiff* out, int max)
+{
+    return dbc_diff_history(&g_default, flavor_code, out, max);
+}
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    stmt = NULL;
+int db_sync_seed_data(DbSeedSyncStats* out)
+{
+    return dbc_sync_seed_data(&g_default, out);
+}
 
-    if (rc == SQLITE_CONSTRAINT) { db_exec_simple("ROLLBACK;"); return -1; }
-    if (rc != SQLITE_DONE) { db_exec_simple("ROLLBACK;"); return rc; }
+int db_add_compound(const CompoundInfo* c)
+{
+    return dbc_add_compound(&g_default, c);
+}
 
-    base_id = sqlite3_last_insert_rowid(g_db);
+int db_get_compound_by_name(const char* name, CompoundInfo* c)
+{
+    return dbc_get_compound_by_name(&g_default, name, c);
+}
 
-    if (sb->compound_count > 0) {
-        rc = sqlite3_prepare_v2(g_db,
-            "INSERT INTO soda_base_compounds "
-            "(soda_base_id, compound_name, concentration_ppm, compound_library_id) "
-            "VALUES (?, ?, ?, ?);",
-            -1, &stmt, NULL);
-        if (rc != SQLITE_OK) { db_exec_simple("ROLLBACK;"); return rc; }
+int db_list_compounds(void)
+{
+    return dbc_list_compounds(&g_default);
+}
 
-        for (i = 0; i < sb->compound_count; i++) {
-            sqlite3_int64 lib_id = lookup_compound_library_id(sb->compounds[i].compound_name);
-            sqlite3_reset(stmt);
-            sqlite3_bind_int64 (stmt, 1, base_id);
-            sqlite3_bind_text  (stmt, 2, sb->compounds[i].compound_name, -1, SQLITE_STATIC);
-            sqlite3_bind_double(stmt, 3, (double)sb->compounds[i].concentration_ppm);
-            if (lib_id > 0) sqlite3_bind_int64(stmt, 4, lib_id);
-            else            sqlite3_bind_null(stmt, 4);
-            rc = sqlite3_step(stmt);
-            if (rc != SQLITE_DONE) {
-                sqlite3_finalize(stmt);
-                db_exec_simple("ROLLBACK;");
-                return rc;
-            }
-        }
-        sqlite3_finalize(stmt);
-        stmt = NULL;
-    }
+int db_set_compound_cost(const char* compound_name, float cost_per_gram)
+{
+    return dbc_set_compound_cost(&g_default, compound_name, cost_per_gram);
+}
 
-    if (sb->ingredient_count > 0) {
-        rc = sqlite3_prepare_v2(g_db,
-            "INSERT INTO soda_base_ingredients "
-            "(soda_base_id, ingredient_id, amount, unit) VALUES (?, ?, ?, ?);",
-            -1, &stmt, NULL);
-        if (rc != SQLITE_OK) { db_exec_simple("ROLLBACK;"); return rc; }
+int db_find_compounds_by_app(unsigned int mask, int mode, int* ids, int max)
+{
+    return dbc_find_compounds_by_app(&g_default, mask, mode, ids, max);
+}
 
-        for (i = 0; i < sb->ingredient_count; i++) {
-            sqlite3_reset(stmt);
-            sqlite3_bind_int64 (stmt, 1, base_id);
-            sqlite3_bind_int   (stmt, 2, sb->ingredients[i].ingredient_id);
-            sqlite3_bind_double(stmt, 3, (double)sb->ingredients[i].amount);
-            sqlite3_bind_text  (stmt, 4, sb->ingredients[i].unit, -1, SQLITE_STATIC);
-            rc = sqlite3_step(stmt);
-            if (rc != SQLITE_DONE) {
-                sqlite3_finalize(stmt);
-                db_exec_simple("ROLLBACK;");
-                return rc;
-            }
-        }
-        sqlite3_finalize(stmt);
-    }
+int db_count_compounds_by_app(int counts[APP_CATEGORY_COUNT])
+{
+    return dbc_count_compounds_by_app(&g_default, counts);
+}
 
-    return db_exec_simple("COMMIT;");
+int db_validate_formulation(const Formulation* f)
+{
+    return dbc_validate_formulation(&g_default, f);
 }
 
-/* =========================================================================
-   db_load_latest_base
-   Returns 0=ok, 1=not found, negative=DB error.
-   ========================================================================= */
-int db_load_latest_base(const char *base_code, SodaBase *sb)
+int db_check_formulation_limits(const Formulation* f, ValidationResult* out)
 {
-    sqlite3_stmt *stmt;
-    sqlite3_int64 base_id;
-    int rc;
-    int i;
-    const char *v;
+    return dbc_check_formulation_limits(&g_default, f, out);
+}
 
-    if (!g_db) return -1;
+int db_save_tasting(const char* flavor_code,
+                    int major, int minor, int patch,
+                    TastingSession* ts)
+{
+    return dbc_save_tasting(&g_default, flavor_code, major, minor, patch, ts);
+}
 
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT id, base_code, base_name, ver_major, ver_minor, ver_patch, "
-        "       yield_liters, COALESCE(notes, '') "
-        "FROM soda_bases WHERE base_code=? "
-        "ORDER BY ver_major DESC, ver_minor DESC, ver_patch DESC LIMIT 1;",
-        -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return rc;
+int db_list_tastings_for_flavor(const char* flavor_code)
+{
+    return dbc_list_tastings_for_flavor(&g_default, flavor_code);
+}
 
-    sqlite3_bind_text(stmt, 1, base_code, -1, SQLITE_STATIC);
-    rc = sqlite3_step(stmt);
-    if (rc == SQLITE_DONE) { sqlite3_finalize(stmt); return 1; }
-    if (rc != SQLITE_ROW)  { sqlite3_finalize(stmt); return rc; }
+int db_get_avg_scores(const char* flavor_code)
+{
+    return dbc_get_avg_scores(&g_default, flavor_code);
+}
 
-    base_id = sqlite3_column_int64(stmt, 0);
-    sb->id  = (int)base_id;
+int db_get_tasting_stats(const char* flavor_code, int major, int minor, int patch,
+                         DbTastingStats* out)
+{
+    return dbc_get_tasting_stats(&g_default, flavor_code, major, minor, patch, out);
+}
 
-    v = (const char *)sqlite3_column_text(stmt, 1);
-    strncpy(sb->base_code, v ? v : "", MAX_BASE_CODE - 1);
-    sb->base_code[MAX_BASE_CODE - 1] = '\0';
+int db_get_flavor_tasting_stats(const char* flavor_code, DbTastingStats* out)
+{
+    return dbc_get_flavor_tasting_stats(&g_default, flavor_code, out);
+}
 
-    v = (const char *)sqlite3_column_text(stmt, 2);
-    strncpy(sb->base_name, v ? v : "", MAX_BASE_NAME - 1);
-    sb->base_name[MAX_BASE_NAME - 1] = '\0';
+int db_rebuild_tasting_aggregates(int* mismatches)
+{
+    return dbc_rebuild_tasting_aggregates(&g_default, mismatches);
+}
 
-    sb->version.major = sqlite3_column_int(stmt, 3);
-    sb->version.minor = sqlite3_column_int(stmt, 4);
-    sb->version.patch = sqlite3_column_int(stmt, 5);
-    sb->yield_liters  = (float)sqlite3_column_double(stmt, 6);
+int db_sensory_report(const char* flavor_code, double confidence, SensoryReport** out)
+{
+    return dbc_sensory_report(&g_default, flavor_code, confidence, out);
+}
 
-    v = (const char *)sqlite3_column_text(stmt, 7);
-    strncpy(sb->notes, v ? v : "", 255);
-    sb->notes[255] = '\0';
+int db_cost_batch(BatchRun* br)
+{
+    return dbc_cost_batch(&g_default, br);
+}
 
-    sqlite3_finalize(stmt);
+int db_save_batch(const char* flavor_code,
+                  int major, int minor, int patch,
+                  BatchRun* br)
+{
+    return dbc_save_batch(&g_default, flavor_code, major, minor, patch, br);
+}
 
-    sb->compound_count = 0;
-    if (sqlite3_prepare_v2(g_db,
-        "SELECT compound_name, concentration_ppm, COALESCE(compound_library_id, 0) "
-        "FROM soda_base_compounds WHERE soda_base_id=? ORDER BY id;",
-        -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_int64(stmt, 1, base_id);
-        i = 0;
-        while (sqlite3_step(stmt) == SQLITE_ROW && i < MAX_BASE_COMPOUNDS) {
-            v = (const char *)sqlite3_column_text(stmt, 0);
-            strncpy(sb->compounds[i].compound_name, v ? v : "", 63);
-            sb->compounds[i].compound_name[63] = '\0';
-            sb->compounds[i].concentration_ppm      = (float)sqlite3_column_double(stmt, 1);
-            sb->compounds[i].compound_library_id    = sqlite3_column_int(stmt, 2);
-            i++;
-        }
-        sb->compound_count = i;
-        sqlite3_finalize(stmt);
-    }
+int db_peek_batch_number(const char* flavor_code, char* out, int out_len)
+{
+    return dbc_peek_batch_number(&g_default, flavor_code, out, out_len);
+}
 
-    sb->ingredient_count = 0;
-    if (sqlite3_prepare_v2(g_db,
-        "SELECT sbi.ingredient_id, i.ingredient_name, sbi.amount, sbi.unit "
-        "FROM soda_base_ingredients sbi "
-        "JOIN ingredients i ON i.id = sbi.ingredient_id "
-        "WHERE sbi.soda_base_id=? ORDER BY sbi.id;",
-        -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_int64(stmt, 1, base_id);
-        i = 0;
-        while (sqlite3_step(stmt) == SQLITE_ROW && i < MAX_BASE_INGREDIENTS) {
-            sb->ingredients[i].ingredient_id = sqlite3_column_int(stmt, 0);
-            v = (const char *)sqlite3_column_text(stmt, 1);
-            strncpy(sb->ingredients[i].ingredient_name, v ? v : "", 63);
-            sb->ingredients[i].ingredient_name[63] = '\0';
-            sb->ingredients[i].amount = (float)sqlite3_column_double(stmt, 2);
-            v = (const char *)sqlite3_column_text(stmt, 3);
-            strncpy(sb->ingredients[i].unit, v ? v : "g", 15);
-            sb->ingredients[i].unit[15] = '\0';
-            i++;
-        }
-        sb->ingredient_count = i;
-        sqlite3_finalize(stmt);
-    }
+int db_set_batch_number_format(const char* fmt)
+{
+    return dbc_set_batch_number_format(&g_default, fmt);
+}
 
-    return 0;
+int db_list_batches(const char* flavor_code)
+{
+    return dbc_list_batches(&g_default, flavor_code);
 }
 
-/* =========================================================================
-   db_delete_soda_base
-   Returns 0=ok, 1=referenced by a formulation, negative=DB error.
-   ========================================================================= */
-int db_delete_soda_base(const char *base_code)
+int db_check_inventory(const BatchRun* br)
+{
+    return dbc_check_inventory(&g_default, br);
+}
+
+int db_deduct_inventory(const BatchRun* br)
 {
-    sqlite3_stmt *stmt;
-    int count = 0;
-    int rc;
+    return dbc_deduct_inventory(&g_default, br);
+}
 
-    if (!g_db) return -1;
+int db_receive_stock(const char* compound_name, float grams, const char* note)
+{
+    return dbc_receive_stock(&g_default, compound_name, grams, note);
+}
 
-    if (sqlite3_prepare_v2(g_db,
-        "SELECT COUNT(*) FROM formulation_bases fb "
-        "JOIN soda_bases sb ON sb.id = fb.soda_base_id "
-        "WHERE sb.base_code=?;",
-        -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, base_code, -1, SQLITE_STATIC);
-        if (sqlite3_step(stmt) == SQLITE_ROW)
-            count = sqlite3_column_int(stmt, 0);
-        sqlite3_finalize(stmt);
-    }
-    if (count > 0) return 1;
+int db_adjust_stock(const char* compound_name, float counted_grams, const char* note)
+{
+    return dbc_adjust_stock(&g_default, compound_name, counted_grams, note);
+}
 
-    rc = db_exec_simple("BEGIN;");
-    if (rc != SQLITE_OK) return rc;
+int db_set_reorder_threshold(const char* compound_name, float grams)
+{
+    return dbc_set_reorder_threshold(&g_default, compound_name, grams);
+}
 
-    if (sqlite3_prepare_v2(g_db,
-        "DELETE FROM soda_base_compounds WHERE soda_base_id IN "
-        "(SELECT id FROM soda_bases WHERE base_code=?);",
-        -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, base_code, -1, SQLITE_STATIC);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-    }
+int db_stock_take(const char* compound_name, float counted_grams,
+                  float reorder_threshold_grams, const char* note)
+{
+    return dbc_stock_take(&g_default, compound_name, counted_grams,
+                          reorder_threshold_grams, note);
+}
 
-    if (sqlite3_prepare_v2(g_db,
-        "DELETE FROM soda_base_ingredients WHERE soda_base_id IN "
-        "(SELECT id FROM soda_bases WHERE base_code=?);",
-        -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, base_code, -1, SQLITE_STATIC);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-    }
+int db_reverse_stock_movement(int movement_id, const char* note)
+{
+    return dbc_reverse_stock_movement(&g_default, movement_id, note);
+}
 
-    if (sqlite3_prepare_v2(g_db,
-        "DELETE FROM soda_bases WHERE base_code=?;",
-        -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, base_code, -1, SQLITE_STATIC);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-    }
+int db_get_stock(const char* compound_name, const char* when, float* out_grams)
+{
+    return dbc_get_stock(&g_default, compound_name, when, out_grams);
+}
 
-    return db_exec_simple("COMMIT;");
+int db_snapshot_stock(void)
+{
+    return dbc_snapshot_stock(&g_default);
 }
 
-/* =========================================================================
-   db_save_formulation_extras
-   Returns 0=ok, 1=formulation not found, negative=DB error.
-   ========================================================================= */
-int db_save_formulation_extras(const char *flavor_code,
-                               int major, int minor, int patch,
-                               const FormBase *bases, int base_count,
-                               const FormIngredient *ings, int ing_count)
+int db_list_stock_movements(const char* compound_name)
 {
-    sqlite3_stmt *stmt;
-    sqlite3_int64 form_id = 0;
-    int rc;
-    int i;
+    return dbc_list_stock_movements(&g_default, compound_name);
+}
 
-    if (!g_db) return -1;
+int db_get_active_limit(const char* compound_name, float* out_max_ppm)
+{
+    return dbc_get_active_limit(&g_default, compound_name, out_max_ppm);
+}
 
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT id FROM formulations "
-        "WHERE flavor_code=? AND ver_major=? AND ver_minor=? AND ver_patch=?;",
-        -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return rc;
+int db_add_regulatory_limit(const char* compound_name, const char* source,
+                            float max_use_ppm, const char* effective_date,
+                            const char* notes)
+{
+    return dbc_add_regulatory_limit(&g_default, compound_name, source, max_use_ppm, effective_date, notes);
+}
 
-    sqlite3_bind_text(stmt, 1, flavor_code, -1, SQLITE_STATIC);
-    sqlite3_bind_int (stmt, 2, major);
-    sqlite3_bind_int (stmt, 3, minor);
-    sqlite3_bind_int (stmt, 4, patch);
+int db_list_inventory(void)
+{
+    return dbc_list_inventory(&g_default);
+}
 
-    rc = sqlite3_step(stmt);
-    if (rc == SQLITE_DONE) { sqlite3_finalize(stmt); return 1; }
-    form_id = sqlite3_column_int64(stmt, 0);
-    sqlite3_finalize(stmt);
+int db_get_setting(const char *key, char *out_value, int out_len)
+{
+    return dbc_get_setting(&g_default, key, out_value, out_len);
+}
 
-    rc = db_exec_simple("BEGIN;");
-    if (rc != SQLITE_OK) return rc;
+void db_set_setting(const char *key, const char *value)
+{
+    dbc_set_setting(&g_default, key, value);
+}
 
-    if (sqlite3_prepare_v2(g_db,
-        "DELETE FROM formulation_bases WHERE formulation_id=?;",
-        -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_int64(stmt, 1, form_id);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-    }
+int db_add_supplier(const char *name, const char *website,
+                    const char *email, const char *phone, const char *notes)
+{
+    return dbc_add_supplier(&g_default, name, website, email, phone, notes);
+}
 
-    if (sqlite3_prepare_v2(g_db,
-        "DELETE FROM formulation_ingredients WHERE formulation_id=?;",
-        -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_int64(stmt, 1, form_id);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-    }
+int db_update_supplier(int id, const char *name, const char *website,
+                       const char *email, const char *phone, const char *notes)
+{
+    return dbc_update_supplier(&g_default, id, name, website, email, phone, notes);
+}
 
-    if (base_count > 0) {
-        rc = sqlite3_prepare_v2(g_db,
-            "INSERT INTO formulation_bases "
-            "(formulation_id, soda_base_id, amount, unit) VALUES (?, ?, ?, ?);",
-            -1, &stmt, NULL);
-        if (rc != SQLITE_OK) { db_exec_simple("ROLLBACK;"); return rc; }
+int db_delete_supplier(int id)
+{
+    return dbc_delete_supplier(&g_default, id);
+}
 
-        for (i = 0; i < base_count; i++) {
-            sqlite3_reset(stmt);
-            sqlite3_bind_int64 (stmt, 1, form_id);
-            sqlite3_bind_int   (stmt, 2, bases[i].soda_base_id);
-            sqlite3_bind_double(stmt, 3, (double)bases[i].amount);
-            sqlite3_bind_text  (stmt, 4, bases[i].unit, -1, SQLITE_STATIC);
-            rc = sqlite3_step(stmt);
-            if (rc != SQLITE_DONE) {
-                sqlite3_finalize(stmt);
-                db_exec_simple("ROLLBACK;");
-                return rc;
-            }
-        }
-        sqlite3_finalize(stmt);
-    }
+int db_add_compound_supplier(int supplier_id, const char *compound_name,
+                             const char *catalog_number,
+                             float price_per_gram, float min_order_grams,
+                             int lead_time_days)
+{
+    return dbc_add_compound_supplier(&g_default, supplier_id, compound_name, catalog_number, price_per_gram, min_order_grams, lead_time_days);
+}
 
-    if (ing_count > 0) {
-        rc = sqlite3_prepare_v2(g_db,
-            "INSERT INTO formulation_ingredients "
-            "(formulation_id, ingredient_id, amount, unit) VALUES (?, ?, ?, ?);",
-            -1, &stmt, NULL);
-        if (rc != SQLITE_OK) { db_exec_simple("ROLLBACK;"); return rc; }
+int db_update_compound_supplier(int cs_id, const char *catalog_number,
+                                float price_per_gram, float min_order_grams,
+                                int lead_time_days)
+{
+    return dbc_update_compound_supplier(&g_default, cs_id, catalog_number, price_per_gram, min_order_grams, lead_time_days);
+}
 
-        for (i = 0; i < ing_count; i++) {
-            sqlite3_reset(stmt);
-            sqlite3_bind_int64 (stmt, 1, form_id);
-            sqlite3_bind_int   (stmt, 2, ings[i].ingredient_id);
-            sqlite3_bind_double(stmt, 3, (double)ings[i].amount);
-            sqlite3_bind_text  (stmt, 4, ings[i].unit, -1, SQLITE_STATIC);
-            rc = sqlite3_step(stmt);
-            if (rc != SQLITE_DONE) {
-                sqlite3_finalize(stmt);
-                db_exec_simple("ROLLBACK;");
-                return rc;
-            }
-        }
-        sqlite3_finalize(stmt);
-    }
+int db_remove_compound_supplier(int cs_id)
+{
+    return dbc_remove_compound_supplier(&g_default, cs_id);
+}
 
-    return db_exec_simple("COMMIT;");
+int db_add_ingredient(const Ingredient *ing)
+{
+    return dbc_add_ingredient(&g_default, ing);
 }
 
-/* =========================================================================
-   db_load_formulation_extras
-   Returns 0=ok, 1=not found, negative=DB error.
-   ========================================================================= */
-int db_load_formulation_extras(const char *flavor_code,
-                               int major, int minor, int patch,
-                               FormBase *bases, int *base_count,
-                               FormIngredient *ings, int *ing_count)
+int db_update_ingredient(const Ingredient *ing)
 {
-    sqlite3_stmt *stmt;
-    sqlite3_int64 form_id = 0;
-    int rc;
-    int i;
-    const char *v;
+    return dbc_update_ingredient(&g_default, ing);
+}
 
-    if (!g_db) return -1;
-    *base_count = 0;
-    *ing_count  = 0;
+int db_delete_ingredient(int id)
+{
+    return dbc_delete_ingredient(&g_default, id);
+}
 
-    rc = sqlite3_prepare_v2(g_db,
-        "SELECT id FROM formulations "
-        "WHERE flavor_code=? AND ver_major=? AND ver_minor=? AND ver_patch=?;",
-        -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return rc;
+int db_get_ingredient(int id, Ingredient *out)
+{
+    return dbc_get_ingredient(&g_default, id, out);
+}
 
-    sqlite3_bind_text(stmt, 1, flavor_code, -1, SQLITE_STATIC);
-    sqlite3_bind_int (stmt, 2, major);
-    sqlite3_bind_int (stmt, 3, minor);
-    sqlite3_bind_int (stmt, 4, patch);
+int db_save_soda_base(const SodaBase *sb)
+{
+    return dbc_save_soda_base(&g_default, sb);
+}
 
-    rc = sqlite3_step(stmt);
-    if (rc == SQLITE_DONE) { sqlite3_finalize(stmt); return 1; }
-    form_id = sqlite3_column_int64(stmt, 0);
-    sqlite3_finalize(stmt);
+int db_load_latest_base(const char *base_code, SodaBase *sb)
+{
+    return dbc_load_latest_base(&g_default, base_code, sb);
+}
 
-    if (sqlite3_prepare_v2(g_db,
-        "SELECT fb.soda_base_id, sb.base_name, fb.amount, fb.unit "
-        "FROM formulation_bases fb "
-        "JOIN soda_bases sb ON sb.id = fb.soda_base_id "
-        "WHERE fb.formulation_id=? ORDER BY fb.id;",
-        -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_int64(stmt, 1, form_id);
-        i = 0;
-        while (sqlite3_step(stmt) == SQLITE_ROW && i < MAX_FORM_BASES) {
-            bases[i].soda_base_id = sqlite3_column_int(stmt, 0);
-            v = (const char *)sqlite3_column_text(stmt, 1);
-            strncpy(bases[i].base_name, v ? v : "", MAX_BASE_NAME - 1);
-            bases[i].base_name[MAX_BASE_NAME - 1] = '\0';
-            bases[i].amount = (float)sqlite3_column_double(stmt, 2);
-            v = (const char *)sqlite3_column_text(stmt, 3);
-            strncpy(bases[i].unit, v ? v : "%", 15);
-            bases[i].unit[15] = '\0';
-            i++;
-        }
-        *base_count = i;
-        sqlite3_finalize(stmt);
-    }
+int db_delete_soda_base(const char *base_code)
+{
+    return dbc_delete_soda_base(&g_default, base_code);
+}
 
-    if (sqlite3_prepare_v2(g_db,
-        "SELECT fi.ingredient_id, i.ingredient_name, fi.amount, fi.unit "
-        "FROM formulation_ingredients fi "
-        "JOIN ingredients i ON i.id = fi.ingredient_id "
-        "WHERE fi.formulation_id=? ORDER BY fi.id;",
-        -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_int64(stmt, 1, form_id);
-        i = 0;
-        while (sqlite3_step(stmt) == SQLITE_ROW && i < MAX_FORM_INGREDIENTS) {
-            ings[i].ingredient_id = sqlite3_column_int(stmt, 0);
-            v = (const char *)sqlite3_column_text(stmt, 1);
-            strncpy(ings[i].ingredient_name, v ? v : "", MAX_INGREDIENT_NAME - 1);
-            ings[i].ingredient_name[MAX_INGREDIENT_NAME - 1] = '\0';
-            ings[i].amount = (float)sqlite3_column_double(stmt, 2);
-            v = (const char *)sqlite3_column_text(stmt, 3);
-            strncpy(ings[i].unit, v ? v : "g", 15);
-            ings[i].unit[15] = '\0';
-            i++;
-        }
-        *ing_count = i;
-        sqlite3_finalize(stmt);
-    }
+int db_save_formulation_extras(const char *flavor_code,
+                               int major, int minor, int patch,
+                               const FormBase *bases, int base_count,
+                               const FormIngredient *ings, int ing_count)
+{
+    return dbc_save_formulation_extras(&g_default, flavor_code, major, minor, patch, bases, base_count, ings, ing_count);
+}
 
-    return 0;
+int db_load_formulation_extras(const char *flavor_code,
+                               int major, int minor, int patch,
+                               FormBase *bases, int *base_count,
+                               FormIngredient *ings, int *ing_count)
+{
+    return dbc_load_formulation_extras(&g_default, flavor_code, major, minor, patch, bases, base_count, ings, ing_count);
 }
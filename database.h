@@ -1,22 +1,46 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
+#include <stddef.h>
 #include "formulation.h"
 #include "compound.h"
 #include "tasting.h"
+#include "sensory.h"
 #include "batch.h"
 #include "ingredient.h"
 #include "soda_base.h"
 #include "sqlite3.h"
 
+/* One connection and its caches; see "Explicit contexts" at the end. */
+typedef struct DbContext DbContext;
+
 /*
  * Opens (or creates) the SQLite database at db_path.
- * Creates all tables (formulations, formulation_compounds, compound_library)
- * if they do not exist.
+ * Brings the schema up to date by applying any migration steps newer than
+ * the file's PRAGMA user_version (see db_get_migration_stats).
  * Returns 0 on success, negative on error.
  */
 int db_open(const char* db_path);
 
+/*
+ * Turns the informational messages the db_* functions print to stdout
+ * (database opened, schema migrated, saved, inventory updated ...) on or
+ * off for every context.  On by default; warnings and errors always go
+ * to stderr.  Set it before any other thread uses the database.
+ */
+void db_set_verbose(int on);
+
+/*
+ * Creates db_path as a copy of a serialized database image, normally the
+ * prebuilt template from template_db.c (see mktemplate.c), so a first run
+ * starts with the schema and seed data already in place.
+ * Does nothing if db_path already exists or the image is empty.
+ * Call before db_open.
+ * Returns 0 if the file was created, 1 if skipped, negative on error.
+ */
+int db_create_from_image(const char* db_path,
+                         const unsigned char* image, size_t size);
+
 /*
  * Closes the database connection.
  */
@@ -55,24 +79,105 @@ int db_list_formulations(void);
  */
 int db_get_version_history(const char* flavor_code);
 
+/* What a DbDiffItem refers to */
+#define DB_DIFF_COMPOUND    0
+#define DB_DIFF_BASE        1
+#define DB_DIFF_INGREDIENT  2
+
+/* How it changed between the two versions */
+#define DB_DIFF_ADDED       1
+#define DB_DIFF_REMOVED     2
+#define DB_DIFF_CHANGED     3
+
+/* One compound, base or ingredient that differs between two versions. */
+typedef struct {
+    unsigned char what;        /* DB_DIFF_COMPOUND / _BASE / _INGREDIENT       */
+    unsigned char kind;        /* DB_DIFF_ADDED / _REMOVED / _CHANGED          */
+    int   id;                  /* compound_library_id, soda_base_id or
+                                  ingredient_id; 0 for an unlinked compound   */
+    int   name_id;             /* intern() id of the display name              */
+    int   old_unit_id;         /* intern() ids of the units; 0 for compounds   */
+    int   new_unit_id;
+    float old_value;           /* ppm or amount; 0 on the side that lacks it   */
+    float new_value;
+    float delta;               /* new_value - old_value                        */
+    float delta_pct;           /* delta / old_value * 100; 0 when old_value 0  */
+} DbDiffItem;
+
+#define DB_DIFF_MAX_ITEMS (2 * (MAX_COMPOUNDS + MAX_FORM_BASES + MAX_FORM_INGREDIENTS))
+
+typedef struct {
+    Version    from, to;
+    float      old_ph,   new_ph;
+    float      old_brix, new_brix;
+    int        added, removed, changed;    /* item counts by kind */
+    DbDiffItem items[DB_DIFF_MAX_ITEMS];   /* compounds, then bases, then
+                                              ingredients; each by id    */
+    int        count;
+} DbVersionDiff;
+
+/*
+ * Compare two saved versions of flavor_code: compounds, bases and
+ * ingredients that were added, removed or changed, plus target pH and
+ * Brix.  Each list is sorted by id and the two sides are merged in one
+ * pass.
+ * Returns 0 on success, 1 if either version is not found, negative on
+ * DB error.
+ */
+int db_diff_versions(const char* flavor_code, Version from, Version to,
+                     DbVersionDiff* out);
+
 /*
- * Seed compound_library with pre-defined compounds (INSERT OR IGNORE).
- * Safe to call every startup. Returns 0 on success, negative on DB error.
+ * Diff every adjacent pair of flavor_code's versions, oldest first:
+ * out[i] goes from the i-th version to the (i+1)-th.  The whole history
+ * is read in four queries and rebuilt in memory, so this is far cheaper
+ * than db_diff_versions per pair.  Writes at most max diffs; with max 0
+ * only the version list is read, to size out.
+ * Returns the number of adjacent pairs (versions - 1, possibly more
+ * than max), 0 for fewer than two versions, negative on DB error.
  */
-int db_seed_compound_library(void);
+int db_diff_history(const char* flavor_code, DbVersionDiff* out, int max);
+
+typedef struct {
+    int    skipped;            /* 1 = fingerprint matched, nothing was read */
+    int    compounds_added;
+    int    compounds_updated;  /* existing rows whose seed columns changed  */
+    int    inventory_added;
+    int    oils_added;
+    double elapsed_ms;
+} DbSeedSyncStats;
 
 /*
- * Insert or replace a single compound in the library.
+ * Bring compound_library, compound_inventory and the essential-oil
+ * ingredients in line with the seed tables in compound_data.h.
+ * Does nothing when the stored seed fingerprint matches this build.
+ * Otherwise inserts missing rows and updates changed reference columns;
+ * user-owned values (costs already set, stock levels) are left alone.
+ * Prints a one-line summary.  out may be NULL.
+ * Returns 0 on success, negative on DB error.
+ */
+int db_sync_seed_data(DbSeedSyncStats* out);
+
+/*
+ * Insert a single compound into the library, or update the existing row
+ * of the same name in place (its id, cost and descriptors are kept).
  * Returns 0 on success, negative on DB error.
  */
 int db_add_compound(const CompoundInfo* c);
 
 /*
  * Load a compound by name into c.
+ * Served from the in-memory compound cache; reads through to SQL on a miss.
  * Returns 0 = found, 1 = not found, negative = DB error.
  */
 int db_get_compound_by_name(const char* name, CompoundInfo* c);
 
+/*
+ * Load a compound by compound_library.id into c (compound cache only).
+ * Returns 0 = found, 1 = not found, negative = DB error.
+ */
+int db_get_compound_by_id(int id, CompoundInfo* c);
+
 /*
  * Print formatted table of all compounds in the library.
  * Returns 0 on success, negative on DB error.
@@ -86,13 +191,54 @@ int db_list_compounds(void);
  */
 int db_set_compound_cost(const char* compound_name, float cost_per_gram);
 
+/* Match modes for db_find_compounds_by_app */
+#define DB_APP_ANY  0   /* at least one category in mask */
+#define DB_APP_ALL  1   /* every category in mask        */
+
+/*
+ * Find compounds by application category (APP_* bits, see compound.h).
+ * Writes up to max compound_library ids into ids, ordered by name.
+ * An empty mask matches nothing with DB_APP_ANY and everything with
+ * DB_APP_ALL.
+ * Returns the total number of matches (may exceed max), negative on DB error.
+ */
+int db_find_compounds_by_app(unsigned int mask, int mode, int* ids, int max);
+
+/*
+ * Count compounds per application category: counts[i] is the number of
+ * compounds with bit (1 << i) set.
+ * Returns the number of compounds in the library, negative on DB error.
+ */
+int db_count_compounds_by_app(int counts[APP_CATEGORY_COUNT]);
+
 /*
  * Check every compound in f against library limits.
  * Prints [SAFETY WARNING] lines for each violation.
- * Returns count of violations (0 = all clear).
+ * Returns count of violations (0 = all clear), negative on DB error.
  */
 int db_validate_formulation(const Formulation* f);
 
+/* One compound over its active limit. */
+typedef struct {
+    char  compound_name[64];
+    float concentration_ppm;
+    float limit_ppm;       /* active limit that was exceeded               */
+    int   from_override;   /* 1 = regulatory_limits, 0 = compound_library */
+} SafetyViolation;
+
+typedef struct {
+    SafetyViolation items[MAX_COMPOUNDS];
+    int             count;
+} ValidationResult;
+
+/*
+ * Same check as db_validate_formulation, without printing: resolves the
+ * active limit for every compound in one query and fills out with the
+ * violations in formulation order.
+ * Returns count of violations (0 = all clear), negative on DB error.
+ */
+int db_check_formulation_limits(const Formulation* f, ValidationResult* out);
+
 /* -------------------------------------------------------------------------
    Phase 3: Tasting Sessions
    ------------------------------------------------------------------------- */
@@ -121,22 +267,60 @@ int db_list_tastings_for_flavor(const char* flavor_code);
  */
 int db_get_avg_scores(const char* flavor_code);
 
-/* -------------------------------------------------------------------------
-   Phase 4: Batch Scaling, Cost Analysis, Inventory
-   ------------------------------------------------------------------------- */
+/*
+ * Tasting aggregates: per formulation version, tasting_aggregates holds the
+ * session count and, per score dimension, the count, sum and sum of
+ * squares of the scores given.  Triggers on tasting_sessions keep it in
+ * step with every save, so these reads never scan the sessions.
+ * Dimensions are indexed overall, aroma, flavor, mouthfeel, finish,
+ * sweetness.
+ */
+#define DB_SCORE_DIMENSIONS 6
+
+typedef struct {
+    int    n;           /* sessions that gave this score                 */
+    double mean;        /* 0 when n == 0                                 */
+    double variance;    /* sample variance, 0 when n < 2                 */
+} DbScoreStat;
+
+typedef struct {
+    int         sessions;
+    DbScoreStat score[DB_SCORE_DIMENSIONS];
+} DbTastingStats;
 
 /*
- * Seed compound_inventory with starting stock levels (INSERT OR IGNORE).
- * Safe to call every startup. Call after db_seed_compound_library.
+ * Stats for one version of flavor_code.
+ * Returns 0=found (sessions may be 0), 1=version not found, negative=DB error.
+ */
+int db_get_tasting_stats(const char* flavor_code, int major, int minor, int patch,
+                         DbTastingStats* out);
+
+/*
+ * The same over every version of flavor_code (all zero if none).
  * Returns 0 on success, negative on DB error.
  */
-int db_seed_inventory(void);
+int db_get_flavor_tasting_stats(const char* flavor_code, DbTastingStats* out);
+
+/*
+ * Recompute tasting_aggregates from tasting_sessions and replace it.
+ * *mismatches (may be NULL) gets the number of stored rows that disagreed
+ * with the recompute; anything but 0 means the triggers were bypassed.
+ * Returns 0 on success, or an SQLite error code (nothing is changed).
+ */
+int db_rebuild_tasting_aggregates(int* mismatches);
 
 /*
- * Seed the ingredients table with all food-safe essential oils (INSERT OR IGNORE).
- * Safe to call every startup. Returns 0 on success, negative on DB error.
+ * Build a sensory report (sensory.h) from every tasting session of
+ * flavor_code, or of every flavor when it is NULL or "", in one read of
+ * the sessions.  confidence is the interval level; outside (0, 1) means
+ * SENSORY_DEFAULT_CONFIDENCE.  Free *out with sensory_report_free.
+ * Returns 0 on success, negative on DB error or out of memory (*out NULL).
  */
-int db_seed_essential_oils(void);
+int db_sensory_report(const char* flavor_code, double confidence, SensoryReport** out);
+
+/* -------------------------------------------------------------------------
+   Phase 4: Batch Scaling, Cost Analysis, Inventory
+   ------------------------------------------------------------------------- */
 
 /*
  * Fill br->ingredients[*].cost_line and br->cost_total from compound_library.
@@ -147,14 +331,33 @@ int db_cost_batch(BatchRun* br);
 
 /*
  * Save a batch run linked to flavor_code v major.minor.patch.
- * Auto-generates batch_number if br->batch_number is empty.
+ * If br->batch_number is empty, takes the flavor's next number for the
+ * current year from batch_sequences, in the same transaction as the
+ * insert, and writes it back to br->batch_number (cleared again if the
+ * save fails).  Safe with several connections saving at once.
  * Fills br->id and br->batched_at on success.
- * Returns 0 on success, 1 if formulation version not found, negative on DB error.
+ * Returns 0 on success, 1 if formulation version not found, nonzero
+ * SQLite code on DB error (e.g. a hand-entered number already in use).
  */
 int db_save_batch(const char* flavor_code,
                   int major, int minor, int patch,
                   BatchRun* br);
 
+/*
+ * The number db_save_batch would give flavor_code's next batch right
+ * now, without reserving it; another station may take it first.
+ * Returns 0, or nonzero on DB error.
+ */
+int db_peek_batch_number(const char* flavor_code, char* out, int out_len);
+
+/*
+ * Set the layout of generated batch numbers (app_settings key
+ * batch_number_format; see batch_format_number for the codes).
+ * Sequences keep counting per flavor and year whatever the layout.
+ * Returns 0, or -1 for a malformed format.
+ */
+int db_set_batch_number_format(const char* fmt);
+
 /*
  * Print all batch runs for flavor_code ordered by batched_at.
  * Returns 0 on success, negative on DB error.
@@ -169,7 +372,9 @@ int db_list_batches(const char* flavor_code);
 int db_check_inventory(const BatchRun* br);
 
 /*
- * Deduct batch ingredient quantities from compound_inventory.
+ * Record a 'consume' stock movement for each batch ingredient, linked to
+ * br->id when the batch is saved.  All lines or none.  Stock may go
+ * below zero; that is drift to correct with db_adjust_stock.
  * Skips compounds not present in inventory (no error).
  * Returns 0 on success, negative on DB error.
  */
@@ -181,12 +386,269 @@ int db_deduct_inventory(const BatchRun* br);
  */
 int db_list_inventory(void);
 
+/* -------------------------------------------------------------------------
+   Stock ledger
+   stock_movements is append-only: receipts, batch consumption,
+   adjustments and reversals, plus one 'opening' row per compound with
+   its starting stock.  compound_inventory.stock_grams mirrors the
+   current balance.  A snapshot of the balance is written every 64
+   movements of a compound, so any balance is a snapshot plus a short
+   tail of movements.
+   ------------------------------------------------------------------------- */
+
+/*
+ * Record grams received (> 0).  Starts tracking the compound if it had
+ * no inventory row.
+ * Returns 0 on success, 1 if the compound is unknown, negative on bad
+ * grams, or an SQLite error code.
+ */
+int db_receive_stock(const char* compound_name, float grams, const char* note);
+
+/*
+ * Stock take: record the difference between counted_grams and the
+ * ledger balance as an 'adjust' movement (nothing if they agree to
+ * 4 decimals, the precision stock is displayed with).
+ * Returns 0 on success, 1 if the compound is unknown or untracked.
+ */
+int db_adjust_stock(const char* compound_name, float counted_grams, const char* note);
+
+/*
+ * Set the stock level below which the compound is flagged for reorder.
+ * Returns 0 on success, 1 if the compound is unknown or untracked,
+ * -1 on negative grams, or an SQLite error code.
+ */
+int db_set_reorder_threshold(const char* compound_name, float grams);
+
+/*
+ * db_adjust_stock and db_set_reorder_threshold as one savepoint: both
+ * are saved or neither is.  Returns as those do.
+ */
+int db_stock_take(const char* compound_name, float counted_grams,
+                  float reorder_threshold_grams, const char* note);
+
+/*
+ * Cancel a receipt, consumption or adjustment with an equal and
+ * opposite 'reversal' movement.  Each movement can be reversed once.
+ * Returns 0 on success, 1 if not found or not reversible.
+ */
+int db_reverse_stock_movement(int movement_id, const char* note);
+
+/*
+ * Stock of compound_name as of when ("YYYY-MM-DD HH:MM:SS", local time;
+ * a bare date means its first second), or now if when is NULL.
+ * Returns 0 and sets *out_grams, 1 if the compound was not tracked
+ * then, or an SQLite error code.
+ */
+int db_get_stock(const char* compound_name, const char* when, float* out_grams);
+
+/*
+ * Snapshot every compound with movements since its last snapshot,
+ * e.g. at a period close.  Returns the number of snapshots written,
+ * negative on DB error.
+ */
+int db_snapshot_stock(void);
+
+/*
+ * Print the ledger of one compound, oldest first, with its balance.
+ * Returns 0 on success, 1 if the compound is unknown.
+ */
+int db_list_stock_movements(const char* compound_name);
+
 /*
  * Returns the raw SQLite database handle.
  * Used by panel code that queries directly.
  */
 sqlite3* db_get_handle(void);
 
+/* -------------------------------------------------------------------------
+   Prepared-statement cache
+   ------------------------------------------------------------------------- */
+
+typedef struct {
+    unsigned long hits;      /* calls served by an already-prepared statement */
+    unsigned long misses;    /* calls that had to run sqlite3_prepare          */
+    int           prepared;  /* statements currently held by the cache         */
+} DbStmtCacheStats;
+
+/*
+ * Copy the statement cache counters into out.
+ * The cache is created by db_open and finalized by db_close.
+ */
+void db_get_stmt_cache_stats(DbStmtCacheStats* out);
+
+/* Zero the hit/miss counters (prepared count is left alone). */
+void db_reset_stmt_cache_stats(void);
+
+/* -------------------------------------------------------------------------
+   Schema migrations
+   ------------------------------------------------------------------------- */
+
+typedef struct {
+    int    from_version;   /* PRAGMA user_version found by db_open          */
+    int    to_version;     /* user_version after db_open                    */
+    int    steps_applied;  /* 0 when the database was already up to date    */
+    double elapsed_ms;     /* time spent migrating, all steps               */
+} DbMigrationStats;
+
+/*
+ * Copy what the last db_open did to the schema into out.
+ * Per-step timings are kept in the schema_migrations table.
+ */
+void db_get_migration_stats(DbMigrationStats* out);
+
+/* -------------------------------------------------------------------------
+   Compound cache
+   ------------------------------------------------------------------------- */
+
+typedef struct {
+    unsigned long hits;      /* lookups served from memory                  */
+    unsigned long misses;    /* lookups that went to compound_library       */
+    int           entries;   /* compounds currently cached                  */
+} DbCompoundCacheStats;
+
+/*
+ * Copy the compound cache counters into out.
+ * The cache is filled on first lookup (or by db_sync_seed_data)
+ * and kept in step by db_add_compound, db_set_compound_cost and
+ * db_add_regulatory_limit.
+ */
+void db_get_compound_cache_stats(DbCompoundCacheStats* out);
+
+/*
+ * Run EXPLAIN QUERY PLAN on every cached statement and every panel
+ * refresh query (panel_sql.h).  Listing queries may scan their outer
+ * table; any other full-table SCAN is printed to stderr as [QUERY PLAN].
+ * Returns the number of offending queries (0 = all indexed),
+ * negative on DB error.
+ */
+int db_check_query_plans(void);
+
+/* -------------------------------------------------------------------------
+   SQL profiling
+   Off unless db_set_sql_profile(1) was called or app_settings has
+   sql_profile = '1' when the database is opened.  Every statement run on
+   the connection is timed, the panels' own queries included.  Related
+   app_settings keys, read at open:
+     sql_slow_ms       executions at or over this many ms are printed to
+                       stderr as [SLOW SQL] with their bound values
+     sql_profile_dump  file the profile is written to by db_close
+   ------------------------------------------------------------------------- */
+
+#define DB_PROFILE_TIME_BUCKETS 20
+#define DB_PROFILE_ROW_BUCKETS  16
+
+typedef struct {
+    const char*   sql;        /* statement text; valid until reset/close    */
+    unsigned long calls;      /* completed executions                       */
+    unsigned long rows;       /* rows stepped, all executions               */
+    unsigned long slow;       /* executions at or over sql_slow_ms          */
+    double        total_ms;
+    double        max_ms;
+    /* time_hist[i]: executions under 2^i microseconds;
+       row_hist[0]: no rows, row_hist[i]: under 2^i rows.
+       The last bucket of each takes everything above. */
+    unsigned long time_hist[DB_PROFILE_TIME_BUCKETS];
+    unsigned long row_hist[DB_PROFILE_ROW_BUCKETS];
+} DbSqlProfile;
+
+/* Profile every database opened after this call (overrides sql_profile). */
+void db_set_sql_profile(int on);
+
+/*
+ * Copy up to max per-statement profiles into out, slowest total first.
+ * Returns the number copied, 0 when profiling is off.
+ */
+int db_get_sql_profile(DbSqlProfile* out, int max);
+
+/* Forget everything collected so far. */
+void db_reset_sql_profile(void);
+
+/*
+ * Write the profile as a text table to path (NULL = stderr).
+ * Returns 0 on success, -1 if profiling is off or the file can't be written.
+ */
+int db_dump_sql_profile(const char* path);
+
+/* -------------------------------------------------------------------------
+   Change tracking
+   db_open hooks the connection (sqlite3_update_hook / commit / rollback
+   hooks) and numbers every committed transaction that wrote a table: the
+   generation.  A consumer notes db_change_generation() when it reads and
+   later asks what changed since, to skip a reload or patch single rows.
+   Generation 0 is the database as opened.  Commits made through another
+   connection or process are picked up (PRAGMA data_version) as a change
+   to every table whose rows are unknown.  Changes may be over-reported,
+   e.g. a row written and rolled back to a savepoint; rows removed by a
+   REPLACE conflict are not reported.  Call under the same locking as the
+   connection itself (db_executor_lock while the executor runs).
+   ------------------------------------------------------------------------- */
+
+#define DB_CHANGE_INSERT  1
+#define DB_CHANGE_UPDATE  2
+#define DB_CHANGE_DELETE  3
+
+typedef struct {
+    unsigned long generation; /* commit that made the change               */
+    const char*   table;      /* valid until db_close                      */
+    sqlite3_int64 rowid;
+    int           op;         /* DB_CHANGE_*; the net effect when a row is
+                                 written several times in a row            */
+} DbChange;
+
+typedef struct {
+    unsigned long generation; /* current generation                        */
+    unsigned long commits;    /* transactions that wrote a table           */
+    unsigned long rollbacks;
+    unsigned long rows;       /* row changes seen by the update hook       */
+    unsigned long external;   /* commits by other connections noticed      */
+    int           tables;     /* distinct tables written so far            */
+} DbChangeStats;
+
+/* Generation of the last committed change (0 = none since open). */
+unsigned long db_change_generation(void);
+
+/*
+ * 1 if any table in the NULL-terminated list (NULL = any table) was
+ * changed by a commit after generation gen, else 0.
+ */
+int db_changed_since(const char* const* tables, unsigned long gen);
+
+/*
+ * Copy the row changes committed after generation gen into out, oldest
+ * first, up to max.  Returns the number of changes (which may exceed
+ * max), or -1 when they are no longer all known (too many since gen, or
+ * another connection committed): reload instead.
+ */
+int db_changes_since(unsigned long gen, DbChange* out, int max);
+
+void db_get_change_stats(DbChangeStats* out);
+
+/* -------------------------------------------------------------------------
+   Storage profiles
+   Named PRAGMA sets (page cache, mmap_size, temp_store, synchronous,
+   wal_autocheckpoint) applied per connection:
+     default      SQLite's stock settings
+     laptop       bigger cache, mmap, synchronous=NORMAL; a power cut can
+                  lose the last commits but never corrupts the file
+     bulk_import  large cache, synchronous=OFF; for seed syncs and big
+                  imports only, a crash can corrupt the file
+     durable      synchronous=FULL, no mmap, temp tables on disk
+   The app_settings key storage_profile selects one at open.
+   ------------------------------------------------------------------------- */
+
+/*
+ * Apply the named profile to the open connection now and store it in
+ * app_settings so later opens use it too.
+ * Returns 0 on success, -1 for an unknown name, or an SQLite error code.
+ */
+int db_set_storage_profile(const char* name);
+
+/* Name of the profile in effect ("default" if none was applied). */
+const char* db_get_storage_profile(void);
+
+/* Name of profile i, or NULL past the last one; for listing choices. */
+const char* db_storage_profile_name(int i);
+
 /* -------------------------------------------------------------------------
    Regulatory Limits
    ------------------------------------------------------------------------- */
@@ -194,6 +656,8 @@ sqlite3* db_get_handle(void);
 /*
  * Insert a new regulatory override for compound_name.
  * effective_date must be "YYYY-MM-DD". notes may be NULL or empty.
+ * The override is keyed by the compound's library id; one recorded for a
+ * name outside compound_library is kept but never applies.
  * Returns 0 on success, negative on DB error.
  */
 int db_add_regulatory_limit(const char* compound_name,
@@ -205,7 +669,8 @@ int db_add_regulatory_limit(const char* compound_name,
 /*
  * Get the active maximum use ppm for compound_name.
  * Checks regulatory_limits first (most recent effective_date/id wins).
- * Falls back to compound_library if no override exists.
+ * Falls back to compound_library if no override exists
+ * (0.0 for a name that is not in the library).
  * Returns  0 if an override was found,
  *          1 if falling back to compound_library,
  *         negative on DB error.
@@ -306,4 +771,123 @@ int db_load_formulation_extras(const char *flavor_code,
                                FormBase *bases, int *base_count,
                                FormIngredient *ings, int *ing_count);
 
+/* -------------------------------------------------------------------------
+   Explicit contexts
+   Every db_* function above runs on one process-wide connection.  A
+   DbContext is a separate connection with its own statement cache,
+   compound cache and stats; dbc_X(ctx, ...) has the same contract as
+   db_X(...) but touches only ctx.  Contexts share no state, so threads
+   may each use their own concurrently (one thread per context at a time).
+   ------------------------------------------------------------------------- */
+
+/* Open db_path as a new context, migrating it like db_open.
+   Returns 0 and sets *out, or a negative/SQLite error code with *out NULL. */
+int dbc_open(const char* db_path, DbContext** out);
+
+/* Close the connection and free ctx.  NULL is ignored. */
+void dbc_close(DbContext* ctx);
+
+sqlite3* dbc_get_handle(DbContext* ctx);
+
+int dbc_save_formulation(DbContext* ctx, const Formulation* f);
+int dbc_load_latest(DbContext* ctx, const char* flavor_code, Formulation* f);
+int dbc_load_version(DbContext* ctx, const char* flavor_code, int major, int minor, int patch, Formulation* f);
+int dbc_list_formulations(DbContext* ctx);
+int dbc_get_version_history(DbContext* ctx, const char* flavor_code);
+int dbc_diff_versions(DbContext* ctx, const char* flavor_code, Version from, Version to,
+                      DbVersionDiff* out);
+int dbc_diff_history(DbContext* ctx, const char* flavor_code, DbVersionDiff* out, int max);
+int dbc_sync_seed_data(DbContext* ctx, DbSeedSyncStats* out);
+int dbc_add_compound(DbContext* ctx, const CompoundInfo* c);
+int dbc_get_compound_by_name(DbContext* ctx, const char* name, CompoundInfo* c);
+int dbc_get_compound_by_id(DbContext* ctx, int id, CompoundInfo* c);
+int dbc_list_compounds(DbContext* ctx);
+int dbc_set_compound_cost(DbContext* ctx, const char* compound_name, float cost_per_gram);
+int dbc_find_compounds_by_app(DbContext* ctx, unsigned int mask, int mode, int* ids, int max);
+int dbc_count_compounds_by_app(DbContext* ctx, int counts[APP_CATEGORY_COUNT]);
+int dbc_validate_formulation(DbContext* ctx, const Formulation* f);
+int dbc_check_formulation_limits(DbContext* ctx, const Formulation* f, ValidationResult* out);
+int dbc_save_tasting(DbContext* ctx, const char* flavor_code,
+                                     int major, int minor, int patch,
+                                     TastingSession* ts);
+int dbc_list_tastings_for_flavor(DbContext* ctx, const char* flavor_code);
+int dbc_get_avg_scores(DbContext* ctx, const char* flavor_code);
+int dbc_get_tasting_stats(DbContext* ctx, const char* flavor_code,
+                          int major, int minor, int patch, DbTastingStats* out);
+int dbc_get_flavor_tasting_stats(DbContext* ctx, const char* flavor_code,
+                                 DbTastingStats* out);
+int dbc_rebuild_tasting_aggregates(DbContext* ctx, int* mismatches);
+int dbc_sensory_report(DbContext* ctx, const char* flavor_code, double confidence,
+                       SensoryReport** out);
+int dbc_cost_batch(DbContext* ctx, BatchRun* br);
+int dbc_save_batch(DbContext* ctx, const char* flavor_code,
+                                   int major, int minor, int patch,
+                                   BatchRun* br);
+int dbc_peek_batch_number(DbContext* ctx, const char* flavor_code,
+                          char* out, int out_len);
+int dbc_set_batch_number_format(DbContext* ctx, const char* fmt);
+int dbc_list_batches(DbContext* ctx, const char* flavor_code);
+int dbc_check_inventory(DbContext* ctx, const BatchRun* br);
+int dbc_deduct_inventory(DbContext* ctx, const BatchRun* br);
+int dbc_list_inventory(DbContext* ctx);
+int dbc_receive_stock(DbContext* ctx, const char* compound_name, float grams, const char* note);
+int dbc_adjust_stock(DbContext* ctx, const char* compound_name, float counted_grams, const char* note);
+int dbc_set_reorder_threshold(DbContext* ctx, const char* compound_name, float grams);
+int dbc_stock_take(DbContext* ctx, const char* compound_name, float counted_grams,
+                   float reorder_threshold_grams, const char* note);
+int dbc_reverse_stock_movement(DbContext* ctx, int movement_id, const char* note);
+int dbc_get_stock(DbContext* ctx, const char* compound_name, const char* when, float* out_grams);
+int dbc_snapshot_stock(DbContext* ctx);
+int dbc_list_stock_movements(DbContext* ctx, const char* compound_name);
+void dbc_get_stmt_cache_stats(DbContext* ctx, DbStmtCacheStats* out);
+void dbc_reset_stmt_cache_stats(DbContext* ctx);
+void dbc_get_migration_stats(DbContext* ctx, DbMigrationStats* out);
+void dbc_get_compound_cache_stats(DbContext* ctx, DbCompoundCacheStats* out);
+int dbc_check_query_plans(DbContext* ctx);
+int dbc_get_sql_profile(DbContext* ctx, DbSqlProfile* out, int max);
+void dbc_reset_sql_profile(DbContext* ctx);
+int dbc_dump_sql_profile(DbContext* ctx, const char* path);
+unsigned long dbc_change_generation(DbContext* ctx);
+int dbc_changed_since(DbContext* ctx, const char* const* tables, unsigned long gen);
+int dbc_changes_since(DbContext* ctx, unsigned long gen, DbChange* out, int max);
+void dbc_get_change_stats(DbContext* ctx, DbChangeStats* out);
+int dbc_set_storage_profile(DbContext* ctx, const char* name);
+const char* dbc_get_storage_profile(DbContext* ctx);
+int dbc_add_regulatory_limit(DbContext* ctx, const char* compound_name,
+                                             const char* source,
+                                             float       max_use_ppm,
+                                             const char* effective_date,
+                                             const char* notes);
+int dbc_get_active_limit(DbContext* ctx, const char* compound_name, float* out_max_ppm);
+int  dbc_get_setting(DbContext* ctx, const char *key, char *out_value, int out_len);
+void dbc_set_setting(DbContext* ctx, const char *key, const char *value);
+int dbc_add_supplier(DbContext* ctx, const char *name, const char *website,
+                                     const char *email, const char *phone, const char *notes);
+int dbc_update_supplier(DbContext* ctx, int id, const char *name, const char *website,
+                                        const char *email, const char *phone, const char *notes);
+int dbc_delete_supplier(DbContext* ctx, int id);
+int dbc_add_compound_supplier(DbContext* ctx, int supplier_id, const char *compound_name,
+                                              const char *catalog_number,
+                                              float price_per_gram, float min_order_grams,
+                                              int lead_time_days);
+int dbc_update_compound_supplier(DbContext* ctx, int cs_id, const char *catalog_number,
+                                                 float price_per_gram, float min_order_grams,
+                                                 int lead_time_days);
+int dbc_remove_compound_supplier(DbContext* ctx, int cs_id);
+int dbc_add_ingredient(DbContext* ctx, const Ingredient *ing);
+int dbc_update_ingredient(DbContext* ctx, const Ingredient *ing);
+int dbc_delete_ingredient(DbContext* ctx, int id);
+int dbc_get_ingredient(DbContext* ctx, int id, Ingredient *out);
+int dbc_save_soda_base(DbContext* ctx, const SodaBase *sb);
+int dbc_load_latest_base(DbContext* ctx, const char *base_code, SodaBase *sb);
+int dbc_delete_soda_base(DbContext* ctx, const char *base_code);
+int dbc_save_formulation_extras(DbContext* ctx, const char *flavor_code,
+                                                int major, int minor, int patch,
+                                                const FormBase *bases, int base_count,
+                                                const FormIngredient *ings, int ing_count);
+int dbc_load_formulation_extras(DbContext* ctx, const char *flavor_code,
+                                                int major, int minor, int patch,
+                                                FormBase *bases, int *base_count,
+                                                FormIngredient *ings, int *ing_count);
+
 #endif
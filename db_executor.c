@@ -0,0 +1,382 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "db_executor.h"
+#include "database.h"
+#include "thread.h"
+
+/* =========================================================================
+   Job queues
+   Every job lives on exactly one list: the write or read queue, then
+   (briefly) a worker's hands, then the completion list until dispatch.
+   g_q_lock guards all lists and worker state; g_conn_lock is held by
+   whoever is using the main connection.  Lock order: g_conn_lock before
+   g_q_lock, never the other way round.
+   ========================================================================= */
+typedef struct DbJob {
+    int           id;
+    DbJobFn       fn;
+    DbDoneFn      done;
+    void*         arg;
+    int           result;
+    struct DbJob* next;
+} DbJob;
+
+typedef struct {
+    DbJob* head;
+    DbJob* tail;
+} JobList;
+
+/* A worker thread and the connection it runs jobs on. */
+typedef struct {
+    Thread   thread;
+    sqlite3* conn;
+    JobList* queue;
+    CondVar* wake;
+    int      running_id;   /* job in progress, 0 = idle */
+} Worker;
+
+static Mutex    g_q_lock;
+static Mutex    g_conn_lock;
+static CondVar  g_write_wake;
+static CondVar  g_read_wake;
+static CondVar  g_idle;
+static JobList  g_write_q;
+static JobList  g_read_q;
+static JobList  g_done_q;
+static Worker   g_writer;
+static Worker   g_readers[DB_EXECUTOR_MAX_READERS];
+static int      g_reader_count = 0;
+static int      g_busy         = 0;   /* jobs queued or running */
+static int      g_next_id      = 0;
+static int      g_stopping     = 0;
+static int      g_running      = 0;
+static int      g_locks_ready  = 0;
+static void   (*g_notify)(void* ctx) = NULL;
+static void*    g_notify_ctx   = NULL;
+
+static void list_push(JobList* l, DbJob* j)
+{
+    j->next = NULL;
+    if (l->tail) l->tail->next = j;
+    else         l->head = j;
+    l->tail = j;
+}
+
+static DbJob* list_pop(JobList* l)
+{
+    DbJob* j = l->head;
+    if (j) {
+        l->head = j->next;
+        if (l->head == NULL) l->tail = NULL;
+    }
+    return j;
+}
+
+/* Unlink job id from l. Returns it, or NULL if not there. */
+static DbJob* list_remove(JobList* l, int id)
+{
+    DbJob* prev = NULL;
+    DbJob* j;
+
+    for (j = l->head; j != NULL; prev = j, j = j->next) {
+        if (j->id != id) continue;
+        if (prev) prev->next = j->next;
+        else      l->head    = j->next;
+        if (l->tail == j) l->tail = prev;
+        return j;
+    }
+    return NULL;
+}
+
+/* Queue a finished job's completion. Caller holds g_q_lock. */
+static void complete_locked(DbJob* j)
+{
+    list_push(&g_done_q, j);
+    if (--g_busy == 0) cond_broadcast(&g_idle);
+}
+
+/* Called with g_q_lock released */
+static void notify_owner(void)
+{
+    if (g_notify) g_notify(g_notify_ctx);
+}
+
+/* =========================================================================
+   Worker loop — shared by the writer and the readers
+   ========================================================================= */
+static void worker_main(void* p)
+{
+    Worker* w        = (Worker*)p;
+    int     is_write = (w == &g_writer);
+
+    for (;;) {
+        DbJob* j;
+
+        mutex_lock(&g_q_lock);
+        while (w->queue->head == NULL && !g_stopping)
+            cond_wait(w->wake, &g_q_lock);
+        j = list_pop(w->queue);
+        if (j == NULL) {               /* stopping and nothing left */
+            mutex_unlock(&g_q_lock);
+            break;
+        }
+        w->running_id = j->id;
+        mutex_unlock(&g_q_lock);
+
+        if (is_write) mutex_lock(&g_conn_lock);
+        j->result = j->fn(w->conn, j->arg);
+
+        /* Clear running_id before the connection changes hands, so a
+           late cancel cannot interrupt someone else's statement */
+        mutex_lock(&g_q_lock);
+        w->running_id = 0;
+        complete_locked(j);
+        mutex_unlock(&g_q_lock);
+        if (is_write) mutex_unlock(&g_conn_lock);
+        notify_owner();
+    }
+}
+
+/* =========================================================================
+   Start / stop
+   ========================================================================= */
+int db_executor_start(const char* db_path, int readers,
+                      void (*notify)(void* ctx), void* notify_ctx)
+{
+    int i, rc;
+
+    if (g_running) return -1;
+    if (db_get_handle() == NULL) {
+        fprintf(stderr, "db_executor_start: database is not open\n");
+        return -1;
+    }
+    if (readers < 0) readers = 0;
+    if (readers > DB_EXECUTOR_MAX_READERS) readers = DB_EXECUTOR_MAX_READERS;
+
+    if (!g_locks_ready) {
+        mutex_init(&g_q_lock);
+        mutex_init(&g_conn_lock);
+        cond_init(&g_write_wake);
+        cond_init(&g_read_wake);
+        cond_init(&g_idle);
+        g_locks_ready = 1;
+    }
+
+    /* Reader connections first: nothing is running yet if one fails */
+    for (i = 0; i < readers; i++) {
+        Worker* w = &g_readers[i];
+
+        w->conn = NULL;
+        rc = sqlite3_open_v2(db_path, &w->conn,
+                             SQLITE_OPEN_READONLY, NULL);
+        if (rc != SQLITE_OK) {
+            fprintf(stderr, "Cannot open reader %d on '%s': %s\n",
+                    i, db_path, sqlite3_errmsg(w->conn));
+            sqlite3_close(w->conn);
+            while (--i >= 0) sqlite3_close(g_readers[i].conn);
+            return -1;
+        }
+        sqlite3_busy_timeout(w->conn, 2000);
+        w->queue      = &g_read_q;
+        w->wake       = &g_read_wake;
+        w->running_id = 0;
+    }
+
+    g_writer.conn       = db_get_handle();
+    g_writer.queue      = &g_write_q;
+    g_writer.wake       = &g_write_wake;
+    g_writer.running_id = 0;
+
+    g_notify       = notify;
+    g_notify_ctx   = notify_ctx;
+    g_stopping     = 0;
+    g_reader_count = 0;
+
+    if (thread_start(&g_writer.thread, worker_main, &g_writer) != 0) {
+        fprintf(stderr, "db_executor_start: cannot start writer thread\n");
+        for (i = 0; i < readers; i++) sqlite3_close(g_readers[i].conn);
+        return -1;
+    }
+    for (i = 0; i < readers; i++) {
+        if (thread_start(&g_readers[i].thread, worker_main, &g_readers[i]) != 0) {
+            fprintf(stderr, "db_executor_start: cannot start reader %d\n", i);
+            sqlite3_close(g_readers[i].conn);
+            while (++i < readers) sqlite3_close(g_readers[i].conn);
+            break;
+        }
+        g_reader_count++;
+    }
+
+    g_running = 1;
+    printf("Database executor started (1 writer, %d readers)\n", g_reader_count);
+    return 0;
+}
+
+void db_executor_stop(void)
+{
+    DbJob* j;
+    int    i;
+
+    if (!g_running) return;
+
+    mutex_lock(&g_q_lock);
+    while ((j = list_pop(&g_write_q)) != NULL) {
+        j->result = SQLITE_INTERRUPT;
+        complete_locked(j);
+    }
+    while ((j = list_pop(&g_read_q)) != NULL) {
+        j->result = SQLITE_INTERRUPT;
+        complete_locked(j);
+    }
+    g_stopping = 1;
+    cond_broadcast(&g_write_wake);
+    cond_broadcast(&g_read_wake);
+    mutex_unlock(&g_q_lock);
+
+    thread_join(g_writer.thread);
+    for (i = 0; i < g_reader_count; i++) {
+        thread_join(g_readers[i].thread);
+        sqlite3_close(g_readers[i].conn);
+        g_readers[i].conn = NULL;
+    }
+    g_reader_count = 0;
+    g_running      = 0;
+
+    db_executor_dispatch();
+    g_notify     = NULL;
+    g_notify_ctx = NULL;
+}
+
+int db_executor_running(void)
+{
+    return g_running;
+}
+
+/* =========================================================================
+   Submit / cancel
+   ========================================================================= */
+static int submit(JobList* q, CondVar* wake, DbJobFn fn, DbDoneFn done, void* arg)
+{
+    DbJob* j;
+    int    id;
+
+    if (fn == NULL) return -1;
+
+    if (!g_running) {
+        /* Inline: same contract, no thread */
+        int result;
+
+        id = ++g_next_id;
+        db_executor_lock();
+        result = fn(db_get_handle(), arg);
+        db_executor_unlock();
+        if (done) done(id, result, arg);
+        return id;
+    }
+
+    j = (DbJob*)malloc(sizeof(DbJob));
+    if (j == NULL) return -1;
+    j->fn     = fn;
+    j->done   = done;
+    j->arg    = arg;
+    j->result = 0;
+
+    mutex_lock(&g_q_lock);
+    id = j->id = ++g_next_id;
+    list_push(q, j);
+    g_busy++;
+    cond_signal(wake);
+    mutex_unlock(&g_q_lock);
+    return id;
+}
+
+int db_executor_submit_write(DbJobFn fn, DbDoneFn done, void* arg)
+{
+    return submit(&g_write_q, &g_write_wake, fn, done, arg);
+}
+
+int db_executor_submit_read(DbJobFn fn, DbDoneFn done, void* arg)
+{
+    if (g_running && g_reader_count == 0)
+        return submit(&g_write_q, &g_write_wake, fn, done, arg);
+    return submit(&g_read_q, &g_read_wake, fn, done, arg);
+}
+
+int db_executor_cancel(int job_id)
+{
+    DbJob* j;
+    int    i;
+    int    state = -1;
+
+    if (!g_running || job_id <= 0) return -1;
+
+    mutex_lock(&g_q_lock);
+    j = list_remove(&g_write_q, job_id);
+    if (j == NULL) j = list_remove(&g_read_q, job_id);
+    if (j != NULL) {
+        j->result = SQLITE_INTERRUPT;
+        complete_locked(j);
+        state = 0;
+    } else if (g_writer.running_id == job_id) {
+        sqlite3_interrupt(g_writer.conn);
+        state = 1;
+    } else {
+        for (i = 0; i < g_reader_count; i++) {
+            if (g_readers[i].running_id == job_id) {
+                sqlite3_interrupt(g_readers[i].conn);
+                state = 1;
+                break;
+            }
+        }
+    }
+    mutex_unlock(&g_q_lock);
+
+    if (state == 0) notify_owner();
+    return state;
+}
+
+/* =========================================================================
+   Completions
+   ========================================================================= */
+int db_executor_dispatch(void)
+{
+    DbJob* list;
+    DbJob* next;
+    int    n = 0;
+
+    if (!g_locks_ready) return 0;
+
+    mutex_lock(&g_q_lock);
+    list = g_done_q.head;
+    g_done_q.head = g_done_q.tail = NULL;
+    mutex_unlock(&g_q_lock);
+
+    for (; list != NULL; list = next) {
+        next = list->next;
+        if (list->done) list->done(list->id, list->result, list->arg);
+        free(list);
+        n++;
+    }
+    return n;
+}
+
+void db_executor_drain(void)
+{
+    if (g_running) {
+        mutex_lock(&g_q_lock);
+        while (g_busy > 0)
+            cond_wait(&g_idle, &g_q_lock);
+        mutex_unlock(&g_q_lock);
+    }
+    db_executor_dispatch();
+}
+
+void db_executor_lock(void)
+{
+    if (g_locks_ready) mutex_lock(&g_conn_lock);
+}
+
+void db_executor_unlock(void)
+{
+    if (g_locks_ready) mutex_unlock(&g_conn_lock);
+}
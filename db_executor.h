@@ -0,0 +1,87 @@
+#ifndef DB_EXECUTOR_H
+#define DB_EXECUTOR_H
+
+#include "sqlite3.h"
+
+/*
+ * db_executor.h — runs database work off the calling (UI) thread.
+ *
+ * One writer thread owns the main connection (db_get_handle) while the
+ * executor runs; write jobs execute there one at a time, in submit order,
+ * and may call any db_* function.  A pool of reader threads, each with
+ * its own read-only connection, runs read jobs concurrently with the
+ * writer (WAL readers see the last committed state).  Read jobs must use
+ * the connection they are given, not db_* functions.
+ *
+ * Completions are queued, not called from the worker: the notify hook
+ * passed to db_executor_start fires (on a worker thread) whenever one is
+ * ready, and the owning thread runs the callbacks with
+ * db_executor_dispatch.  With no hook, poll dispatch or use
+ * db_executor_drain.
+ */
+
+#define DB_EXECUTOR_MAX_READERS  8
+
+/* Job body. conn is the main connection for write jobs, a read-only
+   pooled connection for read jobs. Returns a result code for done. */
+typedef int  (*DbJobFn)(sqlite3* conn, void* arg);
+
+/* Completion, run by db_executor_dispatch on the dispatching thread.
+   result is the job's return value, or SQLITE_INTERRUPT if it was
+   cancelled before it started. */
+typedef void (*DbDoneFn)(int job_id, int result, void* arg);
+
+/*
+ * Start the writer and `readers` reader threads (0 to
+ * DB_EXECUTOR_MAX_READERS) on db_path, which db_open must already have
+ * opened.  notify(notify_ctx) is called from a worker thread each time a
+ * completion is queued; it may be NULL.
+ * Returns 0 on success, negative on error (nothing is started).
+ */
+int  db_executor_start(const char* db_path, int readers,
+                       void (*notify)(void* ctx), void* notify_ctx);
+
+/*
+ * Cancel every queued job, wait for running ones, run all pending
+ * completions, then stop the threads and close the reader connections.
+ * The main connection stays open for db_close.
+ * Must not be called while holding db_executor_lock.
+ */
+void db_executor_stop(void);
+
+/* 1 while the executor is running. */
+int  db_executor_running(void);
+
+/*
+ * Queue fn(arg) for the writer / the reader pool.  done may be NULL.
+ * Read jobs go to the writer when the pool is empty.  When the executor
+ * is not running the job runs inline on the calling thread against the
+ * main connection and done is called before this returns.
+ * Returns the job id (> 0), or negative if the job could not be queued.
+ */
+int  db_executor_submit_write(DbJobFn fn, DbDoneFn done, void* arg);
+int  db_executor_submit_read (DbJobFn fn, DbDoneFn done, void* arg);
+
+/*
+ * Cancel a job.  A queued job is dropped and completes with
+ * SQLITE_INTERRUPT; a running one has its connection interrupted with
+ * sqlite3_interrupt and completes with whatever it returns.
+ * Returns 0 if the job was queued, 1 if running, -1 if already finished.
+ */
+int  db_executor_cancel(int job_id);
+
+/* Run the queued completion callbacks on this thread. Returns how many. */
+int  db_executor_dispatch(void);
+
+/* Wait until no job is queued or running, then dispatch. */
+void db_executor_drain(void);
+
+/*
+ * Hold the main connection against the writer.  Code that still calls
+ * db_* directly while the executor runs must do so inside
+ * lock/unlock.  Recursive.
+ */
+void db_executor_lock(void);
+void db_executor_unlock(void);
+
+#endif /* DB_EXECUTOR_H */
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "formulation.h"
+#include "intern.h"
 
 Formulation* create_formulation(const char* flavor_code, const char* flavor_name) {
     Formulation* f = (Formulation*)malloc(sizeof(Formulation));
@@ -22,7 +23,9 @@ void add_compound(Formulation* f, const char* compound_name, float concentration
         return;
     }
     
-    strcpy(f->compounds[f->compound_count].compound_name, compound_name);
+    /* The library id is resolved when the formulation is saved */
+    f->compounds[f->compound_count].compound_library_id = 0;
+    f->compounds[f->compound_count].name_id = intern(compound_name);
     f->compounds[f->compound_count].concentration_ppm = concentration_ppm;
     f->compound_count++;
 }
@@ -38,7 +41,7 @@ void print_formulation(Formulation* f) {
     
     for (int i = 0; i < f->compound_count; i++) {
         printf("  - %-20s: %.1f ppm\n", 
-               f->compounds[i].compound_name,
+               intern_str(f->compounds[i].name_id),
                f->compounds[i].concentration_ppm);
     }
     printf("\n");
@@ -9,8 +9,14 @@
 #define MAX_FLAVOR_NAME 64
 #define MAX_COMPOUNDS 50
 
+/*
+ * compound_library_id is the identity of a compound line; 0 means the name
+ * is not (yet) in the library.  name_id is the intern() id of the compound
+ * name and is kept only for display and for resolving id-less lines.
+ */
 typedef struct {
-    char compound_name[64];
+    int   compound_library_id;
+    int   name_id;
     float concentration_ppm;
 } FormulaCompound;
 
@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <string.h>
+#include "intern.h"
+#include "thread.h"
+
+/* Strings are indexed by id (slot 0 unused).  The hash table holds ids,
+   open addressing with linear probing; 0 marks an empty slot. */
+static char** g_strs      = NULL;
+static int    g_count     = 0;   /* highest id in use */
+static int    g_strs_cap  = 0;
+static int*   g_slots     = NULL;
+static int    g_slots_cap = 0;   /* always a power of two */
+
+/* Database contexts on different threads intern concurrently */
+static StaticLock g_lock = STATIC_LOCK_INIT;
+
+static unsigned int hash_str(const char* s)
+{
+    /* FNV-1a */
+    unsigned int h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int find_slot(const char* s, unsigned int h)
+{
+    unsigned int mask = (unsigned int)g_slots_cap - 1;
+    unsigned int i    = h & mask;
+
+    while (g_slots[i] != 0) {
+        if (strcmp(g_strs[g_slots[i]], s) == 0)
+            return (int)i;
+        i = (i + 1) & mask;
+    }
+    return (int)i;
+}
+
+static int grow_slots(void)
+{
+    int  new_cap = g_slots_cap ? g_slots_cap * 2 : 256;
+    int* slots   = (int*)calloc((size_t)new_cap, sizeof(int));
+    int  id;
+
+    if (slots == NULL) return -1;
+    free(g_slots);
+    g_slots     = slots;
+    g_slots_cap = new_cap;
+
+    for (id = 1; id <= g_count; id++)
+        g_slots[find_slot(g_strs[id], hash_str(g_strs[id]))] = id;
+    return 0;
+}
+
+static int intern_locked(const char* s)
+{
+    unsigned int h;
+    int          slot;
+    size_t       len;
+    char*        copy;
+
+    /* Keep the load factor under one half */
+    if ((g_count + 1) * 2 > g_slots_cap && grow_slots() != 0)
+        return 0;
+
+    h    = hash_str(s);
+    slot = find_slot(s, h);
+    if (g_slots[slot] != 0)
+        return g_slots[slot];
+
+    if (g_count + 1 >= g_strs_cap) {
+        int    new_cap = g_strs_cap ? g_strs_cap * 2 : 256;
+        char** strs    = (char**)realloc(g_strs, (size_t)new_cap * sizeof(char*));
+        if (strs == NULL) return 0;
+        g_strs     = strs;
+        g_strs_cap = new_cap;
+    }
+
+    len  = strlen(s);
+    copy = (char*)malloc(len + 1);
+    if (copy == NULL) return 0;
+    memcpy(copy, s, len + 1);
+
+    g_strs[++g_count] = copy;
+    g_slots[slot]     = g_count;
+    return g_count;
+}
+
+int intern(const char* s)
+{
+    int id;
+
+    if (s == NULL) return 0;
+    static_lock(&g_lock);
+    id = intern_locked(s);
+    static_unlock(&g_lock);
+    return id;
+}
+
+int intern_lookup(const char* s)
+{
+    int id = 0;
+
+    if (s == NULL) return 0;
+    static_lock(&g_lock);
+    if (g_slots_cap != 0)
+        id = g_slots[find_slot(s, hash_str(s))];
+    static_unlock(&g_lock);
+    return id;
+}
+
+const char* intern_str(int id)
+{
+    const char* s = "";
+
+    /* The string itself never moves; only the g_strs array does */
+    static_lock(&g_lock);
+    if (id > 0 && id <= g_count)
+        s = g_strs[id];
+    static_unlock(&g_lock);
+    return s;
+}
+
+int intern_count(void)
+{
+    int n;
+
+    static_lock(&g_lock);
+    n = g_count;
+    static_unlock(&g_lock);
+    return n;
+}
+
+void intern_clear(void)
+{
+    int id;
+
+    static_lock(&g_lock);
+    for (id = 1; id <= g_count; id++)
+        free(g_strs[id]);
+    free(g_strs);
+    free(g_slots);
+    g_strs      = NULL;
+    g_slots     = NULL;
+    g_count     = 0;
+    g_strs_cap  = 0;
+    g_slots_cap = 0;
+    static_unlock(&g_lock);
+}
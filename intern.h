@@ -0,0 +1,28 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+/*
+ * Interned string table.
+ * Each distinct string is stored once and given a small positive id.
+ * Equal strings always map to the same id (and the same pointer), so
+ * callers can compare ids instead of calling strcmp.  Ids stay valid
+ * until intern_clear().
+ * Safe to call from any thread.
+ */
+
+/* Returns the id of s, adding it if new. Returns 0 for NULL or out of memory. */
+int intern(const char* s);
+
+/* Returns the id of s, or 0 if s has never been interned. */
+int intern_lookup(const char* s);
+
+/* Returns the string for id, or "" for 0 / unknown ids. */
+const char* intern_str(int id);
+
+/* Number of strings currently interned. */
+int intern_count(void);
+
+/* Free every interned string. All previously returned ids become invalid. */
+void intern_clear(void);
+
+#endif
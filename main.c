@@ -3,9 +3,12 @@
 #include <stdio.h>
 #include "ui.h"
 #include "database.h"
+#include "db_executor.h"
+#include "template_db.h"
 
 HINSTANCE g_hInst;
 
+static HWND g_hMain;
 static HWND g_hStatus;
 static HWND g_hNav;
 static HWND g_hPanels[9];
@@ -14,11 +17,41 @@ static int  g_curPanel = -1;
 typedef void (*PanelRefreshFn)(void);
 static PanelRefreshFn g_refreshFns[9];
 
+/* Tables each panel's refresh reads; ShowPanel skips the refresh when
+   none of them changed since the panel last loaded (db_changed_since) */
+static const char* const g_panelTables[9][6] = {
+    [NAV_FORMULATIONS] = { "formulations", "latest_formulations", NULL },
+    [NAV_COMPOUNDS]    = { "compound_library", NULL },
+    [NAV_TASTING]      = { "tasting_sessions", "formulations", NULL },
+    [NAV_BATCH]        = { "batch_runs", "formulations", NULL },
+    [NAV_INVENTORY]    = { "compound_inventory", "compound_library", NULL },
+    [NAV_REGULATORY]   = { "regulatory_limits", "compound_library", NULL },
+    [NAV_SUPPLIERS]    = { "suppliers", "compound_suppliers", "compound_library", NULL },
+    [NAV_INGREDIENTS]  = { "ingredients", "suppliers", NULL },
+    [NAV_BASES]        = { "soda_bases", "latest_soda_bases", "soda_base_compounds",
+                           "soda_base_ingredients", NULL },
+};
+static int           g_panelLoaded[9];
+static unsigned long g_panelGen[9];
+
 /* Forward declarations */
 static LRESULT CALLBACK MainWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
 /* -------------------------------------------------------------------------
-   ShowPanel — hide the old panel, size and show the new one, then refresh.
+   Database executor hooks.  Completions come back on the UI thread via
+   WM_APP_DB_DONE.  Panel saves, checks and list refreshes are executor
+   jobs; the few db_* calls panels still make directly (combo fills,
+   dialog loads, deletes) take db_executor_lock around just that call.
+   ------------------------------------------------------------------------- */
+static void NotifyDbDone(void* ctx)
+{
+    (void)ctx;
+    if (g_hMain) PostMessage(g_hMain, WM_APP_DB_DONE, 0, 0);
+}
+
+/* -------------------------------------------------------------------------
+   ShowPanel — hide the old panel, size and show the new one, then refresh
+   it unless nothing it shows has been written since it last loaded.
    ------------------------------------------------------------------------- */
 static void ShowPanel(HWND hMain, int idx)
 {
@@ -44,6 +77,14 @@ static void ShowPanel(HWND hMain, int idx)
     MoveWindow(g_hPanels[idx], NAV_WIDTH, 0, pw, ph, TRUE);
 
     g_curPanel = idx;
+    db_executor_lock();
+    if (g_panelLoaded[idx] && !db_changed_since(g_panelTables[idx], g_panelGen[idx])) {
+        db_executor_unlock();
+        return;
+    }
+    g_panelGen[idx]    = db_change_generation();
+    db_executor_unlock();
+    g_panelLoaded[idx] = 1;
     g_refreshFns[idx]();
 }
 
@@ -155,6 +196,10 @@ static LRESULT CALLBACK MainWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM l
         }
         return 0;
 
+    case WM_APP_DB_DONE:
+        db_executor_dispatch();
+        return 0;
+
     case WM_DESTROY:
         PostQuitMessage(0);
         return 0;
@@ -184,14 +229,20 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
     icex.dwICC  = ICC_LISTVIEW_CLASSES | ICC_BAR_CLASSES;
     InitCommonControlsEx(&icex);
 
-    /* Open database */
+    /* Open database (first run: start from the prebuilt template) */
+    db_create_from_image("formulations.db", g_template_db, g_template_db_size);
     if (db_open("formulations.db") != 0) {
         MessageBox(NULL, "Failed to open formulations.db", "Error", MB_ICONERROR);
         return 1;
     }
-    db_seed_compound_library();
-    db_seed_inventory();
-    db_seed_essential_oils();
+    db_sync_seed_data(NULL);
+
+#ifdef _DEBUG
+    if (db_check_query_plans() > 0)
+        MessageBox(NULL, "Some queries fall back to a full table scan.\n"
+                   "Check stderr for [QUERY PLAN] details.",
+                   "Query Plan Check", MB_ICONWARNING);
+#endif
 
     /* Register main window class */
     ZeroMemory(&wc, sizeof(wc));
@@ -217,6 +268,10 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
         db_close();
         return 1;
     }
+    g_hMain = hWnd;
+
+    /* Writer + 2 readers; on failure jobs simply run inline */
+    db_executor_start("formulations.db", 2, NotifyDbDone, NULL);
 
     ShowWindow(hWnd, nCmdShow);
     UpdateWindow(hWnd);
@@ -227,6 +282,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
         DispatchMessage(&msg);
     }
 
+    g_hMain = NULL;
+    db_executor_stop();
     db_close();
     return (int)msg.wParam;
 }
@@ -0,0 +1,73 @@
+/*
+ * mktemplate.c — build tool that writes template_db.c.
+ *
+ * Builds the starting database in memory (db_open runs every migration,
+ * db_sync_seed_data loads compound_data.h), compacts it, and emits the
+ * sqlite3_serialize image as a C array.  SodaFormulator.vcxproj runs it
+ * before compiling whenever compound_data.h or database.c changes.
+ *
+ * Usage: mktemplate [output.c]      (default: template_db.c)
+ */
+#include <stdio.h>
+#include "database.h"
+#include "sqlite3.h"
+
+static int write_template(const char* out_path,
+                          const unsigned char* image, sqlite3_int64 size)
+{
+    FILE*         fp;
+    sqlite3_int64 i;
+
+    fp = fopen(out_path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Cannot write '%s'\n", out_path);
+        return 1;
+    }
+
+    fprintf(fp, "/* Generated by mktemplate from compound_data.h - do not edit. */\n");
+    fprintf(fp, "#include \"template_db.h\"\n\n");
+    fprintf(fp, "const unsigned char g_template_db[] = {\n");
+    for (i = 0; i < size; i++) {
+        fprintf(fp, "%s0x%02x,", (i % 16) == 0 ? "    " : "", image[i]);
+        if ((i % 16) == 15 || i == size - 1) fputc('\n', fp);
+    }
+    fprintf(fp, "};\n\n");
+    fprintf(fp, "const size_t g_template_db_size = sizeof(g_template_db);\n");
+
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "Error writing '%s'\n", out_path);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    const char*    out_path = argc > 1 ? argv[1] : "template_db.c";
+    unsigned char* image;
+    sqlite3_int64  size = 0;
+    int            rc;
+
+    if (db_open(":memory:") != 0)
+        return 1;
+    if (db_sync_seed_data(NULL) != 0) {
+        db_close();
+        return 1;
+    }
+    sqlite3_exec(db_get_handle(), "VACUUM;", NULL, NULL, NULL);
+
+    image = sqlite3_serialize(db_get_handle(), "main", &size, 0);
+    if (image == NULL) {
+        fprintf(stderr, "sqlite3_serialize failed\n");
+        db_close();
+        return 1;
+    }
+
+    rc = write_template(out_path, image, size);
+    if (rc == 0)
+        printf("Wrote %s (%lld bytes)\n", out_path, (long long)size);
+
+    sqlite3_free(image);
+    db_close();
+    return rc;
+}
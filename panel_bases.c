@@ -1,12 +1,17 @@
 #include <windows.h>
 #include <commctrl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "ui.h"
 #include "database.h"
+#include "db_executor.h"
 #include "soda_base.h"
 #include "ingredient.h"
+#include "intern.h"
 #include "sqlite3.h"
+#include "panel_sql.h"
+#include "panel_rows.h"
 
 /* =========================================================================
    File-scope state
@@ -81,7 +86,7 @@ static void DlgRefreshBaseCpdList(void)
 
     for (i = 0; i < g_baseDlgData.compound_count; i++) {
         LV_InsertRow(g_hBaseDlgCpdLV, i,
-                     g_baseDlgData.compounds[i].compound_name, (LPARAM)i);
+                     intern_str(g_baseDlgData.compounds[i].name_id), (LPARAM)i);
         snprintf(buf, sizeof(buf), "%.2f",
                  g_baseDlgData.compounds[i].concentration_ppm);
         LV_SetCell(g_hBaseDlgCpdLV, i, 1, buf);
@@ -119,11 +124,14 @@ static void FilterBaseIngCombo(HWND hCombo, const char *filter)
 
     snprintf(pat, sizeof(pat), "%%%s%%", filter ? filter : "");
 
+    db_executor_lock();
     if (sqlite3_prepare_v2(db,
         "SELECT id, ingredient_name FROM ingredients "
         "WHERE ingredient_name LIKE ? ORDER BY ingredient_name;",
-        -1, &stmt, NULL) != SQLITE_OK)
+        -1, &stmt, NULL) != SQLITE_OK) {
+        db_executor_unlock();
         return;
+    }
 
     sqlite3_bind_text(stmt, 1, pat, -1, SQLITE_TRANSIENT);
     while (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -133,6 +141,46 @@ static void FilterBaseIngCombo(HWND hCombo, const char *filter)
         SendMessage(hCombo, CB_SETITEMDATA, (WPARAM)ci, (LPARAM)id);
     }
     sqlite3_finalize(stmt);
+    db_executor_unlock();
+}
+
+/* =========================================================================
+   Save — db_save_soda_base runs as a write job on a copy of the base; the
+   dialog is disabled until BaseSaveDone closes it or reports the failure.
+   ========================================================================= */
+typedef struct {
+    HWND     hDlg;
+    SodaBase base;
+} BaseSaveJob;
+
+static int BaseSaveJobRun(sqlite3* db, void* arg)
+{
+    BaseSaveJob* j = (BaseSaveJob*)arg;
+
+    (void)db;
+    return db_save_soda_base(&j->base);
+}
+
+static void BaseSaveDone(int job_id, int result, void* arg)
+{
+    BaseSaveJob* j = (BaseSaveJob*)arg;
+
+    (void)job_id;
+    if (IsWindow(j->hDlg)) {
+        EnableWindow(j->hDlg, TRUE);
+        if (result == -1) {
+            MessageBox(j->hDlg,
+                "Save failed: this version already exists.",
+                "Error", MB_ICONERROR);
+        } else if (result != 0) {
+            MessageBox(j->hDlg, "Save failed.", "Error", MB_ICONERROR);
+        } else {
+            g_baseDlgSaved = TRUE;
+            g_baseDlgDone  = TRUE;
+            DestroyWindow(j->hDlg);
+        }
+    }
+    free(j);
 }
 
 /* =========================================================================
@@ -216,6 +264,7 @@ static LRESULT CALLBACK BaseDlgWndProc(HWND hWnd, UINT msg,
             WS_CHILD|WS_VISIBLE|CBS_DROPDOWNLIST|WS_VSCROLL,
             lx+35, y, 250, 250,
             hWnd, (HMENU)(INT_PTR)IDC_BASE_CPD_COMBO, g_hInst, NULL);
+        db_executor_lock();
         if (db && sqlite3_prepare_v2(db,
             "SELECT compound_name FROM compound_library ORDER BY compound_name;",
             -1, &stmt, NULL) == SQLITE_OK) {
@@ -225,6 +274,7 @@ static LRESULT CALLBACK BaseDlgWndProc(HWND hWnd, UINT msg,
             }
             sqlite3_finalize(stmt);
         }
+        db_executor_unlock();
         SendMessage(hCombo, CB_SETCURSEL, 0, 0);
 
         CreateWindowEx(0, "STATIC", "ppm:",
@@ -274,6 +324,7 @@ static LRESULT CALLBACK BaseDlgWndProc(HWND hWnd, UINT msg,
             WS_CHILD|WS_VISIBLE|CBS_DROPDOWN|WS_VSCROLL,
             lx+35, y, 220, 250,
             hWnd, (HMENU)(INT_PTR)IDC_BASE_ING_COMBO, g_hInst, NULL);
+        db_executor_lock();
         if (db && sqlite3_prepare_v2(db,
             "SELECT id, ingredient_name FROM ingredients ORDER BY ingredient_name;",
             -1, &stmt, NULL) == SQLITE_OK) {
@@ -286,6 +337,7 @@ static LRESULT CALLBACK BaseDlgWndProc(HWND hWnd, UINT msg,
             }
             sqlite3_finalize(stmt);
         }
+        db_executor_unlock();
         SendMessage(hCombo, CB_SETCURSEL, 0, 0);
 
         CreateWindowEx(WS_EX_CLIENTEDGE, "EDIT", "0.0",
@@ -376,9 +428,7 @@ static LRESULT CALLBACK BaseDlgWndProc(HWND hWnd, UINT msg,
                 MessageBox(hWnd, "Enter a positive ppm value.", "Input", MB_OK);
                 return 0;
             }
-            strncpy(g_baseDlgData.compounds[g_baseDlgData.compound_count].compound_name,
-                    name, 63);
-            g_baseDlgData.compounds[g_baseDlgData.compound_count].compound_name[63] = '\0';
+            g_baseDlgData.compounds[g_baseDlgData.compound_count].name_id = intern(name);
             g_baseDlgData.compounds[g_baseDlgData.compound_count].concentration_ppm = ppm;
             g_baseDlgData.compounds[g_baseDlgData.compound_count].compound_library_id = 0;
             g_baseDlgData.compound_count++;
@@ -468,7 +518,7 @@ static LRESULT CALLBACK BaseDlgWndProc(HWND hWnd, UINT msg,
         /* ---- Save ---- */
         if (ctl == IDC_BBASE_SAVE) {
             char code[MAX_BASE_CODE], name[MAX_BASE_NAME], yieldStr[32];
-            int rc;
+            BaseSaveJob* j;
 
             GetWindowText(GetDlgItem(hWnd, IDC_BASE_CODE),  code,     sizeof(code));
             GetWindowText(GetDlgItem(hWnd, IDC_BASE_NAME),  name,     sizeof(name));
@@ -491,21 +541,19 @@ static LRESULT CALLBACK BaseDlgWndProc(HWND hWnd, UINT msg,
                 g_baseDlgData.version =
                     increment_version(g_baseDlgData.version, INCREMENT_PATCH);
 
-            rc = db_save_soda_base(&g_baseDlgData);
-            if (rc == -1) {
-                MessageBox(hWnd,
-                    "Save failed: this version already exists.",
-                    "Error", MB_ICONERROR);
-                return 0;
-            }
-            if (rc != 0) {
+            j = (BaseSaveJob*)malloc(sizeof(BaseSaveJob));
+            if (j == NULL) return 0;
+            j->hDlg = hWnd;
+            j->base = g_baseDlgData;
+
+            /* Without a running executor BaseSaveDone has already run,
+               and may have destroyed hWnd, when submit returns */
+            EnableWindow(hWnd, FALSE);
+            if (db_executor_submit_write(BaseSaveJobRun, BaseSaveDone, j) < 0) {
+                free(j);
+                EnableWindow(hWnd, TRUE);
                 MessageBox(hWnd, "Save failed.", "Error", MB_ICONERROR);
-                return 0;
             }
-
-            g_baseDlgSaved = TRUE;
-            g_baseDlgDone  = TRUE;
-            DestroyWindow(hWnd);
             return 0;
         }
 
@@ -651,8 +699,12 @@ static LRESULT CALLBACK BasesPanelWndProc(HWND hWnd, UINT msg,
                 if (sel < 0) return 0;
                 ListView_GetItemText(g_hLVBases, sel, 0,
                                      base_code, sizeof(base_code));
+                int rc;
                 ZeroMemory(&g_baseDlgData, sizeof(g_baseDlgData));
-                if (db_load_latest_base(base_code, &g_baseDlgData) != 0) {
+                db_executor_lock();
+                rc = db_load_latest_base(base_code, &g_baseDlgData);
+                db_executor_unlock();
+                if (rc != 0) {
                     MessageBox(hWnd, "Failed to load soda base.", "Error",
                                MB_ICONERROR);
                     return 0;
@@ -677,7 +729,9 @@ static LRESULT CALLBACK BasesPanelWndProc(HWND hWnd, UINT msg,
                         "Confirm Delete",
                         MB_YESNO | MB_ICONWARNING) != IDYES)
                     return 0;
+                db_executor_lock();
                 rc = db_delete_soda_base(base_code);
+                db_executor_unlock();
                 if (rc == 1) {
                     MessageBox(hWnd,
                         "Cannot delete: base is referenced by a formulation.",
@@ -745,63 +799,78 @@ HWND Panel_Bases_Create(HWND hParent)
 }
 
 /* =========================================================================
-   Panel_Bases_Refresh
+   Panel_Bases_Refresh — the list and selection are reset at once; the
+   query runs on a reader thread (BaseListJob) and BaseListDone fills the
+   list unless a newer refresh has been started.
    ========================================================================= */
+static int g_refreshSeq = 0;   /* only the newest query fills the list */
+static int g_refreshJob = 0;   /* its executor job id, for cancelling  */
+
+static int BaseListJob(sqlite3* db, void* arg)
+{
+    PanelRows*    r    = (PanelRows*)arg;
+    sqlite3_stmt* stmt = NULL;
+    int           rc;
+
+    rc = sqlite3_prepare_v2(db, SQL_BASES_REFRESH, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return rc;
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        PanelCell* c = panel_rows_add(r, (LPARAM)sqlite3_column_int(stmt, 0));
+        if (c == NULL) { rc = SQLITE_NOMEM; break; }
+
+        panel_cell_text(c[0], sqlite3_column_text(stmt, 1), "");
+        panel_cell_text(c[1], sqlite3_column_text(stmt, 2), "");
+        snprintf(c[2], PANEL_ROWS_CELL, "%d.%d.%d",
+                 sqlite3_column_int(stmt, 3),
+                 sqlite3_column_int(stmt, 4),
+                 sqlite3_column_int(stmt, 5));
+        snprintf(c[3], PANEL_ROWS_CELL, "%.2f", sqlite3_column_double(stmt, 6));
+        snprintf(c[4], PANEL_ROWS_CELL, "%d",   sqlite3_column_int(stmt, 8));
+        snprintf(c[5], PANEL_ROWS_CELL, "%d",   sqlite3_column_int(stmt, 9));
+        panel_cell_text(c[6], sqlite3_column_text(stmt, 7), "");
+    }
+
+    sqlite3_finalize(stmt);
+    return (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+}
+
+static void BaseListDone(int job_id, int result, void* arg)
+{
+    PanelRows* r = (PanelRows*)arg;
+
+    (void)job_id;
+
+    /* Superseded, cancelled or failed: leave the list empty */
+    if (r->seq == g_refreshSeq && result == SQLITE_OK && g_hLVBases) {
+        g_refreshJob = 0;
+        panel_rows_fill(g_hLVBases, r);
+    }
+
+    panel_rows_free(r);
+    free(r);
+}
+
 void Panel_Bases_Refresh(void)
 {
-    sqlite3      *db   = db_get_handle();
-    sqlite3_stmt *stmt = NULL;
-    int           row  = 0;
+    PanelRows* r;
 
-    if (!g_hLVBases || !db) return;
+    if (!g_hLVBases || !db_get_handle()) return;
 
     ListView_DeleteAllItems(g_hLVBases);
     g_selBaseId = 0;
     EnableWindow(g_hBtnEdit, FALSE);
     EnableWindow(g_hBtnDel,  FALSE);
 
-    if (sqlite3_prepare_v2(db,
-        "SELECT sb.id, sb.base_code, sb.base_name, "
-        "       sb.ver_major, sb.ver_minor, sb.ver_patch, "
-        "       sb.yield_liters, sb.saved_at, "
-        "       (SELECT COUNT(*) FROM soda_base_compounds WHERE soda_base_id=sb.id), "
-        "       (SELECT COUNT(*) FROM soda_base_ingredients WHERE soda_base_id=sb.id) "
-        "FROM soda_bases sb "
-        "WHERE sb.id = ("
-        "    SELECT id FROM soda_bases WHERE base_code = sb.base_code "
-        "    ORDER BY ver_major DESC, ver_minor DESC, ver_patch DESC LIMIT 1"
-        ") "
-        "ORDER BY sb.base_code;",
-        -1, &stmt, NULL) != SQLITE_OK)
-        return;
+    r = (PanelRows*)calloc(1, sizeof(PanelRows));
+    if (r == NULL) return;
+    r->columns = 7;
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        int         id      = sqlite3_column_int(stmt, 0);
-        const char *code    = (const char *)sqlite3_column_text(stmt, 1);
-        const char *name    = (const char *)sqlite3_column_text(stmt, 2);
-        int         vmaj    = sqlite3_column_int(stmt, 3);
-        int         vmin    = sqlite3_column_int(stmt, 4);
-        int         vpat    = sqlite3_column_int(stmt, 5);
-        double      yield   = sqlite3_column_double(stmt, 6);
-        const char *saved   = (const char *)sqlite3_column_text(stmt, 7);
-        int         ncpd    = sqlite3_column_int(stmt, 8);
-        int         ning    = sqlite3_column_int(stmt, 9);
-        char ver[16], yieldbuf[16], cpdbuf[8], ingbuf[8];
-        int actual;
-
-        snprintf(ver,      sizeof(ver),      "%d.%d.%d", vmaj, vmin, vpat);
-        snprintf(yieldbuf, sizeof(yieldbuf), "%.2f",     yield);
-        snprintf(cpdbuf,   sizeof(cpdbuf),   "%d",       ncpd);
-        snprintf(ingbuf,   sizeof(ingbuf),   "%d",       ning);
-
-        actual = LV_InsertRow(g_hLVBases, row, code ? code : "", (LPARAM)id);
-        LV_SetCell(g_hLVBases, actual, 1, name  ? name  : "");
-        LV_SetCell(g_hLVBases, actual, 2, ver);
-        LV_SetCell(g_hLVBases, actual, 3, yieldbuf);
-        LV_SetCell(g_hLVBases, actual, 4, cpdbuf);
-        LV_SetCell(g_hLVBases, actual, 5, ingbuf);
-        LV_SetCell(g_hLVBases, actual, 6, saved ? saved : "");
-        row++;
+    if (g_refreshJob > 0) db_executor_cancel(g_refreshJob);
+    r->seq = ++g_refreshSeq;
+    g_refreshJob = db_executor_submit_read(BaseListJob, BaseListDone, r);
+    if (g_refreshJob < 0) {
+        g_refreshJob = 0;
+        free(r);
     }
-    sqlite3_finalize(stmt);
 }
@@ -6,9 +6,11 @@
 #include <stdlib.h>
 #include "ui.h"
 #include "database.h"
+#include "db_executor.h"
 #include "formulation.h"
 #include "batch.h"
 #include "sqlite3.h"
+#include "row_provider.h"
 
 /* =========================================================================
    File-scope state
@@ -17,6 +19,7 @@ static HWND g_hPanel       = NULL;
 static HWND g_hListView    = NULL;
 static HWND g_hFilterCombo = NULL;
 static HWND g_hBtnNew;
+static RowProvider* g_rows = NULL;
 
 /* Dialog state */
 static BOOL    g_dlgDone;
@@ -41,20 +44,25 @@ static void LV_AddCol(HWND hLV, int idx, const char* text, int width)
     ListView_InsertColumn(hLV, idx, &lvc);
 }
 
-static int LV_InsertRow(HWND hLV, int row, const char* col0)
+/* Owner-data ListView: cells come from g_rows, a page at a time, off
+   the main connection, so each fetch holds db_executor_lock. */
+static void LV_HandleOwnerData(NMHDR* pnm)
 {
-    LVITEM lvi;
-    ZeroMemory(&lvi, sizeof(lvi));
-    lvi.mask     = LVIF_TEXT;
-    lvi.iItem    = row;
-    lvi.iSubItem = 0;
-    lvi.pszText  = (char*)col0;
-    return ListView_InsertItem(hLV, &lvi);
-}
-
-static void LV_SetCell(HWND hLV, int row, int col, const char* text)
-{
-    ListView_SetItemText(hLV, row, col, (char*)text);
+    if (pnm->code == LVN_GETDISPINFO) {
+        LVITEM* item = &((NMLVDISPINFO*)pnm)->item;
+        if (item->mask & LVIF_TEXT) {
+            db_executor_lock();
+            lstrcpyn(item->pszText,
+                     row_provider_cell(g_rows, item->iItem, item->iSubItem),
+                     item->cchTextMax);
+            db_executor_unlock();
+        }
+    } else if (pnm->code == LVN_ODCACHEHINT) {
+        NMLVCACHEHINT* hint = (NMLVCACHEHINT*)pnm;
+        db_executor_lock();
+        row_provider_prefetch(g_rows, hint->iFrom, hint->iTo - hint->iFrom + 1);
+        db_executor_unlock();
+    }
 }
 
 /* =========================================================================
@@ -72,6 +80,7 @@ static void PopulateFlavorCombo(HWND hCombo)
     SendMessage(hCombo, CB_RESETCONTENT, 0, 0);
     SendMessage(hCombo, CB_ADDSTRING, 0, (LPARAM)"(All)");
 
+    db_executor_lock();
     if (sqlite3_prepare_v2(db,
             "SELECT DISTINCT flavor_code FROM formulations ORDER BY flavor_code;",
             -1, &stmt, NULL) == SQLITE_OK)
@@ -82,6 +91,7 @@ static void PopulateFlavorCombo(HWND hCombo)
         }
         sqlite3_finalize(stmt);
     }
+    db_executor_unlock();
 
     SendMessage(hCombo, CB_SETCURSEL, (prev >= 0 ? prev : 0), 0);
 }
@@ -95,6 +105,7 @@ static void DlgPopulateVersionCombo(HWND hVerCombo, const char* flavor)
 
     SendMessage(hVerCombo, CB_RESETCONTENT, 0, 0);
 
+    db_executor_lock();
     if (sqlite3_prepare_v2(db,
             "SELECT ver_major, ver_minor, ver_patch FROM formulations "
             "WHERE flavor_code=? ORDER BY ver_major DESC, ver_minor DESC, ver_patch DESC;",
@@ -111,32 +122,104 @@ static void DlgPopulateVersionCombo(HWND hVerCombo, const char* flavor)
         }
         sqlite3_finalize(stmt);
     }
+    db_executor_unlock();
 
     SendMessage(hVerCombo, CB_SETCURSEL, 0, 0);
 }
 
 /* =========================================================================
-   Build auto batch number string (same logic as db_save_batch)
+   Preview the next auto batch number.  It is only reserved when the batch
+   is saved, so the preview is remembered: left untouched, the field is
+   saved empty and db_save_batch numbers the batch itself.
    ========================================================================= */
+static char g_autoBatchNo[MAX_BATCH_NUMBER];
+
 static void BuildBatchNumber(const char* flavor, char* out, int outLen)
 {
-    sqlite3*      db   = db_get_handle();
-    sqlite3_stmt* stmt = NULL;
-    int           seq  = 1;
+    db_executor_lock();
+    if (db_peek_batch_number(flavor, out, outLen) != 0)
+        out[0] = '\0';
+    db_executor_unlock();
+    strncpy(g_autoBatchNo, out, MAX_BATCH_NUMBER - 1);
+    g_autoBatchNo[MAX_BATCH_NUMBER - 1] = '\0';
+}
 
-    if (db && sqlite3_prepare_v2(db,
-            "SELECT COUNT(*) FROM batch_runs br "
-            "JOIN formulations f ON f.id = br.formulation_id "
-            "WHERE f.flavor_code = ?;",
-            -1, &stmt, NULL) == SQLITE_OK)
-    {
-        sqlite3_bind_text(stmt, 1, flavor, -1, SQLITE_STATIC);
-        if (sqlite3_step(stmt) == SQLITE_ROW)
-            seq = sqlite3_column_int(stmt, 0) + 1;
-        sqlite3_finalize(stmt);
+/* =========================================================================
+   Check Inventory and Save — both scale the formulation's ingredients to
+   the volume as a write job; Save then records the batch.  The dialog is
+   disabled while the job runs and BatchJobDone updates or closes it.
+   ========================================================================= */
+typedef struct {
+    HWND     hDlg;
+    BOOL     save;                        /* FALSE = check only */
+    char     flavor[MAX_FLAVOR_CODE];
+    int      major, minor, patch;
+    float    vol;
+    char     batchno[MAX_BATCH_NUMBER];   /* "" = numbered on save */
+    BatchRun br;
+} BatchJob;
+
+static int BatchJobRun(sqlite3* db, void* arg)
+{
+    BatchJob*      b = (BatchJob*)arg;
+    FormBase       bases[MAX_FORM_BASES];
+    FormIngredient ings[MAX_FORM_INGREDIENTS];
+    int            bc = 0, ic = 0;
+
+    (void)db;
+    ZeroMemory(&b->br, sizeof(b->br));
+    db_load_formulation_extras(b->flavor, b->major, b->minor, b->patch,
+                               bases, &bc, ings, &ic);
+    batch_calculate_from_ingredients(&b->br, bases, bc, ings, ic, b->vol);
+    if (!b->save) return 0;
+
+    strncpy(b->br.batch_number, b->batchno, MAX_BATCH_NUMBER - 1);
+    return db_save_batch(b->flavor, b->major, b->minor, b->patch, &b->br) != 0 ? -1 : 0;
+}
+
+static void BatchJobDone(int job_id, int result, void* arg)
+{
+    BatchJob* b = (BatchJob*)arg;
+    char      costBuf[64];
+
+    (void)job_id;
+    if (!IsWindow(b->hDlg)) {
+        free(b);
+        return;
     }
+    EnableWindow(b->hDlg, TRUE);
 
-    snprintf(out, outLen, "%s-2026-%03d", flavor, seq);
+    if (b->save) {
+        if (result != 0) {
+            MessageBox(b->hDlg, "Failed to save batch.", "Error", MB_ICONERROR);
+        } else {
+            g_dlgSaved = TRUE;
+            g_dlgDone  = TRUE;
+            DestroyWindow(b->hDlg);
+        }
+    } else if (result == 0) {
+        if (b->br.cost_total >= 0.0f)
+            sprintf(costBuf, "$%.4f", b->br.cost_total);
+        else
+            strcpy(costBuf, "(missing cost data)");
+
+        SetWindowText(GetDlgItem(b->hDlg, IDC_DLG_STATUS_LBL), "Ingredients calculated.");
+        SetWindowText(GetDlgItem(b->hDlg, IDC_DLG_COST_LBL),   costBuf);
+    }
+    free(b);
+}
+
+/* Submit b for hDlg.  Without a running executor BatchJobDone has already
+   run, and may have destroyed hDlg, when this returns. */
+static void BatchJobSubmit(HWND hDlg, BatchJob* b)
+{
+    b->hDlg = hDlg;
+    EnableWindow(hDlg, FALSE);
+    if (db_executor_submit_write(BatchJobRun, BatchJobDone, b) < 0) {
+        free(b);
+        EnableWindow(hDlg, TRUE);
+        MessageBox(hDlg, "The database is not available.", "Error", MB_ICONERROR);
+    }
 }
 
 /* =========================================================================
@@ -280,9 +363,7 @@ static LRESULT CALLBACK BatchDlgWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPAR
             int  flvSel, verSel;
             int  major, minor, patch;
             float vol;
-            BatchRun    br;
-            char        statusBuf[128];
-            char        costBuf[64];
+            BatchJob*   b;
 
             flvSel = (int)SendMessage(hFlv, CB_GETCURSEL, 0, 0);
             verSel = (int)SendMessage(hVer, CB_GETCURSEL, 0, 0);
@@ -296,25 +377,12 @@ static LRESULT CALLBACK BatchDlgWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPAR
             vol = (float)atof(volStr);
             if (vol <= 0.0f) { MessageBox(hWnd, "Enter a positive volume.", "Input", MB_OK); break; }
 
-            ZeroMemory(&br, sizeof(br));
-            {
-                FormBase       bases[MAX_FORM_BASES];
-                FormIngredient ings[MAX_FORM_INGREDIENTS];
-                int            bc = 0, ic = 0;
-                db_load_formulation_extras(flvBuf, major, minor, patch,
-                                           bases, &bc, ings, &ic);
-                batch_calculate_from_ingredients(&br, bases, bc, ings, ic, vol);
-            }
-
-            strcpy(statusBuf, "Ingredients calculated.");
-
-            if (br.cost_total >= 0.0f)
-                sprintf(costBuf, "$%.4f", br.cost_total);
-            else
-                strcpy(costBuf, "(missing cost data)");
-
-            SetWindowText(GetDlgItem(hWnd, IDC_DLG_STATUS_LBL), statusBuf);
-            SetWindowText(GetDlgItem(hWnd, IDC_DLG_COST_LBL),   costBuf);
+            b = (BatchJob*)calloc(1, sizeof(BatchJob));
+            if (b == NULL) break;
+            strcpy(b->flavor, flvBuf);
+            b->major = major; b->minor = minor; b->patch = patch;
+            b->vol   = vol;
+            BatchJobSubmit(hWnd, b);
             break;
         }
 
@@ -334,7 +402,7 @@ static LRESULT CALLBACK BatchDlgWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPAR
             int  flvSel, verSel;
             int  major, minor, patch;
             float vol;
-            BatchRun    br;
+            BatchJob*   b;
 
             flvSel = (int)SendMessage(hFlv, CB_GETCURSEL, 0, 0);
             verSel = (int)SendMessage(hVer, CB_GETCURSEL, 0, 0);
@@ -356,27 +424,15 @@ static LRESULT CALLBACK BatchDlgWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPAR
 
             GetWindowText(GetDlgItem(hWnd, IDC_DLG_BATCHNO), batchnoStr, sizeof(batchnoStr));
 
-            ZeroMemory(&br, sizeof(br));
-            {
-                FormBase       bases[MAX_FORM_BASES];
-                FormIngredient ings[MAX_FORM_INGREDIENTS];
-                int            bc = 0, ic = 0;
-                db_load_formulation_extras(flvBuf, major, minor, patch,
-                                           bases, &bc, ings, &ic);
-                batch_calculate_from_ingredients(&br, bases, bc, ings, ic, vol);
-            }
-
-            if (batchnoStr[0])
-                strncpy(br.batch_number, batchnoStr, MAX_BATCH_NUMBER - 1);
-
-            if (db_save_batch(flvBuf, major, minor, patch, &br) != 0) {
-                MessageBox(hWnd, "Failed to save batch.", "Error", MB_ICONERROR);
-                break;
-            }
-
-            g_dlgSaved = TRUE;
-            g_dlgDone  = TRUE;
-            DestroyWindow(hWnd);
+            b = (BatchJob*)calloc(1, sizeof(BatchJob));
+            if (b == NULL) break;
+            b->save = TRUE;
+            strcpy(b->flavor, flvBuf);
+            b->major = major; b->minor = minor; b->patch = patch;
+            b->vol   = vol;
+            if (batchnoStr[0] && strcmp(batchnoStr, g_autoBatchNo) != 0)
+                strcpy(b->batchno, batchnoStr);
+            BatchJobSubmit(hWnd, b);
         }
     }
     return 0;
@@ -397,6 +453,51 @@ static LRESULT CALLBACK BatchDlgWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPAR
 /* Stored batch number for the label dialog (set by OpenFDALabelDialog) */
 static char g_labelBatchNo[MAX_BATCH_NUMBER];
 
+/* Put a saved label setting, if there is one, into control id */
+static void LabelSettingText(HWND hWnd, int id, const char* key)
+{
+    char saved[256];
+    int  found;
+
+    db_executor_lock();
+    found = db_get_setting(key, saved, sizeof(saved));
+    db_executor_unlock();
+    if (found && saved[0])
+        SetDlgItemText(hWnd, id, saved);
+}
+
+/* Save Settings — the six label settings, written as one write job */
+typedef struct {
+    HWND hDlg;
+    char co_name[128], co_addr[256];
+    char oz_str[16],   sv_str[16];
+    char sweetener[64], acid[64];
+} LabelSettingsJob;
+
+static int LabelSettingsJobRun(sqlite3* db, void* arg)
+{
+    LabelSettingsJob* l = (LabelSettingsJob*)arg;
+
+    (void)db;
+    db_set_setting("company_name",    l->co_name);
+    db_set_setting("company_address", l->co_addr);
+    db_set_setting("label_cont_oz",   l->oz_str);
+    db_set_setting("label_servings",  l->sv_str);
+    db_set_setting("label_sweetener", l->sweetener);
+    db_set_setting("label_acid",      l->acid);
+    return 0;
+}
+
+static void LabelSettingsDone(int job_id, int result, void* arg)
+{
+    LabelSettingsJob* l = (LabelSettingsJob*)arg;
+
+    (void)job_id;
+    if (result == 0 && IsWindow(l->hDlg))
+        MessageBox(l->hDlg, "Settings saved.", "Saved", MB_OK);
+    free(l);
+}
+
 static LRESULT CALLBACK FDALabelDlgWndProc(HWND hWnd, UINT msg,
                                             WPARAM wParam, LPARAM lParam)
 {
@@ -406,7 +507,6 @@ static LRESULT CALLBACK FDALabelDlgWndProc(HWND hWnd, UINT msg,
     {
         int lx = 10, lw = 90, ex = 105, ew = 400, rh = 22;
         int y = 10;
-        char saved[256];
 
         /* Company Name */
         CreateWindowEx(0, "STATIC", "Company:",
@@ -416,8 +516,7 @@ static LRESULT CALLBACK FDALabelDlgWndProc(HWND hWnd, UINT msg,
             WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL,
             ex, y, ew, rh, hWnd,
             (HMENU)(INT_PTR)IDC_DLG_CO_NAME, g_hInst, NULL);
-        if (db_get_setting("company_name", saved, sizeof(saved)) && saved[0])
-            SetDlgItemText(hWnd, IDC_DLG_CO_NAME, saved);
+        LabelSettingText(hWnd, IDC_DLG_CO_NAME, "company_name");
         y += 32;
 
         /* Company Address */
@@ -428,8 +527,7 @@ static LRESULT CALLBACK FDALabelDlgWndProc(HWND hWnd, UINT msg,
             WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL,
             ex, y, ew, rh, hWnd,
             (HMENU)(INT_PTR)IDC_DLG_CO_ADDR, g_hInst, NULL);
-        if (db_get_setting("company_address", saved, sizeof(saved)) && saved[0])
-            SetDlgItemText(hWnd, IDC_DLG_CO_ADDR, saved);
+        LabelSettingText(hWnd, IDC_DLG_CO_ADDR, "company_address");
         y += 32;
 
         /* Container oz + Servings on same row */
@@ -442,8 +540,7 @@ static LRESULT CALLBACK FDALabelDlgWndProc(HWND hWnd, UINT msg,
                 WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL,
                 ex, y, 55, rh, hWnd,
                 (HMENU)(INT_PTR)IDC_DLG_CONT_OZ, g_hInst, NULL);
-            if (db_get_setting("label_cont_oz", saved, sizeof(saved)) && saved[0])
-                SetDlgItemText(hWnd, IDC_DLG_CONT_OZ, saved);
+            LabelSettingText(hWnd, IDC_DLG_CONT_OZ, "label_cont_oz");
         }
         CreateWindowEx(0, "STATIC", "Servings:",
             WS_CHILD | WS_VISIBLE,
@@ -454,8 +551,7 @@ static LRESULT CALLBACK FDALabelDlgWndProc(HWND hWnd, UINT msg,
                 WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL,
                 ex + 135, y, 40, rh, hWnd,
                 (HMENU)(INT_PTR)IDC_DLG_SERVINGS, g_hInst, NULL);
-            if (db_get_setting("label_servings", saved, sizeof(saved)) && saved[0])
-                SetDlgItemText(hWnd, IDC_DLG_SERVINGS, saved);
+            LabelSettingText(hWnd, IDC_DLG_SERVINGS, "label_servings");
         }
         y += 32;
 
@@ -469,8 +565,7 @@ static LRESULT CALLBACK FDALabelDlgWndProc(HWND hWnd, UINT msg,
                 WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL,
                 ex, y, 140, rh, hWnd,
                 (HMENU)(INT_PTR)IDC_DLG_SWEETENER, g_hInst, NULL);
-            if (db_get_setting("label_sweetener", saved, sizeof(saved)) && saved[0])
-                SetDlgItemText(hWnd, IDC_DLG_SWEETENER, saved);
+            LabelSettingText(hWnd, IDC_DLG_SWEETENER, "label_sweetener");
         }
         CreateWindowEx(0, "STATIC", "Acid:",
             WS_CHILD | WS_VISIBLE,
@@ -481,8 +576,7 @@ static LRESULT CALLBACK FDALabelDlgWndProc(HWND hWnd, UINT msg,
                 WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL,
                 ex + 195, y, 120, rh, hWnd,
                 (HMENU)(INT_PTR)IDC_DLG_ACID, g_hInst, NULL);
-            if (db_get_setting("label_acid", saved, sizeof(saved)) && saved[0])
-                SetDlgItemText(hWnd, IDC_DLG_ACID, saved);
+            LabelSettingText(hWnd, IDC_DLG_ACID, "label_acid");
         }
         y += 32;
 
@@ -553,6 +647,7 @@ static LRESULT CALLBACK FDALabelDlgWndProc(HWND hWnd, UINT msg,
             flavor_code[0] = '\0';
             ver_str[0]     = '\0';
 
+            db_executor_lock();
             if (db && sqlite3_prepare_v2(db,
                     "SELECT f.flavor_name, f.flavor_code, "
                     "       f.ver_major, f.ver_minor, f.ver_patch, f.target_brix "
@@ -575,6 +670,7 @@ static LRESULT CALLBACK FDALabelDlgWndProc(HWND hWnd, UINT msg,
                 }
                 sqlite3_finalize(stmt);
             }
+            db_executor_unlock();
 
             if (!flavor_name[0]) {
                 MessageBox(hWnd, "Could not find formulation for this batch.",
@@ -641,25 +737,19 @@ static LRESULT CALLBACK FDALabelDlgWndProc(HWND hWnd, UINT msg,
 
         if (id == IDC_BTN_SAVE_SETTINGS)
         {
-            char co_name[128], co_addr[256];
-            char oz_str[16],   sv_str[16];
-            char sweetener[64], acid[64];
-
-            GetDlgItemText(hWnd, IDC_DLG_CO_NAME,   co_name,   sizeof(co_name));
-            GetDlgItemText(hWnd, IDC_DLG_CO_ADDR,   co_addr,   sizeof(co_addr));
-            GetDlgItemText(hWnd, IDC_DLG_CONT_OZ,   oz_str,    sizeof(oz_str));
-            GetDlgItemText(hWnd, IDC_DLG_SERVINGS,  sv_str,    sizeof(sv_str));
-            GetDlgItemText(hWnd, IDC_DLG_SWEETENER, sweetener, sizeof(sweetener));
-            GetDlgItemText(hWnd, IDC_DLG_ACID,      acid,      sizeof(acid));
-
-            db_set_setting("company_name",    co_name);
-            db_set_setting("company_address", co_addr);
-            db_set_setting("label_cont_oz",   oz_str);
-            db_set_setting("label_servings",  sv_str);
-            db_set_setting("label_sweetener", sweetener);
-            db_set_setting("label_acid",      acid);
-
-            MessageBox(hWnd, "Settings saved.", "Saved", MB_OK);
+            LabelSettingsJob* l = (LabelSettingsJob*)calloc(1, sizeof(LabelSettingsJob));
+            if (l == NULL) break;
+            l->hDlg = hWnd;
+
+            GetDlgItemText(hWnd, IDC_DLG_CO_NAME,   l->co_name,   sizeof(l->co_name));
+            GetDlgItemText(hWnd, IDC_DLG_CO_ADDR,   l->co_addr,   sizeof(l->co_addr));
+            GetDlgItemText(hWnd, IDC_DLG_CONT_OZ,   l->oz_str,    sizeof(l->oz_str));
+            GetDlgItemText(hWnd, IDC_DLG_SERVINGS,  l->sv_str,    sizeof(l->sv_str));
+            GetDlgItemText(hWnd, IDC_DLG_SWEETENER, l->sweetener, sizeof(l->sweetener));
+            GetDlgItemText(hWnd, IDC_DLG_ACID,      l->acid,      sizeof(l->acid));
+
+            if (db_executor_submit_write(LabelSettingsJobRun, LabelSettingsDone, l) < 0)
+                free(l);
             break;
         }
 
@@ -798,7 +888,7 @@ static LRESULT CALLBACK BatchPanelWndProc(HWND hWnd, UINT msg, WPARAM wParam, LP
 
         g_hListView = CreateWindowEx(WS_EX_CLIENTEDGE, WC_LISTVIEW, NULL,
             WS_CHILD | WS_VISIBLE |
-            LVS_REPORT | LVS_SINGLESEL | LVS_SHOWSELALWAYS,
+            LVS_REPORT | LVS_SINGLESEL | LVS_SHOWSELALWAYS | LVS_OWNERDATA,
             0, 36, 100, 100, hWnd,
             (HMENU)(INT_PTR)IDC_LISTVIEW, g_hInst, NULL);
         ListView_SetExtendedListViewStyle(g_hListView,
@@ -826,10 +916,19 @@ static LRESULT CALLBACK BatchPanelWndProc(HWND hWnd, UINT msg, WPARAM wParam, LP
         if (pnm->idFrom == IDC_LISTVIEW && pnm->code == LVN_ITEMCHANGED) {
             int sel = ListView_GetNextItem(g_hListView, -1, LVNI_SELECTED);
             EnableWindow(g_hBtnFDALabel, sel >= 0);
+        } else if (pnm->idFrom == IDC_LISTVIEW) {
+            LV_HandleOwnerData(pnm);
         }
     }
     return 0;
 
+    case WM_DESTROY:
+        db_executor_lock();
+        row_provider_close(g_rows);
+        db_executor_unlock();
+        g_rows = NULL;
+        break;
+
     case WM_COMMAND:
     {
         int id     = LOWORD(wParam);
@@ -896,19 +995,13 @@ HWND Panel_Batch_Create(HWND hParent)
 void Panel_Batch_Refresh(void)
 {
     sqlite3*      db    = db_get_handle();
-    sqlite3_stmt* stmt  = NULL;
     char          filter[MAX_FLAVOR_CODE];
     int           fsel;
-    int           row   = 0;
-    char          buf[32];
-    char          sql[512];
 
     if (!g_hListView || !db) return;
 
     PopulateFlavorCombo(g_hFilterCombo);
 
-    ListView_DeleteAllItems(g_hListView);
-
     fsel = (int)SendMessage(g_hFilterCombo, CB_GETCURSEL, 0, 0);
     if (fsel > 0) {
         SendMessage(g_hFilterCombo, CB_GETLBTEXT, fsel, (LPARAM)filter);
@@ -916,58 +1009,14 @@ void Panel_Batch_Refresh(void)
         filter[0] = '\0';
     }
 
-    if (filter[0]) {
-        sprintf(sql,
-            "SELECT br.batch_number, f.flavor_code, "
-            "       f.ver_major, f.ver_minor, f.ver_patch, "
-            "       br.volume_liters, br.cost_total, br.batched_at "
-            "FROM batch_runs br "
-            "JOIN formulations f ON f.id = br.formulation_id "
-            "WHERE f.flavor_code = '%s' "
-            "ORDER BY br.batched_at ASC;", filter);
-    } else {
-        sprintf(sql,
-            "SELECT br.batch_number, f.flavor_code, "
-            "       f.ver_major, f.ver_minor, f.ver_patch, "
-            "       br.volume_liters, br.cost_total, br.batched_at "
-            "FROM batch_runs br "
-            "JOIN formulations f ON f.id = br.formulation_id "
-            "ORDER BY br.batched_at ASC;");
-    }
-
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK)
-        return;
-
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char* bn    = (const char*)sqlite3_column_text(stmt, 0);
-        const char* code  = (const char*)sqlite3_column_text(stmt, 1);
-
-        LV_InsertRow(g_hListView, row, bn ? bn : "");
-        LV_SetCell(g_hListView, row, 1, code ? code : "");
-
-        sprintf(buf, "%d.%d.%d",
-            sqlite3_column_int(stmt, 2),
-            sqlite3_column_int(stmt, 3),
-            sqlite3_column_int(stmt, 4));
-        LV_SetCell(g_hListView, row, 2, buf);
-
-        sprintf(buf, "%.2f", sqlite3_column_double(stmt, 5));
-        LV_SetCell(g_hListView, row, 3, buf);
-
-        if (sqlite3_column_type(stmt, 6) == SQLITE_NULL) {
-            strcpy(buf, "--");
-        } else {
-            sprintf(buf, "$%.4f", sqlite3_column_double(stmt, 6));
-        }
-        LV_SetCell(g_hListView, row, 4, buf);
-
-        {
-            const char* d = (const char*)sqlite3_column_text(stmt, 7);
-            LV_SetCell(g_hListView, row, 5, d ? d : "");
-        }
-
-        row++;
-    }
+    /* Only the key index is walked here; rows are fetched as they scroll in */
+    db_executor_lock();
+    row_provider_close(g_rows);
+    g_rows = row_provider_open(db, ROW_SOURCE_BATCHES, filter);
+    db_executor_unlock();
 
-    sqlite3_finalize(stmt);
+    ListView_SetItemState(g_hListView, -1, 0, LVIS_SELECTED | LVIS_FOCUSED);
+    ListView_SetItemCountEx(g_hListView, row_provider_count(g_rows), 0);
+    EnableWindow(g_hBtnFDALabel, FALSE);
+    InvalidateRect(g_hListView, NULL, TRUE);
 }
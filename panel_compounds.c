@@ -5,8 +5,10 @@
 #include <stdlib.h>
 #include "ui.h"
 #include "database.h"
+#include "db_executor.h"
 #include "compound.h"
 #include "sqlite3.h"
+#include "panel_sql.h"
 
 /* =========================================================================
    Panel-internal constants
@@ -398,6 +400,42 @@ static void OpenPopOutWindow(const CompoundInfo* c)
         free(copy);
 }
 
+/* =========================================================================
+   Edit Cost save — a write job; the dialog is disabled until CostSaveDone
+   closes it or reports the failure.
+   ========================================================================= */
+typedef struct {
+    HWND  hDlg;
+    char  compound[128];
+    float cost;
+} CostSaveJob;
+
+static int CostSaveJobRun(sqlite3* db, void* arg)
+{
+    CostSaveJob* c = (CostSaveJob*)arg;
+
+    (void)db;
+    return db_set_compound_cost(c->compound, c->cost) == 0 ? 0 : -1;
+}
+
+static void CostSaveDone(int job_id, int result, void* arg)
+{
+    CostSaveJob* c = (CostSaveJob*)arg;
+
+    (void)job_id;
+    if (IsWindow(c->hDlg)) {
+        EnableWindow(c->hDlg, TRUE);
+        if (result == 0) {
+            g_dlgSaved = TRUE;
+            g_dlgDone  = TRUE;
+            DestroyWindow(c->hDlg);
+        } else {
+            MessageBox(c->hDlg, "Failed to update cost.", "Error", MB_ICONERROR);
+        }
+    }
+    free(c);
+}
+
 /* =========================================================================
    Edit Cost dialog WndProc
    ========================================================================= */
@@ -409,8 +447,7 @@ static LRESULT CALLBACK CostDlgWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
     {
         char label[160];
         char curCost[32];
-        sqlite3*      db   = db_get_handle();
-        sqlite3_stmt* stmt = NULL;
+        CompoundInfo  ci;
 
         sprintf(label, "Compound: %s", g_dlgCompoundName);
         CreateWindowEx(0, "STATIC", label,
@@ -418,17 +455,10 @@ static LRESULT CALLBACK CostDlgWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
             10, 12, 320, 18, hWnd, NULL, g_hInst, NULL);
 
         curCost[0] = '\0';
-        if (db) {
-            if (sqlite3_prepare_v2(db,
-                    "SELECT cost_per_gram FROM compound_library WHERE compound_name=?;",
-                    -1, &stmt, NULL) == SQLITE_OK)
-            {
-                sqlite3_bind_text(stmt, 1, g_dlgCompoundName, -1, SQLITE_STATIC);
-                if (sqlite3_step(stmt) == SQLITE_ROW)
-                    sprintf(curCost, "%.4f", sqlite3_column_double(stmt, 0));
-                sqlite3_finalize(stmt);
-            }
-        }
+        db_executor_lock();
+        if (db_get_compound_by_name(g_dlgCompoundName, &ci) == 0)
+            sprintf(curCost, "%.4f", ci.cost_per_gram);
+        db_executor_unlock();
 
         CreateWindowEx(0, "STATIC", "Cost ($/g):",
             WS_CHILD | WS_VISIBLE,
@@ -453,19 +483,28 @@ static LRESULT CALLBACK CostDlgWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
         switch (LOWORD(wParam)) {
         case IDC_BTN_SAVE:
         {
-            char  costStr[32];
-            float cost;
+            char         costStr[32];
+            float        cost;
+            CostSaveJob* c;
             GetWindowText(GetDlgItem(hWnd, IDC_DLG_COST_FIELD), costStr, sizeof(costStr));
             cost = (float)atof(costStr);
             if (cost < 0.0f) {
                 MessageBox(hWnd, "Cost cannot be negative.", "Input", MB_OK);
                 break;
             }
-            if (db_set_compound_cost(g_dlgCompoundName, cost) == 0) {
-                g_dlgSaved = TRUE;
-                g_dlgDone  = TRUE;
-                DestroyWindow(hWnd);
-            } else {
+
+            c = (CostSaveJob*)malloc(sizeof(CostSaveJob));
+            if (c == NULL) break;
+            c->hDlg = hWnd;
+            strcpy(c->compound, g_dlgCompoundName);
+            c->cost = cost;
+
+            /* Without a running executor CostSaveDone has already run,
+               and may have destroyed hWnd, when submit returns */
+            EnableWindow(hWnd, FALSE);
+            if (db_executor_submit_write(CostSaveJobRun, CostSaveDone, c) < 0) {
+                free(c);
+                EnableWindow(hWnd, TRUE);
                 MessageBox(hWnd, "Failed to update cost.", "Error", MB_ICONERROR);
             }
         }
@@ -571,13 +610,26 @@ static LRESULT CALLBACK CompPanelWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPA
             476, 7, 120, 200, hWnd,
             (HMENU)(INT_PTR)IDC_APP_COMBO, g_hInst, NULL);
         SendMessage(g_hAppCombo, CB_ADDSTRING, 0, (LPARAM)"All");
-        SendMessage(g_hAppCombo, CB_ADDSTRING, 0, (LPARAM)"Beverages");
-        SendMessage(g_hAppCombo, CB_ADDSTRING, 0, (LPARAM)"Alcoholic");
-        SendMessage(g_hAppCombo, CB_ADDSTRING, 0, (LPARAM)"Baked Goods");
-        SendMessage(g_hAppCombo, CB_ADDSTRING, 0, (LPARAM)"Dairy");
-        SendMessage(g_hAppCombo, CB_ADDSTRING, 0, (LPARAM)"Meat");
-        SendMessage(g_hAppCombo, CB_ADDSTRING, 0, (LPARAM)"Confections");
-        SendMessage(g_hAppCombo, CB_ADDSTRING, 0, (LPARAM)"Savory");
+        {
+            /* One entry per category, item data = its APP_* bit */
+            int  counts[APP_CATEGORY_COUNT];
+            int  have_counts;
+            char label[64];
+            int  i, idx;
+
+            db_executor_lock();
+            have_counts = (db_count_compounds_by_app(counts) >= 0);
+            db_executor_unlock();
+
+            for (i = 0; i < APP_CATEGORY_COUNT; i++) {
+                if (have_counts)
+                    sprintf(label, "%s (%d)", compound_app_label(i), counts[i]);
+                else
+                    strcpy(label, compound_app_label(i));
+                idx = (int)SendMessage(g_hAppCombo, CB_ADDSTRING, 0, (LPARAM)label);
+                SendMessage(g_hAppCombo, CB_SETITEMDATA, idx, (LPARAM)(1u << i));
+            }
+        }
         SendMessage(g_hAppCombo, CB_SETCURSEL, 0, 0);
 
         /* Apply fonts */
@@ -636,8 +688,10 @@ static LRESULT CALLBACK CompPanelWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPA
                 char name[128];
                 ListView_GetItemText(g_hListView, pnlv->iItem, 0, name, sizeof(name));
                 ZeroMemory(&g_selectedCompound, sizeof(g_selectedCompound));
+                db_executor_lock();
                 g_hasSelection =
                     (db_get_compound_by_name(name, &g_selectedCompound) == 0);
+                db_executor_unlock();
                 if (g_hDetailPane)
                     InvalidateRect(g_hDetailPane, NULL, TRUE);
             }
@@ -675,7 +729,9 @@ static LRESULT CALLBACK CompPanelWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPA
                 if (g_hasSelection &&
                     strcmp(g_selectedCompound.compound_name, g_dlgCompoundName) == 0)
                 {
+                    db_executor_lock();
                     db_get_compound_by_name(g_dlgCompoundName, &g_selectedCompound);
+                    db_executor_unlock();
                     if (g_hDetailPane) InvalidateRect(g_hDetailPane, NULL, TRUE);
                 }
             }
@@ -755,103 +811,161 @@ HWND Panel_Compounds_Create(HWND hParent)
 }
 
 /* =========================================================================
-   Panel_Compounds_Refresh — single parameterized SQL with search, app, and
-   solubilizer filters.
+   Compound list query — runs on a database reader thread.
+   The rows are copied out so the list view is only touched back on the
+   UI thread, in CompoundQueryDone.
+   ========================================================================= */
+typedef struct {
+    char   name[128];
+    int    fema;
+    double maxppm;
+    double recmin;
+    double recmax;
+    double cpg;
+    int    solub;
+    char   storage[16];
+} CompoundRow;
+
+typedef struct {
+    int          seq;          /* g_refreshSeq when submitted        */
+    char         match[512];   /* compound_fts MATCH, "" = list all  */
+    int          solub;        /* -1=all, 0/1=filter                 */
+    unsigned int app_mask;     /* APP_* bits, 0 = any                */
+    CompoundRow* rows;
+    int          count;
+    int          cap;
+} CompoundQuery;
+
+static int g_refreshSeq = 0;   /* only the newest query fills the list */
+static int g_refreshJob = 0;   /* its executor job id, for cancelling  */
+
+static int CompoundQueryJob(sqlite3* db, void* arg)
+{
+    CompoundQuery* q    = (CompoundQuery*)arg;
+    sqlite3_stmt*  stmt = NULL;
+    int            rc;
+
+    if (q->match[0]) {
+        rc = sqlite3_prepare_v2(db, SQL_COMPOUNDS_SEARCH, -1, &stmt, NULL);
+        if (rc != SQLITE_OK) return rc;
+        sqlite3_bind_text(stmt, 1, q->match, -1, SQLITE_STATIC);
+        sqlite3_bind_int (stmt, 2, q->solub);
+        sqlite3_bind_int (stmt, 3, (int)q->app_mask);
+    } else {
+        rc = sqlite3_prepare_v2(db, SQL_COMPOUNDS_REFRESH, -1, &stmt, NULL);
+        if (rc != SQLITE_OK) return rc;
+        sqlite3_bind_int (stmt, 1, q->solub);
+        sqlite3_bind_int (stmt, 2, (int)q->app_mask);
+    }
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char*  name = (const char*)sqlite3_column_text(stmt, 0);
+        const char*  stor = (const char*)sqlite3_column_text(stmt, 7);
+        CompoundRow* r;
+
+        if (q->count == q->cap) {
+            int          new_cap = q->cap ? q->cap * 2 : 256;
+            CompoundRow* rows    = (CompoundRow*)realloc(q->rows,
+                                       (size_t)new_cap * sizeof(CompoundRow));
+            if (rows == NULL) { rc = SQLITE_NOMEM; break; }
+            q->rows = rows;
+            q->cap  = new_cap;
+        }
+        r = &q->rows[q->count++];
+
+        strncpy(r->name, name ? name : "", sizeof(r->name) - 1);
+        r->name[sizeof(r->name) - 1] = '\0';
+        r->fema   = sqlite3_column_int   (stmt, 1);
+        r->maxppm = sqlite3_column_double(stmt, 2);
+        r->recmin = sqlite3_column_double(stmt, 3);
+        r->recmax = sqlite3_column_double(stmt, 4);
+        r->cpg    = sqlite3_column_double(stmt, 5);
+        r->solub  = sqlite3_column_int   (stmt, 6);
+        strncpy(r->storage, stor ? stor : "", sizeof(r->storage) - 1);
+        r->storage[sizeof(r->storage) - 1] = '\0';
+    }
+
+    sqlite3_finalize(stmt);
+    return (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+}
+
+static void CompoundQueryDone(int job_id, int result, void* arg)
+{
+    CompoundQuery* q = (CompoundQuery*)arg;
+    char buf[64];
+    int  row;
+
+    (void)job_id;
+
+    /* Superseded, cancelled or failed: keep whatever the list shows */
+    if (q->seq == g_refreshSeq && result == SQLITE_OK && g_hListView) {
+        g_refreshJob = 0;
+        SendMessage(g_hListView, WM_SETREDRAW, FALSE, 0);
+        ListView_DeleteAllItems(g_hListView);
+
+        for (row = 0; row < q->count; row++) {
+            const CompoundRow* r = &q->rows[row];
+
+            LV_InsertRow(g_hListView, row, r->name);
+
+            sprintf(buf, "%d",   r->fema);   LV_SetCell(g_hListView, row, 1, buf);
+            sprintf(buf, "%.1f", r->maxppm); LV_SetCell(g_hListView, row, 2, buf);
+            sprintf(buf, "%.2f", r->recmin); LV_SetCell(g_hListView, row, 3, buf);
+            sprintf(buf, "%.2f", r->recmax); LV_SetCell(g_hListView, row, 4, buf);
+            sprintf(buf, "%.4f", r->cpg);    LV_SetCell(g_hListView, row, 5, buf);
+            LV_SetCell(g_hListView, row, 6, r->solub ? "Yes" : "No");
+            LV_SetCell(g_hListView, row, 7, r->storage);
+        }
+
+        SendMessage(g_hListView, WM_SETREDRAW, TRUE, 0);
+        InvalidateRect(g_hListView, NULL, TRUE);
+    }
+
+    free(q->rows);
+    free(q);
+}
+
+/* =========================================================================
+   Panel_Compounds_Refresh — search text goes through the compound_fts
+   index (best match first); with none, the whole library is listed by
+   name.  Solubilizer and app_mask category filters apply to both.
+   The query runs on a reader thread; a newer refresh (the next keystroke)
+   cancels the one still in flight.
    ========================================================================= */
 void Panel_Compounds_Refresh(void)
 {
-    /* App token map: combobox index → pipe-search token */
-    static const char* app_tokens[] = {
-        "",            /* 0 = All */
-        "beverages",   /* 1 */
-        "alcoholic",   /* 2 */
-        "baked goods", /* 3 */
-        "dairy",       /* 4 */
-        "meat",        /* 5 */
-        "confections", /* 6 */
-        "savory"       /* 7 */
-    };
-
-    sqlite3*      db        = db_get_handle();
-    sqlite3_stmt* stmt      = NULL;
-    int           row       = 0;
-    char          buf[64];
-    char          search[256];
-    char          like_search[260]; /* for name/odor/flavor */
-    char          like_app[140];    /* for applications column */
-    int           solub_sel;
-    int           app_sel;
-    int           solub_sentinel;   /* -1=all, 0/1=filter */
-
-    if (!g_hListView || !db) return;
+    CompoundQuery* q;
+    char           search[256];
+    int            solub_sel;
+    int            app_sel;
+
+    if (!g_hListView || !db_get_handle()) return;
+
+    q = (CompoundQuery*)calloc(1, sizeof(CompoundQuery));
+    if (q == NULL) return;
 
     /* Read search text */
     search[0] = '\0';
     if (g_hSearchEdit) GetWindowText(g_hSearchEdit, search, sizeof(search));
-    if (search[0])
-        sprintf(like_search, "%%%s%%", search);
-    else
-        strcpy(like_search, "%");
+    compound_search_expr(search, q->match, sizeof(q->match));
 
     /* Read solubilizer selection: 0=All, 1=Yes, 2=No */
     solub_sel = 0;
     if (g_hSolubCombo) solub_sel = (int)SendMessage(g_hSolubCombo, CB_GETCURSEL, 0, 0);
     if (solub_sel < 0) solub_sel = 0;
-    solub_sentinel = (solub_sel == 0) ? -1 : (solub_sel == 1 ? 1 : 0);
+    q->solub = (solub_sel == 0) ? -1 : (solub_sel == 1 ? 1 : 0);
 
     /* Read app filter */
     app_sel = 0;
     if (g_hAppCombo) app_sel = (int)SendMessage(g_hAppCombo, CB_GETCURSEL, 0, 0);
-    if (app_sel < 0) app_sel = 0;
-    if (app_sel == 0 || app_sel >= (int)(sizeof(app_tokens)/sizeof(app_tokens[0])))
-        strcpy(like_app, "%");
-    else
-        sprintf(like_app, "%%%s%%", app_tokens[app_sel]);
-
-    ListView_DeleteAllItems(g_hListView);
-
-    /* Single query handles all filter combinations via sentinels */
-    sqlite3_prepare_v2(db,
-        "SELECT compound_name, fema_number, max_use_ppm, "
-        "       rec_min_ppm, rec_max_ppm, cost_per_gram, "
-        "       requires_solubilizer, storage_temp "
-        "FROM compound_library "
-        "WHERE (compound_name      LIKE ?1"
-        "    OR odor_profile       LIKE ?1"
-        "    OR flavor_descriptors LIKE ?1)"
-        "  AND (applications       LIKE ?2)"
-        "  AND (?3 = -1 OR requires_solubilizer = ?3)"
-        "ORDER BY compound_name;",
-        -1, &stmt, NULL);
-
-    if (!stmt) return;
-
-    sqlite3_bind_text(stmt, 1, like_search,   -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, like_app,       -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int (stmt, 3, solub_sentinel);
-
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char* name   = (const char*)sqlite3_column_text(stmt, 0);
-        int         fema   = sqlite3_column_int   (stmt, 1);
-        double      maxppm = sqlite3_column_double(stmt, 2);
-        double      recmin = sqlite3_column_double(stmt, 3);
-        double      recmax = sqlite3_column_double(stmt, 4);
-        double      cpg    = sqlite3_column_double(stmt, 5);
-        int         solub  = sqlite3_column_int   (stmt, 6);
-        const char* stor   = (const char*)sqlite3_column_text(stmt, 7);
-
-        LV_InsertRow(g_hListView, row, name ? name : "");
-
-        sprintf(buf, "%d",   fema);   LV_SetCell(g_hListView, row, 1, buf);
-        sprintf(buf, "%.1f", maxppm); LV_SetCell(g_hListView, row, 2, buf);
-        sprintf(buf, "%.2f", recmin); LV_SetCell(g_hListView, row, 3, buf);
-        sprintf(buf, "%.2f", recmax); LV_SetCell(g_hListView, row, 4, buf);
-        sprintf(buf, "%.4f", cpg);    LV_SetCell(g_hListView, row, 5, buf);
-        LV_SetCell(g_hListView, row, 6, solub ? "Yes" : "No");
-        LV_SetCell(g_hListView, row, 7, stor ? stor : "");
-
-        row++;
+    if (app_sel > 0)
+        q->app_mask = (unsigned int)SendMessage(g_hAppCombo, CB_GETITEMDATA, app_sel, 0);
+
+    if (g_refreshJob > 0) db_executor_cancel(g_refreshJob);
+    q->seq = ++g_refreshSeq;
+    g_refreshJob = db_executor_submit_read(CompoundQueryJob, CompoundQueryDone, q);
+    if (g_refreshJob < 0) {
+        g_refreshJob = 0;
+        free(q);
     }
-
-    sqlite3_finalize(stmt);
 }
@@ -1,12 +1,16 @@
 #include <windows.h>
 #include <commctrl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "ui.h"
 #include "database.h"
 #include "formulation.h"
 #include "version.h"
 #include "sqlite3.h"
+#include "panel_sql.h"
+#include "panel_rows.h"
+#include "db_executor.h"
 
 /* =========================================================================
    File-scope state
@@ -47,28 +51,6 @@ static void LV_AddCol(HWND hLV, int idx, const char* text, int width)
     ListView_InsertColumn(hLV, idx, &lvc);
 }
 
-/* =========================================================================
-   Helper: set a cell in a ListView
-   ========================================================================= */
-static void LV_SetCell(HWND hLV, int row, int col, const char* text)
-{
-    ListView_SetItemText(hLV, row, col, (char*)text);
-}
-
-/* =========================================================================
-   Helper: insert a blank row
-   ========================================================================= */
-static int LV_InsertRow(HWND hLV, int row, const char* col0)
-{
-    LVITEM lvi;
-    ZeroMemory(&lvi, sizeof(lvi));
-    lvi.mask     = LVIF_TEXT;
-    lvi.iItem    = row;
-    lvi.iSubItem = 0;
-    lvi.pszText  = (char*)col0;
-    return ListView_InsertItem(hLV, &lvi);
-}
-
 /* =========================================================================
    Unified combo + list helpers (bases encoded as negative id, ings positive)
    ========================================================================= */
@@ -85,18 +67,10 @@ static void FilterItemCombo(HWND hCombo, const char *filter)
     if (!db) return;
 
     snprintf(pat, sizeof(pat), "%%%s%%", filter ? filter : "");
+    db_executor_lock();
 
     /* Soda bases */
-    if (sqlite3_prepare_v2(db,
-        "SELECT sb.id, sb.base_name, sb.base_code, "
-        "       sb.ver_major, sb.ver_minor, sb.ver_patch "
-        "FROM soda_bases sb "
-        "WHERE sb.id = ("
-        "    SELECT id FROM soda_bases WHERE base_code = sb.base_code "
-        "    ORDER BY ver_major DESC, ver_minor DESC, ver_patch DESC LIMIT 1"
-        ") AND sb.base_name LIKE ? "
-        "ORDER BY sb.base_name;",
-        -1, &stmt, NULL) == SQLITE_OK)
+    if (sqlite3_prepare_v2(db, SQL_FORM_ITEM_BASES, -1, &stmt, NULL) == SQLITE_OK)
     {
         sqlite3_bind_text(stmt, 1, pat, -1, SQLITE_TRANSIENT);
         while (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -132,6 +106,7 @@ static void FilterItemCombo(HWND hCombo, const char *filter)
         }
         sqlite3_finalize(stmt);
     }
+    db_executor_unlock();
 }
 
 static void DlgPopulateItemCombo(HWND hCombo)
@@ -178,6 +153,54 @@ static void DlgRefreshItemList(void)
     }
 }
 
+/* =========================================================================
+   Save — runs as a write job on a copy of the dialog data.  The dialog is
+   disabled meanwhile; FormSaveDone closes it, or re-enables it and says
+   why the save failed.
+   ========================================================================= */
+typedef struct {
+    HWND        hDlg;
+    FormDlgData data;
+} FormSaveJob;
+
+static int FormSaveJobRun(sqlite3* db, void* arg)
+{
+    FormSaveJob* s = (FormSaveJob*)arg;
+
+    (void)db;
+    if (db_save_formulation(&s->data.form) != 0) return -1;
+
+    /* Save associated bases and ingredients */
+    db_save_formulation_extras(
+        s->data.form.flavor_code,
+        s->data.form.version.major,
+        s->data.form.version.minor,
+        s->data.form.version.patch,
+        s->data.bases,       s->data.base_count,
+        s->data.ingredients, s->data.ingredient_count);
+    return 0;
+}
+
+static void FormSaveDone(int job_id, int result, void* arg)
+{
+    FormSaveJob* s = (FormSaveJob*)arg;
+
+    (void)job_id;
+    if (IsWindow(s->hDlg)) {
+        EnableWindow(s->hDlg, TRUE);
+        if (result != 0) {
+            MessageBox(s->hDlg,
+                "Save failed. Version may already exist or a compound limit was exceeded.",
+                "Error", MB_ICONERROR);
+        } else {
+            g_dlgSaved = TRUE;
+            g_dlgDone  = TRUE;
+            DestroyWindow(s->hDlg);
+        }
+    }
+    free(s);
+}
+
 /* =========================================================================
    Dialog WndProc
    ========================================================================= */
@@ -484,25 +507,21 @@ static LRESULT CALLBACK FormDlgWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
                 g_dlgData.form.version =
                     increment_version(g_dlgData.form.version, INCREMENT_PATCH);
 
-            if (db_save_formulation(&g_dlgData.form) != 0) {
-                MessageBox(hWnd,
-                    "Save failed. Version may already exist or a compound limit was exceeded.",
-                    "Error", MB_ICONERROR);
-                break;
+            {
+                FormSaveJob* s = (FormSaveJob*)malloc(sizeof(FormSaveJob));
+                if (s == NULL) break;
+                s->hDlg = hWnd;
+                s->data = g_dlgData;
+
+                /* Without a running executor FormSaveDone has already
+                   run, and may have destroyed hWnd, when submit returns */
+                EnableWindow(hWnd, FALSE);
+                if (db_executor_submit_write(FormSaveJobRun, FormSaveDone, s) < 0) {
+                    free(s);
+                    EnableWindow(hWnd, TRUE);
+                    MessageBox(hWnd, "Save failed.", "Error", MB_ICONERROR);
+                }
             }
-
-            /* Save associated bases and ingredients */
-            db_save_formulation_extras(
-                g_dlgData.form.flavor_code,
-                g_dlgData.form.version.major,
-                g_dlgData.form.version.minor,
-                g_dlgData.form.version.patch,
-                g_dlgData.bases,       g_dlgData.base_count,
-                g_dlgData.ingredients, g_dlgData.ingredient_count);
-
-            g_dlgSaved = TRUE;
-            g_dlgDone  = TRUE;
-            DestroyWindow(hWnd);
         }
         break;
 
@@ -554,7 +573,9 @@ static void FormulationPreview(HWND hParent, const char *flavor_code)
     int            i;
 
     ZeroMemory(&f, sizeof(f));
+    db_executor_lock();
     if (db_load_latest(flavor_code, &f) != 0) {
+        db_executor_unlock();
         MessageBox(hParent, "Failed to load formulation.", "Error", MB_ICONERROR);
         return;
     }
@@ -562,6 +583,7 @@ static void FormulationPreview(HWND hParent, const char *flavor_code)
         flavor_code,
         f.version.major, f.version.minor, f.version.patch,
         bases, &base_count, ings, &ing_count);
+    db_executor_unlock();
 
     GetTempPathA(sizeof(tempDir), tempDir);
     _snprintf(htmlPath, sizeof(htmlPath) - 1,
@@ -688,6 +710,67 @@ static void OpenFormDialog(HWND hParent)
     SetForegroundWindow(hParent);
 }
 
+/* =========================================================================
+   Validate — loads the latest version and checks it against the limits
+   as a write job (both go through the main connection); FormCheckDone
+   reports the result.
+   ========================================================================= */
+typedef struct {
+    HWND             hWnd;
+    char             code[MAX_FLAVOR_CODE];
+    Formulation      f;
+    ValidationResult vr;
+    int              violations;
+} FormCheckJob;
+
+static int FormCheckJobRun(sqlite3* db, void* arg)
+{
+    FormCheckJob* c = (FormCheckJob*)arg;
+
+    (void)db;
+    if (db_load_latest(c->code, &c->f) != 0) return -1;
+    c->violations = db_check_formulation_limits(&c->f, &c->vr);
+    return 0;
+}
+
+static void FormCheckDone(int job_id, int result, void* arg)
+{
+    FormCheckJob* c = (FormCheckJob*)arg;
+    char msg[8192];
+    char line[160];
+    int  i;
+
+    (void)job_id;
+    if (result != 0 || !IsWindow(c->hWnd)) {
+        free(c);
+        return;
+    }
+
+    if (c->violations < 0)
+        sprintf(msg, "%s v%d.%d.%d: Validation failed (database error).",
+            c->code, c->f.version.major, c->f.version.minor, c->f.version.patch);
+    else if (c->violations == 0)
+        sprintf(msg, "%s v%d.%d.%d: All compounds within FEMA limits.",
+            c->code, c->f.version.major, c->f.version.minor, c->f.version.patch);
+    else {
+        sprintf(msg, "%s v%d.%d.%d: %d safety limit violation(s):\n\n",
+            c->code, c->f.version.major, c->f.version.minor, c->f.version.patch,
+            c->violations);
+        for (i = 0; i < c->vr.count; i++) {
+            snprintf(line, sizeof(line), "  %s: %.2f ppm exceeds %s limit %.2f ppm\n",
+                c->vr.items[i].compound_name,
+                c->vr.items[i].concentration_ppm,
+                c->vr.items[i].from_override ? "regulatory override" : "library",
+                c->vr.items[i].limit_ppm);
+            strcat(msg, line);
+        }
+    }
+
+    MessageBox(c->hWnd, msg, "Validation Result",
+               c->violations != 0 ? MB_ICONWARNING : MB_ICONINFORMATION);
+    free(c);
+}
+
 /* =========================================================================
    Panel WndProc
    ========================================================================= */
@@ -774,7 +857,9 @@ static LRESULT CALLBACK FormPanelWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPA
 
             ZeroMemory(&g_dlgData, sizeof(g_dlgData));
             g_dlgData.is_edit = TRUE;
+            db_executor_lock();
             if (db_load_latest(code, &g_dlgData.form) != 0) {
+                db_executor_unlock();
                 MessageBox(hWnd, "Failed to load formulation.", "Error", MB_ICONERROR);
                 break;
             }
@@ -785,6 +870,7 @@ static LRESULT CALLBACK FormPanelWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPA
                 g_dlgData.form.version.patch,
                 g_dlgData.bases,       &g_dlgData.base_count,
                 g_dlgData.ingredients, &g_dlgData.ingredient_count);
+            db_executor_unlock();
             OpenFormDialog(hWnd);
             if (g_dlgSaved) Panel_Formulations_Refresh();
         }
@@ -800,10 +886,12 @@ static LRESULT CALLBACK FormPanelWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPA
         {
             int sel = ListView_GetNextItem(g_hListView, -1, LVNI_SELECTED);
             char code[MAX_FLAVOR_CODE];
-            char buf[2048];
-            char line[64];
+            char buf[4096];
+            char line[160];
             sqlite3* db;
             sqlite3_stmt* stmt;
+            DbVersionDiff* diffs = NULL;
+            int ndiff, k = 0;
 
             if (sel < 0) { MessageBox(hWnd, "Select a formulation.", "History", MB_OK); break; }
 
@@ -811,6 +899,15 @@ static LRESULT CALLBACK FormPanelWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPA
             db = db_get_handle();
             if (!db) break;
 
+            /* Each version after the first also says what changed since
+               the one before it */
+            db_executor_lock();
+            ndiff = db_diff_history(code, NULL, 0);
+            if (ndiff > 0)
+                diffs = (DbVersionDiff*)malloc((size_t)ndiff * sizeof(DbVersionDiff));
+            if (diffs) ndiff = db_diff_history(code, diffs, ndiff);
+            if (!diffs || ndiff < 0) ndiff = 0;
+
             sprintf(buf, "Version history for %s:\n\n", code);
 
             if (sqlite3_prepare_v2(db,
@@ -821,15 +918,31 @@ static LRESULT CALLBACK FormPanelWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPA
             {
                 sqlite3_bind_text(stmt, 1, code, -1, SQLITE_STATIC);
                 while (sqlite3_step(stmt) == SQLITE_ROW) {
-                    sprintf(line, "  v%d.%d.%d   saved %s\n",
+                    int n = snprintf(line, sizeof(line), "  v%d.%d.%d   saved %s",
                         sqlite3_column_int(stmt, 0),
                         sqlite3_column_int(stmt, 1),
                         sqlite3_column_int(stmt, 2),
                         (const char*)sqlite3_column_text(stmt, 3));
+                    if (k > 0 && k <= ndiff && n > 0 && n < (int)sizeof(line)) {
+                        const DbVersionDiff* d = &diffs[k - 1];
+                        n += snprintf(line + n, sizeof(line) - n, "   +%d -%d ~%d",
+                                      d->added, d->removed, d->changed);
+                        if (d->old_ph != d->new_ph && n < (int)sizeof(line))
+                            n += snprintf(line + n, sizeof(line) - n, "  pH %.2f->%.2f",
+                                          d->old_ph, d->new_ph);
+                        if (d->old_brix != d->new_brix && n < (int)sizeof(line))
+                            snprintf(line + n, sizeof(line) - n, "  Brix %.1f->%.1f",
+                                     d->old_brix, d->new_brix);
+                    }
+                    k++;
+                    if (strlen(buf) + strlen(line) + 2 >= sizeof(buf)) break;
                     strcat(buf, line);
+                    strcat(buf, "\n");
                 }
                 sqlite3_finalize(stmt);
             }
+            db_executor_unlock();
+            free(diffs);
 
             MessageBox(hWnd, buf, "Version History", MB_OK);
         }
@@ -838,25 +951,16 @@ static LRESULT CALLBACK FormPanelWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPA
         case IDC_BTN_VALIDATE:
         {
             int sel = ListView_GetNextItem(g_hListView, -1, LVNI_SELECTED);
-            char code[MAX_FLAVOR_CODE];
-            Formulation f;
-            int violations;
-            char msg[256];
+            FormCheckJob* c;
 
             if (sel < 0) { MessageBox(hWnd, "Select a formulation.", "Validate", MB_OK); break; }
 
-            ListView_GetItemText(g_hListView, sel, 0, code, sizeof(code));
-            if (db_load_latest(code, &f) != 0) break;
-
-            violations = db_validate_formulation(&f);
-            if (violations == 0)
-                sprintf(msg, "%s v%d.%d.%d: All compounds within FEMA limits.",
-                    code, f.version.major, f.version.minor, f.version.patch);
-            else
-                sprintf(msg, "%s v%d.%d.%d: %d safety limit violation(s). Check stderr for details.",
-                    code, f.version.major, f.version.minor, f.version.patch, violations);
-
-            MessageBox(hWnd, msg, "Validation Result", violations ? MB_ICONWARNING : MB_ICONINFORMATION);
+            c = (FormCheckJob*)calloc(1, sizeof(FormCheckJob));
+            if (c == NULL) break;
+            c->hWnd = hWnd;
+            ListView_GetItemText(g_hListView, sel, 0, c->code, sizeof(c->code));
+            if (db_executor_submit_write(FormCheckJobRun, FormCheckDone, c) < 0)
+                free(c);
         }
         break;
 
@@ -913,60 +1017,70 @@ HWND Panel_Formulations_Create(HWND hParent)
 }
 
 /* =========================================================================
-   Panel_Formulations_Refresh
+   Panel_Formulations_Refresh — latest version of each flavor.  The query
+   runs on a reader thread (FormListJob); FormListDone fills the list
+   unless a newer refresh has been started since.
    ========================================================================= */
-void Panel_Formulations_Refresh(void)
+static int g_refreshSeq = 0;   /* only the newest query fills the list */
+static int g_refreshJob = 0;   /* its executor job id, for cancelling  */
+
+static int FormListJob(sqlite3* db, void* arg)
 {
-    sqlite3*      db   = db_get_handle();
+    PanelRows*    r    = (PanelRows*)arg;
     sqlite3_stmt* stmt = NULL;
-    int           row  = 0;
-    char          buf[64];
-
-    if (!g_hListView || !db) return;
+    int           rc;
+
+    rc = sqlite3_prepare_v2(db, SQL_FORMULATIONS_REFRESH, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return rc;
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        PanelCell* c = panel_rows_add(r, 0);
+        if (c == NULL) { rc = SQLITE_NOMEM; break; }
+
+        panel_cell_text(c[0], sqlite3_column_text(stmt, 0), "");
+        panel_cell_text(c[1], sqlite3_column_text(stmt, 1), "");
+        sprintf(c[2], "%d.%d.%d", sqlite3_column_int(stmt, 2),
+                sqlite3_column_int(stmt, 3), sqlite3_column_int(stmt, 4));
+        sprintf(c[3], "%.2f", sqlite3_column_double(stmt, 5));
+        sprintf(c[4], "%.2f", sqlite3_column_double(stmt, 6));
+        panel_cell_text(c[5], sqlite3_column_text(stmt, 7), "");
+    }
 
-    ListView_DeleteAllItems(g_hListView);
+    sqlite3_finalize(stmt);
+    return (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+}
 
-    /* Latest version of each flavor */
-    if (sqlite3_prepare_v2(db,
-            "SELECT f.flavor_code, f.flavor_name, "
-            "       f.ver_major, f.ver_minor, f.ver_patch, "
-            "       f.target_ph, f.target_brix, f.saved_at "
-            "FROM formulations f "
-            "WHERE f.id = ("
-            "    SELECT id FROM formulations "
-            "    WHERE flavor_code = f.flavor_code "
-            "    ORDER BY ver_major DESC, ver_minor DESC, ver_patch DESC LIMIT 1"
-            ") "
-            "ORDER BY f.flavor_code;",
-            -1, &stmt, NULL) != SQLITE_OK)
-        return;
+static void FormListDone(int job_id, int result, void* arg)
+{
+    PanelRows* r = (PanelRows*)arg;
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char* code    = (const char*)sqlite3_column_text(stmt, 0);
-        const char* name    = (const char*)sqlite3_column_text(stmt, 1);
-        int         vmaj    = sqlite3_column_int   (stmt, 2);
-        int         vmin    = sqlite3_column_int   (stmt, 3);
-        int         vpat    = sqlite3_column_int   (stmt, 4);
-        double      ph      = sqlite3_column_double(stmt, 5);
-        double      brix    = sqlite3_column_double(stmt, 6);
-        const char* saved   = (const char*)sqlite3_column_text(stmt, 7);
+    (void)job_id;
 
-        LV_InsertRow(g_hListView, row, code ? code : "");
+    /* Superseded, cancelled or failed: keep whatever the list shows */
+    if (r->seq == g_refreshSeq && result == SQLITE_OK && g_hListView) {
+        g_refreshJob = 0;
+        panel_rows_fill(g_hListView, r);
+    }
 
-        sprintf(buf, "%d.%d.%d", vmaj, vmin, vpat);
-        LV_SetCell(g_hListView, row, 1, name  ? name : "");
-        LV_SetCell(g_hListView, row, 2, buf);
+    panel_rows_free(r);
+    free(r);
+}
 
-        sprintf(buf, "%.2f", ph);
-        LV_SetCell(g_hListView, row, 3, buf);
+void Panel_Formulations_Refresh(void)
+{
+    PanelRows* r;
 
-        sprintf(buf, "%.2f", brix);
-        LV_SetCell(g_hListView, row, 4, buf);
+    if (!g_hListView || !db_get_handle()) return;
 
-        LV_SetCell(g_hListView, row, 5, saved ? saved : "");
+    r = (PanelRows*)calloc(1, sizeof(PanelRows));
+    if (r == NULL) return;
+    r->columns = 6;
 
-        row++;
+    if (g_refreshJob > 0) db_executor_cancel(g_refreshJob);
+    r->seq = ++g_refreshSeq;
+    g_refreshJob = db_executor_submit_read(FormListJob, FormListDone, r);
+    if (g_refreshJob < 0) {
+        g_refreshJob = 0;
+        free(r);
     }
-
-    sqlite3_finalize(stmt);
 }
@@ -1,11 +1,14 @@
 #include <windows.h>
 #include <commctrl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "ui.h"
 #include "database.h"
+#include "db_executor.h"
 #include "ingredient.h"
 #include "sqlite3.h"
+#include "panel_rows.h"
 
 /* =========================================================================
    File-scope state
@@ -45,21 +48,42 @@ static void LV_AddCol(HWND hLV, int idx, const char *text, int width)
     ListView_InsertColumn(hLV, idx, &lvc);
 }
 
-static int LV_InsertRow(HWND hLV, int row, const char *col0, LPARAM lp)
+/* =========================================================================
+   Save — db_add_ingredient / db_update_ingredient as a write job; the
+   dialog is disabled until IngSaveDone closes it or reports the failure.
+   ========================================================================= */
+typedef struct {
+    HWND       hDlg;
+    Ingredient ing;      /* id 0 = new */
+} IngSaveJob;
+
+static int IngSaveJobRun(sqlite3* db, void* arg)
 {
-    LVITEM lvi;
-    ZeroMemory(&lvi, sizeof(lvi));
-    lvi.mask     = LVIF_TEXT | LVIF_PARAM;
-    lvi.iItem    = row;
-    lvi.iSubItem = 0;
-    lvi.pszText  = (char *)col0;
-    lvi.lParam   = lp;
-    return ListView_InsertItem(hLV, &lvi);
+    IngSaveJob* j = (IngSaveJob*)arg;
+
+    (void)db;
+    return (j->ing.id == 0) ? db_add_ingredient(&j->ing) : db_update_ingredient(&j->ing);
 }
 
-static void LV_SetCell(HWND hLV, int row, int col, const char *text)
+static void IngSaveDone(int job_id, int result, void* arg)
 {
-    ListView_SetItemText(hLV, row, col, (char *)text);
+    IngSaveJob* j = (IngSaveJob*)arg;
+
+    (void)job_id;
+    if (IsWindow(j->hDlg)) {
+        EnableWindow(j->hDlg, TRUE);
+        if (result == 1) {
+            MessageBox(j->hDlg, "Name already exists.", "Error", MB_ICONWARNING);
+        } else if (result != 0) {
+            MessageBox(j->hDlg, "Failed to save ingredient.", "Error", MB_ICONERROR);
+        } else {
+            g_dlgSaved = TRUE;
+            g_dlgDone  = TRUE;
+            EnableWindow(GetParent(j->hDlg), TRUE);
+            DestroyWindow(j->hDlg);
+        }
+    }
+    free(j);
 }
 
 /* =========================================================================
@@ -139,6 +163,7 @@ static LRESULT CALLBACK IngDlgWndProc(HWND hWnd, UINT msg,
         {
             sqlite3      *db  = db_get_handle();
             sqlite3_stmt *qst = NULL;
+            db_executor_lock();
             if (db && sqlite3_prepare_v2(db,
                 "SELECT id, supplier_name FROM suppliers ORDER BY supplier_name;",
                 -1, &qst, NULL) == SQLITE_OK) {
@@ -151,6 +176,7 @@ static LRESULT CALLBACK IngDlgWndProc(HWND hWnd, UINT msg,
                 }
                 sqlite3_finalize(qst);
             }
+            db_executor_unlock();
         }
         SendMessage(hSup, CB_SETCURSEL, 0, 0);
         y += 32;
@@ -188,7 +214,12 @@ static LRESULT CALLBACK IngDlgWndProc(HWND hWnd, UINT msg,
         /* Pre-fill if editing */
         if (iid != 0) {
             Ingredient ing;
-            if (db_get_ingredient(iid, &ing) == 0) {
+            int        found;
+
+            db_executor_lock();
+            found = (db_get_ingredient(iid, &ing) == 0);
+            db_executor_unlock();
+            if (found) {
                 char buf[32];
                 HWND hCat2, hUnit2, hSup2;
                 int  ci, cnt;
@@ -245,7 +276,8 @@ static LRESULT CALLBACK IngDlgWndProc(HWND hWnd, UINT msg,
             char unitStr[MAX_INGREDIENT_UNIT];
             int  iid = (int)GetWindowLongPtr(hWnd, GWLP_USERDATA);
             Ingredient ing;
-            int rc, ci;
+            IngSaveJob* j;
+            int ci;
             HWND hCat2, hUnit2, hSup2;
 
             GetWindowText(GetDlgItem(hWnd, IDC_ING_NAME),  name,    sizeof(name));
@@ -283,21 +315,19 @@ static LRESULT CALLBACK IngDlgWndProc(HWND hWnd, UINT msg,
             strncpy(ing.brand, brand, MAX_INGREDIENT_BRAND - 1);
             strncpy(ing.notes, notes, 255);
 
-            rc = (iid == 0) ? db_add_ingredient(&ing) : db_update_ingredient(&ing);
-
-            if (rc == 1) {
-                MessageBox(hWnd, "Name already exists.", "Error", MB_ICONWARNING);
-                return 0;
-            }
-            if (rc != 0) {
+            j = (IngSaveJob*)malloc(sizeof(IngSaveJob));
+            if (j == NULL) return 0;
+            j->hDlg = hWnd;
+            j->ing  = ing;
+
+            /* Without a running executor IngSaveDone has already run,
+               and may have destroyed hWnd, when submit returns */
+            EnableWindow(hWnd, FALSE);
+            if (db_executor_submit_write(IngSaveJobRun, IngSaveDone, j) < 0) {
+                free(j);
+                EnableWindow(hWnd, TRUE);
                 MessageBox(hWnd, "Failed to save ingredient.", "Error", MB_ICONERROR);
-                return 0;
             }
-
-            g_dlgSaved = TRUE;
-            g_dlgDone  = TRUE;
-            EnableWindow(GetParent(hWnd), TRUE);
-            DestroyWindow(hWnd);
             return 0;
         }
 
@@ -451,7 +481,9 @@ static LRESULT CALLBACK IngPanelWndProc(HWND hWnd, UINT msg,
                 if (MessageBox(hWnd, "Delete this ingredient?",
                         "Confirm Delete", MB_YESNO | MB_ICONWARNING) != IDYES)
                     return 0;
+                db_executor_lock();
                 rc = db_delete_ingredient(g_selIngId);
+                db_executor_unlock();
                 if (rc == 1) {
                     MessageBox(hWnd,
                         "Cannot delete: ingredient is in use by a formulation or soda base.",
@@ -519,17 +551,81 @@ HWND Panel_Ingredients_Create(HWND hParent)
 }
 
 /* =========================================================================
-   Panel_Ingredients_Refresh
+   Panel_Ingredients_Refresh — names matching the search bar.  The query
+   runs on a reader thread (IngListJob); IngListDone fills the list
+   unless a newer refresh (the next keystroke) has been started since.
    ========================================================================= */
+typedef struct {
+    PanelRows rows;
+    char      pat[260];    /* LIKE pattern */
+} IngQuery;
+
+static int g_refreshSeq = 0;   /* only the newest query fills the list */
+static int g_refreshJob = 0;   /* its executor job id, for cancelling  */
+
+static int IngListJob(sqlite3* db, void* arg)
+{
+    IngQuery*     q    = (IngQuery*)arg;
+    sqlite3_stmt* stmt = NULL;
+    int           rc;
+
+    rc = sqlite3_prepare_v2(db,
+        "SELECT i.id, i.ingredient_name, i.category, i.unit, i.cost_per_unit, "
+        "       COALESCE(s.supplier_name,'--'), COALESCE(i.brand,'') "
+        "FROM ingredients i "
+        "LEFT JOIN suppliers s ON s.id = i.supplier_id "
+        "WHERE i.ingredient_name LIKE ? "
+        "ORDER BY i.ingredient_name;",
+        -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return rc;
+
+    sqlite3_bind_text(stmt, 1, q->pat, -1, SQLITE_STATIC);
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        PanelCell* c = panel_rows_add(&q->rows, (LPARAM)sqlite3_column_int(stmt, 0));
+        if (c == NULL) { rc = SQLITE_NOMEM; break; }
+
+        panel_cell_text(c[0], sqlite3_column_text(stmt, 1), "");
+        panel_cell_text(c[1], sqlite3_column_text(stmt, 2), "");
+        panel_cell_text(c[2], sqlite3_column_text(stmt, 3), "");
+        snprintf(c[3], PANEL_ROWS_CELL, "$%.4f", sqlite3_column_double(stmt, 4));
+        panel_cell_text(c[4], sqlite3_column_text(stmt, 5), "");
+        panel_cell_text(c[5], sqlite3_column_text(stmt, 6), "");
+    }
+
+    sqlite3_finalize(stmt);
+    return (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+}
+
+static void IngListDone(int job_id, int result, void* arg)
+{
+    IngQuery* q = (IngQuery*)arg;
+
+    (void)job_id;
+
+    /* Superseded, cancelled or failed: keep whatever the list shows */
+    if (q->rows.seq == g_refreshSeq && result == SQLITE_OK && g_hLV) {
+        g_refreshJob = 0;
+        g_selIngId   = 0;
+        EnableWindow(g_hBtnEdit, FALSE);
+        EnableWindow(g_hBtnDel,  FALSE);
+        panel_rows_fill(g_hLV, &q->rows);
+    }
+
+    panel_rows_free(&q->rows);
+    free(q);
+}
+
 void Panel_Ingredients_Refresh(void)
 {
-    sqlite3      *db   = db_get_handle();
-    sqlite3_stmt *stmt = NULL;
-    int           row  = 0;
-    char          filter[256];
-    char          pat[260];
+    IngQuery* q;
+    char      filter[256];
 
-    if (!g_hLV || !db) return;
+    if (!g_hLV || !db_get_handle()) return;
+
+    q = (IngQuery*)calloc(1, sizeof(IngQuery));
+    if (q == NULL) return;
+    q->rows.columns = 6;
 
     /* Read search bar text; build LIKE pattern */
     if (g_hSearch)
@@ -537,44 +633,13 @@ void Panel_Ingredients_Refresh(void)
     else
         filter[0] = '\0';
 
-    snprintf(pat, sizeof(pat), "%%%s%%", filter);
-
-    ListView_DeleteAllItems(g_hLV);
-    g_selIngId = 0;
-    EnableWindow(g_hBtnEdit, FALSE);
-    EnableWindow(g_hBtnDel,  FALSE);
+    snprintf(q->pat, sizeof(q->pat), "%%%s%%", filter);
 
-    if (sqlite3_prepare_v2(db,
-        "SELECT i.id, i.ingredient_name, i.category, i.unit, i.cost_per_unit, "
-        "       COALESCE(s.supplier_name,'--'), COALESCE(i.brand,'') "
-        "FROM ingredients i "
-        "LEFT JOIN suppliers s ON s.id = i.supplier_id "
-        "WHERE i.ingredient_name LIKE ? "
-        "ORDER BY i.ingredient_name;",
-        -1, &stmt, NULL) != SQLITE_OK)
-        return;
-
-    sqlite3_bind_text(stmt, 1, pat, -1, SQLITE_TRANSIENT);
-
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        int         id    = sqlite3_column_int(stmt, 0);
-        const char *nm    = (const char *)sqlite3_column_text(stmt, 1);
-        const char *cat   = (const char *)sqlite3_column_text(stmt, 2);
-        const char *unit  = (const char *)sqlite3_column_text(stmt, 3);
-        double      cost  = sqlite3_column_double(stmt, 4);
-        const char *sup   = (const char *)sqlite3_column_text(stmt, 5);
-        const char *brand = (const char *)sqlite3_column_text(stmt, 6);
-        char costbuf[32];
-        int actual;
-
-        snprintf(costbuf, sizeof(costbuf), "$%.4f", cost);
-        actual = LV_InsertRow(g_hLV, row, nm ? nm : "", (LPARAM)id);
-        LV_SetCell(g_hLV, actual, 1, cat   ? cat   : "");
-        LV_SetCell(g_hLV, actual, 2, unit  ? unit  : "");
-        LV_SetCell(g_hLV, actual, 3, costbuf);
-        LV_SetCell(g_hLV, actual, 4, sup   ? sup   : "");
-        LV_SetCell(g_hLV, actual, 5, brand ? brand : "");
-        row++;
+    if (g_refreshJob > 0) db_executor_cancel(g_refreshJob);
+    q->rows.seq = ++g_refreshSeq;
+    g_refreshJob = db_executor_submit_read(IngListJob, IngListDone, q);
+    if (g_refreshJob < 0) {
+        g_refreshJob = 0;
+        free(q);
     }
-    sqlite3_finalize(stmt);
 }
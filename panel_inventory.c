@@ -1,10 +1,13 @@
 #include <windows.h>
 #include <commctrl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "ui.h"
 #include "database.h"
+#include "db_executor.h"
 #include "sqlite3.h"
+#include "row_provider.h"
 
 /* =========================================================================
    File-scope state
@@ -13,6 +16,7 @@ static HWND g_hPanel    = NULL;
 static HWND g_hListView = NULL;
 static HWND g_hBtnUpdateStock;
 static HWND g_hBtnUpdateCost;
+static RowProvider* g_rows = NULL;
 
 /* Dialog state */
 static BOOL g_dlgDone;
@@ -37,20 +41,70 @@ static void LV_AddCol(HWND hLV, int idx, const char* text, int width)
     ListView_InsertColumn(hLV, idx, &lvc);
 }
 
-static int LV_InsertRow(HWND hLV, int row, const char* col0)
+/* Owner-data ListView: cells come from g_rows, a page at a time, off
+   the main connection, so each fetch holds db_executor_lock. */
+static void LV_HandleOwnerData(NMHDR* pnm)
 {
-    LVITEM lvi;
-    ZeroMemory(&lvi, sizeof(lvi));
-    lvi.mask     = LVIF_TEXT;
-    lvi.iItem    = row;
-    lvi.iSubItem = 0;
-    lvi.pszText  = (char*)col0;
-    return ListView_InsertItem(hLV, &lvi);
+    if (pnm->code == LVN_GETDISPINFO) {
+        LVITEM* item = &((NMLVDISPINFO*)pnm)->item;
+        if (item->mask & LVIF_TEXT) {
+            db_executor_lock();
+            lstrcpyn(item->pszText,
+                     row_provider_cell(g_rows, item->iItem, item->iSubItem),
+                     item->cchTextMax);
+            db_executor_unlock();
+        }
+    } else if (pnm->code == LVN_ODCACHEHINT) {
+        NMLVCACHEHINT* hint = (NMLVCACHEHINT*)pnm;
+        db_executor_lock();
+        row_provider_prefetch(g_rows, hint->iFrom, hint->iTo - hint->iFrom + 1);
+        db_executor_unlock();
+    }
 }
 
-static void LV_SetCell(HWND hLV, int row, int col, const char* text)
+/* =========================================================================
+   Save — the stock count or the cost, as a write job; the dialog is
+   disabled until InvSaveDone closes it or reports the failure.
+   ========================================================================= */
+typedef struct {
+    HWND  hDlg;
+    int   mode;                 /* as g_dlgMode */
+    char  compound[128];
+    float stock, reorder;       /* mode 0 */
+    float cost;                 /* mode 1 */
+} InvSaveJob;
+
+static int InvSaveJobRun(sqlite3* db, void* arg)
 {
-    ListView_SetItemText(hLV, row, col, (char*)text);
+    InvSaveJob* j = (InvSaveJob*)arg;
+
+    (void)db;
+    if (j->mode == 0) {
+        /* The counted stock goes through the ledger as an
+           adjustment, saved together with the threshold */
+        return db_stock_take(j->compound, j->stock, j->reorder, "stock count") != 0 ? -1 : 0;
+    }
+    return db_set_compound_cost(j->compound, j->cost) != 0 ? -1 : 0;
+}
+
+static void InvSaveDone(int job_id, int result, void* arg)
+{
+    InvSaveJob* j = (InvSaveJob*)arg;
+
+    (void)job_id;
+    if (IsWindow(j->hDlg)) {
+        EnableWindow(j->hDlg, TRUE);
+        if (result == 0) {
+            g_dlgSaved = TRUE;
+            g_dlgDone  = TRUE;
+            DestroyWindow(j->hDlg);
+        } else {
+            MessageBox(j->hDlg,
+                       j->mode == 0 ? "Failed to update stock." : "Failed to update cost.",
+                       "Error", MB_ICONERROR);
+        }
+    }
+    free(j);
 }
 
 /* =========================================================================
@@ -77,6 +131,7 @@ static LRESULT CALLBACK InvDlgWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM
 
         /* Fetch current values */
         if (db) {
+            db_executor_lock();
             if (sqlite3_prepare_v2(db,
                     "SELECT ci.stock_grams, ci.reorder_threshold_grams, cl.cost_per_gram "
                     "FROM compound_inventory ci "
@@ -92,6 +147,7 @@ static LRESULT CALLBACK InvDlgWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM
                 }
                 sqlite3_finalize(stmt);
             }
+            db_executor_unlock();
         }
 
         if (g_dlgMode == 0) {
@@ -152,64 +208,46 @@ static LRESULT CALLBACK InvDlgWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM
 
         case IDC_BTN_SAVE:
         {
+            InvSaveJob* j = (InvSaveJob*)calloc(1, sizeof(InvSaveJob));
+            if (j == NULL) break;
+            j->hDlg = hWnd;
+            j->mode = g_dlgMode;
+            strcpy(j->compound, g_dlgCompoundName);
+
             if (g_dlgMode == 0) {
                 /* Update stock + reorder */
                 char stockStr[32], reorderStr[32];
-                float stock, reorder;
-                sqlite3*      db   = db_get_handle();
-                sqlite3_stmt* stmt = NULL;
 
                 GetWindowText(GetDlgItem(hWnd, IDC_DLG_STOCK_FIELD),  stockStr,   sizeof(stockStr));
                 GetWindowText(GetDlgItem(hWnd, IDC_DLG_REORDER),       reorderStr, sizeof(reorderStr));
-                stock   = (float)atof(stockStr);
-                reorder = (float)atof(reorderStr);
+                j->stock   = (float)atof(stockStr);
+                j->reorder = (float)atof(reorderStr);
 
-                if (stock < 0.0f || reorder < 0.0f) {
+                if (j->stock < 0.0f || j->reorder < 0.0f) {
+                    free(j);
                     MessageBox(hWnd, "Values cannot be negative.", "Input", MB_OK);
                     break;
                 }
-
-                if (db && sqlite3_prepare_v2(db,
-                        "UPDATE compound_inventory "
-                        "SET stock_grams = ?, reorder_threshold_grams = ?, "
-                        "    last_updated = DATETIME('now','localtime') "
-                        "WHERE compound_library_id = "
-                        "    (SELECT id FROM compound_library WHERE compound_name = ?);",
-                        -1, &stmt, NULL) == SQLITE_OK)
-                {
-                    sqlite3_bind_double(stmt, 1, (double)stock);
-                    sqlite3_bind_double(stmt, 2, (double)reorder);
-                    sqlite3_bind_text  (stmt, 3, g_dlgCompoundName, -1, SQLITE_STATIC);
-
-                    if (sqlite3_step(stmt) == SQLITE_DONE) {
-                        g_dlgSaved = TRUE;
-                        g_dlgDone  = TRUE;
-                    } else {
-                        MessageBox(hWnd, "Failed to update stock.", "Error", MB_ICONERROR);
-                    }
-                    sqlite3_finalize(stmt);
-                }
-
-                if (g_dlgSaved) DestroyWindow(hWnd);
             } else {
                 /* Update cost */
                 char costStr[32];
-                float cost;
                 GetWindowText(GetDlgItem(hWnd, IDC_DLG_COST_FIELD), costStr, sizeof(costStr));
-                cost = (float)atof(costStr);
+                j->cost = (float)atof(costStr);
 
-                if (cost < 0.0f) {
+                if (j->cost < 0.0f) {
+                    free(j);
                     MessageBox(hWnd, "Cost cannot be negative.", "Input", MB_OK);
                     break;
                 }
+            }
 
-                if (db_set_compound_cost(g_dlgCompoundName, cost) == 0) {
-                    g_dlgSaved = TRUE;
-                    g_dlgDone  = TRUE;
-                    DestroyWindow(hWnd);
-                } else {
-                    MessageBox(hWnd, "Failed to update cost.", "Error", MB_ICONERROR);
-                }
+            /* Without a running executor InvSaveDone has already run,
+               and may have destroyed hWnd, when submit returns */
+            EnableWindow(hWnd, FALSE);
+            if (db_executor_submit_write(InvSaveJobRun, InvSaveDone, j) < 0) {
+                free(j);
+                EnableWindow(hWnd, TRUE);
+                MessageBox(hWnd, "Failed to save.", "Error", MB_ICONERROR);
             }
         }
         break;
@@ -295,7 +333,7 @@ static LRESULT CALLBACK InvPanelWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPAR
 
         g_hListView = CreateWindowEx(WS_EX_CLIENTEDGE, WC_LISTVIEW, NULL,
             WS_CHILD | WS_VISIBLE |
-            LVS_REPORT | LVS_SINGLESEL | LVS_SHOWSELALWAYS,
+            LVS_REPORT | LVS_SINGLESEL | LVS_SHOWSELALWAYS | LVS_OWNERDATA,
             0, 36, 100, 100, hWnd,
             (HMENU)(INT_PTR)IDC_LISTVIEW, g_hInst, NULL);
         ListView_SetExtendedListViewStyle(g_hListView,
@@ -317,6 +355,21 @@ static LRESULT CALLBACK InvPanelWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPAR
     }
     return 0;
 
+    case WM_NOTIFY:
+    {
+        NMHDR *pnm = (NMHDR*)lParam;
+        if (pnm->idFrom == IDC_LISTVIEW)
+            LV_HandleOwnerData(pnm);
+    }
+    return 0;
+
+    case WM_DESTROY:
+        db_executor_lock();
+        row_provider_close(g_rows);
+        db_executor_unlock();
+        g_rows = NULL;
+        break;
+
     case WM_COMMAND:
     {
         int id = LOWORD(wParam);
@@ -376,49 +429,16 @@ HWND Panel_Inventory_Create(HWND hParent)
    ========================================================================= */
 void Panel_Inventory_Refresh(void)
 {
-    sqlite3*      db   = db_get_handle();
-    sqlite3_stmt* stmt = NULL;
-    int           row  = 0;
-    char          buf[32];
+    sqlite3* db = db_get_handle();
 
     if (!g_hListView || !db) return;
 
-    ListView_DeleteAllItems(g_hListView);
-
-    if (sqlite3_prepare_v2(db,
-            "SELECT cl.compound_name, cl.cost_per_gram, "
-            "       ci.stock_grams, ci.reorder_threshold_grams, ci.last_updated "
-            "FROM compound_inventory ci "
-            "JOIN compound_library cl ON cl.id = ci.compound_library_id "
-            "ORDER BY cl.compound_name;",
-            -1, &stmt, NULL) != SQLITE_OK)
-        return;
-
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char* name    = (const char*)sqlite3_column_text(stmt, 0);
-        double      cpg     = sqlite3_column_double(stmt, 1);
-        double      stock   = sqlite3_column_double(stmt, 2);
-        double      reorder = sqlite3_column_double(stmt, 3);
-        const char* updated = (const char*)sqlite3_column_text(stmt, 4);
-        const char* status;
-
-        if (stock <= 0.0)
-            status = "OUT";
-        else if (stock <= reorder)
-            status = "LOW";
-        else
-            status = "OK";
-
-        LV_InsertRow(g_hListView, row, name ? name : "");
-
-        sprintf(buf, "%.4f", stock);   LV_SetCell(g_hListView, row, 1, buf);
-        sprintf(buf, "%.4f", reorder); LV_SetCell(g_hListView, row, 2, buf);
-        sprintf(buf, "%.4f", cpg);     LV_SetCell(g_hListView, row, 3, buf);
-        LV_SetCell(g_hListView, row, 4, status);
-        LV_SetCell(g_hListView, row, 5, updated ? updated : "");
-
-        row++;
-    }
+    db_executor_lock();
+    row_provider_close(g_rows);
+    g_rows = row_provider_open(db, ROW_SOURCE_INVENTORY, NULL);
+    db_executor_unlock();
 
-    sqlite3_finalize(stmt);
+    ListView_SetItemState(g_hListView, -1, 0, LVIS_SELECTED | LVIS_FOCUSED);
+    ListView_SetItemCountEx(g_hListView, row_provider_count(g_rows), 0);
+    InvalidateRect(g_hListView, NULL, TRUE);
 }
@@ -1,10 +1,14 @@
 #include <windows.h>
 #include <commctrl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "ui.h"
 #include "database.h"
+#include "db_executor.h"
 #include "sqlite3.h"
+#include "panel_sql.h"
+#include "panel_rows.h"
 
 /* =========================================================================
    File-scope state
@@ -44,21 +48,43 @@ static void LV_AddCol(HWND hLV, int idx, const char* text, int width)
     ListView_InsertColumn(hLV, idx, &lvc);
 }
 
-static int LV_InsertRow(HWND hLV, int row, const char* col0, LPARAM lp)
+/* =========================================================================
+   Save — db_add_regulatory_limit as a write job; the dialog is disabled
+   until RegSaveDone closes it or reports the failure.
+   ========================================================================= */
+typedef struct {
+    HWND  hDlg;
+    char  name[128], source[128], date[16], notes[256];
+    float ppm;
+} RegSaveJob;
+
+static int RegSaveJobRun(sqlite3* db, void* arg)
 {
-    LVITEM lvi;
-    ZeroMemory(&lvi, sizeof(lvi));
-    lvi.mask     = LVIF_TEXT | LVIF_PARAM;
-    lvi.iItem    = row;
-    lvi.iSubItem = 0;
-    lvi.pszText  = (char*)col0;
-    lvi.lParam   = lp;
-    return ListView_InsertItem(hLV, &lvi);
+    RegSaveJob* j = (RegSaveJob*)arg;
+
+    (void)db;
+    return db_add_regulatory_limit(j->name, j->source, j->ppm, j->date,
+                                   j->notes[0] ? j->notes : NULL) != 0 ? -1 : 0;
 }
 
-static void LV_SetCell(HWND hLV, int row, int col, const char* text)
+static void RegSaveDone(int job_id, int result, void* arg)
 {
-    ListView_SetItemText(hLV, row, col, (char*)text);
+    RegSaveJob* j = (RegSaveJob*)arg;
+
+    (void)job_id;
+    if (IsWindow(j->hDlg)) {
+        EnableWindow(j->hDlg, TRUE);
+        if (result != 0) {
+            MessageBox(j->hDlg, "Failed to save regulatory limit.",
+                       "Error", MB_ICONERROR);
+        } else {
+            g_dlgSaved = TRUE;
+            g_dlgDone  = TRUE;
+            EnableWindow(GetParent(j->hDlg), TRUE);
+            DestroyWindow(j->hDlg);
+        }
+    }
+    free(j);
 }
 
 /* =========================================================================
@@ -88,6 +114,7 @@ static LRESULT CALLBACK RegLimitDlgWndProc(HWND hWnd, UINT msg,
             hWnd, (HMENU)(INT_PTR)IDC_REG_CPD_COMBO, g_hInst, NULL);
 
         /* Populate compound names from library */
+        db_executor_lock();
         if (db && sqlite3_prepare_v2(db,
                 "SELECT compound_name FROM compound_library "
                 "ORDER BY compound_name ASC;",
@@ -98,6 +125,7 @@ static LRESULT CALLBACK RegLimitDlgWndProc(HWND hWnd, UINT msg,
             }
             sqlite3_finalize(stmt);
         }
+        db_executor_unlock();
         SendMessage(hCombo, CB_SETCURSEL, 0, 0);
 
         /* Current active limit label */
@@ -193,7 +221,9 @@ static LRESULT CALLBACK RegLimitDlgWndProc(HWND hWnd, UINT msg,
             int idx = (int)SendMessage(hCombo, CB_GETCURSEL, 0, 0);
             if (idx != CB_ERR) {
                 SendMessage(hCombo, CB_GETLBTEXT, (WPARAM)idx, (LPARAM)name);
+                db_executor_lock();
                 int src = db_get_active_limit(name, &cur_max);
+                db_executor_unlock();
                 if (src >= 0 && cur_max > 0.0f) {
                     char buf[64];
                     snprintf(buf, sizeof(buf), "%.2f ppm (%s)",
@@ -214,6 +244,7 @@ static LRESULT CALLBACK RegLimitDlgWndProc(HWND hWnd, UINT msg,
             char name[128], source[128], ppmStr[32], date[16], notes[256];
             HWND hCombo = GetDlgItem(hWnd, IDC_REG_CPD_COMBO);
             int  idx    = (int)SendMessage(hCombo, CB_GETCURSEL, 0, 0);
+            RegSaveJob* j;
 
             if (idx == CB_ERR) {
                 MessageBox(hWnd, "Select a compound.", "Error", MB_ICONWARNING);
@@ -242,17 +273,24 @@ static LRESULT CALLBACK RegLimitDlgWndProc(HWND hWnd, UINT msg,
                 return 0;
             }
 
-            if (db_add_regulatory_limit(name, source, ppm, date,
-                                        notes[0] ? notes : NULL) != 0) {
+            j = (RegSaveJob*)malloc(sizeof(RegSaveJob));
+            if (j == NULL) return 0;
+            j->hDlg = hWnd;
+            strcpy(j->name,   name);
+            strcpy(j->source, source);
+            strcpy(j->date,   date);
+            strcpy(j->notes,  notes);
+            j->ppm = ppm;
+
+            /* Without a running executor RegSaveDone has already run,
+               and may have destroyed hWnd, when submit returns */
+            EnableWindow(hWnd, FALSE);
+            if (db_executor_submit_write(RegSaveJobRun, RegSaveDone, j) < 0) {
+                free(j);
+                EnableWindow(hWnd, TRUE);
                 MessageBox(hWnd, "Failed to save regulatory limit.",
                            "Error", MB_ICONERROR);
-                return 0;
             }
-
-            g_dlgSaved = TRUE;
-            g_dlgDone  = TRUE;
-            EnableWindow(GetParent(hWnd), TRUE);
-            DestroyWindow(hWnd);
             return 0;
         }
 
@@ -401,63 +439,78 @@ static LRESULT CALLBACK RegPanelWndProc(HWND hWnd, UINT msg,
 }
 
 /* =========================================================================
-   Panel_Regulatory_Refresh
+   Panel_Regulatory_Refresh — every override, flagged active/superseded.
+   The query runs on a reader thread (RegListJob); RegListDone fills the
+   list unless a newer refresh has been started since.
    ========================================================================= */
-void Panel_Regulatory_Refresh(void)
+static int g_refreshSeq = 0;   /* only the newest query fills the list */
+static int g_refreshJob = 0;   /* its executor job id, for cancelling  */
+
+static int RegListJob(sqlite3* db, void* arg)
 {
-    sqlite3*      db   = db_get_handle();
+    PanelRows*    r    = (PanelRows*)arg;
     sqlite3_stmt* stmt = NULL;
-    int           row  = 0;
-
-    if (!g_hListView || !db) return;
-
-    ListView_DeleteAllItems(g_hListView);
-
-    if (sqlite3_prepare_v2(db,
-        "SELECT rl.compound_name, rl.source, rl.max_use_ppm, "
-        "       COALESCE(cl.max_use_ppm, 0.0), "
-        "       rl.effective_date, "
-        "       CASE WHEN rl.id = ("
-        "           SELECT id FROM regulatory_limits r2 "
-        "           WHERE r2.compound_name = rl.compound_name "
-        "           ORDER BY r2.effective_date DESC, r2.id DESC LIMIT 1"
-        "       ) THEN 1 ELSE 0 END AS is_active, "
-        "       COALESCE(rl.notes, '') "
-        "FROM regulatory_limits rl "
-        "LEFT JOIN compound_library cl "
-        "       ON cl.compound_name = rl.compound_name "
-        "ORDER BY rl.compound_name ASC, rl.effective_date DESC, rl.id DESC;",
-        -1, &stmt, NULL) != SQLITE_OK)
-        return;
-
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char* cpd      = (const char*)sqlite3_column_text(stmt, 0);
-        const char* src      = (const char*)sqlite3_column_text(stmt, 1);
-        double      ovr_ppm  = sqlite3_column_double(stmt, 2);
-        double      lib_ppm  = sqlite3_column_double(stmt, 3);
-        const char* eff_date = (const char*)sqlite3_column_text(stmt, 4);
-        int         is_act   = sqlite3_column_int(stmt, 5);
-        const char* notes    = (const char*)sqlite3_column_text(stmt, 6);
-
-        char ovr_buf[32], lib_buf[32];
-        snprintf(ovr_buf, sizeof(ovr_buf), "%.2f", ovr_ppm);
+    int           rc;
+
+    rc = sqlite3_prepare_v2(db, SQL_REGULATORY_REFRESH, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return rc;
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        double     lib_ppm = sqlite3_column_double(stmt, 3);
+        int        is_act  = sqlite3_column_int(stmt, 5);
+        /* lParam stores is_active for the custom draw */
+        PanelCell* c       = panel_rows_add(r, (LPARAM)is_act);
+        if (c == NULL) { rc = SQLITE_NOMEM; break; }
+
+        panel_cell_text(c[0], sqlite3_column_text(stmt, 0), "");
+        panel_cell_text(c[1], sqlite3_column_text(stmt, 1), "");
+        snprintf(c[2], PANEL_ROWS_CELL, "%.2f", sqlite3_column_double(stmt, 2));
         if (lib_ppm > 0.0)
-            snprintf(lib_buf, sizeof(lib_buf), "%.2f", lib_ppm);
+            snprintf(c[3], PANEL_ROWS_CELL, "%.2f", lib_ppm);
         else
-            strncpy(lib_buf, "--", sizeof(lib_buf));
+            strcpy(c[3], "--");
+        panel_cell_text(c[4], sqlite3_column_text(stmt, 4), "");
+        strcpy(c[5], is_act ? "Active" : "Superseded");
+        panel_cell_text(c[6], sqlite3_column_text(stmt, 6), "");
+    }
 
-        int actual = LV_InsertRow(g_hListView, row, cpd ? cpd : "", (LPARAM)is_act);
-        LV_SetCell(g_hListView, actual, 1, src      ? src      : "");
-        LV_SetCell(g_hListView, actual, 2, ovr_buf);
-        LV_SetCell(g_hListView, actual, 3, lib_buf);
-        LV_SetCell(g_hListView, actual, 4, eff_date ? eff_date : "");
-        LV_SetCell(g_hListView, actual, 5, is_act   ? "Active" : "Superseded");
-        LV_SetCell(g_hListView, actual, 6, notes    ? notes    : "");
+    sqlite3_finalize(stmt);
+    return (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+}
 
-        row++;
+static void RegListDone(int job_id, int result, void* arg)
+{
+    PanelRows* r = (PanelRows*)arg;
+
+    (void)job_id;
+
+    /* Superseded, cancelled or failed: keep whatever the list shows */
+    if (r->seq == g_refreshSeq && result == SQLITE_OK && g_hListView) {
+        g_refreshJob = 0;
+        panel_rows_fill(g_hListView, r);
     }
 
-    sqlite3_finalize(stmt);
+    panel_rows_free(r);
+    free(r);
+}
+
+void Panel_Regulatory_Refresh(void)
+{
+    PanelRows* r;
+
+    if (!g_hListView || !db_get_handle()) return;
+
+    r = (PanelRows*)calloc(1, sizeof(PanelRows));
+    if (r == NULL) return;
+    r->columns = 7;
+
+    if (g_refreshJob > 0) db_executor_cancel(g_refreshJob);
+    r->seq = ++g_refreshSeq;
+    g_refreshJob = db_executor_submit_read(RegListJob, RegListDone, r);
+    if (g_refreshJob < 0) {
+        g_refreshJob = 0;
+        free(r);
+    }
 }
 
 /* =========================================================================
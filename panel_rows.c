@@ -0,0 +1,70 @@
+#include <windows.h>
+#include <commctrl.h>
+#include <stdlib.h>
+#include <string.h>
+#include "panel_rows.h"
+
+PanelCell* panel_rows_add(PanelRows* r, LPARAM param)
+{
+    PanelCell* row;
+
+    if (r->count == r->cap) {
+        int        new_cap = r->cap ? r->cap * 2 : 128;
+        LPARAM*    params  = (LPARAM*)realloc(r->params, (size_t)new_cap * sizeof(LPARAM));
+        PanelCell* cells;
+
+        if (params == NULL) return NULL;
+        r->params = params;
+        cells = (PanelCell*)realloc(r->cells,
+                    (size_t)new_cap * PANEL_ROWS_MAX_COLS * sizeof(PanelCell));
+        if (cells == NULL) return NULL;
+        r->cells = cells;
+        r->cap   = new_cap;
+    }
+
+    row = &r->cells[(size_t)r->count * PANEL_ROWS_MAX_COLS];
+    memset(row, 0, PANEL_ROWS_MAX_COLS * sizeof(PanelCell));
+    r->params[r->count++] = param;
+    return row;
+}
+
+void panel_cell_text(PanelCell cell, const unsigned char* s, const char* if_null)
+{
+    strncpy(cell, s ? (const char*)s : if_null, PANEL_ROWS_CELL - 1);
+    cell[PANEL_ROWS_CELL - 1] = '\0';
+}
+
+void panel_rows_fill(HWND hLV, const PanelRows* r)
+{
+    int row, col;
+
+    SendMessage(hLV, WM_SETREDRAW, FALSE, 0);
+    ListView_DeleteAllItems(hLV);
+
+    for (row = 0; row < r->count; row++) {
+        const PanelCell* c = &r->cells[(size_t)row * PANEL_ROWS_MAX_COLS];
+        LVITEM lvi;
+        int    item;
+
+        ZeroMemory(&lvi, sizeof(lvi));
+        lvi.mask    = LVIF_TEXT | LVIF_PARAM;
+        lvi.iItem   = row;
+        lvi.pszText = (char*)c[0];
+        lvi.lParam  = r->params[row];
+        item = ListView_InsertItem(hLV, &lvi);
+        for (col = 1; col < r->columns && col < PANEL_ROWS_MAX_COLS; col++)
+            ListView_SetItemText(hLV, item, col, (char*)c[col]);
+    }
+
+    SendMessage(hLV, WM_SETREDRAW, TRUE, 0);
+    InvalidateRect(hLV, NULL, TRUE);
+}
+
+void panel_rows_free(PanelRows* r)
+{
+    free(r->params);
+    free(r->cells);
+    r->params = NULL;
+    r->cells  = NULL;
+    r->count  = r->cap = 0;
+}
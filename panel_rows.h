@@ -0,0 +1,47 @@
+#ifndef PANEL_ROWS_H
+#define PANEL_ROWS_H
+
+#include <windows.h>
+
+/*
+ * panel_rows.h — a panel's list, read off the UI thread.
+ *
+ * A panel refresh runs as a db_executor read job: the job steps its
+ * query on the pooled connection it is given and formats every row into
+ * a PanelRows; the completion, back on the UI thread, puts the rows into
+ * the ListView with panel_rows_fill.  Each refresh takes the next seq of
+ * its panel, so a completion can tell a newer refresh has been started
+ * since and drop its rows instead.
+ */
+
+#define PANEL_ROWS_MAX_COLS  10
+#define PANEL_ROWS_CELL     260   /* bytes per cell, as much as a ListView shows */
+
+typedef char PanelCell[PANEL_ROWS_CELL];
+
+typedef struct {
+    int        seq;       /* refresh these rows belong to      */
+    int        columns;
+    int        count;
+    int        cap;
+    LPARAM*    params;    /* item data of each row             */
+    PanelCell* cells;     /* count * PANEL_ROWS_MAX_COLS       */
+} PanelRows;
+
+/*
+ * Append a row whose ListView item data is param.  Returns its cells,
+ * all "", to be filled with panel_cell_text / snprintf; NULL when out
+ * of memory.
+ */
+PanelCell* panel_rows_add(PanelRows* r, LPARAM param);
+
+/* Copy a column's text into a cell; NULL becomes if_null. */
+void panel_cell_text(PanelCell cell, const unsigned char* s, const char* if_null);
+
+/* Replace the ListView's items with the rows (redraw held off meanwhile). */
+void panel_rows_fill(HWND hLV, const PanelRows* r);
+
+/* Free the rows; r itself is not freed. */
+void panel_rows_free(PanelRows* r);
+
+#endif /* PANEL_ROWS_H */
@@ -0,0 +1,176 @@
+#ifndef PANEL_SQL_H
+#define PANEL_SQL_H
+/*
+ * panel_sql.h — SQL text for the panel refresh queries.
+ * Included by the panel_*.c files that run them and by database.c,
+ * which feeds them to db_check_query_plans() so an index regression in
+ * a list screen shows up without opening the UI.
+ *
+ * Listing queries walk one table in full by design; everything they
+ * join or look up per row must still be an indexed SEARCH.
+ */
+
+/* Panel_Formulations_Refresh — latest version of each flavor */
+#define SQL_FORMULATIONS_REFRESH \
+    "SELECT f.flavor_code, f.flavor_name, " \
+    "       f.ver_major, f.ver_minor, f.ver_patch, " \
+    "       f.target_ph, f.target_brix, f.saved_at " \
+    "FROM latest_formulations lf " \
+    "JOIN formulations f ON f.id = lf.formulation_id " \
+    "ORDER BY lf.flavor_code;"
+
+/* FilterItemCombo (formulation editor) — latest soda bases by name */
+#define SQL_FORM_ITEM_BASES \
+    "SELECT sb.id, sb.base_name, sb.base_code, " \
+    "       sb.ver_major, sb.ver_minor, sb.ver_patch " \
+    "FROM latest_soda_bases ls " \
+    "JOIN soda_bases sb ON sb.id = ls.soda_base_id " \
+    "WHERE sb.base_name LIKE ? " \
+    "ORDER BY sb.base_name;"
+
+/* Panel_Bases_Refresh — latest version of each base with item counts */
+#define SQL_BASES_REFRESH \
+    "SELECT sb.id, sb.base_code, sb.base_name, " \
+    "       sb.ver_major, sb.ver_minor, sb.ver_patch, " \
+    "       sb.yield_liters, sb.saved_at, " \
+    "       (SELECT COUNT(*) FROM soda_base_compounds WHERE soda_base_id=sb.id), " \
+    "       (SELECT COUNT(*) FROM soda_base_ingredients WHERE soda_base_id=sb.id) " \
+    "FROM latest_soda_bases ls " \
+    "JOIN soda_bases sb ON sb.id = ls.soda_base_id " \
+    "ORDER BY ls.base_code;"
+
+/* Panel_Batch_Refresh, Panel_Tasting_Refresh, Panel_Inventory_Refresh —
+   virtual ListViews fed by row_provider.c.  Each list has a KEYS query,
+   which walks the list's (sort key, id) index once to count rows and
+   bookmark every page, and a PAGE query, which seeks from a bookmark:
+   ?1 = sort key, ?2 = id, ?3 = page size.  ?5, ?6 = the next page's
+   bookmark, an exclusive upper bound, so a page never runs into its
+   neighbour (the last page binds an empty BLOB, which sorts after every
+   key); ?7 = the highest id the KEYS walk saw, so rows added since are
+   left out.  In the per-flavor variants the flavor_code is ?1 of KEYS
+   and ?4 of PAGE. */
+#define SQL_BATCH_KEYS_ALL \
+    "SELECT br.batched_at, br.id " \
+    "FROM batch_runs br " \
+    "ORDER BY br.batched_at, br.id;"
+
+#define SQL_BATCH_KEYS_FLAVOR \
+    "SELECT br.batched_at, br.id " \
+    "FROM formulations f " \
+    "JOIN batch_runs br ON br.formulation_id = f.id " \
+    "WHERE f.flavor_code = ?1 " \
+    "ORDER BY br.batched_at, br.id;"
+
+#define SQL_BATCH_PAGE_ALL \
+    "SELECT br.batch_number, f.flavor_code, " \
+    "       f.ver_major, f.ver_minor, f.ver_patch, " \
+    "       br.volume_liters, br.cost_total, br.batched_at " \
+    "FROM batch_runs br " \
+    "JOIN formulations f ON f.id = br.formulation_id " \
+    "WHERE br.batched_at >= ?1 AND (br.batched_at > ?1 OR br.id >= ?2) " \
+    "  AND br.batched_at <= ?5 AND (br.batched_at < ?5 OR br.id < ?6) AND br.id <= ?7 " \
+    "ORDER BY br.batched_at, br.id LIMIT ?3;"
+
+#define SQL_BATCH_PAGE_FLAVOR \
+    "SELECT br.batch_number, f.flavor_code, " \
+    "       f.ver_major, f.ver_minor, f.ver_patch, " \
+    "       br.volume_liters, br.cost_total, br.batched_at " \
+    "FROM formulations f " \
+    "JOIN batch_runs br ON br.formulation_id = f.id " \
+    "WHERE f.flavor_code = ?4 " \
+    "  AND br.batched_at >= ?1 AND (br.batched_at > ?1 OR br.id >= ?2) " \
+    "  AND br.batched_at <= ?5 AND (br.batched_at < ?5 OR br.id < ?6) AND br.id <= ?7 " \
+    "ORDER BY br.batched_at, br.id LIMIT ?3;"
+
+#define SQL_TASTING_KEYS_ALL \
+    "SELECT t.tasted_at, t.id " \
+    "FROM tasting_sessions t " \
+    "ORDER BY t.tasted_at, t.id;"
+
+#define SQL_TASTING_KEYS_FLAVOR \
+    "SELECT t.tasted_at, t.id " \
+    "FROM formulations f " \
+    "JOIN tasting_sessions t ON t.formulation_id = f.id " \
+    "WHERE f.flavor_code = ?1 " \
+    "ORDER BY t.tasted_at, t.id;"
+
+#define SQL_TASTING_PAGE_ALL \
+    "SELECT f.flavor_code, f.ver_major, f.ver_minor, f.ver_patch, " \
+    "       t.taster, t.tasted_at, " \
+    "       t.overall_score, t.aroma_score, t.flavor_score, " \
+    "       t.mouthfeel_score, t.finish_score, t.sweetness_score " \
+    "FROM tasting_sessions t " \
+    "JOIN formulations f ON f.id = t.formulation_id " \
+    "WHERE t.tasted_at >= ?1 AND (t.tasted_at > ?1 OR t.id >= ?2) " \
+    "  AND t.tasted_at <= ?5 AND (t.tasted_at < ?5 OR t.id < ?6) AND t.id <= ?7 " \
+    "ORDER BY t.tasted_at, t.id LIMIT ?3;"
+
+#define SQL_TASTING_PAGE_FLAVOR \
+    "SELECT f.flavor_code, f.ver_major, f.ver_minor, f.ver_patch, " \
+    "       t.taster, t.tasted_at, " \
+    "       t.overall_score, t.aroma_score, t.flavor_score, " \
+    "       t.mouthfeel_score, t.finish_score, t.sweetness_score " \
+    "FROM formulations f " \
+    "JOIN tasting_sessions t ON t.formulation_id = f.id " \
+    "WHERE f.flavor_code = ?4 " \
+    "  AND t.tasted_at >= ?1 AND (t.tasted_at > ?1 OR t.id >= ?2) " \
+    "  AND t.tasted_at <= ?5 AND (t.tasted_at < ?5 OR t.id < ?6) AND t.id <= ?7 " \
+    "ORDER BY t.tasted_at, t.id LIMIT ?3;"
+
+#define SQL_INVENTORY_KEYS \
+    "SELECT cl.compound_name, cl.id " \
+    "FROM compound_inventory ci " \
+    "JOIN compound_library cl ON cl.id = ci.compound_library_id " \
+    "ORDER BY cl.compound_name, cl.id;"
+
+#define SQL_INVENTORY_PAGE \
+    "SELECT cl.compound_name, cl.cost_per_gram, " \
+    "       ci.stock_grams, ci.reorder_threshold_grams, ci.last_updated " \
+    "FROM compound_library cl " \
+    "JOIN compound_inventory ci ON ci.compound_library_id = cl.id " \
+    "WHERE cl.compound_name >= ?1 AND (cl.compound_name > ?1 OR cl.id >= ?2) " \
+    "  AND cl.compound_name <= ?5 AND (cl.compound_name < ?5 OR cl.id < ?6) AND cl.id <= ?7 " \
+    "ORDER BY cl.compound_name, cl.id LIMIT ?3;"
+
+/* Panel_Regulatory_Refresh — every override, flagged active/superseded */
+#define SQL_REGULATORY_REFRESH \
+    "SELECT rl.compound_name, rl.source, rl.max_use_ppm, " \
+    "       COALESCE(cl.max_use_ppm, 0.0), " \
+    "       rl.effective_date, " \
+    "       CASE WHEN rl.id = (" \
+    "           SELECT id FROM regulatory_limits r2 " \
+    "           WHERE r2.compound_library_id = rl.compound_library_id " \
+    "           ORDER BY r2.effective_date DESC, r2.id DESC LIMIT 1" \
+    "       ) THEN 1 ELSE 0 END AS is_active, " \
+    "       COALESCE(rl.notes, '') " \
+    "FROM regulatory_limits rl " \
+    "LEFT JOIN compound_library cl " \
+    "       ON cl.id = rl.compound_library_id " \
+    "ORDER BY rl.compound_name ASC, rl.effective_date DESC, rl.id DESC;"
+
+/* Panel_Compounds_Refresh, no search text — ?1 = solubilizer filter
+   (-1 = any), ?2 = APP_* category mask (0 = any) */
+#define SQL_COMPOUNDS_REFRESH \
+    "SELECT compound_name, fema_number, max_use_ppm, " \
+    "       rec_min_ppm, rec_max_ppm, cost_per_gram, " \
+    "       requires_solubilizer, storage_temp " \
+    "FROM compound_library " \
+    "WHERE (?1 = -1 OR requires_solubilizer = ?1) " \
+    "  AND (?2 = 0 OR (app_mask & ?2) != 0) " \
+    "ORDER BY compound_name;"
+
+/* Panel_Compounds_Refresh, searching — ?1 = compound_fts MATCH expression
+   (see compound_search_expr), ?2 = solubilizer filter (-1 = any),
+   ?3 = APP_* category mask (0 = any).  Best match first. */
+#define SQL_COMPOUNDS_SEARCH \
+    "SELECT cl.compound_name, cl.fema_number, cl.max_use_ppm, " \
+    "       cl.rec_min_ppm, cl.rec_max_ppm, cl.cost_per_gram, " \
+    "       cl.requires_solubilizer, cl.storage_temp " \
+    "FROM compound_fts " \
+    "JOIN compound_library cl ON cl.id = compound_fts.rowid " \
+    "WHERE compound_fts MATCH ?1 " \
+    "  AND (?2 = -1 OR cl.requires_solubilizer = ?2) " \
+    "  AND (?3 = 0 OR (cl.app_mask & ?3) != 0) " \
+    "ORDER BY compound_fts.rank, cl.compound_name;"
+
+#endif /* PANEL_SQL_H */
@@ -1,10 +1,13 @@
 #include <windows.h>
 #include <commctrl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "ui.h"
 #include "database.h"
+#include "db_executor.h"
 #include "sqlite3.h"
+#include "panel_rows.h"
 
 /* =========================================================================
    File-scope state
@@ -56,77 +59,193 @@ static void LV_AddCol(HWND hLV, int idx, const char *text, int width)
     ListView_InsertColumn(hLV, idx, &lvc);
 }
 
-static int LV_InsertRow(HWND hLV, int row, const char *col0, LPARAM lp)
+/* =========================================================================
+   RefreshLinks — repopulate the compound-links ListView for a supplier.
+   The list is emptied at once; the query runs on a reader thread
+   (LinkListJob) and LinkListDone fills it unless another supplier has
+   been picked since.
+   ========================================================================= */
+typedef struct {
+    PanelRows rows;
+    int       supplier_id;
+} LinkQuery;
+
+static int g_linksSeq = 0;     /* only the newest query fills the list */
+static int g_linksJob = 0;     /* its executor job id, for cancelling  */
+
+static int LinkListJob(sqlite3* db, void* arg)
 {
-    LVITEM lvi;
-    ZeroMemory(&lvi, sizeof(lvi));
-    lvi.mask     = LVIF_TEXT | LVIF_PARAM;
-    lvi.iItem    = row;
-    lvi.iSubItem = 0;
-    lvi.pszText  = (char *)col0;
-    lvi.lParam   = lp;
-    return ListView_InsertItem(hLV, &lvi);
+    LinkQuery*    q    = (LinkQuery*)arg;
+    sqlite3_stmt* stmt = NULL;
+    int           rc;
+
+    rc = sqlite3_prepare_v2(db,
+        "SELECT cs.id, cl.compound_name, cs.price_per_gram, "
+        "       cs.min_order_grams, cs.lead_time_days, "
+        "       COALESCE(cs.catalog_number, '') "
+        "FROM compound_suppliers cs "
+        "JOIN compound_library cl ON cl.id = cs.compound_library_id "
+        "WHERE cs.supplier_id = ? "
+        "ORDER BY cl.compound_name;",
+        -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return rc;
+
+    sqlite3_bind_int(stmt, 1, q->supplier_id);
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        double     price = sqlite3_column_double(stmt, 2);
+        PanelCell* c     = panel_rows_add(&q->rows, (LPARAM)sqlite3_column_int(stmt, 0));
+        if (c == NULL) { rc = SQLITE_NOMEM; break; }
+
+        panel_cell_text(c[0], sqlite3_column_text(stmt, 1), "");
+        if (price > 0.0)
+            snprintf(c[1], PANEL_ROWS_CELL, "$%.4f", price);
+        else
+            strcpy(c[1], "--");
+        snprintf(c[2], PANEL_ROWS_CELL, "%.0f g", sqlite3_column_double(stmt, 3));
+        snprintf(c[3], PANEL_ROWS_CELL, "%d d", sqlite3_column_int(stmt, 4));
+        panel_cell_text(c[4], sqlite3_column_text(stmt, 5), "");
+    }
+
+    sqlite3_finalize(stmt);
+    return (rc == SQLITE_DONE) ? SQLITE_OK : rc;
 }
 
-static void LV_SetCell(HWND hLV, int row, int col, const char *text)
+static void LinkListDone(int job_id, int result, void* arg)
 {
-    ListView_SetItemText(hLV, row, col, (char *)text);
+    LinkQuery* q = (LinkQuery*)arg;
+
+    (void)job_id;
+
+    /* Superseded, cancelled or failed: leave the list empty */
+    if (q->rows.seq == g_linksSeq && result == SQLITE_OK && g_hLVLinks) {
+        g_linksJob = 0;
+        panel_rows_fill(g_hLVLinks, &q->rows);
+    }
+
+    panel_rows_free(&q->rows);
+    free(q);
 }
 
-/* =========================================================================
-   RefreshLinks — repopulate the compound-links ListView for a supplier
-   ========================================================================= */
 static void RefreshLinks(int supplier_id)
 {
-    sqlite3      *db   = db_get_handle();
-    sqlite3_stmt *stmt = NULL;
-    int           row  = 0;
+    LinkQuery* q;
 
     ListView_DeleteAllItems(g_hLVLinks);
     EnableWindow(g_hBtnEditLink,   FALSE);
     EnableWindow(g_hBtnRemoveLink, FALSE);
     g_selLinkId = 0;
 
-    if (supplier_id == 0 || !db) return;
+    if (g_linksJob > 0) db_executor_cancel(g_linksJob);
+    g_linksJob = 0;
+    ++g_linksSeq;
 
-    if (sqlite3_prepare_v2(db,
-        "SELECT cs.id, cl.compound_name, cs.price_per_gram, "
-        "       cs.min_order_grams, cs.lead_time_days, "
-        "       COALESCE(cs.catalog_number, '') "
-        "FROM compound_suppliers cs "
-        "JOIN compound_library cl ON cl.id = cs.compound_library_id "
-        "WHERE cs.supplier_id = ? "
-        "ORDER BY cl.compound_name;",
-        -1, &stmt, NULL) != SQLITE_OK)
-        return;
+    if (supplier_id == 0 || !db_get_handle()) return;
+
+    q = (LinkQuery*)calloc(1, sizeof(LinkQuery));
+    if (q == NULL) return;
+    q->rows.columns = 5;
+    q->rows.seq     = g_linksSeq;
+    q->supplier_id  = supplier_id;
 
-    sqlite3_bind_int(stmt, 1, supplier_id);
+    g_linksJob = db_executor_submit_read(LinkListJob, LinkListDone, q);
+    if (g_linksJob < 0) {
+        g_linksJob = 0;
+        free(q);
+    }
+}
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        int         cs_id   = sqlite3_column_int(stmt, 0);
-        const char *name    = (const char *)sqlite3_column_text(stmt, 1);
-        double      price   = sqlite3_column_double(stmt, 2);
-        double      minord  = sqlite3_column_double(stmt, 3);
-        int         lead    = sqlite3_column_int(stmt, 4);
-        const char *cat     = (const char *)sqlite3_column_text(stmt, 5);
-        char        pbuf[32], mbuf[32], lbuf[16];
+/* =========================================================================
+   Saves — the supplier and the compound link are each written by a write
+   job; the dialog is disabled until the job's done callback closes it or
+   reports the failure.
+   ========================================================================= */
+typedef struct {
+    HWND hDlg;
+    int  sid;      /* 0 = new supplier */
+    char name[128], website[256], email[128], phone[64], notes[512];
+} SupSaveJob;
 
-        if (price > 0.0)
-            snprintf(pbuf, sizeof(pbuf), "$%.4f", price);
-        else
-            strncpy(pbuf, "--", sizeof(pbuf));
+static int SupSaveJobRun(sqlite3* db, void* arg)
+{
+    SupSaveJob* j = (SupSaveJob*)arg;
 
-        snprintf(mbuf, sizeof(mbuf), "%.0f g", minord);
-        snprintf(lbuf, sizeof(lbuf), "%d d", lead);
+    (void)db;
+    if (j->sid == 0)
+        return db_add_supplier(j->name, j->website, j->email, j->phone, j->notes);
+    return db_update_supplier(j->sid, j->name, j->website, j->email, j->phone, j->notes);
+}
 
-        int actual = LV_InsertRow(g_hLVLinks, row, name ? name : "", (LPARAM)cs_id);
-        LV_SetCell(g_hLVLinks, actual, 1, pbuf);
-        LV_SetCell(g_hLVLinks, actual, 2, mbuf);
-        LV_SetCell(g_hLVLinks, actual, 3, lbuf);
-        LV_SetCell(g_hLVLinks, actual, 4, cat  ? cat  : "");
-        row++;
+static void SupSaveDone(int job_id, int result, void* arg)
+{
+    SupSaveJob* j = (SupSaveJob*)arg;
+
+    (void)job_id;
+    if (IsWindow(j->hDlg)) {
+        EnableWindow(j->hDlg, TRUE);
+        if (result == 1) {
+            MessageBox(j->hDlg, "Name already exists.", "Error", MB_ICONWARNING);
+        } else if (result != 0) {
+            MessageBox(j->hDlg, "Failed to save supplier.", "Error", MB_ICONERROR);
+        } else {
+            g_dlgSaved = TRUE;
+            g_dlgDone  = TRUE;
+            EnableWindow(GetParent(j->hDlg), TRUE);
+            DestroyWindow(j->hDlg);
+        }
     }
-    sqlite3_finalize(stmt);
+    free(j);
+}
+
+typedef struct {
+    HWND  hDlg;
+    int   sid;
+    int   csid;    /* 0 = new link */
+    char  cpdname[128], cat[128];
+    float pr, mo;
+    int   lead;
+    BOOL  updCost;
+} LinkSaveJob;
+
+static int LinkSaveJobRun(sqlite3* db, void* arg)
+{
+    LinkSaveJob* j = (LinkSaveJob*)arg;
+    int          rc;
+
+    (void)db;
+    if (j->csid == 0)
+        rc = db_add_compound_supplier(j->sid, j->cpdname, j->cat, j->pr, j->mo, j->lead);
+    else
+        rc = db_update_compound_supplier(j->csid, j->cat, j->pr, j->mo, j->lead);
+    if (rc != 0) return rc;
+
+    if (j->updCost && j->pr > 0.0f && j->cpdname[0])
+        db_set_compound_cost(j->cpdname, j->pr);
+    return 0;
+}
+
+static void LinkSaveDone(int job_id, int result, void* arg)
+{
+    LinkSaveJob* j = (LinkSaveJob*)arg;
+
+    (void)job_id;
+    if (IsWindow(j->hDlg)) {
+        EnableWindow(j->hDlg, TRUE);
+        if (result == 1) {
+            MessageBox(j->hDlg, "Compound not found in library.", "Error", MB_ICONWARNING);
+        } else if (result == 2) {
+            MessageBox(j->hDlg, "This compound is already linked to this supplier.", "Error", MB_ICONWARNING);
+        } else if (result != 0) {
+            MessageBox(j->hDlg, "Failed to save compound link.", "Error", MB_ICONERROR);
+        } else {
+            g_dlgSaved = TRUE;
+            g_dlgDone  = TRUE;
+            RemoveProp(j->hDlg, "csid");
+            EnableWindow(GetParent(j->hDlg), TRUE);
+            DestroyWindow(j->hDlg);
+        }
+    }
+    free(j);
 }
 
 /* =========================================================================
@@ -197,6 +316,7 @@ static LRESULT CALLBACK SupplierDlgWndProc(HWND hWnd, UINT msg,
         if (sid != 0) {
             sqlite3      *db   = db_get_handle();
             sqlite3_stmt *qst  = NULL;
+            db_executor_lock();
             if (db && sqlite3_prepare_v2(db,
                 "SELECT supplier_name, website, email, phone, notes "
                 "FROM suppliers WHERE id=?;",
@@ -217,6 +337,7 @@ static LRESULT CALLBACK SupplierDlgWndProc(HWND hWnd, UINT msg,
                 }
                 sqlite3_finalize(qst);
             }
+            db_executor_unlock();
             SetWindowText(hWnd, "Edit Supplier");
         }
 
@@ -230,39 +351,31 @@ static LRESULT CALLBACK SupplierDlgWndProc(HWND hWnd, UINT msg,
         int ctl = LOWORD(wParam);
 
         if (ctl == IDC_DLG_SAVE) {
-            char name[128], website[256], email[128], phone[64], notes[512];
-            int  sid = (int)GetWindowLongPtr(hWnd, GWLP_USERDATA);
-            int  rc;
-
-            GetWindowText(GetDlgItem(hWnd, IDC_SUP_NAME),    name,    sizeof(name));
-            GetWindowText(GetDlgItem(hWnd, IDC_SUP_WEBSITE), website, sizeof(website));
-            GetWindowText(GetDlgItem(hWnd, IDC_SUP_EMAIL),   email,   sizeof(email));
-            GetWindowText(GetDlgItem(hWnd, IDC_SUP_PHONE),   phone,   sizeof(phone));
-            GetWindowText(GetDlgItem(hWnd, IDC_SUP_NOTES),   notes,   sizeof(notes));
-
-            if (!name[0]) {
+            SupSaveJob* j = (SupSaveJob*)calloc(1, sizeof(SupSaveJob));
+            if (j == NULL) return 0;
+            j->hDlg = hWnd;
+            j->sid  = (int)GetWindowLongPtr(hWnd, GWLP_USERDATA);
+
+            GetWindowText(GetDlgItem(hWnd, IDC_SUP_NAME),    j->name,    sizeof(j->name));
+            GetWindowText(GetDlgItem(hWnd, IDC_SUP_WEBSITE), j->website, sizeof(j->website));
+            GetWindowText(GetDlgItem(hWnd, IDC_SUP_EMAIL),   j->email,   sizeof(j->email));
+            GetWindowText(GetDlgItem(hWnd, IDC_SUP_PHONE),   j->phone,   sizeof(j->phone));
+            GetWindowText(GetDlgItem(hWnd, IDC_SUP_NOTES),   j->notes,   sizeof(j->notes));
+
+            if (!j->name[0]) {
+                free(j);
                 MessageBox(hWnd, "Supplier name is required.", "Error", MB_ICONWARNING);
                 return 0;
             }
 
-            if (sid == 0)
-                rc = db_add_supplier(name, website, email, phone, notes);
-            else
-                rc = db_update_supplier(sid, name, website, email, phone, notes);
-
-            if (rc == 1) {
-                MessageBox(hWnd, "Name already exists.", "Error", MB_ICONWARNING);
-                return 0;
-            }
-            if (rc != 0) {
+            /* Without a running executor SupSaveDone has already run,
+               and may have destroyed hWnd, when submit returns */
+            EnableWindow(hWnd, FALSE);
+            if (db_executor_submit_write(SupSaveJobRun, SupSaveDone, j) < 0) {
+                free(j);
+                EnableWindow(hWnd, TRUE);
                 MessageBox(hWnd, "Failed to save supplier.", "Error", MB_ICONERROR);
-                return 0;
             }
-
-            g_dlgSaved = TRUE;
-            g_dlgDone  = TRUE;
-            EnableWindow(GetParent(hWnd), TRUE);
-            DestroyWindow(hWnd);
             return 0;
         }
 
@@ -317,6 +430,7 @@ static LRESULT CALLBACK LinkDlgWndProc(HWND hWnd, UINT msg,
                 WS_CHILD | WS_VISIBLE | CBS_DROPDOWNLIST | WS_VSCROLL,
                 140, 10, 220, 200,
                 hWnd, (HMENU)(INT_PTR)IDC_LINK_CPD, g_hInst, NULL);
+            db_executor_lock();
             if (db && sqlite3_prepare_v2(db,
                 "SELECT compound_name FROM compound_library ORDER BY compound_name;",
                 -1, &qst, NULL) == SQLITE_OK) {
@@ -326,6 +440,7 @@ static LRESULT CALLBACK LinkDlgWndProc(HWND hWnd, UINT msg,
                 }
                 sqlite3_finalize(qst);
             }
+            db_executor_unlock();
             SendMessage(hCombo, CB_SETCURSEL, 0, 0);
             SetWindowText(hWnd, "Add Compound Link");
         } else {
@@ -388,6 +503,7 @@ static LRESULT CALLBACK LinkDlgWndProc(HWND hWnd, UINT msg,
         if (csid != 0) {
             sqlite3      *db  = db_get_handle();
             sqlite3_stmt *qst = NULL;
+            db_executor_lock();
             if (db && sqlite3_prepare_v2(db,
                 "SELECT cs.catalog_number, cs.price_per_gram, "
                 "       cs.min_order_grams, cs.lead_time_days, "
@@ -416,6 +532,7 @@ static LRESULT CALLBACK LinkDlgWndProc(HWND hWnd, UINT msg,
                 }
                 sqlite3_finalize(qst);
             }
+            db_executor_unlock();
             /* Store csid in the extra bytes slot — use window title tag via GWLP */
             /* We'll pass csid via a second SetWindowLongPtr slot trick:
                store csid in the STATIC control's ID field isn't possible,
@@ -432,62 +549,47 @@ static LRESULT CALLBACK LinkDlgWndProc(HWND hWnd, UINT msg,
         int ctl = LOWORD(wParam);
 
         if (ctl == IDC_DLG_SAVE) {
-            char   prStr[32], moStr[32], ldStr[16], cat[128], cpdname[128];
-            int    sid   = (int)GetWindowLongPtr(hWnd, GWLP_USERDATA);
-            int    csid  = (int)(INT_PTR)GetProp(hWnd, "csid");
-            float  pr, mo;
-            int    lead;
-            BOOL   updCost;
-            int    rc;
+            char   prStr[32], moStr[32], ldStr[16];
+            LinkSaveJob* j = (LinkSaveJob*)calloc(1, sizeof(LinkSaveJob));
+            if (j == NULL) return 0;
+            j->hDlg = hWnd;
+            j->sid  = (int)GetWindowLongPtr(hWnd, GWLP_USERDATA);
+            j->csid = (int)(INT_PTR)GetProp(hWnd, "csid");
 
             GetWindowText(GetDlgItem(hWnd, IDC_LINK_PRICE),    prStr,   sizeof(prStr));
             GetWindowText(GetDlgItem(hWnd, IDC_LINK_MINORDER), moStr,   sizeof(moStr));
             GetWindowText(GetDlgItem(hWnd, IDC_LINK_LEADTIME), ldStr,   sizeof(ldStr));
-            GetWindowText(GetDlgItem(hWnd, IDC_LINK_CATALOG),  cat,     sizeof(cat));
+            GetWindowText(GetDlgItem(hWnd, IDC_LINK_CATALOG),  j->cat,  sizeof(j->cat));
 
-            pr   = (float)atof(prStr);
-            mo   = (float)atof(moStr);
-            lead = atoi(ldStr);
-            updCost = (SendMessage(GetDlgItem(hWnd, IDC_LINK_UPDCOST),
-                                   BM_GETCHECK, 0, 0) == BST_CHECKED);
+            j->pr   = (float)atof(prStr);
+            j->mo   = (float)atof(moStr);
+            j->lead = atoi(ldStr);
+            j->updCost = (SendMessage(GetDlgItem(hWnd, IDC_LINK_UPDCOST),
+                                      BM_GETCHECK, 0, 0) == BST_CHECKED);
 
-            if (csid == 0) {
+            if (j->csid == 0) {
                 /* Add mode — get compound from combo */
                 HWND hCombo = GetDlgItem(hWnd, IDC_LINK_CPD);
                 int  idx    = (int)SendMessage(hCombo, CB_GETCURSEL, 0, 0);
                 if (idx == CB_ERR) {
+                    free(j);
                     MessageBox(hWnd, "Select a compound.", "Error", MB_ICONWARNING);
                     return 0;
                 }
-                SendMessage(hCombo, CB_GETLBTEXT, (WPARAM)idx, (LPARAM)cpdname);
-                rc = db_add_compound_supplier(sid, cpdname, cat, pr, mo, lead);
-                if (rc == 1) {
-                    MessageBox(hWnd, "Compound not found in library.", "Error", MB_ICONWARNING);
-                    return 0;
-                }
-                if (rc == 2) {
-                    MessageBox(hWnd, "This compound is already linked to this supplier.", "Error", MB_ICONWARNING);
-                    return 0;
-                }
+                SendMessage(hCombo, CB_GETLBTEXT, (WPARAM)idx, (LPARAM)j->cpdname);
             } else {
                 /* Edit mode */
-                GetWindowText(GetDlgItem(hWnd, IDC_LINK_CPD), cpdname, sizeof(cpdname));
-                rc = db_update_compound_supplier(csid, cat, pr, mo, lead);
+                GetWindowText(GetDlgItem(hWnd, IDC_LINK_CPD), j->cpdname, sizeof(j->cpdname));
             }
 
-            if (rc != 0 && rc != 1 && rc != 2) {
+            /* Without a running executor LinkSaveDone has already run,
+               and may have destroyed hWnd, when submit returns */
+            EnableWindow(hWnd, FALSE);
+            if (db_executor_submit_write(LinkSaveJobRun, LinkSaveDone, j) < 0) {
+                free(j);
+                EnableWindow(hWnd, TRUE);
                 MessageBox(hWnd, "Failed to save compound link.", "Error", MB_ICONERROR);
-                return 0;
             }
-
-            if (updCost && pr > 0.0f && cpdname[0])
-                db_set_compound_cost(cpdname, pr);
-
-            g_dlgSaved = TRUE;
-            g_dlgDone  = TRUE;
-            RemoveProp(hWnd, "csid");
-            EnableWindow(GetParent(hWnd), TRUE);
-            DestroyWindow(hWnd);
             return 0;
         }
 
@@ -717,7 +819,9 @@ static LRESULT CALLBACK SuppliersPanelWndProc(HWND hWnd, UINT msg,
                 if (MessageBox(hWnd,
                     "Delete this supplier and all its compound links?",
                     "Confirm Delete", MB_YESNO | MB_ICONWARNING) == IDYES) {
+                    db_executor_lock();
                     db_delete_supplier(g_selSupplierId);
+                    db_executor_unlock();
                     g_selSupplierId = 0;
                     Panel_Suppliers_Refresh();
                 }
@@ -743,7 +847,9 @@ static LRESULT CALLBACK SuppliersPanelWndProc(HWND hWnd, UINT msg,
                 if (MessageBox(hWnd,
                     "Remove this compound link?",
                     "Confirm Remove", MB_YESNO | MB_ICONWARNING) == IDYES) {
+                    db_executor_lock();
                     db_remove_compound_supplier(g_selLinkId);
+                    db_executor_unlock();
                     g_selLinkId = 0;
                     RefreshLinks(g_selSupplierId);
                 }
@@ -824,15 +930,63 @@ HWND Panel_Suppliers_Create(HWND hParent)
 }
 
 /* =========================================================================
-   Panel_Suppliers_Refresh
+   Panel_Suppliers_Refresh — the selection and the links list are reset
+   at once; the supplier query runs on a reader thread (SupListJob) and
+   SupListDone fills the list unless a newer refresh has been started.
    ========================================================================= */
+static int g_refreshSeq = 0;   /* only the newest query fills the list */
+static int g_refreshJob = 0;   /* its executor job id, for cancelling  */
+
+static int SupListJob(sqlite3* db, void* arg)
+{
+    PanelRows*    r    = (PanelRows*)arg;
+    sqlite3_stmt* stmt = NULL;
+    int           rc;
+
+    rc = sqlite3_prepare_v2(db,
+        "SELECT id, supplier_name, "
+        "       COALESCE(website, ''), "
+        "       COALESCE(email, ''), "
+        "       COALESCE(phone, '') "
+        "FROM suppliers ORDER BY supplier_name;",
+        -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return rc;
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        PanelCell* c = panel_rows_add(r, (LPARAM)sqlite3_column_int(stmt, 0));
+        if (c == NULL) { rc = SQLITE_NOMEM; break; }
+
+        panel_cell_text(c[0], sqlite3_column_text(stmt, 1), "");
+        panel_cell_text(c[1], sqlite3_column_text(stmt, 2), "");
+        panel_cell_text(c[2], sqlite3_column_text(stmt, 3), "");
+        panel_cell_text(c[3], sqlite3_column_text(stmt, 4), "");
+    }
+
+    sqlite3_finalize(stmt);
+    return (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+}
+
+static void SupListDone(int job_id, int result, void* arg)
+{
+    PanelRows* r = (PanelRows*)arg;
+
+    (void)job_id;
+
+    /* Superseded, cancelled or failed: leave the list empty */
+    if (r->seq == g_refreshSeq && result == SQLITE_OK && g_hLVSupplier) {
+        g_refreshJob = 0;
+        panel_rows_fill(g_hLVSupplier, r);
+    }
+
+    panel_rows_free(r);
+    free(r);
+}
+
 void Panel_Suppliers_Refresh(void)
 {
-    sqlite3      *db   = db_get_handle();
-    sqlite3_stmt *stmt = NULL;
-    int           row  = 0;
+    PanelRows* r;
 
-    if (!g_hLVSupplier || !db) return;
+    if (!g_hLVSupplier || !db_get_handle()) return;
 
     ListView_DeleteAllItems(g_hLVSupplier);
     g_selSupplierId = 0;
@@ -841,26 +995,15 @@ void Panel_Suppliers_Refresh(void)
     EnableWindow(g_hBtnAddLink, FALSE);
     RefreshLinks(0);
 
-    if (sqlite3_prepare_v2(db,
-        "SELECT id, supplier_name, "
-        "       COALESCE(website, ''), "
-        "       COALESCE(email, ''), "
-        "       COALESCE(phone, '') "
-        "FROM suppliers ORDER BY supplier_name;",
-        -1, &stmt, NULL) != SQLITE_OK)
-        return;
-
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        int         id   = sqlite3_column_int(stmt, 0);
-        const char *name = (const char *)sqlite3_column_text(stmt, 1);
-        const char *web  = (const char *)sqlite3_column_text(stmt, 2);
-        const char *eml  = (const char *)sqlite3_column_text(stmt, 3);
-        const char *ph   = (const char *)sqlite3_column_text(stmt, 4);
-        int actual = LV_InsertRow(g_hLVSupplier, row, name ? name : "", (LPARAM)id);
-        LV_SetCell(g_hLVSupplier, actual, 1, web ? web : "");
-        LV_SetCell(g_hLVSupplier, actual, 2, eml ? eml : "");
-        LV_SetCell(g_hLVSupplier, actual, 3, ph  ? ph  : "");
-        row++;
+    r = (PanelRows*)calloc(1, sizeof(PanelRows));
+    if (r == NULL) return;
+    r->columns = 4;
+
+    if (g_refreshJob > 0) db_executor_cancel(g_refreshJob);
+    r->seq = ++g_refreshSeq;
+    g_refreshJob = db_executor_submit_read(SupListJob, SupListDone, r);
+    if (g_refreshJob < 0) {
+        g_refreshJob = 0;
+        free(r);
     }
-    sqlite3_finalize(stmt);
 }
@@ -1,11 +1,15 @@
 #include <windows.h>
 #include <commctrl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include "ui.h"
 #include "database.h"
+#include "db_executor.h"
 #include "tasting.h"
 #include "sqlite3.h"
+#include "row_provider.h"
 
 /* =========================================================================
    File-scope state
@@ -14,6 +18,8 @@ static HWND g_hPanel      = NULL;
 static HWND g_hListView   = NULL;
 static HWND g_hFilterCombo = NULL;
 static HWND g_hBtnNew;
+static HWND g_hStats;
+static RowProvider* g_rows = NULL;
 
 /* Dialog state */
 static BOOL g_dlgDone;
@@ -34,20 +40,25 @@ static void LV_AddCol(HWND hLV, int idx, const char* text, int width)
     ListView_InsertColumn(hLV, idx, &lvc);
 }
 
-static int LV_InsertRow(HWND hLV, int row, const char* col0)
+/* Owner-data ListView: cells come from g_rows, a page at a time, off
+   the main connection, so each fetch holds db_executor_lock. */
+static void LV_HandleOwnerData(NMHDR* pnm)
 {
-    LVITEM lvi;
-    ZeroMemory(&lvi, sizeof(lvi));
-    lvi.mask     = LVIF_TEXT;
-    lvi.iItem    = row;
-    lvi.iSubItem = 0;
-    lvi.pszText  = (char*)col0;
-    return ListView_InsertItem(hLV, &lvi);
-}
-
-static void LV_SetCell(HWND hLV, int row, int col, const char* text)
-{
-    ListView_SetItemText(hLV, row, col, (char*)text);
+    if (pnm->code == LVN_GETDISPINFO) {
+        LVITEM* item = &((NMLVDISPINFO*)pnm)->item;
+        if (item->mask & LVIF_TEXT) {
+            db_executor_lock();
+            lstrcpyn(item->pszText,
+                     row_provider_cell(g_rows, item->iItem, item->iSubItem),
+                     item->cchTextMax);
+            db_executor_unlock();
+        }
+    } else if (pnm->code == LVN_ODCACHEHINT) {
+        NMLVCACHEHINT* hint = (NMLVCACHEHINT*)pnm;
+        db_executor_lock();
+        row_provider_prefetch(g_rows, hint->iFrom, hint->iTo - hint->iFrom + 1);
+        db_executor_unlock();
+    }
 }
 
 /* =========================================================================
@@ -65,6 +76,7 @@ static void PopulateFlavorCombo(HWND hCombo)
     SendMessage(hCombo, CB_RESETCONTENT, 0, 0);
     SendMessage(hCombo, CB_ADDSTRING, 0, (LPARAM)"(All)");
 
+    db_executor_lock();
     if (sqlite3_prepare_v2(db,
             "SELECT DISTINCT flavor_code FROM formulations ORDER BY flavor_code;",
             -1, &stmt, NULL) == SQLITE_OK)
@@ -75,6 +87,7 @@ static void PopulateFlavorCombo(HWND hCombo)
         }
         sqlite3_finalize(stmt);
     }
+    db_executor_unlock();
 
     SendMessage(hCombo, CB_SETCURSEL, (prev >= 0 ? prev : 0), 0);
 }
@@ -91,6 +104,7 @@ static void DlgPopulateVersionCombo(HWND hVerCombo, const char* flavor)
 
     SendMessage(hVerCombo, CB_RESETCONTENT, 0, 0);
 
+    db_executor_lock();
     if (sqlite3_prepare_v2(db,
             "SELECT ver_major, ver_minor, ver_patch FROM formulations "
             "WHERE flavor_code=? ORDER BY ver_major, ver_minor, ver_patch;",
@@ -107,10 +121,48 @@ static void DlgPopulateVersionCombo(HWND hVerCombo, const char* flavor)
         }
         sqlite3_finalize(stmt);
     }
+    db_executor_unlock();
 
     SendMessage(hVerCombo, CB_SETCURSEL, 0, 0);
 }
 
+/* =========================================================================
+   Save — a write job on a copy of the session; the dialog is disabled
+   until TastingSaveDone closes it or reports the failure.
+   ========================================================================= */
+typedef struct {
+    HWND           hDlg;
+    char           flavor[MAX_FLAVOR_CODE];
+    int            major, minor, patch;
+    TastingSession ts;
+} TastingSaveJob;
+
+static int TastingSaveJobRun(sqlite3* db, void* arg)
+{
+    TastingSaveJob* t = (TastingSaveJob*)arg;
+
+    (void)db;
+    return db_save_tasting(t->flavor, t->major, t->minor, t->patch, &t->ts) == 0 ? 0 : -1;
+}
+
+static void TastingSaveDone(int job_id, int result, void* arg)
+{
+    TastingSaveJob* t = (TastingSaveJob*)arg;
+
+    (void)job_id;
+    if (IsWindow(t->hDlg)) {
+        EnableWindow(t->hDlg, TRUE);
+        if (result == 0) {
+            g_dlgSaved = TRUE;
+            g_dlgDone  = TRUE;
+            DestroyWindow(t->hDlg);
+        } else {
+            MessageBox(t->hDlg, "Failed to save tasting session.", "Error", MB_ICONERROR);
+        }
+    }
+    free(t);
+}
+
 /* =========================================================================
    Tasting dialog WndProc
    ========================================================================= */
@@ -249,6 +301,7 @@ static LRESULT CALLBACK TastingDlgWndProc(HWND hWnd, UINT msg, WPARAM wParam, LP
             char noteBuf[MAX_TASTING_NOTES];
             char scoreBuf[16];
             TastingSession ts;
+            TastingSaveJob* t;
             int   major, minor, patch;
             HWND  hFlvCombo, hVerCombo;
             int   flvSel, verSel;
@@ -297,11 +350,19 @@ static LRESULT CALLBACK TastingDlgWndProc(HWND hWnd, UINT msg, WPARAM wParam, LP
             GetWindowText(GetDlgItem(hWnd, IDC_DLG_NOTES), noteBuf, sizeof(noteBuf));
             strncpy(ts.notes, noteBuf, MAX_TASTING_NOTES - 1);
 
-            if (db_save_tasting(flvBuf, major, minor, patch, &ts) == 0) {
-                g_dlgSaved = TRUE;
-                g_dlgDone  = TRUE;
-                DestroyWindow(hWnd);
-            } else {
+            t = (TastingSaveJob*)malloc(sizeof(TastingSaveJob));
+            if (t == NULL) break;
+            t->hDlg = hWnd;
+            strcpy(t->flavor, flvBuf);
+            t->major = major; t->minor = minor; t->patch = patch;
+            t->ts    = ts;
+
+            /* Without a running executor TastingSaveDone has already run,
+               and may have destroyed hWnd, when submit returns */
+            EnableWindow(hWnd, FALSE);
+            if (db_executor_submit_write(TastingSaveJobRun, TastingSaveDone, t) < 0) {
+                free(t);
+                EnableWindow(hWnd, TRUE);
                 MessageBox(hWnd, "Failed to save tasting session.", "Error", MB_ICONERROR);
             }
         }
@@ -381,10 +442,15 @@ static LRESULT CALLBACK TastingPanelWndProc(HWND hWnd, UINT msg, WPARAM wParam,
             bx + 222, by, 100, 28, hWnd,
             (HMENU)(INT_PTR)IDC_BTN_NEW_SESSION, g_hInst, NULL);
 
+        /* Running averages for the selected flavor */
+        g_hStats = CreateWindowEx(0, "STATIC", "",
+            WS_CHILD | WS_VISIBLE | SS_LEFTNOWORDWRAP,
+            bx + 330, by + 6, 640, 18, hWnd, NULL, g_hInst, NULL);
+
         /* ListView */
         g_hListView = CreateWindowEx(WS_EX_CLIENTEDGE, WC_LISTVIEW, NULL,
             WS_CHILD | WS_VISIBLE |
-            LVS_REPORT | LVS_SINGLESEL | LVS_SHOWSELALWAYS,
+            LVS_REPORT | LVS_SINGLESEL | LVS_SHOWSELALWAYS | LVS_OWNERDATA,
             0, 36, 100, 100, hWnd,
             (HMENU)(INT_PTR)IDC_LISTVIEW, g_hInst, NULL);
         ListView_SetExtendedListViewStyle(g_hListView,
@@ -410,6 +476,21 @@ static LRESULT CALLBACK TastingPanelWndProc(HWND hWnd, UINT msg, WPARAM wParam,
     }
     return 0;
 
+    case WM_NOTIFY:
+    {
+        NMHDR *pnm = (NMHDR*)lParam;
+        if (pnm->idFrom == IDC_LISTVIEW)
+            LV_HandleOwnerData(pnm);
+    }
+    return 0;
+
+    case WM_DESTROY:
+        db_executor_lock();
+        row_provider_close(g_rows);
+        db_executor_unlock();
+        g_rows = NULL;
+        break;
+
     case WM_COMMAND:
     {
         int id     = LOWORD(wParam);
@@ -462,25 +543,53 @@ HWND Panel_Tasting_Create(HWND hParent)
     return g_hPanel;
 }
 
+/* =========================================================================
+   Stats line — read from tasting_aggregates, so it costs the same with 20
+   sessions as with 20,000 and can follow every save
+   ========================================================================= */
+static void UpdateStats(const char* flavor)
+{
+    static const char* const labels[DB_SCORE_DIMENSIONS] = {
+        "Overall", "Aroma", "Flavor", "Mouthfeel", "Finish", "Sweet"
+    };
+    DbTastingStats st;
+    char buf[512];
+    int  len, i, rc = -1;
+
+    if (flavor[0]) {
+        db_executor_lock();
+        rc = db_get_flavor_tasting_stats(flavor, &st);
+        db_executor_unlock();
+    }
+    if (rc != 0 || st.sessions == 0) {
+        SetWindowText(g_hStats, "");
+        return;
+    }
+
+    len = snprintf(buf, sizeof(buf), "%d session%s:", st.sessions,
+                   st.sessions == 1 ? "" : "s");
+    for (i = 0; i < DB_SCORE_DIMENSIONS && len < (int)sizeof(buf); i++) {
+        const DbScoreStat* d = &st.score[i];
+        if (d->n == 0) continue;
+        len += snprintf(buf + len, sizeof(buf) - len, "  %s %.1f (sd %.1f)",
+                        labels[i], d->mean, sqrt(d->variance));
+    }
+    SetWindowText(g_hStats, buf);
+}
+
 /* =========================================================================
    Panel_Tasting_Refresh
    ========================================================================= */
 void Panel_Tasting_Refresh(void)
 {
     sqlite3*      db    = db_get_handle();
-    sqlite3_stmt* stmt  = NULL;
     char          filter[MAX_FLAVOR_CODE];
     int           fsel;
-    int           row   = 0;
-    char          buf[32];
-    char          sql[512];
 
     if (!g_hListView || !db) return;
 
     PopulateFlavorCombo(g_hFilterCombo);
 
-    ListView_DeleteAllItems(g_hListView);
-
     fsel = (int)SendMessage(g_hFilterCombo, CB_GETCURSEL, 0, 0);
     if (fsel > 0) {
         SendMessage(g_hFilterCombo, CB_GETLBTEXT, fsel, (LPARAM)filter);
@@ -488,66 +597,13 @@ void Panel_Tasting_Refresh(void)
         filter[0] = '\0';
     }
 
-    if (filter[0]) {
-        sprintf(sql,
-            "SELECT f.flavor_code, f.ver_major, f.ver_minor, f.ver_patch, "
-            "       t.taster, t.tasted_at, "
-            "       t.overall_score, t.aroma_score, t.flavor_score, "
-            "       t.mouthfeel_score, t.finish_score, t.sweetness_score "
-            "FROM tasting_sessions t "
-            "JOIN formulations f ON f.id = t.formulation_id "
-            "WHERE f.flavor_code = '%s' "
-            "ORDER BY t.tasted_at ASC;", filter);
-    } else {
-        sprintf(sql,
-            "SELECT f.flavor_code, f.ver_major, f.ver_minor, f.ver_patch, "
-            "       t.taster, t.tasted_at, "
-            "       t.overall_score, t.aroma_score, t.flavor_score, "
-            "       t.mouthfeel_score, t.finish_score, t.sweetness_score "
-            "FROM tasting_sessions t "
-            "JOIN formulations f ON f.id = t.formulation_id "
-            "ORDER BY t.tasted_at ASC;");
-    }
-
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK)
-        return;
-
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char* code = (const char*)sqlite3_column_text(stmt, 0);
-
-        LV_InsertRow(g_hListView, row, code ? code : "");
-
-        sprintf(buf, "%d.%d.%d",
-            sqlite3_column_int(stmt, 1),
-            sqlite3_column_int(stmt, 2),
-            sqlite3_column_int(stmt, 3));
-        LV_SetCell(g_hListView, row, 1, buf);
-
-        {
-            const char* t = (const char*)sqlite3_column_text(stmt, 4);
-            LV_SetCell(g_hListView, row, 2, t ? t : "unknown");
-        }
-        {
-            const char* d = (const char*)sqlite3_column_text(stmt, 5);
-            LV_SetCell(g_hListView, row, 3, d ? d : "");
-        }
-
-        /* Scores */
-        {
-            int i;
-            int colids[] = { 4, 5, 6, 7, 8, 9 };
-            for (i = 0; i < 6; i++) {
-                if (sqlite3_column_type(stmt, 6 + i) == SQLITE_NULL) {
-                    LV_SetCell(g_hListView, row, colids[i], "--");
-                } else {
-                    sprintf(buf, "%.1f", sqlite3_column_double(stmt, 6 + i));
-                    LV_SetCell(g_hListView, row, colids[i], buf);
-                }
-            }
-        }
-
-        row++;
-    }
+    db_executor_lock();
+    row_provider_close(g_rows);
+    g_rows = row_provider_open(db, ROW_SOURCE_TASTINGS, filter);
+    db_executor_unlock();
+    UpdateStats(filter);
 
-    sqlite3_finalize(stmt);
+    ListView_SetItemState(g_hListView, -1, 0, LVIS_SELECTED | LVIS_FOCUSED);
+    ListView_SetItemCountEx(g_hListView, row_provider_count(g_rows), 0);
+    InvalidateRect(g_hListView, NULL, TRUE);
 }
@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "row_provider.h"
+#include "panel_sql.h"
+
+typedef char RowCells[ROW_PROVIDER_MAX_COLS][ROW_PROVIDER_CELL];
+
+/* Formats the current row of a PAGE query into display text. */
+typedef void (*RowFormatFn)(sqlite3_stmt* stmt, RowCells cells);
+
+/* =========================================================================
+   Sources
+   The SQL lives in panel_sql.h so db_check_query_plans sees it; the
+   formatting matches what the panels used to put in each cell.
+   ========================================================================= */
+typedef struct {
+    const char* keys_all;
+    const char* keys_flavor;    /* NULL = the list has no flavor filter */
+    const char* page_all;
+    const char* page_flavor;
+    int         columns;
+    RowFormatFn format;
+} RowSourceDef;
+
+static void cell_text(char* out, const unsigned char* s, const char* if_null)
+{
+    strncpy(out, s ? (const char*)s : if_null, ROW_PROVIDER_CELL - 1);
+    out[ROW_PROVIDER_CELL - 1] = '\0';
+}
+
+static void format_batch(sqlite3_stmt* stmt, RowCells c)
+{
+    cell_text(c[0], sqlite3_column_text(stmt, 0), "");
+    cell_text(c[1], sqlite3_column_text(stmt, 1), "");
+    snprintf(c[2], ROW_PROVIDER_CELL, "%d.%d.%d",
+             sqlite3_column_int(stmt, 2),
+             sqlite3_column_int(stmt, 3),
+             sqlite3_column_int(stmt, 4));
+    snprintf(c[3], ROW_PROVIDER_CELL, "%.2f", sqlite3_column_double(stmt, 5));
+    if (sqlite3_column_type(stmt, 6) == SQLITE_NULL)
+        strcpy(c[4], "--");
+    else
+        snprintf(c[4], ROW_PROVIDER_CELL, "$%.4f", sqlite3_column_double(stmt, 6));
+    cell_text(c[5], sqlite3_column_text(stmt, 7), "");
+}
+
+static void format_tasting(sqlite3_stmt* stmt, RowCells c)
+{
+    int i;
+
+    cell_text(c[0], sqlite3_column_text(stmt, 0), "");
+    snprintf(c[1], ROW_PROVIDER_CELL, "%d.%d.%d",
+             sqlite3_column_int(stmt, 1),
+             sqlite3_column_int(stmt, 2),
+             sqlite3_column_int(stmt, 3));
+    cell_text(c[2], sqlite3_column_text(stmt, 4), "unknown");
+    cell_text(c[3], sqlite3_column_text(stmt, 5), "");
+
+    /* Scores */
+    for (i = 0; i < 6; i++) {
+        if (sqlite3_column_type(stmt, 6 + i) == SQLITE_NULL)
+            strcpy(c[4 + i], "--");
+        else
+            snprintf(c[4 + i], ROW_PROVIDER_CELL, "%.1f",
+                     sqlite3_column_double(stmt, 6 + i));
+    }
+}
+
+static void format_inventory(sqlite3_stmt* stmt, RowCells c)
+{
+    double stock   = sqlite3_column_double(stmt, 2);
+    double reorder = sqlite3_column_double(stmt, 3);
+
+    cell_text(c[0], sqlite3_column_text(stmt, 0), "");
+    snprintf(c[1], ROW_PROVIDER_CELL, "%.4f", stock);
+    snprintf(c[2], ROW_PROVIDER_CELL, "%.4f", reorder);
+    snprintf(c[3], ROW_PROVIDER_CELL, "%.4f", sqlite3_column_double(stmt, 1));
+    if (stock <= 0.0)
+        strcpy(c[4], "OUT");
+    else if (stock <= reorder)
+        strcpy(c[4], "LOW");
+    else
+        strcpy(c[4], "OK");
+    cell_text(c[5], sqlite3_column_text(stmt, 4), "");
+}
+
+static const RowSourceDef g_sources[ROW_SOURCE_COUNT] = {
+    [ROW_SOURCE_BATCHES] = {
+        SQL_BATCH_KEYS_ALL, SQL_BATCH_KEYS_FLAVOR,
+        SQL_BATCH_PAGE_ALL, SQL_BATCH_PAGE_FLAVOR,
+        6, format_batch },
+    [ROW_SOURCE_TASTINGS] = {
+        SQL_TASTING_KEYS_ALL, SQL_TASTING_KEYS_FLAVOR,
+        SQL_TASTING_PAGE_ALL, SQL_TASTING_PAGE_FLAVOR,
+        10, format_tasting },
+    [ROW_SOURCE_INVENTORY] = {
+        SQL_INVENTORY_KEYS, NULL,
+        SQL_INVENTORY_PAGE, NULL,
+        6, format_inventory },
+};
+
+/* =========================================================================
+   Provider
+   marks[i] is the (sort key, id) of row i * ROW_PROVIDER_PAGE; the key is
+   kept as a copied sqlite3_value so it binds back with its own type.
+   Page i runs from marks[i] up to, not including, marks[i + 1].
+   ========================================================================= */
+typedef struct {
+    sqlite3_value* key;
+    sqlite3_int64  id;
+} RowBookmark;
+
+typedef struct {
+    int       page;             /* -1 = empty slot          */
+    int       rows;
+    unsigned  used;             /* LRU stamp                */
+    RowCells* cells;            /* ROW_PROVIDER_PAGE rows   */
+} RowPage;
+
+struct RowProvider {
+    const RowSourceDef* src;
+    sqlite3_stmt*       page_stmt;
+    int                 count;
+    RowBookmark*        marks;
+    int                 mark_count;
+    sqlite3_int64       max_id;         /* highest id in the list at open */
+    RowPage             cache[ROW_PROVIDER_PAGES];
+    unsigned            clock;
+    RowProviderStats    stats;
+};
+
+RowProvider* row_provider_open(sqlite3* db, RowSource src, const char* flavor_code)
+{
+    RowProvider*  p;
+    sqlite3_stmt* keys = NULL;
+    int filtered;
+    int cap = 0;
+    int i, rc;
+
+    if (db == NULL || (int)src < 0 || src >= ROW_SOURCE_COUNT) return NULL;
+
+    p = (RowProvider*)calloc(1, sizeof(RowProvider));
+    if (p == NULL) return NULL;
+    p->src   = &g_sources[src];
+    filtered = flavor_code && flavor_code[0] && p->src->keys_flavor;
+
+    for (i = 0; i < ROW_PROVIDER_PAGES; i++) {
+        p->cache[i].page  = -1;
+        p->cache[i].cells = (RowCells*)malloc(ROW_PROVIDER_PAGE * sizeof(RowCells));
+        if (p->cache[i].cells == NULL) {
+            row_provider_close(p);
+            return NULL;
+        }
+    }
+
+    /* One walk of the key index: count the rows, bookmark every page */
+    rc = sqlite3_prepare_v2(db, filtered ? p->src->keys_flavor : p->src->keys_all,
+                            -1, &keys, NULL);
+    if (rc == SQLITE_OK) {
+        if (filtered) sqlite3_bind_text(keys, 1, flavor_code, -1, SQLITE_TRANSIENT);
+        while ((rc = sqlite3_step(keys)) == SQLITE_ROW) {
+            if (p->count % ROW_PROVIDER_PAGE == 0) {
+                RowBookmark* m;
+                if (p->mark_count == cap) {
+                    cap = cap ? cap * 2 : 64;
+                    m = (RowBookmark*)realloc(p->marks, (size_t)cap * sizeof(RowBookmark));
+                    if (m == NULL) { rc = SQLITE_NOMEM; break; }
+                    p->marks = m;
+                }
+                m = &p->marks[p->mark_count];
+                m->key = sqlite3_value_dup(sqlite3_column_value(keys, 0));
+                m->id  = sqlite3_column_int64(keys, 1);
+                if (m->key == NULL) { rc = SQLITE_NOMEM; break; }
+                p->mark_count++;
+            }
+            if (sqlite3_column_int64(keys, 1) > p->max_id)
+                p->max_id = sqlite3_column_int64(keys, 1);
+            p->count++;
+        }
+    }
+    sqlite3_finalize(keys);
+
+    if (rc == SQLITE_DONE)
+        rc = sqlite3_prepare_v2(db, filtered ? p->src->page_flavor : p->src->page_all,
+                                -1, &p->page_stmt, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Row provider error: %s\n", sqlite3_errmsg(db));
+        row_provider_close(p);
+        return NULL;
+    }
+
+    /* The flavor stays bound across resets */
+    if (filtered) sqlite3_bind_text(p->page_stmt, 4, flavor_code, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(p->page_stmt, 3, ROW_PROVIDER_PAGE);
+    sqlite3_bind_int64(p->page_stmt, 7, p->max_id);
+
+    p->stats.rows      = p->count;
+    p->stats.bookmarks = p->mark_count;
+    return p;
+}
+
+void row_provider_close(RowProvider* p)
+{
+    int i;
+
+    if (p == NULL) return;
+    sqlite3_finalize(p->page_stmt);
+    for (i = 0; i < p->mark_count; i++)
+        sqlite3_value_free(p->marks[i].key);
+    free(p->marks);
+    for (i = 0; i < ROW_PROVIDER_PAGES; i++)
+        free(p->cache[i].cells);
+    free(p);
+}
+
+int row_provider_count(const RowProvider* p)
+{
+    return p ? p->count : 0;
+}
+
+int row_provider_columns(const RowProvider* p)
+{
+    return p ? p->src->columns : 0;
+}
+
+void row_provider_get_stats(const RowProvider* p, RowProviderStats* out)
+{
+    if (p) *out = p->stats;
+    else   memset(out, 0, sizeof(*out));
+}
+
+static RowPage* find_page(RowProvider* p, int page)
+{
+    int i;
+
+    for (i = 0; i < ROW_PROVIDER_PAGES; i++) {
+        if (p->cache[i].page == page) {
+            p->cache[i].used = ++p->clock;
+            return &p->cache[i];
+        }
+    }
+    return NULL;
+}
+
+/* Seek from the page's bookmark into the least recently used slot */
+static RowPage* fetch_page(RowProvider* p, int page)
+{
+    RowPage* slot = &p->cache[0];
+    int i, rc;
+    int n = 0;
+
+    for (i = 1; i < ROW_PROVIDER_PAGES; i++)
+        if (p->cache[i].used < slot->used) slot = &p->cache[i];
+    slot->page = -1;
+
+    sqlite3_bind_value(p->page_stmt, 1, p->marks[page].key);
+    sqlite3_bind_int64(p->page_stmt, 2, p->marks[page].id);
+    if (page + 1 < p->mark_count) {
+        sqlite3_bind_value(p->page_stmt, 5, p->marks[page + 1].key);
+        sqlite3_bind_int64(p->page_stmt, 6, p->marks[page + 1].id);
+    } else {
+        sqlite3_bind_zeroblob(p->page_stmt, 5, 0);   /* after every key */
+        sqlite3_bind_int64(p->page_stmt, 6, 0);
+    }
+    while (n < ROW_PROVIDER_PAGE && (rc = sqlite3_step(p->page_stmt)) == SQLITE_ROW)
+        p->src->format(p->page_stmt, slot->cells[n++]);
+    if (n == ROW_PROVIDER_PAGE) rc = SQLITE_DONE;
+    sqlite3_reset(p->page_stmt);
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Row provider error: %s\n",
+                sqlite3_errmsg(sqlite3_db_handle(p->page_stmt)));
+        return NULL;
+    }
+
+    p->stats.page_fetches++;
+    slot->page = page;
+    slot->rows = n;
+    slot->used = ++p->clock;
+    return slot;
+}
+
+const char* row_provider_cell(RowProvider* p, int row, int col)
+{
+    RowPage* slot;
+
+    if (p == NULL || row < 0 || row >= p->count || col < 0 || col >= p->src->columns)
+        return "";
+
+    slot = find_page(p, row / ROW_PROVIDER_PAGE);
+    if (slot) p->stats.cache_hits++;
+    else      slot = fetch_page(p, row / ROW_PROVIDER_PAGE);
+
+    /* Rows deleted since open leave their page short */
+    if (slot == NULL || row % ROW_PROVIDER_PAGE >= slot->rows) return "";
+    return slot->cells[row % ROW_PROVIDER_PAGE][col];
+}
+
+int row_provider_prefetch(RowProvider* p, int first, int count)
+{
+    int lo, hi, page;
+
+    if (p == NULL || count <= 0 || p->count == 0) return 0;
+    if (first < 0) first = 0;
+    if (first + count > p->count) count = p->count - first;
+    if (count <= 0) return 0;
+
+    lo = first / ROW_PROVIDER_PAGE;
+    hi = (first + count - 1) / ROW_PROVIDER_PAGE;
+    if (hi - lo >= ROW_PROVIDER_PAGES) lo = hi - ROW_PROVIDER_PAGES + 1;
+
+    for (page = lo; page <= hi; page++)
+        if (find_page(p, page) == NULL && fetch_page(p, page) == NULL)
+            return -1;
+    return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef ROW_PROVIDER_H
+#define ROW_PROVIDER_H
+
+#include "sqlite3.h"
+
+/*
+ * row_provider.h — keyset-paginated rows for the long list screens.
+ *
+ * A provider is one list (all batches, one flavor's tastings, ...) as it
+ * stood when it was opened.  Opening walks only the (sort key, id) index
+ * of the list and keeps a bookmark at the first row of every page; a page
+ * is then fetched with one indexed seek from its bookmark, never with
+ * OFFSET, and formatted into display text.  A page stops short of the
+ * next bookmark and of the highest id seen at open, so rows deleted since
+ * leave blank rows at the end of their page and rows added since are not
+ * shown (an inventory row added for an older compound still is, and then
+ * pushes the last row of its page out).  A handful of pages are
+ * cached, so a virtual (LVS_OWNERDATA) ListView asking for the visible
+ * rows costs one small query per page scrolled into view.
+ *
+ * Plain C on top of SQLite: nothing here depends on the UI.  A provider
+ * uses the connection it was opened on and must stay on that thread.
+ */
+
+#define ROW_PROVIDER_PAGE      64   /* rows per page and per bookmark   */
+#define ROW_PROVIDER_PAGES      4   /* pages held in the cache          */
+#define ROW_PROVIDER_MAX_COLS  10
+#define ROW_PROVIDER_CELL      96   /* bytes per formatted cell         */
+
+typedef enum {
+    ROW_SOURCE_BATCHES,     /* batch_runs by batched_at                  */
+    ROW_SOURCE_TASTINGS,    /* tasting_sessions by tasted_at             */
+    ROW_SOURCE_INVENTORY,   /* compound_inventory by compound name       */
+    ROW_SOURCE_COUNT
+} RowSource;
+
+typedef struct RowProvider RowProvider;
+
+typedef struct {
+    int rows;               /* rows in the list                          */
+    int bookmarks;          /* one per page                              */
+    int page_fetches;       /* page queries run since open               */
+    int cache_hits;         /* cell lookups served from a cached page    */
+} RowProviderStats;
+
+/*
+ * Open src on db.  flavor_code limits batches and tastings to one
+ * flavor; NULL or "" lists everything (ignored for the inventory).
+ * Returns NULL on error (reported on stderr).
+ */
+RowProvider* row_provider_open(sqlite3* db, RowSource src, const char* flavor_code);
+
+/* Finalize the provider's statements and free it.  p may be NULL. */
+void row_provider_close(RowProvider* p);
+
+/* Rows in the list, for LVM_SETITEMCOUNT.  0 for NULL. */
+int row_provider_count(const RowProvider* p);
+
+/* Display columns per row. */
+int row_provider_columns(const RowProvider* p);
+
+/*
+ * Text of one cell, fetching its page if it is not cached.  The pointer
+ * is valid until the next provider call.  Returns "" when row or col is
+ * out of range or the fetch fails.
+ */
+const char* row_provider_cell(RowProvider* p, int row, int col);
+
+/*
+ * Make sure rows first .. first+count-1 are cached (LVN_ODCACHEHINT).
+ * Ranges wider than the cache keep the trailing pages.
+ * Returns 0 on success, negative on DB error.
+ */
+int row_provider_prefetch(RowProvider* p, int first, int count);
+
+void row_provider_get_stats(const RowProvider* p, RowProviderStats* out);
+
+#endif /* ROW_PROVIDER_H */
@@ -0,0 +1,746 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sensory.h"
+#include "intern.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* =========================================================================
+   Accumulators
+   ========================================================================= */
+void sensory_acc_add(SensoryAcc* a, double x)
+{
+    double delta = x - a->mean;
+
+    a->n++;
+    a->mean += delta / a->n;
+    a->m2   += delta * (x - a->mean);
+}
+
+/* Chan et al.: combine two partial accumulators without revisiting data */
+void sensory_acc_merge(SensoryAcc* into, const SensoryAcc* from)
+{
+    double delta;
+    int    n;
+
+    if (from->n == 0) return;
+    if (into->n == 0) {
+        *into = *from;
+        return;
+    }
+    n     = into->n + from->n;
+    delta = from->mean - into->mean;
+    into->mean += delta * from->n / n;
+    into->m2   += from->m2 + delta * delta * ((double)into->n * from->n / n);
+    into->n     = n;
+}
+
+double sensory_acc_variance(const SensoryAcc* a)
+{
+    return (a->n > 1) ? a->m2 / (a->n - 1) : 0.0;
+}
+
+/* =========================================================================
+   Student t distribution
+   ========================================================================= */
+
+/* Continued fraction for the incomplete beta function (modified Lentz) */
+static double beta_cf(double a, double b, double x)
+{
+    const double tiny = 1e-300;
+    double c = 1.0;
+    double d = 1.0 - (a + b) * x / (a + 1.0);
+    double h;
+    int    m;
+
+    if (fabs(d) < tiny) d = tiny;
+    d = 1.0 / d;
+    h = d;
+    for (m = 1; m <= 300; m++) {
+        int    m2 = 2 * m;
+        double aa = m * (b - m) * x / ((a + m2 - 1.0) * (a + m2));
+        double del;
+
+        d = 1.0 + aa * d;
+        if (fabs(d) < tiny) d = tiny;
+        c = 1.0 + aa / c;
+        if (fabs(c) < tiny) c = tiny;
+        d = 1.0 / d;
+        h *= d * c;
+
+        aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1.0));
+        d = 1.0 + aa * d;
+        if (fabs(d) < tiny) d = tiny;
+        c = 1.0 + aa / c;
+        if (fabs(c) < tiny) c = tiny;
+        d = 1.0 / d;
+        del = d * c;
+        h *= del;
+        if (fabs(del - 1.0) < 1e-15) break;
+    }
+    return h;
+}
+
+/* Regularized incomplete beta I_x(a, b) */
+static double beta_inc(double a, double b, double x)
+{
+    double front;
+
+    if (x <= 0.0) return 0.0;
+    if (x >= 1.0) return 1.0;
+    front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log1p(-x));
+    if (x < (a + 1.0) / (a + b + 2.0))
+        return front * beta_cf(a, b, x) / a;
+    return 1.0 - front * beta_cf(b, a, 1.0 - x) / b;
+}
+
+/* Two-sided p-value of t with df degrees of freedom */
+static double t_two_sided_p(double t, double df)
+{
+    if (df <= 0.0) return 1.0;
+    if (isinf(t)) return 0.0;
+    return beta_inc(0.5 * df, 0.5, df / (df + t * t));
+}
+
+/* Upper quantile of the standard normal (Abramowitz & Stegun 26.2.23,
+   |error| < 4.5e-4); only a starting point for t_quantile */
+static double z_quantile(double p)
+{
+    double t = sqrt(-2.0 * log(1.0 - p));
+    return t - (2.515517 + 0.802853 * t + 0.010328 * t * t) /
+               (1.0 + 1.432788 * t + 0.189269 * t * t + 0.001308 * t * t * t);
+}
+
+/* The t with P(T <= t) = p, for 0.5 < p < 1.  The CDF is concave above
+   0 and the normal quantile lies below the root, so Newton's method
+   climbs to it without overshooting. */
+static double t_quantile(double p, int df)
+{
+    double lognorm, t;
+    int    i;
+
+    if (df < 1) return 0.0;
+    if (df == 1) return tan(M_PI * (p - 0.5));
+    if (df == 2) return (2.0 * p - 1.0) / sqrt(2.0 * p * (1.0 - p));
+
+    lognorm = lgamma(0.5 * (df + 1)) - lgamma(0.5 * df) - 0.5 * log(df * M_PI);
+    t = z_quantile(p);
+    for (i = 0; i < 100; i++) {
+        double cdf  = 1.0 - 0.5 * beta_inc(0.5 * df, 0.5, df / (df + t * t));
+        double pdf  = exp(lognorm - 0.5 * (df + 1) * log1p(t * t / df));
+        double step = (p - cdf) / pdf;
+
+        t += step;
+        if (fabs(step) < 1e-12 * t) break;
+    }
+    return t;
+}
+
+/* =========================================================================
+   Report
+   A cell is one taster's sessions of one version.  Cells, versions and
+   tasters are arrays in first-seen order, each found through an
+   open-addressing table of index + 1 (0 = empty slot).  Cell slots carry
+   their key so a probe never touches the cells themselves.
+   ========================================================================= */
+typedef struct {
+    int        taster;
+    int        version;
+    SensoryAcc acc[SENSORY_DIMENSIONS];
+} SensoryCell;
+
+typedef struct {
+    int taster;
+    int version;
+    int cell;               /* index + 1 */
+} SensoryCellSlot;
+
+struct SensoryReport {
+    SensoryVersionStats* versions;
+    int                  version_count, version_cap;
+    int*                 version_slots;     /* by formulation_id */
+    int                  version_slots_cap;
+
+    SensoryTasterStats*  tasters;
+    int                  taster_count, taster_cap;
+    int*                 taster_by_sym;     /* intern id -> index + 1 */
+    int                  taster_sym_cap;
+    int*                 taster_cell;       /* cell the taster was last fed */
+
+    SensoryCell*         cells;
+    int                  cell_count, cell_cap;
+    SensoryCellSlot*     cell_slots;        /* by (taster, version) */
+    int                  cell_slots_cap;
+
+    int                  last_fid, last_version;
+    int                  sessions;
+    double               confidence;
+    double*              t_crit;            /* by df; 0 = not computed yet */
+    int                  t_crit_cap;
+    int                  finished;
+};
+
+static unsigned int hash_int(unsigned int x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static unsigned int cell_hash(int taster, int version)
+{
+    return hash_int((unsigned int)taster * 0x9e3779b1u ^ (unsigned int)version);
+}
+
+static int grow(void** arr, int* cap, int need, size_t size)
+{
+    void* p;
+    int   new_cap;
+
+    if (need <= *cap) return 0;
+    new_cap = *cap ? *cap : 16;
+    while (new_cap < need) new_cap *= 2;
+    p = realloc(*arr, (size_t)new_cap * size);
+    if (p == NULL) return -1;
+    memset((char*)p + (size_t)*cap * size, 0, (size_t)(new_cap - *cap) * size);
+    *arr = p;
+    *cap = new_cap;
+    return 0;
+}
+
+/* Rehash once the table would be more than half full */
+static int rehash_versions(SensoryReport* r)
+{
+    int  cap = r->version_slots_cap ? r->version_slots_cap * 2 : 64;
+    int* slots;
+    int  i;
+
+    if (r->version_count * 2 < r->version_slots_cap) return 0;
+    slots = (int*)calloc((size_t)cap, sizeof(int));
+    if (slots == NULL) return -1;
+    for (i = 0; i < r->version_count; i++) {
+        unsigned int s = hash_int((unsigned int)r->versions[i].formulation_id) & (cap - 1);
+        while (slots[s]) s = (s + 1) & (cap - 1);
+        slots[s] = i + 1;
+    }
+    free(r->version_slots);
+    r->version_slots     = slots;
+    r->version_slots_cap = cap;
+    return 0;
+}
+
+static int rehash_cells(SensoryReport* r)
+{
+    int              cap = r->cell_slots_cap ? r->cell_slots_cap * 2 : 256;
+    SensoryCellSlot* slots;
+    int              i;
+
+    if (r->cell_count * 2 < r->cell_slots_cap) return 0;
+    slots = (SensoryCellSlot*)calloc((size_t)cap, sizeof(SensoryCellSlot));
+    if (slots == NULL) return -1;
+    for (i = 0; i < r->cell_slots_cap; i++) {
+        const SensoryCellSlot* old = &r->cell_slots[i];
+        unsigned int s;
+
+        if (old->cell == 0) continue;
+        s = cell_hash(old->taster, old->version) & (cap - 1);
+        while (slots[s].cell) s = (s + 1) & (cap - 1);
+        slots[s] = *old;
+    }
+    free(r->cell_slots);
+    r->cell_slots     = slots;
+    r->cell_slots_cap = cap;
+    return 0;
+}
+
+static int find_version_id(const SensoryReport* r, int formulation_id)
+{
+    unsigned int mask = (unsigned int)r->version_slots_cap - 1;
+    unsigned int s;
+
+    if (r->version_slots_cap == 0) return -1;
+    for (s = hash_int((unsigned int)formulation_id) & mask; r->version_slots[s];
+         s = (s + 1) & mask)
+        if (r->versions[r->version_slots[s] - 1].formulation_id == formulation_id)
+            return r->version_slots[s] - 1;
+    return -1;
+}
+
+static int find_cell(const SensoryReport* r, int taster, int version)
+{
+    unsigned int mask = (unsigned int)r->cell_slots_cap - 1;
+    unsigned int s;
+
+    if (r->cell_slots_cap == 0) return -1;
+    for (s = cell_hash(taster, version) & mask; r->cell_slots[s].cell; s = (s + 1) & mask)
+        if (r->cell_slots[s].taster == taster && r->cell_slots[s].version == version)
+            return r->cell_slots[s].cell - 1;
+    return -1;
+}
+
+static int add_version(SensoryReport* r, const SensoryRow* row)
+{
+    unsigned int s;
+    int i = find_version_id(r, row->formulation_id);
+
+    if (i >= 0) return i;
+    if (rehash_versions(r) != 0 ||
+        grow((void**)&r->versions, &r->version_cap, r->version_count + 1,
+             sizeof(SensoryVersionStats)) != 0)
+        return -1;
+
+    i = r->version_count++;
+    r->versions[i].formulation_id = row->formulation_id;
+
+    s = hash_int((unsigned int)row->formulation_id) & (r->version_slots_cap - 1);
+    while (r->version_slots[s]) s = (s + 1) & (r->version_slots_cap - 1);
+    r->version_slots[s] = i + 1;
+    return i;
+}
+
+static int add_taster(SensoryReport* r, int sym)
+{
+    int i;
+
+    if (grow((void**)&r->taster_by_sym, &r->taster_sym_cap, sym + 1, sizeof(int)) != 0)
+        return -1;
+    if (r->taster_by_sym[sym]) return r->taster_by_sym[sym] - 1;
+    if (r->taster_count == r->taster_cap) {
+        int  cap  = r->taster_cap;
+        int* cell = (int*)realloc(r->taster_cell, ((size_t)cap ? cap * 2 : 16) * sizeof(int));
+
+        if (cell == NULL) return -1;
+        r->taster_cell = cell;
+        if (grow((void**)&r->tasters, &r->taster_cap, r->taster_count + 1,
+                 sizeof(SensoryTasterStats)) != 0)
+            return -1;
+    }
+
+    i = r->taster_count++;
+    r->taster_cell[i] = -1;
+    r->tasters[i].taster = intern_str(sym);
+    r->taster_by_sym[sym] = i + 1;
+    return i;
+}
+
+static int add_cell(SensoryReport* r, int taster, int version)
+{
+    SensoryCell* c;
+    unsigned int s;
+    int i = find_cell(r, taster, version);
+
+    if (i >= 0) return i;
+    if (rehash_cells(r) != 0 ||
+        grow((void**)&r->cells, &r->cell_cap, r->cell_count + 1, sizeof(SensoryCell)) != 0)
+        return -1;
+
+    i = r->cell_count++;
+    c = &r->cells[i];
+    c->taster  = taster;
+    c->version = version;
+
+    s = cell_hash(taster, version) & (r->cell_slots_cap - 1);
+    while (r->cell_slots[s].cell) s = (s + 1) & (r->cell_slots_cap - 1);
+    r->cell_slots[s].taster  = taster;
+    r->cell_slots[s].version = version;
+    r->cell_slots[s].cell    = i + 1;
+    return i;
+}
+
+SensoryReport* sensory_report_new(void)
+{
+    SensoryReport* r = (SensoryReport*)calloc(1, sizeof(SensoryReport));
+
+    if (r) r->last_version = -1;
+    return r;
+}
+
+void sensory_report_free(SensoryReport* r)
+{
+    if (r == NULL) return;
+    free(r->versions);
+    free(r->version_slots);
+    free(r->tasters);
+    free(r->taster_by_sym);
+    free(r->taster_cell);
+    free(r->cells);
+    free(r->cell_slots);
+    free(r->t_crit);
+    free(r);
+}
+
+int sensory_report_add(SensoryReport* r, const SensoryRow* row)
+{
+    SensoryCell* c;
+    int sym = intern(row->taster && row->taster[0] ? row->taster : "unknown");
+    int t, d;
+
+    if (sym == 0 || r->finished) return -1;
+
+    /* Sessions arrive grouped by version, so the version is usually the
+       previous row's and the cell the one this taster was last fed */
+    if (r->last_version < 0 || row->formulation_id != r->last_fid) {
+        r->last_version = add_version(r, row);
+        r->last_fid     = row->formulation_id;
+        if (r->last_version < 0) return -1;
+    }
+    t = add_taster(r, sym);
+    if (t < 0) return -1;
+    if (r->taster_cell[t] < 0 || r->cells[r->taster_cell[t]].version != r->last_version) {
+        int i = add_cell(r, t, r->last_version);
+        if (i < 0) return -1;
+        r->taster_cell[t] = i;
+    }
+
+    c = &r->cells[r->taster_cell[t]];
+    for (d = 0; d < SENSORY_DIMENSIONS; d++)
+        if (row->score[d] >= 0.0)
+            sensory_acc_add(&c->acc[d], row->score[d]);
+    r->tasters[c->taster].sessions++;
+    r->versions[c->version].sessions++;
+    r->sessions++;
+    return 0;
+}
+
+int sensory_report_set_version(SensoryReport* r, int formulation_id,
+                               const char* flavor_code, Version v)
+{
+    int i = find_version_id(r, formulation_id);
+
+    if (i < 0) return -1;
+    strncpy(r->versions[i].flavor_code, flavor_code ? flavor_code : "", MAX_FLAVOR_CODE - 1);
+    r->versions[i].version = v;
+    return 0;
+}
+
+/* =========================================================================
+   Finish
+   ========================================================================= */
+
+/* Two-sided critical t at the report's confidence.  Most versions share a
+   handful of session counts, so each df is solved once. */
+static double critical_t(const SensoryReport* r, int df)
+{
+    if (df < r->t_crit_cap && r->t_crit[df] > 0.0) return r->t_crit[df];
+    return t_quantile(1.0 - 0.5 * (1.0 - r->confidence), df);
+}
+
+static double critical_t_cached(SensoryReport* r, int df)
+{
+    if (df >= r->t_crit_cap &&
+        grow((void**)&r->t_crit, &r->t_crit_cap, df + 1, sizeof(double)) != 0)
+        return critical_t(r, df);
+    if (r->t_crit[df] <= 0.0)
+        r->t_crit[df] = t_quantile(1.0 - 0.5 * (1.0 - r->confidence), df);
+    return r->t_crit[df];
+}
+
+static void estimate(SensoryReport* r, const SensoryAcc* a, SensoryEstimate* e)
+{
+    e->n       = a->n;
+    e->mean    = a->mean;
+    e->sd      = sqrt(sensory_acc_variance(a));
+    e->ci_low  = a->mean;
+    e->ci_high = a->mean;
+    if (a->n > 1) {
+        double half = critical_t_cached(r, a->n - 1) * e->sd / sqrt((double)a->n);
+        e->ci_low  -= half;
+        e->ci_high += half;
+    }
+}
+
+/* One cell's z-scores as an accumulator: shift and scale by the taster's
+   own mean and sd.  Returns 0 (n == 0) when the taster has no spread. */
+static SensoryAcc z_cell(const SensoryAcc* cell, const SensoryAcc* scale)
+{
+    SensoryAcc z = { 0, 0.0, 0.0 };
+    double sd = sqrt(sensory_acc_variance(scale));
+
+    if (cell->n == 0 || sd <= 0.0) return z;
+    z.n    = cell->n;
+    z.mean = (cell->mean - scale->mean) / sd;
+    z.m2   = cell->m2 / (sd * sd);
+    return z;
+}
+
+/* Mean of the version without this cell; 0 if the cell is all of it */
+static int leave_one_out(const SensoryAcc* all, const SensoryAcc* cell, double* mean)
+{
+    int n = all->n - cell->n;
+
+    if (n <= 0) return 0;
+    *mean = (all->n * all->mean - cell->n * cell->mean) / n;
+    return 1;
+}
+
+static int cmp_double(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double* v, int n)
+{
+    qsort(v, (size_t)n, sizeof(double), cmp_double);
+    return (n % 2) ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+}
+
+/* Iglewicz-Hoaglin modified z-scores of x[0..n-1] into z[] (0 if there
+   are fewer than three values or no spread).  scratch holds n doubles. */
+static void modified_z(const double* x, double* z, double* scratch, int n)
+{
+    double med, mad;
+    int    i;
+
+    for (i = 0; i < n; i++) z[i] = 0.0;
+    if (n < 3) return;
+
+    memcpy(scratch, x, (size_t)n * sizeof(double));
+    med = median(scratch, n);
+    for (i = 0; i < n; i++) scratch[i] = fabs(x[i] - med);
+    mad = median(scratch, n);
+    if (mad > 0.0) {
+        for (i = 0; i < n; i++) z[i] = 0.6745 * (x[i] - med) / mad;
+        return;
+    }
+
+    /* Over half the values tie: fall back to the mean absolute deviation */
+    for (i = 0; i < n; i++) mad += fabs(x[i] - med);
+    mad /= n;
+    if (mad > 0.0)
+        for (i = 0; i < n; i++) z[i] = (x[i] - med) / (1.253314 * mad);
+}
+
+/* Bias and disagreement per taster on the overall score, then flags */
+static int find_outliers(SensoryReport* r, const SensoryAcc* vraw, const SensoryAcc* vz)
+{
+    double* w;
+    double* bias;
+    double* dis;
+    double* x;
+    double* z;
+    double* scratch;
+    int*    who;
+    int     i, n = 0;
+    const int dim = SENSORY_OVERALL;
+    const int T   = r->taster_count;
+
+    w = (double*)calloc((size_t)T * 6 + 1, sizeof(double));
+    who = (int*)malloc(((size_t)T + 1) * sizeof(int));
+    if (w == NULL || who == NULL) {
+        free(w);
+        free(who);
+        return -1;
+    }
+    bias = w + T;
+    dis  = bias + T;
+    x    = dis + T;
+    z    = x + T;
+    scratch = z + T;
+
+    for (i = 0; i < r->cell_count; i++) {
+        const SensoryCell* c = &r->cells[i];
+        const SensoryAcc*  a = &c->acc[dim];
+        SensoryAcc zc;
+        double others;
+
+        if (a->n == 0 || !leave_one_out(&vraw[c->version * SENSORY_DIMENSIONS + dim], a, &others))
+            continue;
+        w[c->taster]    += a->n;
+        bias[c->taster] += a->n * (a->mean - others);
+
+        zc = z_cell(a, &r->tasters[c->taster].scale[dim]);
+        if (zc.n && leave_one_out(&vz[c->version * SENSORY_DIMENSIONS + dim], &zc, &others))
+            dis[c->taster] += zc.n * (zc.mean - others) * (zc.mean - others);
+    }
+
+    for (i = 0; i < T; i++) {
+        SensoryTasterStats* t = &r->tasters[i];
+        if (w[i] <= 0.0) continue;
+        t->bias         = bias[i] / w[i];
+        t->disagreement = sqrt(dis[i] / w[i]);
+        who[n++] = i;
+    }
+
+    for (i = 0; i < n; i++) x[i] = r->tasters[who[i]].bias;
+    modified_z(x, z, scratch, n);
+    for (i = 0; i < n; i++) r->tasters[who[i]].bias_z = z[i];
+
+    for (i = 0; i < n; i++) x[i] = r->tasters[who[i]].disagreement;
+    modified_z(x, z, scratch, n);
+    for (i = 0; i < n; i++) {
+        SensoryTasterStats* t = &r->tasters[who[i]];
+        t->disagreement_z = z[i];
+        /* Harsh or lenient both count; agreeing too well does not */
+        t->outlier = fabs(t->bias_z) > SENSORY_OUTLIER_Z ||
+                     t->disagreement_z > SENSORY_OUTLIER_Z;
+    }
+
+    free(w);
+    free(who);
+    return 0;
+}
+
+int sensory_report_finish(SensoryReport* r, double confidence)
+{
+    SensoryAcc* vraw;
+    SensoryAcc* vz;
+    size_t      cells = (size_t)r->version_count * SENSORY_DIMENSIONS;
+    int         i, d, rc;
+
+    if (r->finished) return 0;
+    r->confidence = confidence;
+    vraw = (SensoryAcc*)calloc(cells * 2 + 1, sizeof(SensoryAcc));
+    if (vraw == NULL) return -1;
+    vz = vraw + cells;
+
+    /* Taster scales and raw version totals first: z-scores need the
+       finished scales */
+    for (i = 0; i < r->cell_count; i++) {
+        const SensoryCell* c = &r->cells[i];
+        r->tasters[c->taster].versions++;
+        r->versions[c->version].tasters++;
+        for (d = 0; d < SENSORY_DIMENSIONS; d++) {
+            sensory_acc_merge(&r->tasters[c->taster].scale[d], &c->acc[d]);
+            sensory_acc_merge(&vraw[c->version * SENSORY_DIMENSIONS + d], &c->acc[d]);
+        }
+    }
+    for (i = 0; i < r->cell_count; i++) {
+        const SensoryCell* c = &r->cells[i];
+        for (d = 0; d < SENSORY_DIMENSIONS; d++) {
+            SensoryAcc z = z_cell(&c->acc[d], &r->tasters[c->taster].scale[d]);
+            sensory_acc_merge(&vz[c->version * SENSORY_DIMENSIONS + d], &z);
+        }
+    }
+
+    for (i = 0; i < r->version_count; i++) {
+        SensoryVersionStats* v = &r->versions[i];
+        for (d = 0; d < SENSORY_DIMENSIONS; d++) {
+            estimate(r, &vraw[i * SENSORY_DIMENSIONS + d], &v->raw[d]);
+            estimate(r, &vz[i * SENSORY_DIMENSIONS + d], &v->normalized[d]);
+        }
+    }
+
+    rc = find_outliers(r, vraw, vz);
+    free(vraw);
+    if (rc != 0) return -1;
+
+    r->finished = 1;
+    return 0;
+}
+
+/* =========================================================================
+   Queries
+   ========================================================================= */
+int sensory_session_count(const SensoryReport* r)
+{
+    return r ? r->sessions : 0;
+}
+
+int sensory_version_count(const SensoryReport* r)
+{
+    return r ? r->version_count : 0;
+}
+
+const SensoryVersionStats* sensory_version(const SensoryReport* r, int i)
+{
+    return (r && i >= 0 && i < r->version_count) ? &r->versions[i] : NULL;
+}
+
+int sensory_find_version(const SensoryReport* r, const char* flavor_code, Version v)
+{
+    int i;
+
+    for (i = 0; r && i < r->version_count; i++) {
+        const SensoryVersionStats* s = &r->versions[i];
+        if (s->version.major == v.major && s->version.minor == v.minor &&
+            s->version.patch == v.patch && strcmp(s->flavor_code, flavor_code) == 0)
+            return i;
+    }
+    return -1;
+}
+
+int sensory_taster_count(const SensoryReport* r)
+{
+    return r ? r->taster_count : 0;
+}
+
+const SensoryTasterStats* sensory_taster(const SensoryReport* r, int i)
+{
+    return (r && i >= 0 && i < r->taster_count) ? &r->tasters[i] : NULL;
+}
+
+int sensory_compare(const SensoryReport* r, int a, int b, SensoryDimension dim,
+                    SensoryComparison* out)
+{
+    const SensoryEstimate* ea;
+    const SensoryEstimate* eb;
+    SensoryAcc diff = { 0, 0.0, 0.0 };
+    int i;
+
+    memset(out, 0, sizeof(*out));
+    out->dimension = dim;
+    out->p = out->welch_p = 1.0;
+    if (r == NULL || !r->finished || (int)dim < 0 || dim >= SENSORY_DIMENSIONS ||
+        a < 0 || a >= r->version_count || b < 0 || b >= r->version_count)
+        return -1;
+
+    /* Paired over the tasters who scored both */
+    for (i = 0; i < r->taster_count; i++) {
+        int ca = find_cell(r, i, a);
+        int cb = find_cell(r, i, b);
+        if (ca < 0 || cb < 0) continue;
+        if (r->cells[ca].acc[dim].n == 0 || r->cells[cb].acc[dim].n == 0) continue;
+        sensory_acc_add(&diff, r->cells[ca].acc[dim].mean - r->cells[cb].acc[dim].mean);
+    }
+    out->pairs     = diff.n;
+    out->mean_diff = diff.mean;
+    out->sd_diff   = sqrt(sensory_acc_variance(&diff));
+    out->ci_low    = out->ci_high = diff.mean;
+    if (diff.n > 1) {
+        double se = out->sd_diff / sqrt((double)diff.n);
+        double half = critical_t(r, diff.n - 1) * se;
+
+        out->ci_low  -= half;
+        out->ci_high += half;
+        if (se > 0.0) {
+            out->t = diff.mean / se;
+            out->p = t_two_sided_p(out->t, diff.n - 1);
+        } else if (diff.mean != 0.0) {
+            out->t = (diff.mean > 0.0) ? INFINITY : -INFINITY;   /* every taster agreed */
+            out->p = 0.0;
+        }
+    }
+
+    /* Welch over every session */
+    ea = &r->versions[a].raw[dim];
+    eb = &r->versions[b].raw[dim];
+    out->welch_diff = ea->mean - eb->mean;
+    if (ea->n > 1 && eb->n > 1) {
+        double va = ea->sd * ea->sd / ea->n;
+        double vb = eb->sd * eb->sd / eb->n;
+
+        if (va + vb > 0.0) {
+            out->welch_t  = out->welch_diff / sqrt(va + vb);
+            out->welch_df = (va + vb) * (va + vb) /
+                            (va * va / (ea->n - 1) + vb * vb / (eb->n - 1));
+            out->welch_p  = t_two_sided_p(out->welch_t, out->welch_df);
+        }
+    }
+    return 0;
+}
+
+const char* sensory_dimension_name(SensoryDimension dim)
+{
+    static const char* const names[SENSORY_DIMENSIONS] = {
+        "overall", "aroma", "flavor", "mouthfeel", "finish", "sweetness"
+    };
+    return ((int)dim >= 0 && dim < SENSORY_DIMENSIONS) ? names[dim] : "";
+}
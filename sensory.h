@@ -0,0 +1,159 @@
+#ifndef SENSORY_H
+#define SENSORY_H
+
+#include "formulation.h"
+#include "version.h"
+
+/*
+ * sensory.h — statistics over tasting sessions.
+ *
+ * A report is fed every session once (sensory_report_add) and then
+ * finished; nothing is re-read.  Each (taster, version) pair keeps a
+ * Welford accumulator per score dimension, and everything else — each
+ * taster's own scale, the per-version means, the z-scores — is merged
+ * from those cells with Chan's parallel update, so the work after the
+ * pass is proportional to the cells, not the sessions.
+ *
+ * - Per-taster normalization: a score becomes (score - taster mean) /
+ *   taster sd, which takes out how harshly and how widely each taster
+ *   uses the scale.
+ * - Confidence intervals are Student t intervals on the mean.
+ * - sensory_compare tests two versions: paired over the tasters who
+ *   scored both, and Welch's unpaired test over all their sessions.
+ * - A taster is an outlier when their offset from, or disagreement
+ *   with, the rest of the panel is far from the other tasters' (robust
+ *   modified z-score over the overall score).
+ *
+ * Plain C: nothing here touches the database; see db_sensory_report.
+ */
+
+/* Score dimensions, in tasting_sessions column order */
+typedef enum {
+    SENSORY_OVERALL,
+    SENSORY_AROMA,
+    SENSORY_FLAVOR,
+    SENSORY_MOUTHFEEL,
+    SENSORY_FINISH,
+    SENSORY_SWEETNESS,
+    SENSORY_DIMENSIONS
+} SensoryDimension;
+
+#define SENSORY_DEFAULT_CONFIDENCE 0.95
+#define SENSORY_OUTLIER_Z          3.5    /* modified z-score cut-off       */
+
+/* Welford running mean / sum of squared deviations */
+typedef struct {
+    int    n;
+    double mean;
+    double m2;
+} SensoryAcc;
+
+void   sensory_acc_add(SensoryAcc* a, double x);
+void   sensory_acc_merge(SensoryAcc* into, const SensoryAcc* from);
+double sensory_acc_variance(const SensoryAcc* a);     /* sample; 0 if n < 2 */
+
+typedef struct {
+    int    n;
+    double mean;
+    double sd;              /* sample sd, 0 when n < 2                   */
+    double ci_low;          /* confidence interval on the mean; equal to */
+    double ci_high;         /* the mean when n < 2                       */
+} SensoryEstimate;
+
+typedef struct {
+    int             formulation_id;
+    char            flavor_code[MAX_FLAVOR_CODE];
+    Version         version;
+    int             sessions;
+    int             tasters;
+    SensoryEstimate raw[SENSORY_DIMENSIONS];
+    /* Per-taster z-scores; sessions by tasters with no spread on a
+       dimension (fewer than two distinct scores) are left out of it */
+    SensoryEstimate normalized[SENSORY_DIMENSIONS];
+} SensoryVersionStats;
+
+typedef struct {
+    const char* taster;         /* interned (see intern.h)               */
+    int         sessions;
+    int         versions;
+    SensoryAcc  scale[SENSORY_DIMENSIONS];  /* the taster's own scores   */
+    /* Overall score against the rest of the panel, over the versions
+       somebody else also scored: */
+    double      bias;           /* mean raw offset (harsh < 0 < lenient) */
+    double      disagreement;   /* RMS offset of the z-scores            */
+    double      bias_z;         /* modified z-scores of the two among    */
+    double      disagreement_z; /* all tasters                           */
+    int         outlier;        /* 1 = either is beyond SENSORY_OUTLIER_Z */
+} SensoryTasterStats;
+
+typedef struct {
+    SensoryDimension dimension;
+    /* Paired: one difference (A - B) of means per taster who scored both */
+    int    pairs;
+    double mean_diff;
+    double sd_diff;
+    double ci_low;
+    double ci_high;
+    double t;
+    double p;               /* two-sided; 1 when there is nothing to test */
+    /* Welch: all sessions of A against all sessions of B */
+    double welch_diff;
+    double welch_t;
+    double welch_df;
+    double welch_p;
+} SensoryComparison;
+
+/* Session as fed to a report; a score < 0 means not scored */
+typedef struct {
+    int         formulation_id;
+    const char* taster;
+    double      score[SENSORY_DIMENSIONS];
+} SensoryRow;
+
+typedef struct SensoryReport SensoryReport;
+
+/* Returns NULL when out of memory. */
+SensoryReport* sensory_report_new(void);
+
+void sensory_report_free(SensoryReport* r);
+
+/* Feed one session.  Returns 0, or -1 when out of memory. */
+int sensory_report_add(SensoryReport* r, const SensoryRow* row);
+
+/*
+ * Name a version that sessions were fed for, so the rows carry only the
+ * formulation id.  Returns 0, or -1 if the report has no such version.
+ */
+int sensory_report_set_version(SensoryReport* r, int formulation_id,
+                               const char* flavor_code, Version v);
+
+/*
+ * Compute the version and taster tables.  confidence is the interval
+ * level, e.g. 0.95.  Call once, after the last add.
+ * Returns 0, or -1 when out of memory.
+ */
+int sensory_report_finish(SensoryReport* r, double confidence);
+
+int sensory_session_count(const SensoryReport* r);
+
+/* Versions and tasters are indexed in the order first seen. */
+int sensory_version_count(const SensoryReport* r);
+const SensoryVersionStats* sensory_version(const SensoryReport* r, int i);
+
+/* Index of a version, or -1. */
+int sensory_find_version(const SensoryReport* r, const char* flavor_code, Version v);
+
+int sensory_taster_count(const SensoryReport* r);
+const SensoryTasterStats* sensory_taster(const SensoryReport* r, int i);
+
+/*
+ * Compare versions a and b (indexes) on one dimension.
+ * Returns 0, or -1 for a bad index or an unfinished report.
+ */
+int sensory_compare(const SensoryReport* r, int a, int b, SensoryDimension dim,
+                    SensoryComparison* out);
+
+/* Lower-case dimension name ("overall", "aroma", ...) */
+const char* sensory_dimension_name(SensoryDimension dim);
+
+#endif /* SENSORY_H */
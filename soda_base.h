@@ -9,7 +9,7 @@
 #define MAX_BASE_INGREDIENTS 30
 
 typedef struct {
-    char  compound_name[64];
+    int   name_id;             /* intern() id of the compound name */
     float concentration_ppm;
     int   compound_library_id;
 } BaseCompound;
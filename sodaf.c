@@ -0,0 +1,772 @@
+/*
+ * sodaf.c — headless command-line front end to the formulation core.
+ *
+ *   sodaf [-d file.db] command [args...]   run one command
+ *   sodaf [-d file.db] [-]                 run commands from stdin, one per line
+ *
+ * Every command writes exactly one line of JSON to stdout, flushed, so a
+ * script can keep one process open and pipe thousands of commands
+ * through it:
+ *   {"ok":true, ...}   or   {"ok":false,"error":"..."}
+ * Status chatter from the core is switched off (db_set_verbose); safety
+ * warnings and database errors still go to stderr.
+ *
+ * Commands (REF is CODE for the latest version or CODE@X.Y.Z):
+ *   list
+ *   load   REF
+ *   save   CODE@X.Y.Z NAME [--ph N] [--brix N] COMPOUND=PPM ...
+ *   batch  calc|cost|check|deduct|save REF LITERS | next CODE | format FMT
+ *   label  BATCH_NUMBER
+ *   taste  stats REF | report [CODE] | compare REF REF [DIMENSION] | rebuild
+ *   check-plans
+ *
+ * In stdin mode, arguments containing spaces go in double quotes, and
+ * blank lines and lines starting with '#' are skipped.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "database.h"
+#include "batch.h"
+#include "formulation.h"
+#include "intern.h"
+#include "panel_sql.h"
+
+#define MAX_ARGS 64
+#define MAX_LINE 8192
+
+static FILE*         g_out       = NULL;
+static sqlite3_stmt* g_list_stmt = NULL;   /* SQL_FORMULATIONS_REFRESH */
+
+/* =========================================================================
+   JSON output
+   ========================================================================= */
+static void json_str(const char* s)
+{
+    const unsigned char* p = (const unsigned char*)(s ? s : "");
+
+    fputc('"', g_out);
+    for (; *p; p++) {
+        switch (*p) {
+        case '"':  fputs("\\\"", g_out); break;
+        case '\\': fputs("\\\\", g_out); break;
+        case '\n': fputs("\\n",  g_out); break;
+        case '\r': fputs("\\r",  g_out); break;
+        case '\t': fputs("\\t",  g_out); break;
+        default:
+            if (*p < 0x20) fprintf(g_out, "\\u%04x", *p);
+            else           fputc(*p, g_out);
+        }
+    }
+    fputc('"', g_out);
+}
+
+/* Cost fields use -1 for "no price data"; emit that as null. */
+static void json_cost(float v)
+{
+    if (v < 0.0f) fputs("null", g_out);
+    else          fprintf(g_out, "%.6g", v);
+}
+
+static int fail(const char* msg)
+{
+    fputs("{\"ok\":false,\"error\":", g_out);
+    json_str(msg);
+    fputs("}\n", g_out);
+    return 1;
+}
+
+static void json_version(Version v)
+{
+    fprintf(g_out, "\"%d.%d.%d\"", v.major, v.minor, v.patch);
+}
+
+/* JSON has no inf/nan; a test with no spread at all reports t as null. */
+static void json_num(double v)
+{
+    if (isfinite(v)) fprintf(g_out, "%.6g", v);
+    else             fputs("null", g_out);
+}
+
+static void json_estimate(const SensoryEstimate* e)
+{
+    fprintf(g_out, "{\"n\":%d,\"mean\":", e->n);
+    json_num(e->mean);
+    fputs(",\"sd\":", g_out);
+    json_num(e->sd);
+    fputs(",\"ci\":[", g_out);
+    json_num(e->ci_low);
+    fputc(',', g_out);
+    json_num(e->ci_high);
+    fputs("]}", g_out);
+}
+
+/* =========================================================================
+   Argument helpers
+   ========================================================================= */
+
+/* Split "CODE" or "CODE@X.Y.Z".  Returns 1 if a version was given,
+   0 if not, -1 if ref is malformed. */
+static int parse_ref(const char* ref, char code[MAX_FLAVOR_CODE], Version* v)
+{
+    const char* at = strchr(ref, '@');
+    size_t      len = at ? (size_t)(at - ref) : strlen(ref);
+
+    if (len == 0 || len >= MAX_FLAVOR_CODE) return -1;
+    memcpy(code, ref, len);
+    code[len] = '\0';
+    if (at == NULL) return 0;
+    if (sscanf(at + 1, "%d.%d.%d", &v->major, &v->minor, &v->patch) != 3)
+        return -1;
+    return 1;
+}
+
+/* Load REF into f.  Returns 0, or 1 after reporting the failure. */
+static int load_ref(const char* ref, Formulation* f)
+{
+    char    code[MAX_FLAVOR_CODE];
+    Version v;
+    int     has_ver;
+    int     rc;
+
+    has_ver = parse_ref(ref, code, &v);
+    if (has_ver < 0) return fail("bad formulation reference (CODE or CODE@X.Y.Z)");
+
+    memset(f, 0, sizeof(*f));
+    rc = has_ver ? db_load_version(code, v.major, v.minor, v.patch, f)
+                 : db_load_latest(code, f);
+    if (rc == 1) return fail("formulation not found");
+    if (rc != 0) return fail("database error");
+    return 0;
+}
+
+static int parse_float(const char* s, float* out)
+{
+    char* end;
+    double d = strtod(s, &end);
+    if (end == s || *end != '\0') return -1;
+    *out = (float)d;
+    return 0;
+}
+
+/* =========================================================================
+   Commands
+   ========================================================================= */
+static int cmd_list(int argc, char** argv)
+{
+    int rc;
+    int n = 0;
+
+    (void)argv;
+    if (argc != 1) return fail("usage: list");
+
+    if (g_list_stmt == NULL &&
+        sqlite3_prepare_v2(db_get_handle(), SQL_FORMULATIONS_REFRESH, -1,
+                           &g_list_stmt, NULL) != SQLITE_OK)
+        return fail(sqlite3_errmsg(db_get_handle()));
+
+    /* "ok" goes last: a step error can still end the line with false */
+    fputs("{\"formulations\":[", g_out);
+    while ((rc = sqlite3_step(g_list_stmt)) == SQLITE_ROW) {
+        if (n++) fputc(',', g_out);
+        fputs("{\"code\":", g_out);
+        json_str((const char*)sqlite3_column_text(g_list_stmt, 0));
+        fputs(",\"name\":", g_out);
+        json_str((const char*)sqlite3_column_text(g_list_stmt, 1));
+        fprintf(g_out, ",\"version\":\"%d.%d.%d\",\"ph\":%.6g,\"brix\":%.6g,\"saved_at\":",
+                sqlite3_column_int(g_list_stmt, 2),
+                sqlite3_column_int(g_list_stmt, 3),
+                sqlite3_column_int(g_list_stmt, 4),
+                sqlite3_column_double(g_list_stmt, 5),
+                sqlite3_column_double(g_list_stmt, 6));
+        json_str((const char*)sqlite3_column_text(g_list_stmt, 7));
+        fputc('}', g_out);
+    }
+    sqlite3_reset(g_list_stmt);
+
+    if (rc != SQLITE_DONE) {
+        fputs("],\"ok\":false,\"error\":", g_out);
+        json_str(sqlite3_errmsg(db_get_handle()));
+        fputs("}\n", g_out);
+        return 1;
+    }
+    fputs("],\"ok\":true}\n", g_out);
+    return 0;
+}
+
+static int cmd_load(int argc, char** argv)
+{
+    Formulation f;
+    int i;
+
+    if (argc != 2) return fail("usage: load REF");
+    if (load_ref(argv[1], &f) != 0) return 1;
+
+    fputs("{\"ok\":true,\"code\":", g_out);
+    json_str(f.flavor_code);
+    fputs(",\"name\":", g_out);
+    json_str(f.flavor_name);
+    fputs(",\"version\":", g_out);
+    json_version(f.version);
+    fprintf(g_out, ",\"ph\":%.6g,\"brix\":%.6g,\"compounds\":[",
+            f.target_ph, f.target_brix);
+    for (i = 0; i < f.compound_count; i++) {
+        if (i) fputc(',', g_out);
+        fputs("{\"name\":", g_out);
+        json_str(intern_str(f.compounds[i].name_id));
+        fprintf(g_out, ",\"ppm\":%.6g}", f.compounds[i].concentration_ppm);
+    }
+    fputs("]}\n", g_out);
+    return 0;
+}
+
+static int cmd_save(int argc, char** argv)
+{
+    char             code[MAX_FLAVOR_CODE];
+    Version          v;
+    Formulation*     f;
+    ValidationResult vr;
+    int              i;
+    int              rc;
+
+    if (argc < 3) return fail("usage: save CODE@X.Y.Z NAME [--ph N] [--brix N] COMPOUND=PPM ...");
+    if (parse_ref(argv[1], code, &v) != 1) return fail("save needs CODE@X.Y.Z");
+
+    f = create_formulation(code, argv[2]);
+    if (f == NULL) return fail("out of memory");
+    f->version = v;
+
+    for (i = 3; i < argc; i++) {
+        char* eq;
+        float ppm;
+
+        if (strcmp(argv[i], "--ph") == 0 || strcmp(argv[i], "--brix") == 0) {
+            float* dst = (argv[i][2] == 'p') ? &f->target_ph : &f->target_brix;
+            if (i + 1 >= argc || parse_float(argv[i + 1], dst) != 0) {
+                free_formulation(f);
+                return fail("--ph/--brix need a number");
+            }
+            i++;
+            continue;
+        }
+
+        /* COMPOUND=PPM; split on the last '=' so names may contain one */
+        eq = strrchr(argv[i], '=');
+        if (eq == NULL || eq == argv[i] || parse_float(eq + 1, &ppm) != 0) {
+            free_formulation(f);
+            return fail("compounds are given as NAME=PPM");
+        }
+        if (f->compound_count >= MAX_COMPOUNDS) {
+            free_formulation(f);
+            return fail("too many compounds");
+        }
+        *eq = '\0';
+        add_compound(f, argv[i], ppm);
+        *eq = '=';
+    }
+
+    rc = db_save_formulation(f);
+    if (rc != 0) {
+        free_formulation(f);
+        return fail(rc == -1 ? "version already exists" : "database error");
+    }
+
+    fputs("{\"ok\":true,\"code\":", g_out);
+    json_str(f->flavor_code);
+    fputs(",\"version\":", g_out);
+    json_version(f->version);
+    fprintf(g_out, ",\"compounds\":%d,\"violations\":%d}\n",
+            f->compound_count, db_check_formulation_limits(f, &vr));
+    free_formulation(f);
+    return 0;
+}
+
+static void print_batch_lines(const BatchRun* br, int with_cost)
+{
+    int i;
+
+    fputs(",\"ingredients\":[", g_out);
+    for (i = 0; i < br->ingredient_count; i++) {
+        if (i) fputc(',', g_out);
+        fputs("{\"name\":", g_out);
+        json_str(intern_str(br->ingredients[i].name_id));
+        fprintf(g_out, ",\"grams\":%.6g", br->ingredients[i].grams_needed);
+        if (with_cost) {
+            fputs(",\"cost\":", g_out);
+            json_cost(br->ingredients[i].cost_line);
+        }
+        fputc('}', g_out);
+    }
+    fputc(']', g_out);
+    if (with_cost) {
+        fputs(",\"cost_total\":", g_out);
+        json_cost(br->cost_total);
+    }
+}
+
+static int cmd_batch(int argc, char** argv)
+{
+    const char* op;
+    Formulation f;
+    BatchRun    br;
+    float       liters;
+    int         shortfalls;
+    int         rc;
+
+    /* next: the number the next save would get; format: set the layout */
+    if (argc == 3 && strcmp(argv[1], "next") == 0) {
+        char number[MAX_BATCH_NUMBER];
+        if (db_peek_batch_number(argv[2], number, sizeof(number)) != 0)
+            return fail("database error");
+        fputs("{\"ok\":true,\"code\":", g_out);
+        json_str(argv[2]);
+        fputs(",\"batch_number\":", g_out);
+        json_str(number);
+        fputs("}\n", g_out);
+        return 0;
+    }
+    if (argc == 3 && strcmp(argv[1], "format") == 0) {
+        if (db_set_batch_number_format(argv[2]) != 0)
+            return fail("format codes: %F %Y %y %N %<width>N %%, and %N is required");
+        fputs("{\"ok\":true,\"format\":", g_out);
+        json_str(argv[2]);
+        fputs("}\n", g_out);
+        return 0;
+    }
+
+    if (argc != 4) return fail("usage: batch calc|cost|check|deduct|save REF LITERS "
+                               "| next CODE | format FMT");
+    op = argv[1];
+    if (strcmp(op, "calc")   != 0 && strcmp(op, "cost") != 0 &&
+        strcmp(op, "check")  != 0 && strcmp(op, "deduct") != 0 &&
+        strcmp(op, "save")   != 0)
+        return fail("batch operations: calc, cost, check, deduct, save");
+    if (parse_float(argv[3], &liters) != 0 || liters <= 0.0f)
+        return fail("LITERS must be a positive number");
+    if (load_ref(argv[2], &f) != 0) return 1;
+
+    memset(&br, 0, sizeof(br));
+    batch_calculate(&br, &f, liters);
+    if (strcmp(op, "calc") != 0)
+        db_cost_batch(&br);
+
+    shortfalls = -1;
+    if (strcmp(op, "check") == 0) {
+        shortfalls = db_check_inventory(&br);
+        if (shortfalls < 0) return fail("database error");
+    }
+    if (strcmp(op, "deduct") == 0) {
+        if (db_deduct_inventory(&br) != 0) return fail("database error");
+    }
+    if (strcmp(op, "save") == 0) {
+        rc = db_save_batch(f.flavor_code, f.version.major, f.version.minor,
+                           f.version.patch, &br);
+        if (rc != 0) return fail(rc == 1 ? "formulation not found" : "database error");
+    }
+
+    fputs("{\"ok\":true,\"code\":", g_out);
+    json_str(f.flavor_code);
+    fputs(",\"version\":", g_out);
+    json_version(f.version);
+    fprintf(g_out, ",\"liters\":%.6g", br.volume_liters);
+    if (br.batch_number[0]) {
+        fputs(",\"batch_number\":", g_out);
+        json_str(br.batch_number);
+    }
+    print_batch_lines(&br, strcmp(op, "calc") != 0);
+    if (shortfalls >= 0)
+        fprintf(g_out, ",\"shortfalls\":%d", shortfalls);
+    fputs("}\n", g_out);
+    return 0;
+}
+
+/* FDA consumer label for a saved batch, configured from the same
+   app_settings keys as the label dialog in panel_batch.c. */
+static int cmd_label(int argc, char** argv)
+{
+    sqlite3_stmt* stmt = NULL;
+    LabelConfig   cfg;
+    char          flavor_name[MAX_FLAVOR_NAME] = "";
+    char          flavor_code[MAX_FLAVOR_CODE] = "";
+    char          ver_str[32] = "";
+    char          val[64];
+    char          label[4096];
+    double        brix = 0.0;
+
+    if (argc != 2) return fail("usage: label BATCH_NUMBER");
+
+    memset(&cfg, 0, sizeof(cfg));
+    db_get_setting("company_name",    cfg.company_name,    sizeof(cfg.company_name));
+    db_get_setting("company_address", cfg.company_address, sizeof(cfg.company_address));
+    db_get_setting("label_sweetener", cfg.sweetener_name,  sizeof(cfg.sweetener_name));
+    db_get_setting("label_acid",      cfg.acid_name,       sizeof(cfg.acid_name));
+    cfg.container_oz = db_get_setting("label_cont_oz", val, sizeof(val))
+                     ? (float)atof(val) : 12.0f;
+    cfg.servings_per_container = db_get_setting("label_servings", val, sizeof(val))
+                               ? atoi(val) : 1;
+    if (cfg.container_oz <= 0.0f) cfg.container_oz = 12.0f;
+    if (cfg.servings_per_container <= 0) cfg.servings_per_container = 1;
+
+    if (sqlite3_prepare_v2(db_get_handle(),
+            "SELECT f.flavor_name, f.flavor_code, "
+            "       f.ver_major, f.ver_minor, f.ver_patch, f.target_brix "
+            "FROM batch_runs br "
+            "JOIN formulations f ON f.id = br.formulation_id "
+            "WHERE br.batch_number = ?;",
+            -1, &stmt, NULL) != SQLITE_OK)
+        return fail(sqlite3_errmsg(db_get_handle()));
+    sqlite3_bind_text(stmt, 1, argv[1], -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* fn = (const char*)sqlite3_column_text(stmt, 0);
+        const char* fc = (const char*)sqlite3_column_text(stmt, 1);
+        if (fn) strncpy(flavor_name, fn, sizeof(flavor_name) - 1);
+        if (fc) strncpy(flavor_code, fc, sizeof(flavor_code) - 1);
+        snprintf(ver_str, sizeof(ver_str), "%d.%d.%d",
+                 sqlite3_column_int(stmt, 2),
+                 sqlite3_column_int(stmt, 3),
+                 sqlite3_column_int(stmt, 4));
+        brix = sqlite3_column_double(stmt, 5);
+    }
+    sqlite3_finalize(stmt);
+    if (!flavor_name[0]) return fail("batch not found");
+
+    batch_generate_fda_label(argv[1], flavor_name, flavor_code, ver_str,
+                             (float)brix, &cfg, label, sizeof(label));
+
+    fputs("{\"ok\":true,\"batch_number\":", g_out);
+    json_str(argv[1]);
+    fputs(",\"label\":", g_out);
+    json_str(label);
+    fputs("}\n", g_out);
+    return 0;
+}
+
+/* Tasting aggregates: stats REF for one version (CODE@X.Y.Z) or the
+   whole flavor (CODE); rebuild recomputes them and reports mismatches. */
+/* taste report [CODE]: every version and taster, from one pass */
+static int taste_report(const char* code)
+{
+    SensoryReport* r;
+    int i, d;
+
+    if (db_sensory_report(code, SENSORY_DEFAULT_CONFIDENCE, &r) != 0)
+        return fail("database error");
+
+    fprintf(g_out, "{\"ok\":true,\"sessions\":%d,\"confidence\":%g,\"versions\":[",
+            sensory_session_count(r), SENSORY_DEFAULT_CONFIDENCE);
+    for (i = 0; i < sensory_version_count(r); i++) {
+        const SensoryVersionStats* v = sensory_version(r, i);
+
+        fputs(i ? ",{\"code\":" : "{\"code\":", g_out);
+        json_str(v->flavor_code);
+        fputs(",\"version\":", g_out);
+        json_version(v->version);
+        fprintf(g_out, ",\"sessions\":%d,\"tasters\":%d", v->sessions, v->tasters);
+        for (d = 0; d < SENSORY_DIMENSIONS; d++) {
+            if (v->raw[d].n == 0) continue;
+            fprintf(g_out, ",\"%s\":{\"raw\":", sensory_dimension_name((SensoryDimension)d));
+            json_estimate(&v->raw[d]);
+            fputs(",\"z\":", g_out);
+            json_estimate(&v->normalized[d]);
+            fputc('}', g_out);
+        }
+        fputc('}', g_out);
+    }
+    fputs("],\"tasters\":[", g_out);
+    for (i = 0; i < sensory_taster_count(r); i++) {
+        const SensoryTasterStats* t = sensory_taster(r, i);
+
+        fputs(i ? ",{\"taster\":" : "{\"taster\":", g_out);
+        json_str(t->taster);
+        fprintf(g_out, ",\"sessions\":%d,\"versions\":%d,\"mean\":",
+                t->sessions, t->versions);
+        json_num(t->scale[SENSORY_OVERALL].mean);
+        fputs(",\"sd\":", g_out);
+        json_num(sqrt(sensory_acc_variance(&t->scale[SENSORY_OVERALL])));
+        fputs(",\"bias\":", g_out);
+        json_num(t->bias);
+        fputs(",\"disagreement\":", g_out);
+        json_num(t->disagreement);
+        fputs(",\"bias_z\":", g_out);
+        json_num(t->bias_z);
+        fputs(",\"disagreement_z\":", g_out);
+        json_num(t->disagreement_z);
+        fprintf(g_out, ",\"outlier\":%s}", t->outlier ? "true" : "false");
+    }
+    fputs("]}\n", g_out);
+    sensory_report_free(r);
+    return 0;
+}
+
+/* taste compare CODE@X.Y.Z CODE@X.Y.Z [DIMENSION] */
+static int taste_compare(int argc, char** argv)
+{
+    SensoryReport*    r;
+    SensoryComparison c;
+    SensoryDimension  dim = SENSORY_OVERALL;
+    char    code[2][MAX_FLAVOR_CODE];
+    Version v[2];
+    int     idx[2];
+    int     i;
+
+    for (i = 0; i < 2; i++)
+        if (parse_ref(argv[2 + i], code[i], &v[i]) != 1)
+            return fail("compare needs two CODE@X.Y.Z references");
+    if (argc == 5) {
+        for (i = 0; i < SENSORY_DIMENSIONS; i++)
+            if (strcmp(argv[4], sensory_dimension_name((SensoryDimension)i)) == 0) break;
+        if (i == SENSORY_DIMENSIONS)
+            return fail("unknown dimension (overall, aroma, flavor, mouthfeel, finish, sweetness)");
+        dim = (SensoryDimension)i;
+    }
+
+    /* Taster scales come from the same history either way; one flavor
+       keeps the read short */
+    if (db_sensory_report(strcmp(code[0], code[1]) == 0 ? code[0] : NULL,
+                          SENSORY_DEFAULT_CONFIDENCE, &r) != 0)
+        return fail("database error");
+    idx[0] = sensory_find_version(r, code[0], v[0]);
+    idx[1] = sensory_find_version(r, code[1], v[1]);
+    if (idx[0] < 0 || idx[1] < 0) {
+        sensory_report_free(r);
+        return fail("no tasting sessions for that version");
+    }
+    sensory_compare(r, idx[0], idx[1], dim, &c);
+    sensory_report_free(r);
+
+    fputs("{\"ok\":true,\"a\":", g_out);
+    json_str(argv[2]);
+    fputs(",\"b\":", g_out);
+    json_str(argv[3]);
+    fprintf(g_out, ",\"dimension\":\"%s\",\"paired\":{\"pairs\":%d,\"diff\":",
+            sensory_dimension_name(dim), c.pairs);
+    json_num(c.mean_diff);
+    fputs(",\"ci\":[", g_out);
+    json_num(c.ci_low);
+    fputc(',', g_out);
+    json_num(c.ci_high);
+    fputs("],\"t\":", g_out);
+    json_num(c.t);
+    fputs(",\"p\":", g_out);
+    json_num(c.p);
+    fputs("},\"welch\":{\"diff\":", g_out);
+    json_num(c.welch_diff);
+    fputs(",\"t\":", g_out);
+    json_num(c.welch_t);
+    fputs(",\"df\":", g_out);
+    json_num(c.welch_df);
+    fputs(",\"p\":", g_out);
+    json_num(c.welch_p);
+    fputs("}}\n", g_out);
+    return 0;
+}
+
+static int cmd_taste(int argc, char** argv)
+{
+    static const char* const dims[DB_SCORE_DIMENSIONS] = {
+        "overall", "aroma", "flavor", "mouthfeel", "finish", "sweetness"
+    };
+    DbTastingStats st;
+    char    code[MAX_FLAVOR_CODE];
+    Version v;
+    int     has_ver, mismatches, i, rc;
+
+    if (argc == 2 && strcmp(argv[1], "rebuild") == 0) {
+        if (db_rebuild_tasting_aggregates(&mismatches) != 0)
+            return fail("database error");
+        fprintf(g_out, "{\"ok\":true,\"mismatches\":%d}\n", mismatches);
+        return 0;
+    }
+    if (argc <= 3 && argc >= 2 && strcmp(argv[1], "report") == 0)
+        return taste_report(argc == 3 ? argv[2] : NULL);
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "compare") == 0)
+        return taste_compare(argc, argv);
+    if (argc != 3 || strcmp(argv[1], "stats") != 0)
+        return fail("usage: taste stats REF | report [CODE] | compare REF REF [DIMENSION] | rebuild");
+
+    has_ver = parse_ref(argv[2], code, &v);
+    if (has_ver < 0) return fail("bad formulation reference (CODE or CODE@X.Y.Z)");
+    rc = has_ver ? db_get_tasting_stats(code, v.major, v.minor, v.patch, &st)
+                 : db_get_flavor_tasting_stats(code, &st);
+    if (rc == 1) return fail("formulation not found");
+    if (rc != 0) return fail("database error");
+
+    fputs("{\"ok\":true,\"code\":", g_out);
+    json_str(code);
+    if (has_ver) {
+        fputs(",\"version\":", g_out);
+        json_version(v);
+    }
+    fprintf(g_out, ",\"sessions\":%d", st.sessions);
+    for (i = 0; i < DB_SCORE_DIMENSIONS; i++) {
+        const DbScoreStat* d = &st.score[i];
+        fprintf(g_out, ",\"%s\":{\"n\":%d,\"mean\":%.6g,\"sd\":%.6g}",
+                dims[i], d->n, d->mean, sqrt(d->variance));
+    }
+    fputs("}\n", g_out);
+    return 0;
+}
+
+/* Query plan regression check: fails (exit status 1) if any hot query
+   scans a table; the offenders are printed to stderr as [QUERY PLAN] */
+static int cmd_check_plans(int argc, char** argv)
+{
+    int scans;
+
+    (void)argv;
+    if (argc != 1) return fail("usage: check-plans");
+    scans = db_check_query_plans();
+    if (scans < 0) return fail("database error");
+    if (scans > 0) {
+        fprintf(g_out, "{\"ok\":false,\"error\":\"full table scans\",\"scans\":%d}\n", scans);
+        return 1;
+    }
+    fputs("{\"ok\":true,\"scans\":0}\n", g_out);
+    return 0;
+}
+
+typedef struct {
+    const char* name;
+    int       (*run)(int argc, char** argv);
+} Command;
+
+static const Command g_commands[] = {
+    { "list",        cmd_list        },
+    { "load",        cmd_load        },
+    { "save",        cmd_save        },
+    { "batch",       cmd_batch       },
+    { "label",       cmd_label       },
+    { "taste",       cmd_taste       },
+    { "check-plans", cmd_check_plans },
+};
+
+/* Returns 0 on success, 1 on failure (already reported). */
+static int run_command(int argc, char** argv)
+{
+    size_t i;
+    int    rc = -1;
+
+    for (i = 0; i < sizeof(g_commands) / sizeof(g_commands[0]); i++) {
+        if (strcmp(argv[0], g_commands[i].name) == 0) {
+            rc = g_commands[i].run(argc, argv);
+            break;
+        }
+    }
+    if (rc < 0) rc = fail("unknown command (list, load, save, batch, label, taste, check-plans)");
+    fflush(g_out);
+    return rc;
+}
+
+/* Split line in place into whitespace-separated words; "..." groups a
+   word and \" or \\ inside quotes is taken literally.
+   Returns the word count, or -1 for an unterminated quote. */
+static int split_line(char* line, char** argv, int max)
+{
+    char* r = line;
+    char* w = line;
+    int   argc = 0;
+
+    for (;;) {
+        while (*r == ' ' || *r == '\t' || *r == '\r' || *r == '\n') r++;
+        if (*r == '\0' || argc == max) break;
+
+        argv[argc++] = w;
+        while (*r && *r != ' ' && *r != '\t' && *r != '\r' && *r != '\n') {
+            if (*r != '"') {
+                *w++ = *r++;
+                continue;
+            }
+            r++;
+            while (*r && *r != '"') {
+                if (*r == '\\' && (r[1] == '"' || r[1] == '\\')) r++;
+                *w++ = *r++;
+            }
+            if (*r != '"') return -1;
+            r++;
+        }
+        if (*r) r++;
+        *w++ = '\0';
+    }
+    return argc;
+}
+
+static int run_stdin(void)
+{
+    char  line[MAX_LINE];
+    char* argv[MAX_ARGS];
+    int   argc;
+    int   failures = 0;
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        if (strchr(line, '\n') == NULL && !feof(stdin)) {
+            int c;
+            while ((c = getchar()) != EOF && c != '\n')
+                ;
+            failures += fail("line too long");
+            fflush(g_out);
+            continue;
+        }
+        argc = split_line(line, argv, MAX_ARGS);
+        if (argc < 0) {
+            failures += fail("unterminated quote");
+            fflush(g_out);
+            continue;
+        }
+        if (argc == 0 || argv[0][0] == '#') continue;
+        failures += run_command(argc, argv);
+    }
+    return failures ? 1 : 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: sodaf [-d file.db] command [args...]\n"
+        "       sodaf [-d file.db] [-]      (commands from stdin)\n"
+        "commands:\n"
+        "  list\n"
+        "  load   CODE[@X.Y.Z]\n"
+        "  save   CODE@X.Y.Z NAME [--ph N] [--brix N] COMPOUND=PPM ...\n"
+        "  batch  calc|cost|check|deduct|save CODE[@X.Y.Z] LITERS |\n"
+        "         next CODE | format FMT\n"
+        "  label  BATCH_NUMBER\n"
+        "  taste  stats CODE[@X.Y.Z] | report [CODE] |\n"
+        "         compare CODE@X.Y.Z CODE@X.Y.Z [DIMENSION] | rebuild\n"
+        "  check-plans\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* db_path = "formulations.db";
+    int         i = 1;
+    int         rc;
+
+    g_out = stdout;
+
+    if (i + 1 < argc && strcmp(argv[i], "-d") == 0) {
+        db_path = argv[i + 1];
+        i += 2;
+    }
+    if (i < argc && (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)) {
+        usage();
+        return 0;
+    }
+
+    db_set_verbose(0);
+    if (db_open(db_path) != 0) {
+        fprintf(stderr, "sodaf: cannot open %s\n", db_path);
+        db_close();
+        return 2;
+    }
+    db_sync_seed_data(NULL);
+
+    if (i >= argc || strcmp(argv[i], "-") == 0)
+        rc = run_stdin();
+    else
+        rc = run_command(argc - i, argv + i);
+
+    sqlite3_finalize(g_list_stmt);
+    db_close();
+    return rc;
+}
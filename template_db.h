@@ -0,0 +1,16 @@
+#ifndef TEMPLATE_DB_H
+#define TEMPLATE_DB_H
+
+#include <stddef.h>
+
+/*
+ * template_db.h — prebuilt starting database.
+ * template_db.c is generated at build time by mktemplate (MkTemplate.vcxproj):
+ * an empty database run through every migration and db_sync_seed_data,
+ * serialized with sqlite3_serialize.  main.c hands it to
+ * db_create_from_image when formulations.db does not exist yet.
+ */
+extern const unsigned char g_template_db[];
+extern const size_t        g_template_db_size;
+
+#endif /* TEMPLATE_DB_H */
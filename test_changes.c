@@ -0,0 +1,342 @@
+/*
+ * test_changes.c — change tracking (db_change_generation and friends).
+ *
+ *   test_changes [-d file.db]
+ *
+ * Creates a fresh database and checks what db_changed_since and
+ * db_changes_since report for:
+ *   - a local commit: one new generation, the tables it wrote and no
+ *     others, and its rows;
+ *   - reads and rollbacks (an explicit ROLLBACK and a save that fails):
+ *     no new generation, and nothing carried into the next commit;
+ *   - a commit through a second DbContext and through a plain sqlite3
+ *     handle (the CLI case): noticed through PRAGMA data_version as a
+ *     change to every table, with the rows unknown;
+ *   - a rollback on the second connection: not noticed;
+ *   - a limit and a cost set through a second DbContext: seen at once by
+ *     the default connection's compound cache and limits check.
+ * Exit status 1 on any check that fails.
+ *
+ * stdout goes to the null device, like bench; results go to stderr.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "database.h"
+#include "batch.h"
+#include "tasting.h"
+#include "intern.h"
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+#define MAX_CHANGES 64
+
+static int g_failures = 0;
+
+#define CHECK(cond) do {                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            g_failures++;                                               \
+        }                                                               \
+    } while (0)
+
+static const char* const FORMULATION_TABLES[] = { "formulations", "formulation_compounds", NULL };
+static const char* const BATCH_TABLES[]       = { "batch_runs", NULL };
+static const char* const TASTING_TABLES[]     = { "tasting_sessions", NULL };
+
+static int  g_lib_id = 0;
+static char g_lib_name[128] = "";
+
+static int exec_sql(sqlite3* db, const char* sql)
+{
+    char* err = NULL;
+
+    if (sqlite3_exec(db, sql, NULL, NULL, &err) != SQLITE_OK) {
+        fprintf(stderr, "exec: %s\n", err ? err : "unknown error");
+        sqlite3_free(err);
+        return -1;
+    }
+    return 0;
+}
+
+static void make_formulation(Formulation* f, const char* code, int minor)
+{
+    memset(f, 0, sizeof(*f));
+    strcpy(f->flavor_code, code);
+    strcpy(f->flavor_name, code);
+    f->version = create_version(1, minor, 0);
+    f->compounds[0].compound_library_id = g_lib_id;
+    f->compounds[0].name_id             = intern(g_lib_name);
+    f->compounds[0].concentration_ppm   = 0.001f;
+    f->compound_count = 1;
+}
+
+static int load_compound(void)
+{
+    sqlite3_stmt* stmt = NULL;
+
+    if (sqlite3_prepare_v2(db_get_handle(),
+            "SELECT id, compound_name FROM compound_library "
+            "WHERE max_use_ppm IS NULL OR max_use_ppm >= 100 ORDER BY id LIMIT 1;",
+            -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        g_lib_id = sqlite3_column_int(stmt, 0);
+        strncpy(g_lib_name, (const char*)sqlite3_column_text(stmt, 1), 127);
+    }
+    sqlite3_finalize(stmt);
+    return g_lib_id ? 0 : -1;
+}
+
+/* One save is one generation, reported for its own tables only */
+static void test_local_commit(void)
+{
+    DbChange      out[MAX_CHANGES];
+    Formulation   f;
+    unsigned long g0 = db_change_generation();
+    unsigned long g1;
+    int n, i, found = 0;
+
+    make_formulation(&f, "CHGA", 0);
+    CHECK(db_save_formulation(&f) == 0);
+    g1 = db_change_generation();
+    CHECK(g1 == g0 + 1);
+
+    CHECK(db_changed_since(FORMULATION_TABLES, g0) == 1);
+    CHECK(db_changed_since(NULL, g0) == 1);
+    CHECK(db_changed_since(BATCH_TABLES, g0) == 0);
+    CHECK(db_changed_since(FORMULATION_TABLES, g1) == 0);
+    CHECK(db_changed_since(NULL, g1) == 0);
+
+    n = db_changes_since(g0, out, MAX_CHANGES);
+    CHECK(n >= 2);
+    for (i = 0; i < n && i < MAX_CHANGES; i++) {
+        CHECK(out[i].generation == g1);
+        if (strcmp(out[i].table, "formulations") == 0 && out[i].op == DB_CHANGE_INSERT)
+            found++;
+    }
+    CHECK(found == 1);
+    CHECK(db_changes_since(g1, out, MAX_CHANGES) == 0);
+
+    /* A batch is a separate generation touching batch_runs */
+    {
+        BatchRun br;
+        memset(&br, 0, sizeof(br));
+        br.volume_liters = 20.0f;
+        br.cost_total    = -1.0f;
+        CHECK(db_save_batch("CHGA", 1, 0, 0, &br) == 0);
+    }
+    CHECK(db_change_generation() == g1 + 1);
+    CHECK(db_changed_since(BATCH_TABLES, g1) == 1);
+    CHECK(db_changed_since(FORMULATION_TABLES, g1) == 0);
+    CHECK(db_changed_since(TASTING_TABLES, g0) == 0);
+}
+
+/* Reads and rolled-back writes leave the generation alone */
+static void test_rollback(void)
+{
+    DbChange       out[MAX_CHANGES];
+    DbChangeStats  before, after;
+    Formulation    f;
+    BatchRun       br;
+    TastingSession ts;
+    unsigned long  g = db_change_generation();
+    int n, i, found = 0;
+
+    db_get_change_stats(&before);
+
+    CHECK(db_load_latest("CHGA", &f) == 0);
+    CHECK(db_list_formulations() == 0);
+    CHECK(db_change_generation() == g);
+
+    CHECK(exec_sql(db_get_handle(),
+                   "BEGIN IMMEDIATE;"
+                   "UPDATE batch_runs SET volume_liters = volume_liters + 1;"
+                   "DELETE FROM formulation_compounds;"
+                   "ROLLBACK;") == 0);
+    CHECK(db_change_generation() == g);
+    CHECK(db_changed_since(NULL, g) == 0);
+
+    /* A save that fails inside its transaction, on a batch number already
+       in use (the insert error it prints is expected) */
+    memset(&br, 0, sizeof(br));
+    br.volume_liters = 5.0f;
+    br.cost_total    = -1.0f;
+    {
+        sqlite3_stmt* stmt = NULL;
+        if (sqlite3_prepare_v2(db_get_handle(),
+                "SELECT batch_number FROM batch_runs LIMIT 1;",
+                -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+            strncpy(br.batch_number, (const char*)sqlite3_column_text(stmt, 0),
+                    MAX_BATCH_NUMBER - 1);
+        sqlite3_finalize(stmt);
+    }
+    CHECK(br.batch_number[0] != '\0');
+    CHECK(db_save_batch("CHGA", 1, 0, 0, &br) != 0);
+    CHECK(db_change_generation() == g);
+    CHECK(db_changed_since(BATCH_TABLES, g) == 0);
+
+    /* Nothing rolled back rides along with the next commit */
+    tasting_create(&ts, 0, "Change Test");
+    ts.overall_score = 7.0f;
+    CHECK(db_save_tasting("CHGA", 1, 0, 0, &ts) == 0);
+    CHECK(db_change_generation() == g + 1);
+    CHECK(db_changed_since(TASTING_TABLES, g) == 1);
+    CHECK(db_changed_since(BATCH_TABLES, g) == 0);
+    CHECK(db_changed_since(FORMULATION_TABLES, g) == 0);
+    n = db_changes_since(g, out, MAX_CHANGES);
+    CHECK(n >= 1);
+    for (i = 0; i < n && i < MAX_CHANGES; i++)
+        if (strcmp(out[i].table, "tasting_sessions") == 0 && out[i].rowid == ts.id)
+            found++;
+    CHECK(found == 1);
+
+    db_get_change_stats(&after);
+    CHECK(after.commits == before.commits + 1);
+    CHECK(after.rollbacks >= before.rollbacks + 2);
+    CHECK(after.external == before.external);
+}
+
+/* Other connections' commits come in through data_version */
+static void test_external(const char* db_path)
+{
+    DbChange      out[MAX_CHANGES];
+    DbContext*    ctx = NULL;
+    sqlite3*      raw = NULL;
+    Formulation   f;
+    unsigned long g, other;
+
+    CHECK(dbc_open(db_path, &ctx) == 0);
+    if (ctx == NULL) return;
+
+    /* A second DbContext: its own commit is local to it */
+    g     = db_change_generation();
+    other = dbc_change_generation(ctx);
+    make_formulation(&f, "CHGB", 0);
+    CHECK(dbc_save_formulation(ctx, &f) == 0);
+    CHECK(dbc_change_generation(ctx) == other + 1);
+    CHECK(dbc_changed_since(ctx, BATCH_TABLES, other) == 0);
+
+    CHECK(db_change_generation() == g + 1);
+    CHECK(db_changed_since(FORMULATION_TABLES, g) == 1);
+    CHECK(db_changed_since(TASTING_TABLES, g) == 1);    /* rows unknown */
+    CHECK(db_changes_since(g, out, MAX_CHANGES) == -1);
+    g = db_change_generation();
+    CHECK(db_changed_since(NULL, g) == 0);
+    CHECK(db_load_latest("CHGB", &f) == 0);
+
+    /* And the default connection's commits are external to the context */
+    other = dbc_change_generation(ctx);
+    make_formulation(&f, "CHGA", 1);
+    CHECK(db_save_formulation(&f) == 0);
+    CHECK(db_change_generation() == g + 1);
+    CHECK(dbc_changed_since(ctx, FORMULATION_TABLES, other) == 1);
+    dbc_close(ctx);
+    g = db_change_generation();
+
+    /* A plain handle, as the CLI or another program would write */
+    CHECK(sqlite3_open(db_path, &raw) == SQLITE_OK);
+    sqlite3_busy_timeout(raw, 2000);
+    CHECK(exec_sql(raw, "BEGIN IMMEDIATE;"
+                        "UPDATE batch_runs SET notes = 'rolled back';"
+                        "ROLLBACK;") == 0);
+    CHECK(db_changed_since(NULL, g) == 0);
+    CHECK(db_change_generation() == g);
+
+    CHECK(exec_sql(raw, "UPDATE batch_runs SET notes = 'external';") == 0);
+    CHECK(db_changed_since(BATCH_TABLES, g) == 1);
+    CHECK(db_change_generation() == g + 1);
+    CHECK(db_changes_since(g, out, MAX_CHANGES) == -1);
+    sqlite3_close(raw);
+
+    /* Known again from the next local commit on */
+    g = db_change_generation();
+    make_formulation(&f, "CHGA", 2);
+    CHECK(db_save_formulation(&f) == 0);
+    CHECK(db_changes_since(g, out, MAX_CHANGES) >= 1);
+    CHECK(out[0].generation == g + 1 && strcmp(out[0].table, "formulations") == 0);
+    CHECK(db_changed_since(BATCH_TABLES, g) == 0);
+}
+
+/* The compound cache follows commits made through another connection */
+static void test_compound_cache(const char* db_path)
+{
+    DbContext*       ctx = NULL;
+    CompoundInfo     c;
+    Formulation      f;
+    ValidationResult vr;
+    float            limit = 0.0f;
+
+    CHECK(dbc_open(db_path, &ctx) == 0);
+    if (ctx == NULL) return;
+
+    /* Fill the default connection's cache and resolve the limit */
+    make_formulation(&f, "CHGC", 0);
+    f.compounds[0].concentration_ppm = 5.0f;
+    CHECK(db_check_formulation_limits(&f, &vr) == 0);
+    CHECK(db_get_active_limit(g_lib_name, &limit) >= 0);
+    CHECK(limit == 0.0f || limit >= 100.0f);
+    CHECK(db_get_compound_by_name(g_lib_name, &c) == 0);
+    CHECK(c.cost_per_gram != 99.0f);
+
+    CHECK(dbc_add_regulatory_limit(ctx, g_lib_name, "Change Test", 1.0f,
+                                   "2099-01-01", "external override") == 0);
+    CHECK(dbc_set_compound_cost(ctx, g_lib_name, 99.0f) == 0);
+    dbc_close(ctx);
+
+    CHECK(db_get_active_limit(g_lib_name, &limit) == 0);
+    CHECK(limit == 1.0f);
+    CHECK(db_get_compound_by_name(g_lib_name, &c) == 0);
+    CHECK(c.cost_per_gram == 99.0f);
+    CHECK(db_get_compound_by_id(g_lib_id, &c) == 0);
+    CHECK(c.cost_per_gram == 99.0f);
+    CHECK(db_check_formulation_limits(&f, &vr) == 1);
+    CHECK(vr.count == 1 && vr.items[0].from_override && vr.items[0].limit_ppm == 1.0f);
+}
+
+int main(int argc, char** argv)
+{
+    const char* db_path = "test_changes.db";
+
+    if (argc == 3 && strcmp(argv[1], "-d") == 0) {
+        db_path = argv[2];
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: test_changes [-d file.db]\n");
+        return 2;
+    }
+
+    /* Start from an empty file every run */
+    remove(db_path);
+    {
+        char side[512];
+        snprintf(side, sizeof(side), "%s-wal", db_path);
+        remove(side);
+        snprintf(side, sizeof(side), "%s-shm", db_path);
+        remove(side);
+    }
+
+    if (freopen(NULL_DEVICE, "w", stdout) == NULL)
+        fprintf(stderr, "test_changes: cannot redirect stdout\n");
+    db_set_verbose(0);
+    if (db_open(db_path) != 0) {
+        fprintf(stderr, "test_changes: cannot open %s\n", db_path);
+        return 1;
+    }
+    db_sync_seed_data(NULL);
+    if (load_compound() != 0) {
+        fprintf(stderr, "test_changes: compound library not seeded\n");
+        db_close();
+        return 1;
+    }
+
+    test_local_commit();
+    test_rollback();
+    test_external(db_path);
+    test_compound_cache(db_path);
+
+    db_close();
+    fprintf(stderr, "test_changes: %s\n", g_failures ? "FAILED" : "ok");
+    return g_failures ? 1 : 0;
+}
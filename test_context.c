@@ -0,0 +1,289 @@
+/*
+ * test_context.c — concurrent DbContext test.
+ *
+ *   test_context [-d file.db] [-n threads] [-r rounds]
+ *
+ * Creates a fresh database, then starts one thread per context
+ * (dbc_open), all on the same file and with the default connection
+ * (db_open) open too.  Every thread owns one flavor and for each round
+ * saves a new version of it, loads that version and the latest one back
+ * and lists all formulations.  Any error, or a formulation that does not
+ * load back as saved, fails the run (exit status 1); after the threads
+ * are joined the default connection must see every version exactly once.
+ * Defaults: 8 threads, 50 rounds.
+ *
+ * stdout goes to the null device, like bench, so the db_list_* tables
+ * from every thread do not flood the console; results go to stderr.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "database.h"
+#include "formulation.h"
+#include "intern.h"
+#include "thread.h"
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+#define MAX_THREADS      64
+#define POOL_SIZE        32
+#define LINES_PER_ROUND  5
+
+typedef struct {
+    const char* db_path;
+    int         index;
+    int         rounds;
+    int         errors;
+    int         verified;   /* loads that matched what was saved */
+} Worker;
+
+/* Seeded compound ids and names, read once on the main thread; only
+   compounds whose limit the test doses stay under, so saves are quiet */
+static int  g_pool_ids[POOL_SIZE];
+static char g_pool_names[POOL_SIZE][128];
+static int  g_pool_count = 0;
+
+static void flavor_code(int index, char* out, int out_len)
+{
+    snprintf(out, out_len, "CTX%02d", index);
+}
+
+/* Version 1.round.0 of the worker's flavor; deterministic, so the
+   main thread can rebuild it to compare */
+static void make_round(Formulation* f, int index, int round)
+{
+    int k;
+
+    memset(f, 0, sizeof(*f));
+    flavor_code(index, f->flavor_code, sizeof(f->flavor_code));
+    snprintf(f->flavor_name, sizeof(f->flavor_name), "Context Test %d", index);
+    f->version     = create_version(1, round, 0);
+    f->target_ph   = 3.0f + 0.01f * (float)round;
+    f->target_brix = 10.0f + 0.1f * (float)index;
+    for (k = 0; k < LINES_PER_ROUND; k++) {
+        int p = (index * 7 + round + k * 3) % g_pool_count;
+        f->compounds[k].compound_library_id = g_pool_ids[p];
+        f->compounds[k].name_id             = intern(g_pool_names[p]);
+        f->compounds[k].concentration_ppm   = 0.5f + (float)index + 0.25f * (float)round + (float)k;
+    }
+    f->compound_count = LINES_PER_ROUND;
+}
+
+/* 1 if got has the same version and compound lines as want */
+static int same_formulation(const Formulation* want, const Formulation* got)
+{
+    int i, j;
+
+    if (want->version.major != got->version.major ||
+        want->version.minor != got->version.minor ||
+        want->version.patch != got->version.patch) return 0;
+    if (want->compound_count != got->compound_count) return 0;
+    for (i = 0; i < want->compound_count; i++) {
+        for (j = 0; j < got->compound_count; j++)
+            if (got->compounds[j].compound_library_id == want->compounds[i].compound_library_id)
+                break;
+        if (j == got->compound_count) return 0;
+        if (got->compounds[j].concentration_ppm != want->compounds[i].concentration_ppm)
+            return 0;
+    }
+    return 1;
+}
+
+static void worker_run(void* arg)
+{
+    Worker*     w = (Worker*)arg;
+    DbContext*  ctx = NULL;
+    Formulation f, g;
+    char        code[MAX_FLAVOR_CODE];
+    int         r, rc;
+
+    rc = dbc_open(w->db_path, &ctx);
+    if (rc != 0) {
+        fprintf(stderr, "thread %d: dbc_open failed (%d)\n", w->index, rc);
+        w->errors++;
+        return;
+    }
+    flavor_code(w->index, code, sizeof(code));
+
+    for (r = 0; r < w->rounds; r++) {
+        make_round(&f, w->index, r);
+
+        rc = dbc_save_formulation(ctx, &f);
+        if (rc != 0) {
+            fprintf(stderr, "thread %d round %d: save failed (%d)\n", w->index, r, rc);
+            w->errors++;
+            continue;
+        }
+
+        rc = dbc_load_version(ctx, code, 1, r, 0, &g);
+        if (rc != 0 || !same_formulation(&f, &g)) {
+            fprintf(stderr, "thread %d round %d: load_version %s\n", w->index, r,
+                    rc != 0 ? "failed" : "differs from the save");
+            w->errors++;
+        } else {
+            w->verified++;
+        }
+
+        rc = dbc_load_latest(ctx, code, &g);
+        if (rc != 0 || !same_formulation(&f, &g)) {
+            fprintf(stderr, "thread %d round %d: load_latest %s\n", w->index, r,
+                    rc != 0 ? "failed" : "is not the version just saved");
+            w->errors++;
+        } else {
+            w->verified++;
+        }
+
+        rc = dbc_list_formulations(ctx);
+        if (rc != 0) {
+            fprintf(stderr, "thread %d round %d: list failed (%d)\n", w->index, r, rc);
+            w->errors++;
+        }
+    }
+    dbc_close(ctx);
+}
+
+static int load_pool(void)
+{
+    sqlite3_stmt* stmt = NULL;
+
+    if (sqlite3_prepare_v2(db_get_handle(),
+            "SELECT id, compound_name FROM compound_library "
+            "WHERE max_use_ppm IS NULL OR max_use_ppm >= 100 ORDER BY id LIMIT ?;",
+            -1, &stmt, NULL) != SQLITE_OK)
+        return -1;
+    sqlite3_bind_int(stmt, 1, POOL_SIZE);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        g_pool_ids[g_pool_count] = sqlite3_column_int(stmt, 0);
+        strncpy(g_pool_names[g_pool_count], (const char*)sqlite3_column_text(stmt, 1), 127);
+        g_pool_count++;
+    }
+    sqlite3_finalize(stmt);
+    return g_pool_count >= LINES_PER_ROUND * 3 ? 0 : -1;
+}
+
+/* After the join: every version saved exactly once, as saved */
+static int check_from_default(const Worker* w, int threads)
+{
+    Formulation f, g;
+    char        code[MAX_FLAVOR_CODE];
+    int         t, r, errors = 0;
+
+    for (t = 0; t < threads; t++) {
+        if (w[t].errors) continue;      /* already reported */
+        flavor_code(t, code, sizeof(code));
+        for (r = 0; r < w[t].rounds; r++) {
+            make_round(&f, t, r);
+            if (db_load_version(code, 1, r, 0, &g) != 0 || !same_formulation(&f, &g)) {
+                fprintf(stderr, "%s 1.%d.0: not as saved on the default connection\n", code, r);
+                errors++;
+            }
+        }
+    }
+    {
+        sqlite3_stmt* stmt = NULL;
+        int n = -1;
+        if (sqlite3_prepare_v2(db_get_handle(),
+                "SELECT COUNT(*) FROM formulations WHERE flavor_code LIKE 'CTX%';",
+                -1, &stmt, NULL) == SQLITE_OK &&
+            sqlite3_step(stmt) == SQLITE_ROW)
+            n = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+        if (n != threads * w[0].rounds) {
+            fprintf(stderr, "expected %d formulations, found %d\n", threads * w[0].rounds, n);
+            errors++;
+        }
+    }
+    return errors;
+}
+
+static int arg_int(int argc, char** argv, int* i, int* out)
+{
+    if (*i + 1 >= argc) return -1;
+    *out = atoi(argv[++*i]);
+    return *out > 0 ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+    const char* db_path = "test_context.db";
+    Worker      w[MAX_THREADS];
+    Thread      t[MAX_THREADS];
+    int         threads = 8, rounds = 50;
+    int         started, errors = 0, verified = 0;
+    int         i, rc;
+
+    for (i = 1; i < argc; i++) {
+        rc = 0;
+        if      (strcmp(argv[i], "-d") == 0 && i + 1 < argc) db_path = argv[++i];
+        else if (strcmp(argv[i], "-n") == 0) rc = arg_int(argc, argv, &i, &threads);
+        else if (strcmp(argv[i], "-r") == 0) rc = arg_int(argc, argv, &i, &rounds);
+        else rc = -1;
+        if (rc != 0 || threads > MAX_THREADS) {
+            fprintf(stderr, "usage: test_context [-d file.db] [-n threads (max %d)] [-r rounds]\n",
+                    MAX_THREADS);
+            return 2;
+        }
+    }
+
+    /* Start from an empty file every run */
+    remove(db_path);
+    {
+        char side[512];
+        snprintf(side, sizeof(side), "%s-wal", db_path);
+        remove(side);
+        snprintf(side, sizeof(side), "%s-shm", db_path);
+        remove(side);
+    }
+
+    if (freopen(NULL_DEVICE, "w", stdout) == NULL)
+        fprintf(stderr, "test_context: cannot redirect stdout\n");
+    db_set_verbose(0);
+    if (db_open(db_path) != 0) {
+        fprintf(stderr, "test_context: cannot open %s\n", db_path);
+        return 1;
+    }
+    db_sync_seed_data(NULL);
+    if (load_pool() != 0) {
+        fprintf(stderr, "test_context: compound library not seeded\n");
+        db_close();
+        return 1;
+    }
+
+    memset(w, 0, sizeof(w));
+    for (started = 0; started < threads; started++) {
+        w[started].db_path = db_path;
+        w[started].index   = started;
+        w[started].rounds  = rounds;
+        if (thread_start(&t[started], worker_run, &w[started]) != 0) {
+            fprintf(stderr, "test_context: cannot start thread %d\n", started);
+            errors++;
+            break;
+        }
+    }
+
+    /* The default connection stays busy meanwhile */
+    for (i = 0; i < rounds; i++) {
+        CompoundInfo c;
+        if (db_get_compound_by_name(g_pool_names[i % g_pool_count], &c) != 0) {
+            fprintf(stderr, "default connection: compound lookup failed\n");
+            errors++;
+        }
+    }
+
+    for (i = 0; i < started; i++) {
+        thread_join(t[i]);
+        errors   += w[i].errors;
+        verified += w[i].verified;
+    }
+    if (started == threads)
+        errors += check_from_default(w, threads);
+    db_close();
+
+    fprintf(stderr, "test_context: %d threads x %d rounds, %d loads verified, %d errors\n",
+            threads, rounds, verified, errors);
+    return errors == 0 ? 0 : 1;
+}
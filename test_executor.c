@@ -0,0 +1,419 @@
+/*
+ * test_executor.c — db_executor under a mixed load with cancellations.
+ *
+ *   test_executor [-d file.db] [-n jobs] [-r readers]
+ *
+ * Creates a fresh database, starts the executor and submits a mix of
+ * write jobs (db_set_setting, checked back in the same job), read jobs
+ * on the pooled connections and slow queries that only end when they
+ * are cancelled.  Some jobs are cancelled straight after submit, while
+ * still queued; the slow ones are cancelled once running.  Meanwhile
+ * the main thread calls db_* directly inside db_executor_lock.  After
+ * draining, every job must have completed exactly once:
+ *   - cancelled while queued: SQLITE_INTERRUPT, and its body never ran;
+ *   - slow: interrupted (SQLITE_INTERRUPT);
+ *   - cancelled while running: whatever it returned;
+ *   - every other job: 0;
+ *   - write jobs ran one at a time, in submit order, and all their
+ *     settings are in the database.
+ * It then stops the executor with jobs still queued and checks that
+ * submit runs jobs inline once it is stopped.
+ * Defaults: 400 jobs, 3 readers.  Exit status 1 on any failure.
+ *
+ * stdout goes to the null device, like bench; results go to stderr.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "database.h"
+#include "db_executor.h"
+#include "thread.h"
+#include "timing.h"
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#include <time.h>
+#define NULL_DEVICE "/dev/null"
+#endif
+
+#define MAX_JOBS      10000
+#define SLOW_EVERY    25      /* every 25th job is a slow query           */
+#define CANCEL_EVERY  10      /* every 10th is cancelled right away       */
+#define WAIT_MS       30000   /* longest a slow job may take to interrupt */
+
+enum { JOB_WRITE, JOB_READ, JOB_SLOW_READ, JOB_SLOW_WRITE };
+
+typedef struct {
+    int kind;
+    int index;
+    int id;             /* from submit                                   */
+    int cancel_state;   /* db_executor_cancel: 0 queued, 1 running, -1   */
+    int cancelled;      /* cancel was called                             */
+    int started;        /* body ran (set by the worker, under g_lock)    */
+    int write_order;    /* position among write jobs as run (writer only) */
+    int done_calls;     /* completion ran (dispatching thread)           */
+    int done_id;
+    int result;
+} Job;
+
+static Job        g_jobs[MAX_JOBS];
+static StaticLock g_lock = STATIC_LOCK_INIT;
+static int        g_writes_run = 0;     /* writer thread only            */
+static int        g_notified   = 0;     /* under g_lock                  */
+static int        g_library_count = 0;
+static int        g_inline_calls  = 0;
+
+static void sleep_ms(int ms)
+{
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    struct timespec ts;
+    ts.tv_sec  = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+#endif
+}
+
+static void notify(void* ctx)
+{
+    (void)ctx;
+    static_lock(&g_lock);
+    g_notified++;
+    static_unlock(&g_lock);
+}
+
+static void mark_started(Job* j)
+{
+    static_lock(&g_lock);
+    j->started++;
+    static_unlock(&g_lock);
+}
+
+static int job_started(const Job* j)
+{
+    int s;
+    static_lock(&g_lock);
+    s = j->started;
+    static_unlock(&g_lock);
+    return s;
+}
+
+/* Write jobs may use db_*: they own the main connection */
+static int write_job(sqlite3* conn, void* arg)
+{
+    Job* j = (Job*)arg;
+    char key[32], want[32], got[32];
+
+    (void)conn;
+    mark_started(j);
+    j->write_order = ++g_writes_run;
+    snprintf(key,  sizeof(key),  "exec_test_%04d", j->index);
+    snprintf(want, sizeof(want), "%d", j->write_order);
+    db_set_setting(key, want);
+    if (!db_get_setting(key, got, sizeof(got)) || strcmp(got, want) != 0)
+        return -1;
+    return 0;
+}
+
+/* Read jobs use the connection they are given */
+static int read_job(sqlite3* conn, void* arg)
+{
+    sqlite3_stmt* stmt = NULL;
+    int rc, n = -1;
+
+    mark_started((Job*)arg);
+    rc = sqlite3_prepare_v2(conn, "SELECT COUNT(*) FROM compound_library;", -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return rc;
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) n = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_ROW) return rc;
+    return n == g_library_count ? 0 : -1;
+}
+
+/* Counts far enough to run for minutes unless interrupted */
+static int slow_job(sqlite3* conn, void* arg)
+{
+    sqlite3_stmt* stmt = NULL;
+    int rc;
+
+    mark_started((Job*)arg);
+    rc = sqlite3_prepare_v2(conn,
+            "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) "
+            "SELECT COUNT(*) FROM c WHERE x < 2000000000;", -1, &stmt, NULL);
+    if (rc != SQLITE_OK) return rc;
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_ROW ? 0 : rc;
+}
+
+static void job_done(int job_id, int result, void* arg)
+{
+    Job* j = (Job*)arg;
+    j->done_calls++;
+    j->done_id = job_id;
+    j->result  = result;
+}
+
+static void inline_done(int job_id, int result, void* arg)
+{
+    (void)job_id;
+    (void)arg;
+    if (result == 0) g_inline_calls++;
+}
+
+static int submit(Job* j)
+{
+    switch (j->kind) {
+    case JOB_WRITE:      return db_executor_submit_write(write_job, job_done, j);
+    case JOB_READ:       return db_executor_submit_read (read_job,  job_done, j);
+    case JOB_SLOW_READ:  return db_executor_submit_read (slow_job,  job_done, j);
+    default:             return db_executor_submit_write(slow_job,  job_done, j);
+    }
+}
+
+static int is_slow(const Job* j)
+{
+    return j->kind == JOB_SLOW_READ || j->kind == JOB_SLOW_WRITE;
+}
+
+/* Cancel slow jobs until each has completed; they may not have started
+   yet, or an interrupt may land before their statement runs */
+static int cancel_slow_jobs(int count)
+{
+    double t0 = timing_now_ms();
+    int i, left;
+
+    for (;;) {
+        left = 0;
+        for (i = 0; i < count; i++) {
+            Job* j = &g_jobs[i];
+            if (!is_slow(j) || j->done_calls) continue;
+            left++;
+            if (j->cancelled && j->cancel_state == 0) continue;
+            if (j->cancelled || job_started(j)) {
+                j->cancel_state = db_executor_cancel(j->id);
+                j->cancelled    = 1;
+            }
+        }
+        db_executor_dispatch();
+        if (left == 0) return 0;
+        if (timing_now_ms() - t0 > WAIT_MS) {
+            fprintf(stderr, "%d slow jobs still running after %d ms\n", left, WAIT_MS);
+            return -1;
+        }
+        sleep_ms(5);
+    }
+}
+
+static int check_jobs(int count)
+{
+    int i, errors = 0, last_order = 0, writes = 0, interrupted_writes = 0;
+
+    for (i = 0; i < count; i++) {
+        const Job* j = &g_jobs[i];
+
+        if (j->done_calls != 1 || j->done_id != j->id) {
+            fprintf(stderr, "job %d: completed %d times (id %d, expected %d)\n",
+                    i, j->done_calls, j->done_id, j->id);
+            errors++;
+            continue;
+        }
+        if (j->cancelled && j->cancel_state == 0) {
+            if (j->result != SQLITE_INTERRUPT || j->started) {
+                fprintf(stderr, "job %d: cancelled while queued but result %d, ran %d\n",
+                        i, j->result, j->started);
+                errors++;
+            }
+            continue;
+        }
+        if (j->started != 1) {
+            fprintf(stderr, "job %d: body ran %d times\n", i, j->started);
+            errors++;
+        }
+        if (is_slow(j)) {
+            if (j->result != SQLITE_INTERRUPT) {
+                fprintf(stderr, "job %d: slow job ended with %d, not interrupted\n",
+                        i, j->result);
+                errors++;
+            }
+        } else if (j->result != 0 && !(j->cancelled && j->cancel_state == 1)) {
+            fprintf(stderr, "job %d: result %d\n", i, j->result);
+            errors++;
+        }
+        if (j->kind == JOB_WRITE) {
+            if (j->write_order <= last_order) {
+                fprintf(stderr, "job %d: write ran out of submit order\n", i);
+                errors++;
+            }
+            last_order = j->write_order;
+            writes++;
+            if (j->cancelled && j->cancel_state == 1) interrupted_writes++;
+        }
+    }
+
+    /* Every write that ran left its setting behind, unless it was
+       interrupted */
+    {
+        sqlite3_stmt* stmt = NULL;
+        int n = -1;
+        if (sqlite3_prepare_v2(db_get_handle(),
+                "SELECT COUNT(*) FROM app_settings WHERE key LIKE 'exec_test_%';",
+                -1, &stmt, NULL) == SQLITE_OK &&
+            sqlite3_step(stmt) == SQLITE_ROW)
+            n = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+        if (n < writes - interrupted_writes || n > writes) {
+            fprintf(stderr, "expected %d settings from write jobs, found %d\n", writes, n);
+            errors++;
+        }
+    }
+    return errors;
+}
+
+static int arg_int(int argc, char** argv, int* i, int* out)
+{
+    if (*i + 1 >= argc) return -1;
+    *out = atoi(argv[++*i]);
+    return *out >= 0 ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+    const char* db_path = "test_executor.db";
+    int         jobs = 400, readers = 3;
+    int         errors = 0, cancelled = 0, interrupted = 0;
+    int         i, rc;
+    double      t0;
+
+    for (i = 1; i < argc; i++) {
+        rc = 0;
+        if      (strcmp(argv[i], "-d") == 0 && i + 1 < argc) db_path = argv[++i];
+        else if (strcmp(argv[i], "-n") == 0) rc = arg_int(argc, argv, &i, &jobs);
+        else if (strcmp(argv[i], "-r") == 0) rc = arg_int(argc, argv, &i, &readers);
+        else rc = -1;
+        if (rc != 0 || jobs < 1 || jobs > MAX_JOBS || readers > DB_EXECUTOR_MAX_READERS) {
+            fprintf(stderr, "usage: test_executor [-d file.db] [-n jobs (max %d)] "
+                            "[-r readers (max %d)]\n", MAX_JOBS, DB_EXECUTOR_MAX_READERS);
+            return 2;
+        }
+    }
+
+    /* Start from an empty file every run */
+    remove(db_path);
+    {
+        char side[512];
+        snprintf(side, sizeof(side), "%s-wal", db_path);
+        remove(side);
+        snprintf(side, sizeof(side), "%s-shm", db_path);
+        remove(side);
+    }
+
+    if (freopen(NULL_DEVICE, "w", stdout) == NULL)
+        fprintf(stderr, "test_executor: cannot redirect stdout\n");
+    db_set_verbose(0);
+    if (db_open(db_path) != 0) {
+        fprintf(stderr, "test_executor: cannot open %s\n", db_path);
+        return 1;
+    }
+    db_sync_seed_data(NULL);
+    {
+        sqlite3_stmt* stmt = NULL;
+        if (sqlite3_prepare_v2(db_get_handle(), "SELECT COUNT(*) FROM compound_library;",
+                               -1, &stmt, NULL) == SQLITE_OK &&
+            sqlite3_step(stmt) == SQLITE_ROW)
+            g_library_count = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+
+    if (db_executor_start(db_path, readers, notify, NULL) != 0) {
+        fprintf(stderr, "test_executor: cannot start the executor\n");
+        db_close();
+        return 1;
+    }
+    t0 = timing_now_ms();
+
+    for (i = 0; i < jobs; i++) {
+        Job* j = &g_jobs[i];
+
+        j->index = i;
+        if (i % SLOW_EVERY == SLOW_EVERY - 1)
+            j->kind = (i / SLOW_EVERY) % 2 ? JOB_SLOW_WRITE : JOB_SLOW_READ;
+        else
+            j->kind = (i % 3 == 0) ? JOB_WRITE : JOB_READ;
+
+        j->id = submit(j);
+        if (j->id <= 0) {
+            fprintf(stderr, "job %d: submit failed\n", i);
+            errors++;
+            j->done_calls = 1;
+            j->done_id    = j->id;
+            continue;
+        }
+        if (i % CANCEL_EVERY == CANCEL_EVERY - 1 && !is_slow(j)) {
+            j->cancel_state = db_executor_cancel(j->id);
+            j->cancelled    = 1;
+        }
+
+        /* The main connection is shared with the writer: direct db_*
+           calls go inside the lock */
+        if (i % 50 == 0) {
+            char value[32];
+            db_executor_lock();
+            db_get_setting("exec_test_0000", value, sizeof(value));
+            db_executor_unlock();
+        }
+        if (i % 16 == 0) db_executor_dispatch();
+    }
+
+    if (cancel_slow_jobs(jobs) != 0) errors++;
+    db_executor_drain();
+
+    for (i = 0; i < jobs; i++) {
+        if (g_jobs[i].cancelled && g_jobs[i].cancel_state == 0) cancelled++;
+        if (g_jobs[i].result == SQLITE_INTERRUPT) interrupted++;
+    }
+    errors += check_jobs(jobs);
+    static_lock(&g_lock);
+    if (g_notified < jobs) {
+        fprintf(stderr, "notify ran %d times for %d completions\n", g_notified, jobs);
+        errors++;
+    }
+    static_unlock(&g_lock);
+
+    /* Stopping with work queued completes all of it */
+    {
+        Job tail[20];
+        memset(tail, 0, sizeof(tail));
+        for (i = 0; i < 20; i++) {
+            tail[i].kind = (i % 2) ? JOB_WRITE : JOB_READ;
+            tail[i].index = jobs + i;
+            tail[i].id = submit(&tail[i]);
+        }
+        db_executor_stop();
+        for (i = 0; i < 20; i++) {
+            if (tail[i].done_calls != 1 ||
+                (tail[i].result != 0 && tail[i].result != SQLITE_INTERRUPT)) {
+                fprintf(stderr, "queued at stop, job %d: completed %d times, result %d\n",
+                        i, tail[i].done_calls, tail[i].result);
+                errors++;
+            }
+        }
+    }
+
+    /* Stopped: jobs run inline and complete before submit returns */
+    if (db_executor_submit_read(read_job, inline_done, &g_jobs[0]) <= 0 ||
+        db_executor_submit_write(write_job, inline_done, &g_jobs[0]) <= 0 ||
+        g_inline_calls != 2) {
+        fprintf(stderr, "inline jobs: %d of 2 completed\n", g_inline_calls);
+        errors++;
+    }
+    db_close();
+
+    fprintf(stderr, "test_executor: %d jobs (%d cancelled while queued, %d interrupted) "
+                    "on %d readers in %.0f ms, %d errors\n",
+            jobs, cancelled, interrupted, readers, timing_now_ms() - t0, errors);
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,377 @@
+/*
+ * test_row_provider.c — row_provider.c against a plain ORDER BY.
+ *
+ *   test_row_provider [-d file.db]
+ *
+ * Creates a fresh database with two flavors' batches and tastings whose
+ * sort keys are out of id order and tie often, then reads every list
+ * through a provider and compares it row by row with the same list
+ * read with one ordinary query:
+ *   - paging across bookmarks, forwards and backwards (cache eviction);
+ *   - the short last page and out-of-range rows;
+ *   - prefetch of a range wider than the cache;
+ *   - the flavor filter, and its being ignored for the inventory;
+ *   - rows deleted after open, at the end of the list and mid-list;
+ *   - a row added mid-list after open.
+ * Exit status 1 on any mismatch.
+ *
+ * stdout goes to the null device, like bench; results go to stderr.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "database.h"
+#include "batch.h"
+#include "tasting.h"
+#include "intern.h"
+#include "row_provider.h"
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+#define BATCHES_A   (3 * ROW_PROVIDER_PAGE + 17)   /* short last page   */
+#define BATCHES_B   (ROW_PROVIDER_PAGE + 36)
+#define TASTINGS_A  (ROW_PROVIDER_PAGE + 5)
+#define MAX_ROWS    1024
+
+static int g_failures = 0;
+
+#define CHECK(cond) do {                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            g_failures++;                                               \
+        }                                                               \
+    } while (0)
+
+/* Column col of every row of sql, in order; returns the row count */
+static int expected_rows(const char* sql, const char* flavor, int col,
+                         char rows[][ROW_PROVIDER_CELL])
+{
+    sqlite3_stmt* stmt = NULL;
+    int n = 0;
+
+    if (sqlite3_prepare_v2(db_get_handle(), sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "prepare: %s\n", sqlite3_errmsg(db_get_handle()));
+        return -1;
+    }
+    if (flavor) sqlite3_bind_text(stmt, 1, flavor, -1, SQLITE_STATIC);
+    while (n < MAX_ROWS && sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char* s = sqlite3_column_text(stmt, col);
+        strncpy(rows[n], s ? (const char*)s : "", ROW_PROVIDER_CELL - 1);
+        rows[n][ROW_PROVIDER_CELL - 1] = '\0';
+        n++;
+    }
+    sqlite3_finalize(stmt);
+    return n;
+}
+
+static int exec_sql(const char* sql)
+{
+    char* err = NULL;
+
+    if (sqlite3_exec(db_get_handle(), sql, NULL, NULL, &err) != SQLITE_OK) {
+        fprintf(stderr, "exec: %s\n", err ? err : "unknown error");
+        sqlite3_free(err);
+        return -1;
+    }
+    return 0;
+}
+
+static int build_dataset(void)
+{
+    const char* codes[2] = { "RPA", "RPB" };
+    Formulation f;
+    BatchRun    br;
+    TastingSession ts;
+    sqlite3_stmt* stmt = NULL;
+    int lib_id = 0;
+    char lib_name[128] = "";
+    int a = 0, b = 0, i;
+
+    if (sqlite3_prepare_v2(db_get_handle(),
+            "SELECT id, compound_name FROM compound_library "
+            "WHERE max_use_ppm IS NULL OR max_use_ppm >= 100 ORDER BY id LIMIT 1;",
+            -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        lib_id = sqlite3_column_int(stmt, 0);
+        strncpy(lib_name, (const char*)sqlite3_column_text(stmt, 1), 127);
+    }
+    sqlite3_finalize(stmt);
+    if (lib_id == 0) return -1;
+
+    for (i = 0; i < 2; i++) {
+        memset(&f, 0, sizeof(f));
+        strcpy(f.flavor_code, codes[i]);
+        strcpy(f.flavor_name, codes[i]);
+        f.version = create_version(1, 0, 0);
+        f.compounds[0].compound_library_id = lib_id;
+        f.compounds[0].name_id             = intern(lib_name);
+        f.compounds[0].concentration_ppm   = 0.001f;
+        f.compound_count = 1;
+        if (db_save_formulation(&f) != 0) return -1;
+    }
+
+    /* Interleave the flavors so neither one's rows are contiguous ids */
+    for (i = 0; i < BATCHES_A + BATCHES_B; i++) {
+        int to_a = a < BATCHES_A && (i % 3 != 2 || b == BATCHES_B);
+        memset(&br, 0, sizeof(br));
+        br.volume_liters = 10.0f + (float)i;
+        br.cost_total    = -1.0f;
+        if (db_save_batch(to_a ? "RPA" : "RPB", 1, 0, 0, &br) != 0) return -1;
+        if (to_a) a++; else b++;
+    }
+    for (i = 0; i < TASTINGS_A; i++) {
+        char taster[MAX_TASTER_NAME];
+        snprintf(taster, sizeof(taster), "Taster %03d", i);
+        tasting_create(&ts, 0, taster);
+        ts.overall_score = (float)(i % 10);
+        if (db_save_tasting("RPA", 1, 0, 0, &ts) != 0) return -1;
+    }
+
+    /* Sort keys out of id order, with many ties so bookmarks must fall
+       between rows of equal key */
+    return exec_sql(
+        "UPDATE batch_runs SET batched_at = "
+        "  datetime('2026-01-01', '+' || ((id * 37) % 101) || ' minutes');"
+        "UPDATE tasting_sessions SET tasted_at = "
+        "  datetime('2026-01-01', '+' || ((id * 13) % 17) || ' minutes');");
+}
+
+/* Every cell of column col matches, reading rows in order then in reverse */
+static void check_list(RowProvider* p, char rows[][ROW_PROVIDER_CELL], int n, int col)
+{
+    int r, bad = 0;
+
+    CHECK(row_provider_count(p) == n);
+    for (r = 0; r < n; r++)
+        if (strcmp(row_provider_cell(p, r, col), rows[r]) != 0) bad++;
+    for (r = n - 1; r >= 0; r--)
+        if (strcmp(row_provider_cell(p, r, col), rows[r]) != 0) bad++;
+    CHECK(bad == 0);
+    if (bad) fprintf(stderr, "  %d of %d cells differ\n", bad, 2 * n);
+}
+
+static void test_batches_all(void)
+{
+    static char rows[MAX_ROWS][ROW_PROVIDER_CELL];
+    RowProvider* p = row_provider_open(db_get_handle(), ROW_SOURCE_BATCHES, NULL);
+    RowProviderStats st;
+    int n, fetches;
+
+    CHECK(p != NULL);
+    if (p == NULL) return;
+    n = expected_rows("SELECT batch_number FROM batch_runs ORDER BY batched_at, id;",
+                      NULL, 0, rows);
+    CHECK(n == BATCHES_A + BATCHES_B);
+    CHECK(row_provider_columns(p) == 6);
+    check_list(p, rows, n, 0);
+
+    row_provider_get_stats(p, &st);
+    CHECK(st.rows == n);
+    CHECK(st.bookmarks == (n + ROW_PROVIDER_PAGE - 1) / ROW_PROVIDER_PAGE);
+
+    /* Out of range: empty, never a stale row */
+    CHECK(strcmp(row_provider_cell(p, n, 0), "") == 0);
+    CHECK(strcmp(row_provider_cell(p, -1, 0), "") == 0);
+    CHECK(strcmp(row_provider_cell(p, 0, 6), "") == 0);
+    CHECK(strcmp(row_provider_cell(p, n - 1, 0), rows[n - 1]) == 0);
+
+    /* A range wider than the cache keeps the trailing pages: reading
+       them afterwards fetches nothing */
+    CHECK(row_provider_prefetch(p, 0, n) == 0);
+    row_provider_get_stats(p, &st);
+    fetches = st.page_fetches;
+    CHECK(strcmp(row_provider_cell(p, n - 1, 0), rows[n - 1]) == 0);
+    CHECK(strcmp(row_provider_cell(p, n - 1 - (ROW_PROVIDER_PAGES - 1) * ROW_PROVIDER_PAGE, 0),
+                 rows[n - 1 - (ROW_PROVIDER_PAGES - 1) * ROW_PROVIDER_PAGE]) == 0);
+    row_provider_get_stats(p, &st);
+    CHECK(st.page_fetches == fetches);
+    CHECK(row_provider_prefetch(p, n - 5, 50) == 0);     /* clipped at the end */
+    row_provider_close(p);
+}
+
+static void test_batches_flavor(void)
+{
+    static char rows[MAX_ROWS][ROW_PROVIDER_CELL];
+    const char* sql =
+        "SELECT br.batch_number FROM batch_runs br "
+        "JOIN formulations f ON f.id = br.formulation_id "
+        "WHERE f.flavor_code = ?1 ORDER BY br.batched_at, br.id;";
+    RowProvider* p;
+    int n, r, other = 0;
+
+    p = row_provider_open(db_get_handle(), ROW_SOURCE_BATCHES, "RPA");
+    CHECK(p != NULL);
+    if (p == NULL) return;
+    n = expected_rows(sql, "RPA", 0, rows);
+    CHECK(n == BATCHES_A);
+    check_list(p, rows, n, 0);
+    for (r = 0; r < n; r++)
+        if (strcmp(row_provider_cell(p, r, 1), "RPA") != 0) other++;
+    CHECK(other == 0);
+    row_provider_close(p);
+
+    p = row_provider_open(db_get_handle(), ROW_SOURCE_BATCHES, "RPB");
+    CHECK(p != NULL && row_provider_count(p) == BATCHES_B);
+    row_provider_close(p);
+
+    /* "" is no filter; an unknown flavor is an empty list */
+    p = row_provider_open(db_get_handle(), ROW_SOURCE_BATCHES, "");
+    CHECK(p != NULL && row_provider_count(p) == BATCHES_A + BATCHES_B);
+    row_provider_close(p);
+    p = row_provider_open(db_get_handle(), ROW_SOURCE_BATCHES, "NOSUCH");
+    CHECK(p != NULL && row_provider_count(p) == 0);
+    CHECK(p != NULL && strcmp(row_provider_cell(p, 0, 0), "") == 0);
+    CHECK(row_provider_prefetch(p, 0, 10) == 0);
+    row_provider_close(p);
+}
+
+static void test_tastings_and_inventory(void)
+{
+    static char rows[MAX_ROWS][ROW_PROVIDER_CELL];
+    RowProvider* p;
+    int n;
+
+    p = row_provider_open(db_get_handle(), ROW_SOURCE_TASTINGS, "RPA");
+    CHECK(p != NULL);
+    if (p != NULL) {
+        n = expected_rows("SELECT taster FROM tasting_sessions ORDER BY tasted_at, id;",
+                          NULL, 0, rows);
+        CHECK(n == TASTINGS_A);
+        check_list(p, rows, n, 2);
+        row_provider_close(p);
+    }
+
+    /* The inventory has no flavor filter: the code is ignored */
+    p = row_provider_open(db_get_handle(), ROW_SOURCE_INVENTORY, "RPA");
+    CHECK(p != NULL);
+    if (p != NULL) {
+        n = expected_rows(
+            "SELECT cl.compound_name FROM compound_inventory ci "
+            "JOIN compound_library cl ON cl.id = ci.compound_library_id "
+            "ORDER BY cl.compound_name, cl.id;", NULL, 0, rows);
+        CHECK(n > 0);
+        check_list(p, rows, n, 0);
+        row_provider_close(p);
+    }
+}
+
+/* Rows deleted after open leave the last page short: those rows read
+   as "", the others are unchanged */
+static void test_deleted_rows(void)
+{
+    static char rows[MAX_ROWS][ROW_PROVIDER_CELL];
+    RowProvider* p = row_provider_open(db_get_handle(), ROW_SOURCE_BATCHES, "RPB");
+    const char* sql =
+        "SELECT br.batch_number FROM batch_runs br "
+        "JOIN formulations f ON f.id = br.formulation_id "
+        "WHERE f.flavor_code = ?1 ORDER BY br.batched_at, br.id;";
+    char del[256];
+    int n;
+
+    CHECK(p != NULL);
+    if (p == NULL) return;
+    n = expected_rows(sql, "RPB", 0, rows);
+    snprintf(del, sizeof(del),
+             "DELETE FROM batch_runs WHERE batch_number IN ('%s', '%s');",
+             rows[n - 1], rows[n - 2]);
+    CHECK(exec_sql(del) == 0);
+
+    CHECK(row_provider_count(p) == n);
+    CHECK(strcmp(row_provider_cell(p, n - 3, 0), rows[n - 3]) == 0);
+    CHECK(strcmp(row_provider_cell(p, n - 2, 0), "") == 0);
+    CHECK(strcmp(row_provider_cell(p, n - 1, 0), "") == 0);
+    CHECK(strcmp(row_provider_cell(p, 0, 0), rows[0]) == 0);
+    row_provider_close(p);
+}
+
+/* A row deleted from page 0 and one added inside page 1 after open:
+   page 0 comes up one row short, page 1 and on are still the list as
+   opened, and no row shows twice */
+static void test_mid_list_changes(void)
+{
+    static char rows[MAX_ROWS][ROW_PROVIDER_CELL];
+    RowProvider* p = row_provider_open(db_get_handle(), ROW_SOURCE_BATCHES, NULL);
+    BatchRun br;
+    char sql[256];
+    int n, r, bad = 0;
+
+    CHECK(p != NULL);
+    if (p == NULL) return;
+    n = expected_rows("SELECT batch_number FROM batch_runs ORDER BY batched_at, id;",
+                      NULL, 0, rows);
+    CHECK(n > 2 * ROW_PROVIDER_PAGE);
+
+    snprintf(sql, sizeof(sql),
+             "DELETE FROM batch_runs WHERE batch_number = '%s';", rows[10]);
+    CHECK(exec_sql(sql) == 0);
+
+    /* A new batch taking the sort key of row 70, after it on id */
+    memset(&br, 0, sizeof(br));
+    br.volume_liters = 5.0f;
+    br.cost_total    = -1.0f;
+    CHECK(db_save_batch("RPA", 1, 0, 0, &br) == 0);
+    snprintf(sql, sizeof(sql),
+             "UPDATE batch_runs SET batched_at = "
+             "  (SELECT batched_at FROM batch_runs WHERE batch_number = '%s') "
+             "WHERE id = (SELECT MAX(id) FROM batch_runs);", rows[70]);
+    CHECK(exec_sql(sql) == 0);
+
+    CHECK(row_provider_count(p) == n);
+    for (r = 0; r < ROW_PROVIDER_PAGE - 1; r++)
+        if (strcmp(row_provider_cell(p, r, 0), rows[r < 10 ? r : r + 1]) != 0) bad++;
+    CHECK(strcmp(row_provider_cell(p, ROW_PROVIDER_PAGE - 1, 0), "") == 0);
+    for (r = ROW_PROVIDER_PAGE; r < n; r++)
+        if (strcmp(row_provider_cell(p, r, 0), rows[r]) != 0) bad++;
+    CHECK(bad == 0);
+    if (bad) fprintf(stderr, "  %d of %d cells differ\n", bad, n - 1);
+    row_provider_close(p);
+}
+
+int main(int argc, char** argv)
+{
+    const char* db_path = "test_row_provider.db";
+
+    if (argc == 3 && strcmp(argv[1], "-d") == 0) {
+        db_path = argv[2];
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: test_row_provider [-d file.db]\n");
+        return 2;
+    }
+
+    /* Start from an empty file every run */
+    remove(db_path);
+    {
+        char side[512];
+        snprintf(side, sizeof(side), "%s-wal", db_path);
+        remove(side);
+        snprintf(side, sizeof(side), "%s-shm", db_path);
+        remove(side);
+    }
+
+    if (freopen(NULL_DEVICE, "w", stdout) == NULL)
+        fprintf(stderr, "test_row_provider: cannot redirect stdout\n");
+    db_set_verbose(0);
+    if (db_open(db_path) != 0) {
+        fprintf(stderr, "test_row_provider: cannot open %s\n", db_path);
+        return 1;
+    }
+    db_sync_seed_data(NULL);
+    if (build_dataset() != 0) {
+        fprintf(stderr, "test_row_provider: cannot build the dataset\n");
+        db_close();
+        return 1;
+    }
+
+    test_batches_all();
+    test_batches_flavor();
+    test_tastings_and_inventory();
+    test_deleted_rows();
+    test_mid_list_changes();
+
+    db_close();
+    fprintf(stderr, "test_row_provider: %s\n", g_failures ? "FAILED" : "ok");
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,321 @@
+/*
+ * test_sensory.c — the tasting statistics against known values.
+ *
+ *   test_sensory
+ *
+ * Feeds small hand-built panels to a SensoryReport; no database.
+ *   - critical t at 95%, read back from the interval half-width, for
+ *     df 1, 2, 29 and 1000 against the table values;
+ *   - two-sided p of the paired test at a known t, for df 1 and 2
+ *     (closed forms) and df 10 at the 5% critical value;
+ *   - Welch's t, df and p on two versions worked by hand;
+ *   - accumulators fed in uneven chunks and merged, against a two-pass
+ *     mean and variance, including empty ones on either side;
+ *   - a panel of eight tasters where one scores every version three
+ *     points low: that taster, and only that one, must be an outlier.
+ * Exit status 1 on any failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sensory.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static int g_failures = 0;
+
+#define CHECK(cond) do {                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            g_failures++;                                               \
+        }                                                               \
+    } while (0)
+
+#define NEAR(x, want, tol) (fabs((x) - (want)) <= (tol))
+
+/* One session with every dimension set to score */
+static int add_session(SensoryReport* r, int formulation_id, const char* taster, double score)
+{
+    SensoryRow row;
+    int d;
+
+    row.formulation_id = formulation_id;
+    row.taster = taster;
+    for (d = 0; d < SENSORY_DIMENSIONS; d++) row.score[d] = score;
+    return sensory_report_add(r, &row);
+}
+
+/* =========================================================================
+   Critical t
+   ========================================================================= */
+static void test_critical_t(void)
+{
+    /* Two-sided 95% values of Student's t */
+    static const struct { int df; double t; } table[] = {
+        {    1, 12.7062 },
+        {    2,  4.3027 },
+        {   29,  2.0452 },
+        { 1000,  1.9623 },
+    };
+    const int count = (int)(sizeof(table) / sizeof(table[0]));
+    SensoryReport* r = sensory_report_new();
+    int i, k;
+
+    CHECK(r != NULL);
+    if (r == NULL) return;
+
+    /* Version i gets df + 1 sessions, so its interval uses df */
+    for (i = 0; i < count; i++)
+        for (k = 0; k <= table[i].df; k++)
+            CHECK(add_session(r, i + 1, "solo", (k % 2) ? 6.0 : 4.0) == 0);
+    CHECK(sensory_report_finish(r, 0.95) == 0);
+    CHECK(sensory_version_count(r) == count);
+
+    for (i = 0; i < count; i++) {
+        const SensoryVersionStats* v = sensory_version(r, i);
+        const SensoryEstimate*     e;
+        double t;
+
+        CHECK(v != NULL);
+        if (v == NULL) continue;
+        e = &v->raw[SENSORY_OVERALL];
+        CHECK(e->n == table[i].df + 1);
+        CHECK(e->sd > 0.0);
+        if (e->sd <= 0.0) continue;
+        t = (e->ci_high - e->mean) * sqrt((double)e->n) / e->sd;
+        if (!NEAR(t, table[i].t, 5e-4))
+            fprintf(stderr, "  df %d: t %.5f, want %.4f\n", table[i].df, t, table[i].t);
+        CHECK(NEAR(t, table[i].t, 5e-4));
+        CHECK(NEAR(e->mean - e->ci_low, e->ci_high - e->mean, 1e-12));
+    }
+    sensory_report_free(r);
+}
+
+/* =========================================================================
+   Paired p at a known t
+   ========================================================================= */
+
+/* Version 1 scores 5 + diff[i], version 2 scores 5, taster i each */
+static void compare_paired(const double* diff, int n, SensoryComparison* out)
+{
+    SensoryReport* r = sensory_report_new();
+    char name[32];
+    int  i;
+
+    memset(out, 0, sizeof(*out));
+    CHECK(r != NULL);
+    if (r == NULL) return;
+    for (i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), "taster%d", i);
+        CHECK(add_session(r, 1, name, 5.0 + diff[i]) == 0);
+        CHECK(add_session(r, 2, name, 5.0) == 0);
+    }
+    CHECK(sensory_report_finish(r, 0.95) == 0);
+    CHECK(sensory_compare(r, 0, 1, SENSORY_OVERALL, out) == 0);
+    sensory_report_free(r);
+}
+
+static void test_p_values(void)
+{
+    SensoryComparison c;
+    double diff[11];
+    double m;
+    int    i;
+
+    /* df 1: diffs 0, 2 give t = 1, and p = 1 - 2 atan(t) / pi = 0.5 */
+    diff[0] = 0.0;
+    diff[1] = 2.0;
+    compare_paired(diff, 2, &c);
+    CHECK(c.pairs == 2);
+    CHECK(NEAR(c.t, 1.0, 1e-12));
+    CHECK(NEAR(c.p, 1.0 - 2.0 * atan(1.0) / M_PI, 1e-6));
+
+    /* df 2: diffs 0, 1, 2 give t = sqrt(3), and p = 1 - t / sqrt(2 + t^2) */
+    diff[0] = 0.0;
+    diff[1] = 1.0;
+    diff[2] = 2.0;
+    compare_paired(diff, 3, &c);
+    CHECK(c.pairs == 3);
+    CHECK(NEAR(c.t, sqrt(3.0), 1e-12));
+    CHECK(NEAR(c.p, 1.0 - sqrt(3.0) / sqrt(5.0), 1e-6));
+
+    /* df 10 at its 5% critical value: sd 1, so t = mean * sqrt(11) */
+    m = 2.228139 / sqrt(11.0);
+    for (i = 0; i < 11; i++)
+        diff[i] = m + ((i == 10) ? 0.0 : (i % 2) ? 1.0 : -1.0);
+    compare_paired(diff, 11, &c);
+    CHECK(c.pairs == 11);
+    CHECK(NEAR(c.sd_diff, 1.0, 1e-12));
+    CHECK(NEAR(c.t, 2.228139, 1e-9));
+    CHECK(NEAR(c.p, 0.05, 1e-5));
+    /* At the critical t the interval ends at zero */
+    CHECK(NEAR(c.ci_low, 0.0, 1e-4));
+}
+
+/* =========================================================================
+   Welch
+   ========================================================================= */
+static void test_welch(void)
+{
+    static const double a[] = { 4.0, 5.0, 6.0, 7.0 };
+    static const double b[] = { 7.0, 8.0, 9.0 };
+    SensoryReport*    r = sensory_report_new();
+    SensoryComparison c;
+    char name[32];
+    int  i;
+
+    CHECK(r != NULL);
+    if (r == NULL) return;
+
+    /* Separate tasters per session: nothing pairs, Welch sees all */
+    for (i = 0; i < 4; i++) {
+        snprintf(name, sizeof(name), "a%d", i);
+        CHECK(add_session(r, 1, name, a[i]) == 0);
+    }
+    for (i = 0; i < 3; i++) {
+        snprintf(name, sizeof(name), "b%d", i);
+        CHECK(add_session(r, 2, name, b[i]) == 0);
+    }
+    CHECK(sensory_report_finish(r, 0.95) == 0);
+    CHECK(sensory_compare(r, 0, 1, SENSORY_OVERALL, &c) == 0);
+
+    /* Means 5.5 and 8, variances 5/3 and 1:
+         se^2 = 5/12 + 1/3 = 3/4, t = -2.5 / sqrt(3/4)
+         df   = (3/4)^2 / ((5/12)^2 / 3 + (1/3)^2 / 2) = 243/49
+       p from integrating the t density at that df. */
+    CHECK(c.pairs == 0);
+    CHECK(NEAR(c.welch_diff, -2.5, 1e-12));
+    CHECK(NEAR(c.welch_t, -2.5 / sqrt(0.75), 1e-12));
+    CHECK(NEAR(c.welch_df, 243.0 / 49.0, 1e-12));
+    CHECK(NEAR(c.welch_p, 0.0346476, 1e-6));
+
+    /* Swapping the versions only flips the sign */
+    CHECK(sensory_compare(r, 1, 0, SENSORY_OVERALL, &c) == 0);
+    CHECK(NEAR(c.welch_t, 2.5 / sqrt(0.75), 1e-12));
+    CHECK(NEAR(c.welch_p, 0.0346476, 1e-6));
+    sensory_report_free(r);
+}
+
+/* =========================================================================
+   Merged accumulators
+   ========================================================================= */
+static void test_merge(void)
+{
+    /* Chunk sizes, empty ones included */
+    static const int chunks[] = { 0, 1, 7, 250, 0, 2, 501, 1, 238 };
+    const int count = (int)(sizeof(chunks) / sizeof(chunks[0]));
+    double        x[1000];
+    SensoryAcc    part, all = { 0, 0.0, 0.0 }, empty = { 0, 0.0, 0.0 };
+    unsigned long seed = 12345;
+    double        mean = 0.0, ss = 0.0, var;
+    int           n = 0, i, k;
+
+    /* Large offset, small spread: the case a naive sum of squares loses */
+    for (i = 0; i < 1000; i++) {
+        seed = seed * 1103515245UL + 12345UL;
+        x[i] = 1.0e6 + (double)((seed >> 16) & 0x7fff) / 32768.0 * 10.0;
+    }
+
+    for (i = 0; i < count; i++) {
+        part = empty;
+        for (k = 0; k < chunks[i]; k++) sensory_acc_add(&part, x[n + k]);
+        n += chunks[i];
+        sensory_acc_merge(&all, &part);
+    }
+    sensory_acc_merge(&all, &empty);
+    CHECK(n == 1000);
+    CHECK(all.n == n);
+
+    for (i = 0; i < n; i++) mean += x[i];
+    mean /= n;
+    for (i = 0; i < n; i++) ss += (x[i] - mean) * (x[i] - mean);
+    var = ss / (n - 1);
+
+    CHECK(NEAR(all.mean, mean, 1e-12 * mean));
+    CHECK(NEAR(sensory_acc_variance(&all), var, 1e-9 * var));
+
+    /* Merging into an empty accumulator copies it */
+    part = empty;
+    sensory_acc_merge(&part, &all);
+    CHECK(part.n == all.n && part.mean == all.mean && part.m2 == all.m2);
+
+    /* Fewer than two values have no variance */
+    part = empty;
+    CHECK(sensory_acc_variance(&part) == 0.0);
+    sensory_acc_add(&part, 3.0);
+    CHECK(sensory_acc_variance(&part) == 0.0);
+}
+
+/* =========================================================================
+   Outlier taster
+   ========================================================================= */
+static void test_outlier(void)
+{
+    static const char* const tasters[] = {
+        "ann", "ben", "cat", "dan", "eve", "fay", "gus", "harsh"
+    };
+    static const double base[] = { 5.0, 6.5, 4.0, 7.0, 5.5, 6.0 };
+    const int T = 8, V = 6, SESSIONS = 3;
+    SensoryReport* r = sensory_report_new();
+    int t, v, s, flagged = 0;
+
+    CHECK(r != NULL);
+    if (r == NULL) return;
+
+    /* Everyone tracks the version with a little spread of their own;
+       the last taster scores every version three points low */
+    for (t = 0; t < T; t++)
+        for (v = 0; v < V; v++)
+            for (s = 0; s < SESSIONS; s++) {
+                double noise = 0.25 * (double)((t * 7 + v * 3 + s * 5) % 5 - 2);
+                double score = base[v] + noise - ((t == T - 1) ? 3.0 : 0.0);
+                CHECK(add_session(r, v + 1, tasters[t], score) == 0);
+            }
+    CHECK(sensory_report_finish(r, 0.95) == 0);
+    CHECK(sensory_taster_count(r) == T);
+
+    for (t = 0; t < sensory_taster_count(r); t++) {
+        const SensoryTasterStats* ts = sensory_taster(r, t);
+        int harsh;
+
+        CHECK(ts != NULL);
+        if (ts == NULL) continue;
+        harsh = strcmp(ts->taster, "harsh") == 0;
+        CHECK(ts->sessions == V * SESSIONS);
+        CHECK(ts->versions == V);
+        if (harsh) {
+            CHECK(ts->outlier);
+            CHECK(ts->bias < -2.5);
+            CHECK(ts->bias_z < -SENSORY_OUTLIER_Z);
+        } else {
+            if (ts->outlier)
+                fprintf(stderr, "  %s flagged: bias_z %.2f, disagreement_z %.2f\n",
+                        ts->taster, ts->bias_z, ts->disagreement_z);
+            CHECK(!ts->outlier);
+        }
+        flagged += ts->outlier;
+    }
+    CHECK(flagged == 1);
+    sensory_report_free(r);
+}
+
+int main(int argc, char** argv)
+{
+    (void)argv;
+    if (argc != 1) {
+        fprintf(stderr, "usage: test_sensory\n");
+        return 2;
+    }
+
+    test_critical_t();
+    test_p_values();
+    test_welch();
+    test_merge();
+    test_outlier();
+
+    fprintf(stderr, "test_sensory: %s\n", g_failures ? "FAILED" : "ok");
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include "thread.h"
+
+/* fn/arg pair handed to the platform entry point */
+typedef struct {
+    ThreadFn fn;
+    void*    arg;
+} ThreadStart;
+
+#ifdef _WIN32
+
+static DWORD WINAPI thread_entry(LPVOID p)
+{
+    ThreadStart s = *(ThreadStart*)p;
+    free(p);
+    s.fn(s.arg);
+    return 0;
+}
+
+int thread_start(Thread* t, ThreadFn fn, void* arg)
+{
+    ThreadStart* s = (ThreadStart*)malloc(sizeof(ThreadStart));
+
+    if (s == NULL) return -1;
+    s->fn  = fn;
+    s->arg = arg;
+    *t = CreateThread(NULL, 0, thread_entry, s, 0, NULL);
+    if (*t == NULL) {
+        free(s);
+        return -1;
+    }
+    return 0;
+}
+
+void thread_join(Thread t)
+{
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+}
+
+void mutex_init   (Mutex* m) { InitializeCriticalSection(m); }
+void mutex_destroy(Mutex* m) { DeleteCriticalSection(m); }
+void mutex_lock   (Mutex* m) { EnterCriticalSection(m); }
+void mutex_unlock (Mutex* m) { LeaveCriticalSection(m); }
+
+void cond_init     (CondVar* c)           { InitializeConditionVariable(c); }
+void cond_destroy  (CondVar* c)           { (void)c; }
+void cond_wait     (CondVar* c, Mutex* m) { SleepConditionVariableCS(c, m, INFINITE); }
+void cond_signal   (CondVar* c)           { WakeConditionVariable(c); }
+void cond_broadcast(CondVar* c)           { WakeAllConditionVariable(c); }
+
+void static_lock  (StaticLock* l) { AcquireSRWLockExclusive(l); }
+void static_unlock(StaticLock* l) { ReleaseSRWLockExclusive(l); }
+
+#else
+
+static void* thread_entry(void* p)
+{
+    ThreadStart s = *(ThreadStart*)p;
+    free(p);
+    s.fn(s.arg);
+    return NULL;
+}
+
+int thread_start(Thread* t, ThreadFn fn, void* arg)
+{
+    ThreadStart* s = (ThreadStart*)malloc(sizeof(ThreadStart));
+
+    if (s == NULL) return -1;
+    s->fn  = fn;
+    s->arg = arg;
+    if (pthread_create(t, NULL, thread_entry, s) != 0) {
+        free(s);
+        return -1;
+    }
+    return 0;
+}
+
+void thread_join(Thread t)
+{
+    pthread_join(t, NULL);
+}
+
+void mutex_init(Mutex* m)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(m, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void mutex_destroy(Mutex* m) { pthread_mutex_destroy(m); }
+void mutex_lock   (Mutex* m) { pthread_mutex_lock(m); }
+void mutex_unlock (Mutex* m) { pthread_mutex_unlock(m); }
+
+void cond_init     (CondVar* c)           { pthread_cond_init(c, NULL); }
+void cond_destroy  (CondVar* c)           { pthread_cond_destroy(c); }
+void cond_wait     (CondVar* c, Mutex* m) { pthread_cond_wait(c, m); }
+void cond_signal   (CondVar* c)           { pthread_cond_signal(c); }
+void cond_broadcast(CondVar* c)           { pthread_cond_broadcast(c); }
+
+void static_lock  (StaticLock* l) { pthread_mutex_lock(l); }
+void static_unlock(StaticLock* l) { pthread_mutex_unlock(l); }
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+/*
+ * Minimal threads for the database layer: Win32 primitives on
+ * Windows, pthreads elsewhere.
+ * Mutexes are recursive, but never wait on a CondVar while holding its
+ * mutex more than once.
+ */
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE             Thread;
+typedef CRITICAL_SECTION   Mutex;
+typedef CONDITION_VARIABLE CondVar;
+typedef SRWLOCK            StaticLock;
+#define STATIC_LOCK_INIT   SRWLOCK_INIT
+#else
+#include <pthread.h>
+typedef pthread_t          Thread;
+typedef pthread_mutex_t    Mutex;
+typedef pthread_cond_t     CondVar;
+typedef pthread_mutex_t    StaticLock;
+#define STATIC_LOCK_INIT   PTHREAD_MUTEX_INITIALIZER
+#endif
+
+typedef void (*ThreadFn)(void* arg);
+
+/* Start fn(arg) on a new thread. Returns 0 on success. */
+int  thread_start(Thread* t, ThreadFn fn, void* arg);
+
+/* Wait for the thread to finish and release it. */
+void thread_join(Thread t);
+
+void mutex_init   (Mutex* m);
+void mutex_destroy(Mutex* m);
+void mutex_lock   (Mutex* m);
+void mutex_unlock (Mutex* m);
+
+void cond_init     (CondVar* c);
+void cond_destroy  (CondVar* c);
+void cond_wait     (CondVar* c, Mutex* m);
+void cond_signal   (CondVar* c);
+void cond_broadcast(CondVar* c);
+
+/* For module state with no init call: declare
+   static StaticLock l = STATIC_LOCK_INIT;  Not recursive. */
+void static_lock  (StaticLock* l);
+void static_unlock(StaticLock* l);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+/*
+ * Monotonic wall clock for measuring short intervals.
+ * Only differences between two calls are meaningful.
+ */
+double timing_now_ms(void);
+
+#endif
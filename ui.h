@@ -16,6 +16,10 @@ extern HINSTANCE g_hInst;
 #define NAV_INGREDIENTS   7
 #define NAV_BASES         8
 
+/* Posted to the main window by the database executor when completions
+   are ready; the handler runs them with db_executor_dispatch() */
+#define WM_APP_DB_DONE    (WM_APP + 1)
+
 /* Main layout constants */
 #define NAV_WIDTH         160
 